@@ -117,6 +117,9 @@ struct block_t
 
     /* Rudimentary support for overloading block (de)allocation. */
     block_free_t pf_release;
+
+    /* Payload shared with other blocks (see block_Clone), or NULL */
+    struct block_shared_t *p_shared;
 };
 
 /****************************************************************************
@@ -134,6 +137,11 @@ struct block_t
  *      with preheader and or body (increase
  *      and decrease are supported). Use it as it is optimised.
  * - block_Duplicate : create a copy of a block.
+ * - block_Clone : create a block sharing the payload of another block. The
+ *      payload of shared blocks must be considered read-only, block_Unshare
+ *      returns a block whose payload can be modified (copying it if needed).
+ *      block_Realloc takes care of shared payloads by itself. Packetizers
+ *      and decoders are always given blocks they can modify.
  ****************************************************************************/
 VLC_API void block_Init( block_t *, void *, size_t );
 VLC_API block_t *block_Alloc( size_t ) VLC_USED VLC_MALLOC;
@@ -166,6 +174,9 @@ static inline void block_Release( block_t *p_block )
     p_block->pf_release( p_block );
 }
 
+VLC_API block_t *block_Clone( block_t * ) VLC_USED;
+VLC_API block_t *block_Unshare( block_t * ) VLC_USED;
+
 VLC_API block_t *block_heap_Alloc(void *, size_t) VLC_USED VLC_MALLOC;
 VLC_API block_t *block_mmap_Alloc(void *addr, size_t length) VLC_USED VLC_MALLOC;
 VLC_API block_t * block_shm_Alloc(void *addr, size_t length) VLC_USED VLC_MALLOC;
@@ -299,12 +310,15 @@ static inline block_t *block_ChainGather( block_t *p_list )
  * - block_FifoEmpty : free all blocks in a fifo
  * - block_FifoPut : put a block
  * - block_FifoGet : get a packet from the fifo (and wait if it is empty)
+ * - block_FifoGetBatch : get up to a number of packets from the fifo at once
+ *      (and wait if it is empty)
  * - block_FifoShow : show the first packet of the fifo (and wait if
  *      needed), be carefull, you can use it ONLY if you are sure to be the
  *      only one getting data from the fifo.
  * - block_FifoCount : how many packets are waiting in the fifo
  *
- * block_FifoGet and block_FifoShow are cancellation points.
+ * block_FifoGet, block_FifoGetBatch and block_FifoShow are cancellation
+ * points.
  ****************************************************************************/
 
 VLC_API block_fifo_t *block_FifoNew( void ) VLC_USED VLC_MALLOC;
@@ -314,6 +328,7 @@ VLC_API void block_FifoEmpty( block_fifo_t * );
 VLC_API size_t block_FifoPut( block_fifo_t *, block_t * );
 void block_FifoWake( block_fifo_t * );
 VLC_API block_t * block_FifoGet( block_fifo_t * ) VLC_USED;
+block_t * block_FifoGetBatch( block_fifo_t *, size_t i_max ) VLC_USED;
 VLC_API block_t * block_FifoShow( block_fifo_t * );
 size_t block_FifoSize( const block_fifo_t *p_fifo ) VLC_USED;
 VLC_API size_t block_FifoCount( const block_fifo_t *p_fifo ) VLC_USED;
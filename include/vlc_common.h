@@ -379,6 +379,7 @@ struct vlc_list_t
 #define VLC_ENOVAR         (-6) /**< Variable not found */
 #define VLC_EBADVAR        (-7) /**< Bad variable value */
 #define VLC_ENOITEM        (-8) /**< Item not found */
+#define VLC_ENOTSUP        (-9) /**< Format not supported */
 
 /*****************************************************************************
  * Variable callbacks
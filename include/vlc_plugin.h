@@ -187,8 +187,8 @@ enum vlc_module_properties
 /**
  * Current plugin ABI version
  */
-# define MODULE_SYMBOL 2_1_0a
-# define MODULE_SUFFIX "__2_1_0a"
+# define MODULE_SYMBOL 2_1_0b
+# define MODULE_SUFFIX "__2_1_0b"
 
 /*****************************************************************************
  * Add a few defines. You do not want to read this section. Really.
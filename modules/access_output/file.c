@@ -73,6 +73,21 @@ static void Close( vlc_object_t * );
     "on the file path")
 #define SYNC_TEXT N_("Synchronous writing")
 #define SYNC_LONGTEXT N_( "Open the file with synchronous writing.")
+#define ASYNC_TEXT N_("Write in the background")
+#define ASYNC_LONGTEXT N_( "Queue the data in memory and write it from " \
+    "a separate thread in large aligned chunks, so that a slow disk does " \
+    "not stall the stream output.")
+#define QUEUE_TEXT N_("Write queue size (MiB)")
+#define QUEUE_LONGTEXT N_( "Maximum amount of data waiting to be " \
+    "written in the background. The stream output waits when it is full.")
+#define CHUNK_TEXT N_("Write size (KiB)")
+#define CHUNK_LONGTEXT N_( "Size and alignment of the background writes.")
+#define PREALLOC_TEXT N_("Preallocation extent (MiB)")
+#define PREALLOC_LONGTEXT N_( "Reserve disk space ahead of the background " \
+    "writes by this amount at a time, to limit fragmentation (0 disables).")
+#define SYNCPERIOD_TEXT N_("Data synchronization period (ms)")
+#define SYNCPERIOD_LONGTEXT N_( "Flush the background writes to the disk " \
+    "at this interval (0 leaves it to the system).")
 
 vlc_module_begin ()
     set_description( N_("File stream output") )
@@ -91,6 +106,16 @@ vlc_module_begin ()
     add_bool( SOUT_CFG_PREFIX "sync", false, SYNC_TEXT,SYNC_LONGTEXT,
               false )
 #endif
+    add_bool( SOUT_CFG_PREFIX "async", false, ASYNC_TEXT, ASYNC_LONGTEXT,
+              true )
+    add_integer_with_range( SOUT_CFG_PREFIX "async-queue", 32, 1, 4096,
+                            QUEUE_TEXT, QUEUE_LONGTEXT, true )
+    add_integer_with_range( SOUT_CFG_PREFIX "async-chunk", 1024, 4, 65536,
+                            CHUNK_TEXT, CHUNK_LONGTEXT, true )
+    add_integer( SOUT_CFG_PREFIX "prealloc", 64, PREALLOC_TEXT,
+                 PREALLOC_LONGTEXT, true )
+    add_integer( SOUT_CFG_PREFIX "sync-period", 0, SYNCPERIOD_TEXT,
+                 SYNCPERIOD_LONGTEXT, true )
     set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -105,6 +130,11 @@ static const char *const ppsz_sout_options[] = {
 #ifdef O_SYNC
     "sync",
 #endif
+    "async",
+    "async-queue",
+    "async-chunk",
+    "prealloc",
+    "sync-period",
     NULL
 };
 
@@ -113,6 +143,51 @@ static int Seek ( sout_access_out_t *, off_t  );
 static ssize_t Read ( sout_access_out_t *, block_t * );
 static int Control( sout_access_out_t *, int, va_list );
 
+struct sout_access_out_sys_t
+{
+    int fd;
+
+    /* Write-behind mode */
+    bool b_async;
+    vlc_thread_t thread;
+    vlc_mutex_t lock;
+    vlc_cond_t wait;            /* data queued, or closing */
+    vlc_cond_t done;            /* data written */
+    block_t *p_queue;
+    block_t **pp_queue_last;
+    size_t i_queued;
+    size_t i_queue_max;
+    bool b_busy;
+    bool b_flush;               /* partial chunk requested */
+    bool b_abort;
+    bool b_error;
+
+    /* Writer thread state */
+    uint8_t *p_stage;
+    size_t i_stage;
+    mtime_t i_stage_deadline;
+    size_t i_chunk;
+    off_t i_offset;
+    off_t i_alloc;
+    off_t i_extent;
+    mtime_t i_sync_period;
+    mtime_t i_next_sync;
+
+    /* Statistics */
+    size_t i_queue_peak;
+    mtime_t i_stall_time;
+    uint64_t i_written;
+    unsigned i_writes;
+    unsigned i_syncs;
+    mtime_t i_write_time;
+    mtime_t i_write_max;
+    mtime_t i_next_stats;
+};
+
+static int StartWriter( sout_access_out_t * );
+static void StopWriter( sout_access_out_t * );
+static void FlushWriter( sout_access_out_t * );
+
 /*****************************************************************************
  * Open: open the file
  *****************************************************************************/
@@ -207,16 +282,32 @@ static int Open( vlc_object_t *p_this )
             return VLC_EGENERIC;
     }
 
+    sout_access_out_sys_t *p_sys = malloc (sizeof (*p_sys));
+    if (unlikely(p_sys == NULL))
+    {
+        close (fd);
+        return VLC_ENOMEM;
+    }
+    p_sys->fd = fd;
+    p_access->p_sys = p_sys;
+
+    if (append)
+        lseek (fd, 0, SEEK_END);
+
+    p_sys->b_async = var_GetBool (p_access, SOUT_CFG_PREFIX"async");
+    if (p_sys->b_async && StartWriter (p_access))
+    {
+        close (fd);
+        free (p_sys);
+        return VLC_EGENERIC;
+    }
+
     p_access->pf_write = Write;
     p_access->pf_read  = Read;
     p_access->pf_seek  = Seek;
     p_access->pf_control = Control;
-    p_access->p_sys    = (void *)(intptr_t)fd;
 
     msg_Dbg( p_access, "file access output opened (%s)", p_access->psz_path );
-    if (append)
-        lseek (fd, 0, SEEK_END);
-
     return VLC_SUCCESS;
 }
 
@@ -226,8 +317,12 @@ static int Open( vlc_object_t *p_this )
 static void Close( vlc_object_t * p_this )
 {
     sout_access_out_t *p_access = (sout_access_out_t*)p_this;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
 
-    close( (intptr_t)p_access->p_sys );
+    if( p_sys->b_async )
+        StopWriter( p_access );
+    close( p_sys->fd );
+    free( p_sys );
 
     msg_Dbg( p_access, "file access output closed" );
 }
@@ -254,12 +349,26 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
  *****************************************************************************/
 static ssize_t Read( sout_access_out_t *p_access, block_t *p_buffer )
 {
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
     ssize_t val;
 
+    if( p_sys->b_async )
+    {
+        /* The file position is only known once the queue is written */
+        vlc_mutex_lock( &p_sys->lock );
+        FlushWriter( p_access );
+    }
+
     do
-        val = read( (intptr_t)p_access->p_sys, p_buffer->p_buffer,
-                    p_buffer->i_buffer );
+        val = read( p_sys->fd, p_buffer->p_buffer, p_buffer->i_buffer );
     while (val == -1 && errno == EINTR);
+
+    if( p_sys->b_async )
+    {
+        if( val > 0 )
+            p_sys->i_offset += val;
+        vlc_mutex_unlock( &p_sys->lock );
+    }
     return val;
 }
 
@@ -268,12 +377,45 @@ static ssize_t Read( sout_access_out_t *p_access, block_t *p_buffer )
  *****************************************************************************/
 static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 {
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
     size_t i_write = 0;
 
+    if( p_sys->b_async )
+    {
+        size_t i_size;
+
+        block_ChainProperties( p_buffer, NULL, &i_size, NULL );
+
+        vlc_mutex_lock( &p_sys->lock );
+        if( p_sys->i_queued > 0 &&
+            p_sys->i_queued + i_size > p_sys->i_queue_max )
+        {
+            mtime_t i_start = mdate();
+            while( !p_sys->b_error && p_sys->i_queued > 0 &&
+                   p_sys->i_queued + i_size > p_sys->i_queue_max )
+                vlc_cond_wait( &p_sys->done, &p_sys->lock );
+            p_sys->i_stall_time += mdate() - i_start;
+        }
+        if( p_sys->b_error )
+        {
+            vlc_mutex_unlock( &p_sys->lock );
+            block_ChainRelease( p_buffer );
+            return -1;
+        }
+
+        block_ChainLastAppend( &p_sys->pp_queue_last, p_buffer );
+        p_sys->i_queued += i_size;
+        if( p_sys->i_queued > p_sys->i_queue_peak )
+            p_sys->i_queue_peak = p_sys->i_queued;
+        vlc_cond_signal( &p_sys->wait );
+        vlc_mutex_unlock( &p_sys->lock );
+        return i_size;
+    }
+
     while( p_buffer )
     {
-        ssize_t val = write ((intptr_t)p_access->p_sys,
-                             p_buffer->p_buffer, p_buffer->i_buffer);
+        ssize_t val = write (p_sys->fd, p_buffer->p_buffer,
+                             p_buffer->i_buffer);
         if (val <= 0)
         {
             if (errno == EINTR)
@@ -304,5 +446,326 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
  *****************************************************************************/
 static int Seek( sout_access_out_t *p_access, off_t i_pos )
 {
-    return lseek( (intptr_t)p_access->p_sys, i_pos, SEEK_SET );
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( !p_sys->b_async )
+        return lseek( p_sys->fd, i_pos, SEEK_SET );
+
+    /* Let the writer finish at the current position first */
+    vlc_mutex_lock( &p_sys->lock );
+    FlushWriter( p_access );
+
+    off_t i_ret = lseek( p_sys->fd, i_pos, SEEK_SET );
+    if( i_ret != -1 )
+        p_sys->i_offset = i_ret;
+    vlc_mutex_unlock( &p_sys->lock );
+    return i_ret;
+}
+
+/*****************************************************************************
+ * Write-behind mode
+ *****************************************************************************
+ * Write() only queues the blocks. The writer thread gathers them into
+ * chunks aligned on the file offset, reserves disk space ahead of them and
+ * periodically flushes them to the disk. A partial chunk is only written
+ * when the file is seeked, read or closed, or after STAGE_DELAY.
+ *****************************************************************************/
+/* Longest time data is held back waiting for the rest of its chunk */
+#define STAGE_DELAY (CLOCK_FREQ)
+
+/* Interval between two statistics dumps */
+#define STATS_INTERVAL (10 * CLOCK_FREQ)
+
+static void PrintStats( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    unsigned i_writes = __MAX( p_sys->i_writes, 1 );
+
+    msg_Dbg( p_access, "%"PRIu64" bytes in %u writes, %"PRId64" us average "
+             "(max %"PRId64" us), %u syncs, queue peak %zu bytes, "
+             "producer stalled %"PRId64" ms",
+             p_sys->i_written, p_sys->i_writes,
+             p_sys->i_write_time / i_writes, p_sys->i_write_max,
+             p_sys->i_syncs, p_sys->i_queue_peak,
+             p_sys->i_stall_time / 1000 );
+}
+
+/** Writes data at the current offset, from the writer thread */
+static int WriteChunk( sout_access_out_t *p_access, const uint8_t *p_data,
+                       size_t i_data )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+#ifdef HAVE_FALLOCATE
+    if( p_sys->i_extent > 0 && p_sys->i_offset + (off_t)i_data > p_sys->i_alloc )
+    {
+        if( p_sys->i_alloc < p_sys->i_offset )
+            p_sys->i_alloc = p_sys->i_offset;
+        if( fallocate( p_sys->fd, FALLOC_FL_KEEP_SIZE, p_sys->i_alloc,
+                       p_sys->i_extent ) )
+        {
+            msg_Dbg( p_access, "cannot preallocate: %m" );
+            p_sys->i_extent = 0;
+        }
+        else
+            p_sys->i_alloc += p_sys->i_extent;
+    }
+#endif
+
+    mtime_t i_start = mdate();
+    while( i_data > 0 )
+    {
+        ssize_t val = write( p_sys->fd, p_data, i_data );
+        if( val <= 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            msg_Err( p_access, "cannot write: %m" );
+            return -1;
+        }
+        p_data += val;
+        i_data -= val;
+        p_sys->i_offset += val;
+        p_sys->i_written += val;
+    }
+
+    mtime_t i_now = mdate();
+    p_sys->i_writes++;
+    p_sys->i_write_time += i_now - i_start;
+    if( i_now - i_start > p_sys->i_write_max )
+        p_sys->i_write_max = i_now - i_start;
+
+    if( p_sys->i_sync_period > 0 && i_now >= p_sys->i_next_sync )
+    {
+#if defined(__APPLE__) || defined(__ANDROID__)
+        fsync( p_sys->fd );
+#else
+        fdatasync( p_sys->fd );
+#endif
+        p_sys->i_syncs++;
+        p_sys->i_next_sync = i_now + p_sys->i_sync_period;
+    }
+
+    if( i_now >= p_sys->i_next_stats )
+    {
+        PrintStats( p_access );
+        p_sys->i_next_stats = i_now + STATS_INTERVAL;
+    }
+    return 0;
+}
+
+/** Stages a block, writing out every chunk it completes */
+static int StageBlock( sout_access_out_t *p_access, block_t *p_block )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    const uint8_t *p_data = p_block->p_buffer;
+    size_t i_data = p_block->i_buffer;
+
+    while( i_data > 0 )
+    {
+        /* Bytes up to the next chunk boundary of the file */
+        size_t i_room = p_sys->i_chunk - p_sys->i_offset % p_sys->i_chunk;
+
+        if( p_sys->i_stage == 0 && i_data >= i_room )
+        {
+            /* Large enough, write whole chunks without copying */
+            size_t i_direct = i_room +
+                ( i_data - i_room ) / p_sys->i_chunk * p_sys->i_chunk;
+            if( WriteChunk( p_access, p_data, i_direct ) )
+                return -1;
+            p_data += i_direct;
+            i_data -= i_direct;
+            continue;
+        }
+
+        size_t i_copy = __MIN( i_room - p_sys->i_stage, i_data );
+        if( p_sys->i_stage == 0 )
+            p_sys->i_stage_deadline = mdate() + STAGE_DELAY;
+        memcpy( &p_sys->p_stage[p_sys->i_stage], p_data, i_copy );
+        p_sys->i_stage += i_copy;
+        p_data += i_copy;
+        i_data -= i_copy;
+
+        if( p_sys->i_stage == i_room )
+        {
+            p_sys->i_stage = 0;
+            if( WriteChunk( p_access, p_sys->p_stage, i_room ) )
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static void *WriterThread( void *data )
+{
+    sout_access_out_t *p_access = data;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_sys->lock );
+    for( ;; )
+    {
+        if( p_sys->p_queue == NULL )
+        {
+            if( p_sys->i_stage > 0
+             && ( p_sys->b_flush || p_sys->b_abort || p_sys->b_error
+               || mdate() >= p_sys->i_stage_deadline ) )
+            {
+                /* The partial chunk is needed in the file, or is too old */
+                size_t i_stage = p_sys->i_stage;
+
+                p_sys->i_stage = 0;
+                if( p_sys->b_error )
+                    continue; /* discard it */
+
+                p_sys->b_busy = true;
+                vlc_mutex_unlock( &p_sys->lock );
+                int val = WriteChunk( p_access, p_sys->p_stage, i_stage );
+                vlc_mutex_lock( &p_sys->lock );
+                if( val )
+                    p_sys->b_error = true;
+                continue;
+            }
+
+            p_sys->b_busy = false;
+            if( p_sys->i_stage == 0 )
+                p_sys->b_flush = false;
+            vlc_cond_broadcast( &p_sys->done );
+            if( p_sys->b_abort )
+                break;
+            if( p_sys->i_stage > 0 )
+                vlc_cond_timedwait( &p_sys->wait, &p_sys->lock,
+                                    p_sys->i_stage_deadline );
+            else
+                vlc_cond_wait( &p_sys->wait, &p_sys->lock );
+            continue;
+        }
+
+        block_t *p_chain = p_sys->p_queue;
+        size_t i_size;
+
+        p_sys->p_queue = NULL;
+        p_sys->pp_queue_last = &p_sys->p_queue;
+        p_sys->b_busy = true;
+        /* After an error, the data is only discarded */
+        int val = p_sys->b_error ? -1 : 0;
+        vlc_mutex_unlock( &p_sys->lock );
+
+        block_ChainProperties( p_chain, NULL, &i_size, NULL );
+
+        while( p_chain != NULL )
+        {
+            block_t *p_next = p_chain->p_next;
+
+            if( val == 0 )
+                val = StageBlock( p_access, p_chain );
+            block_Release( p_chain );
+            p_chain = p_next;
+        }
+
+        vlc_mutex_lock( &p_sys->lock );
+        if( val )
+            p_sys->b_error = true;
+        p_sys->i_queued -= i_size;
+        vlc_cond_broadcast( &p_sys->done );
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+static int StartWriter( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    p_sys->i_chunk = 1024 *
+        var_GetInteger( p_access, SOUT_CFG_PREFIX "async-chunk" );
+    p_sys->p_stage = malloc( p_sys->i_chunk );
+    if( unlikely( p_sys->p_stage == NULL ) )
+        return VLC_ENOMEM;
+
+    p_sys->p_queue = NULL;
+    p_sys->pp_queue_last = &p_sys->p_queue;
+    p_sys->i_queued = 0;
+    p_sys->i_queue_max = 1024 * 1024 *
+        var_GetInteger( p_access, SOUT_CFG_PREFIX "async-queue" );
+    p_sys->b_busy = false;
+    p_sys->b_flush = false;
+    p_sys->b_abort = false;
+    p_sys->b_error = false;
+
+    p_sys->i_stage = 0;
+    p_sys->i_offset = lseek( p_sys->fd, 0, SEEK_CUR );
+    if( p_sys->i_offset == -1 ) /* pipe */
+        p_sys->i_offset = 0;
+    p_sys->i_alloc = p_sys->i_offset;
+    p_sys->i_extent = INT64_C(1024) * 1024 *
+        __MAX( var_GetInteger( p_access, SOUT_CFG_PREFIX "prealloc" ), 0 );
+    p_sys->i_sync_period = INT64_C(1000) *
+        __MAX( var_GetInteger( p_access, SOUT_CFG_PREFIX "sync-period" ), 0 );
+    p_sys->i_next_sync = mdate() + p_sys->i_sync_period;
+
+    p_sys->i_queue_peak = 0;
+    p_sys->i_stall_time = 0;
+    p_sys->i_written = 0;
+    p_sys->i_writes = 0;
+    p_sys->i_syncs = 0;
+    p_sys->i_write_time = 0;
+    p_sys->i_write_max = 0;
+    p_sys->i_next_stats = mdate() + STATS_INTERVAL;
+
+    vlc_mutex_init( &p_sys->lock );
+    vlc_cond_init( &p_sys->wait );
+    vlc_cond_init( &p_sys->done );
+
+    if( vlc_clone( &p_sys->thread, WriterThread, p_access,
+                   VLC_THREAD_PRIORITY_OUTPUT ) )
+    {
+        msg_Err( p_access, "cannot spawn writer thread" );
+        vlc_cond_destroy( &p_sys->done );
+        vlc_cond_destroy( &p_sys->wait );
+        vlc_mutex_destroy( &p_sys->lock );
+        free( p_sys->p_stage );
+        return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+/**
+ * Stops the writer thread once all the queued data is written.
+ */
+static void StopWriter( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    vlc_mutex_lock( &p_sys->lock );
+    p_sys->b_abort = true;
+    vlc_cond_signal( &p_sys->wait );
+    vlc_mutex_unlock( &p_sys->lock );
+
+    vlc_join( p_sys->thread, NULL );
+
+    PrintStats( p_access );
+
+    block_ChainRelease( p_sys->p_queue );
+    vlc_cond_destroy( &p_sys->done );
+    vlc_cond_destroy( &p_sys->wait );
+    vlc_mutex_destroy( &p_sys->lock );
+    free( p_sys->p_stage );
+}
+
+/**
+ * Waits until all the queued data, including the last partial chunk, is
+ * written. The lock must be held.
+ */
+static void FlushWriter( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    p_sys->b_flush = true;
+    vlc_cond_signal( &p_sys->wait );
+    while( ( p_sys->p_queue || p_sys->b_busy || p_sys->i_stage > 0 )
+        && !p_sys->b_error )
+        vlc_cond_wait( &p_sys->done, &p_sys->lock );
 }
@@ -45,6 +45,7 @@
 #include <vlc_fs.h>
 #include <vlc_strings.h>
 #include <vlc_charset.h>
+#include <vlc_httpd.h>
 
 #include <gcrypt.h>
 #include <vlc_gcrypt.h>
@@ -104,6 +105,17 @@ static void Close( vlc_object_t * );
 #define RANDOMIV_TEXT N_("Use randomized IV for encryption")
 #define RANDOMIV_LONGTEXT N_("Generate IV instead using segment-number as IV")
 
+#define MEMORY_TEXT N_("Serve segments from memory")
+#define MEMORY_LONGTEXT N_("Keep the index and the last segments in memory "\
+                           "and serve them with the built-in HTTP server "\
+                           "instead of writing them to files. The index and "\
+                           "segment paths are then used as URL paths.")
+
+#define FMP4_TEXT N_("Fragmented MP4 segments")
+#define FMP4_LONGTEXT N_("Segments are fragmented MP4. The data preceding "\
+                         "the first segment is published as the "\
+                         "initialization segment, with number 0.")
+
 vlc_module_begin ()
     set_description( N_("HTTP Live streaming output") )
     set_shortname( N_("LiveHTTP" ))
@@ -123,6 +135,10 @@ vlc_module_begin ()
               NOCACHE_TEXT, NOCACHE_LONGTEXT, true )
     add_bool( SOUT_CFG_PREFIX "generate-iv", false,
               RANDOMIV_TEXT, RANDOMIV_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "memory", false,
+              MEMORY_TEXT, MEMORY_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "fmp4", false,
+              FMP4_TEXT, FMP4_LONGTEXT, true )
     add_string( SOUT_CFG_PREFIX "index", NULL,
                 INDEX_TEXT, INDEX_LONGTEXT, false )
     add_string( SOUT_CFG_PREFIX "index-url", NULL,
@@ -153,6 +169,8 @@ static const char *const ppsz_sout_options[] = {
     "key-file",
     "key-loadfile",
     "generate-iv",
+    "memory",
+    "fmp4",
     NULL
 };
 
@@ -169,6 +187,10 @@ typedef struct output_segment
     float f_seglength;
     uint32_t i_segment_number;
     uint8_t aes_ivs[16];
+    /* In memory mode only */
+    block_t *p_data;
+    size_t i_size;
+    httpd_file_t *p_file;
 } output_segment_t;
 
 struct sout_access_out_sys_t
@@ -185,6 +207,7 @@ struct sout_access_out_sys_t
     float   f_seglen;
     block_t *block_buffer;
     int i_handle;
+    bool b_segment_open;
     unsigned i_numsegs;
     bool b_delsegs;
     bool b_ratecontrol;
@@ -197,10 +220,26 @@ struct sout_access_out_sys_t
     uint8_t stuffing_bytes[16];
     ssize_t stuffing_size;
     vlc_array_t *segments_t;
+
+    /* Fragmented MP4 initialization segment */
+    bool b_fmp4;
+    bool b_init;
+    char *psz_init_uri;
+    output_segment_t *p_init;
+
+    /* Memory mode: segments are served by httpd instead of written */
+    httpd_host_t *p_httpd_host;
+    httpd_file_t *p_index_file;
+    vlc_mutex_t lock; /* protects psz_index */
+    char *psz_index;
+    size_t i_index;
+    block_t *p_segdata;
+    block_t **pp_segdata_last;
 };
 
 static int LoadCryptFile( sout_access_out_t *p_access);
 static int CryptSetup( sout_access_out_t *p_access, char *keyfile );
+static int SetupServer( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys );
 /*****************************************************************************
  * Open: open the file
  *****************************************************************************/
@@ -209,6 +248,7 @@ static int Open( vlc_object_t *p_this )
     sout_access_out_t   *p_access = (sout_access_out_t*)p_this;
     sout_access_out_sys_t *p_sys;
     char *psz_idx;
+    bool b_memory;
 
     config_ChainParse( p_access, SOUT_CFG_PREFIX, ppsz_sout_options, p_access->p_cfg );
 
@@ -232,6 +272,8 @@ static int Open( vlc_object_t *p_this )
     p_sys->b_ratecontrol = var_GetBool( p_access, SOUT_CFG_PREFIX "ratecontrol") ;
     p_sys->b_caching = var_GetBool( p_access, SOUT_CFG_PREFIX "caching") ;
     p_sys->b_generate_iv = var_GetBool( p_access, SOUT_CFG_PREFIX "generate-iv") ;
+    p_sys->b_fmp4 = var_GetBool( p_access, SOUT_CFG_PREFIX "fmp4" );
+    b_memory = var_GetBool( p_access, SOUT_CFG_PREFIX "memory" );
 
     p_sys->segments_t = vlc_array_new();
 
@@ -250,9 +292,12 @@ static int Open( vlc_object_t *p_this )
             free( p_sys );
             return VLC_ENOMEM;
         }
-        path_sanitize( psz_tmp );
         p_sys->psz_indexPath = psz_tmp;
-        vlc_unlink( p_sys->psz_indexPath );
+        if( !b_memory )
+        {
+            path_sanitize( psz_tmp );
+            vlc_unlink( p_sys->psz_indexPath );
+        }
     }
 
     p_sys->psz_indexUrl = var_GetNonEmptyString( p_access, SOUT_CFG_PREFIX "index-url" );
@@ -261,6 +306,17 @@ static int Open( vlc_object_t *p_this )
 
     p_access->p_sys = p_sys;
 
+    if( p_sys->b_fmp4 && ( p_sys->psz_keyfile || p_sys->key_uri ) )
+    {
+        free( p_sys->key_uri );
+        free( p_sys->psz_keyfile );
+        free( p_sys->psz_indexUrl );
+        free( p_sys->psz_indexPath );
+        free( p_sys );
+        msg_Err( p_access, "fragmented MP4 segments cannot be encrypted" );
+        return VLC_EGENERIC;
+    }
+
     if( p_sys->psz_keyfile && ( LoadCryptFile( p_access ) < 0 ) )
     {
         free( p_sys->psz_indexUrl );
@@ -279,9 +335,36 @@ static int Open( vlc_object_t *p_this )
     }
 
     p_sys->i_handle = -1;
+    p_sys->b_segment_open = false;
     p_sys->i_segment = 0;
     p_sys->psz_cursegPath = NULL;
 
+    p_sys->b_init = false;
+    p_sys->psz_init_uri = NULL;
+    p_sys->p_init = NULL;
+    p_sys->p_httpd_host = NULL;
+    p_sys->p_index_file = NULL;
+    p_sys->psz_index = NULL;
+    p_sys->i_index = 0;
+    p_sys->p_segdata = NULL;
+    p_sys->pp_segdata_last = &p_sys->p_segdata;
+    vlc_mutex_init( &p_sys->lock );
+
+    if( b_memory && SetupServer( p_access, p_sys ) )
+    {
+        if( p_sys->key_uri )
+        {
+            gcry_cipher_close( p_sys->aes_ctx );
+            free( p_sys->key_uri );
+        }
+        vlc_array_destroy( p_sys->segments_t );
+        vlc_mutex_destroy( &p_sys->lock );
+        free( p_sys->psz_indexUrl );
+        free( p_sys->psz_indexPath );
+        free( p_sys );
+        return VLC_EGENERIC;
+    }
+
     p_access->pf_write = Write;
     p_access->pf_seek  = Seek;
     p_access->pf_control = Control;
@@ -483,6 +566,9 @@ static char *formatSegmentPath( char *psz_path, uint32_t i_seg, bool b_sanitize
 
 static void destroySegment( output_segment_t *segment )
 {
+    if( segment->p_file )
+        httpd_FileDelete( segment->p_file );
+    block_ChainRelease( segment->p_data );
     free( segment->psz_filename );
     free( segment->psz_duration );
     free( segment->psz_uri );
@@ -490,6 +576,200 @@ static void destroySegment( output_segment_t *segment )
     free( segment );
 }
 
+/*****************************************************************************
+ * Memory mode: the index and the segments are served by httpd
+ *****************************************************************************/
+#define MEMORY_NUMSEGS 10
+
+static const char *segmentMime( sout_access_out_sys_t *p_sys )
+{
+    return p_sys->b_fmp4 ? "video/mp4" : "video/MP2T";
+}
+
+static int SegmentCallback( httpd_file_sys_t *p_args, httpd_file_t *f,
+                            uint8_t *p_request, uint8_t **pp_data, int *pi_data )
+{
+    VLC_UNUSED(f); VLC_UNUSED(p_request);
+    output_segment_t *segment = (output_segment_t *)p_args;
+
+    /* The segment cannot change nor go away while it is registered */
+    *pp_data = malloc( segment->i_size );
+    if( unlikely( *pp_data == NULL ) )
+    {
+        *pi_data = 0;
+        return VLC_ENOMEM;
+    }
+    *pi_data = segment->i_size;
+    block_ChainExtract( segment->p_data, *pp_data, segment->i_size );
+    return VLC_SUCCESS;
+}
+
+static int IndexCallback( httpd_file_sys_t *p_args, httpd_file_t *f,
+                          uint8_t *p_request, uint8_t **pp_data, int *pi_data )
+{
+    VLC_UNUSED(f); VLC_UNUSED(p_request);
+    sout_access_out_sys_t *p_sys = (sout_access_out_sys_t *)p_args;
+
+    *pp_data = NULL;
+    *pi_data = 0;
+
+    vlc_mutex_lock( &p_sys->lock );
+    if( p_sys->psz_index )
+    {
+        *pp_data = malloc( p_sys->i_index );
+        if( likely( *pp_data ) )
+        {
+            memcpy( *pp_data, p_sys->psz_index, p_sys->i_index );
+            *pi_data = p_sys->i_index;
+        }
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+
+    return VLC_SUCCESS;
+}
+
+/*****************************************************************************
+ * SetupServer: register the index URL on the HTTP host
+ *****************************************************************************/
+static int SetupServer( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys )
+{
+    if( !p_sys->psz_indexPath || p_sys->psz_indexPath[0] != '/' ||
+        p_access->psz_path[0] != '/' )
+    {
+        msg_Err( p_access, "memory mode needs absolute index and segment paths" );
+        return VLC_EGENERIC;
+    }
+
+    /* Nothing else bounds memory usage */
+    if( p_sys->i_numsegs == 0 )
+    {
+        msg_Warn( p_access, "keeping only the last %u segments in memory",
+                  MEMORY_NUMSEGS );
+        p_sys->i_numsegs = MEMORY_NUMSEGS;
+    }
+    p_sys->b_delsegs = true;
+
+    p_sys->p_httpd_host = vlc_http_HostNew( VLC_OBJECT(p_access) );
+    if( p_sys->p_httpd_host == NULL )
+        return VLC_EGENERIC;
+
+    p_sys->p_index_file = httpd_FileNew( p_sys->p_httpd_host,
+                                         p_sys->psz_indexPath,
+                                         "application/vnd.apple.mpegurl",
+                                         NULL, NULL, IndexCallback,
+                                         (httpd_file_sys_t *)p_sys );
+    if( p_sys->p_index_file == NULL )
+    {
+        httpd_HostDelete( p_sys->p_httpd_host );
+        p_sys->p_httpd_host = NULL;
+        return VLC_EGENERIC;
+    }
+    msg_Dbg( p_access, "serving index on %s", p_sys->psz_indexPath );
+    return VLC_SUCCESS;
+}
+
+/*****************************************************************************
+ * publishSegment: hand the data of a completed segment over to httpd
+ *****************************************************************************/
+static void publishSegment( sout_access_out_t *p_access, output_segment_t *segment,
+                            block_t *p_data )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    segment->p_data = p_data;
+    block_ChainProperties( p_data, NULL, &segment->i_size, NULL );
+
+    segment->p_file = httpd_FileNew( p_sys->p_httpd_host, segment->psz_filename,
+                                     segmentMime( p_sys ), NULL, NULL,
+                                     SegmentCallback,
+                                     (httpd_file_sys_t *)segment );
+    if( segment->p_file == NULL )
+        msg_Err( p_access, "cannot serve segment %s", segment->psz_filename );
+}
+
+/*****************************************************************************
+ * segmentWrite: write a block to the current segment
+ *****************************************************************************/
+static ssize_t segmentWrite( sout_access_out_sys_t *p_sys, block_t *p_block )
+{
+    if( p_sys->p_httpd_host == NULL )
+        return write( p_sys->i_handle, p_block->p_buffer, p_block->i_buffer );
+
+    /* Keep a reference to the payload, the caller releases its block */
+    block_t *p_ref = block_Clone( p_block );
+    if( unlikely( p_ref == NULL ) )
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    block_ChainLastAppend( &p_sys->pp_segdata_last, p_ref );
+    return p_block->i_buffer;
+}
+
+/*****************************************************************************
+ * storeInitSegment: keep the fragmented MP4 initialization segment
+ *****************************************************************************/
+static int storeInitSegment( sout_access_out_t *p_access,
+                             sout_access_out_sys_t *p_sys, block_t *p_data )
+{
+    bool b_memory = p_sys->p_httpd_host != NULL;
+    output_segment_t *init = calloc( 1, sizeof( *init ) );
+    if( unlikely( !init ) )
+    {
+        block_ChainRelease( p_data );
+        return -1;
+    }
+
+    char *psz_idxFormat = p_sys->psz_indexUrl ? p_sys->psz_indexUrl : p_access->psz_path;
+    init->psz_filename = formatSegmentPath( p_access->psz_path, 0, !b_memory );
+    p_sys->psz_init_uri = formatSegmentPath( psz_idxFormat, 0, false );
+    if( unlikely( !init->psz_filename || !p_sys->psz_init_uri ) )
+    {
+        block_ChainRelease( p_data );
+        destroySegment( init );
+        return -1;
+    }
+    p_sys->p_init = init;
+    p_sys->b_init = true;
+
+    if( b_memory )
+    {
+        publishSegment( p_access, init, p_data );
+        return 0;
+    }
+
+    int fd = vlc_open( init->psz_filename, O_WRONLY | O_CREAT | O_LARGEFILE |
+                       O_TRUNC, 0666 );
+    if( fd == -1 )
+    {
+        msg_Err( p_access, "cannot open `%s' (%m)", init->psz_filename );
+        block_ChainRelease( p_data );
+        return -1;
+    }
+
+    int ret = 0;
+    for( block_t *p_block = p_data; p_block && !ret; p_block = p_block->p_next )
+    {
+        while( p_block->i_buffer > 0 )
+        {
+            ssize_t val = write( fd, p_block->p_buffer, p_block->i_buffer );
+            if( val == -1 )
+            {
+                if( errno == EINTR )
+                    continue;
+                msg_Err( p_access, "cannot write `%s' (%m)", init->psz_filename );
+                ret = -1;
+                break;
+            }
+            p_block->p_buffer += val;
+            p_block->i_buffer -= val;
+        }
+    }
+    close( fd );
+    block_ChainRelease( p_data );
+    return ret;
+}
+
 /************************************************************************
  * segmentAmountNeeded: check that playlist has atleast 3*p_sys->i_seglength of segments
  * return how many segments are needed for that (max of p_sys->i_segment )
@@ -532,6 +812,151 @@ static bool isFirstItemRemovable( sout_access_out_sys_t *p_sys, uint32_t i_first
     return duration >= (first->f_seglength + (float)p_sys->i_seglen);
 }
 
+/************************************************************************
+ * indexAppend: append formatted text to the index being built
+ ************************************************************************/
+static int indexAppend( char **ppsz_index, size_t *pi_index, const char *psz_fmt, ... )
+{
+    va_list args;
+    char *psz_line;
+
+    va_start( args, psz_fmt );
+    int i_line = vasprintf( &psz_line, psz_fmt, args );
+    va_end( args );
+    if ( i_line < 0 )
+        return -1;
+
+    char *psz_index = realloc( *ppsz_index, *pi_index + i_line + 1 );
+    if ( unlikely( !psz_index ) )
+    {
+        free( psz_line );
+        return -1;
+    }
+    memcpy( psz_index + *pi_index, psz_line, i_line + 1 );
+    *ppsz_index = psz_index;
+    *pi_index += i_line;
+    free( psz_line );
+    return 0;
+}
+
+/************************************************************************
+ * formatIndex: build the playlist text, segments i_firstseg and following
+ ************************************************************************/
+static char *formatIndex( sout_access_out_sys_t *p_sys, uint32_t i_firstseg,
+                          unsigned i_index_offset, bool b_isend, size_t *pi_index )
+{
+    char *psz_index = NULL;
+    size_t i_index = 0;
+
+    if ( indexAppend( &psz_index, &i_index, "#EXTM3U\n#EXT-X-TARGETDURATION:%zu\n#EXT-X-VERSION:%d\n#EXT-X-ALLOW-CACHE:%s"
+                      "%s\n#EXT-X-MEDIA-SEQUENCE:%"PRIu32"\n", p_sys->i_seglen,
+                      p_sys->psz_init_uri ? 6 : 3,
+                      p_sys->b_caching ? "YES" : "NO",
+                      p_sys->i_numsegs > 0 ? "" : b_isend ? "\n#EXT-X-PLAYLIST-TYPE:VOD" : "\n#EXT-X-PLAYLIST-TYPE:EVENT",
+                      i_firstseg ) < 0 )
+        goto error;
+
+    if ( p_sys->psz_init_uri &&
+         indexAppend( &psz_index, &i_index, "#EXT-X-MAP:URI=\"%s\"\n",
+                      p_sys->psz_init_uri ) < 0 )
+        goto error;
+
+    const char *psz_current_uri = NULL;
+
+    for ( uint32_t i = i_firstseg; i <= p_sys->i_segment; i++ )
+    {
+        //scale to i_index_offset..numsegs + i_index_offset
+        uint32_t index = i - i_firstseg + i_index_offset;
+
+        output_segment_t *segment = (output_segment_t *)vlc_array_item_at_index( p_sys->segments_t, index );
+        if( p_sys->key_uri &&
+            ( !psz_current_uri ||  strcmp( psz_current_uri, segment->psz_key_uri ) )
+          )
+        {
+            int ret = 0;
+            psz_current_uri = segment->psz_key_uri;
+            if( p_sys->b_generate_iv )
+            {
+                unsigned long long iv_hi = 0, iv_lo = 0;
+                for( unsigned short i = 0; i < 8; i++ )
+                {
+                    iv_hi |= segment->aes_ivs[i] & 0xff;
+                    iv_hi <<= 8;
+                    iv_lo |= segment->aes_ivs[8+i] & 0xff;
+                    iv_lo <<= 8;
+                }
+                ret = indexAppend( &psz_index, &i_index, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
+                                   segment->psz_key_uri, iv_hi, iv_lo );
+
+            } else {
+                ret = indexAppend( &psz_index, &i_index, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
+            }
+            if( ret < 0 )
+                goto error;
+        }
+
+        if ( indexAppend( &psz_index, &i_index, "#EXTINF:%s,\n%s\n",
+                          segment->psz_duration, segment->psz_uri ) < 0 )
+            goto error;
+    }
+
+    if ( b_isend && indexAppend( &psz_index, &i_index, "%s", STR_ENDLIST ) < 0 )
+        goto error;
+
+    *pi_index = i_index;
+    return psz_index;
+
+error:
+    free( psz_index );
+    return NULL;
+}
+
+/************************************************************************
+ * writeIndex: replace the index file with a complete new one
+ ************************************************************************/
+static int writeIndex( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys,
+                       const char *psz_index, size_t i_index )
+{
+    int val;
+    FILE *fp;
+    char *psz_idxTmp;
+    if ( asprintf( &psz_idxTmp, "%s.tmp", p_sys->psz_indexPath ) < 0)
+        return -1;
+
+    fp = vlc_fopen( psz_idxTmp, "wt");
+    if ( !fp )
+    {
+        msg_Err( p_access, "cannot open index file `%s'", psz_idxTmp );
+        free( psz_idxTmp );
+        return -1;
+    }
+
+    val = fwrite( psz_index, 1, i_index, fp ) == i_index ? 0 : -1;
+    if ( fclose( fp ) )
+        val = -1;
+    if ( val < 0 )
+    {
+        msg_Err( p_access, "cannot write index file `%s'", psz_idxTmp );
+        vlc_unlink( psz_idxTmp );
+        free( psz_idxTmp );
+        return -1;
+    }
+
+    /* rename() replaces the index atomically for readers */
+    val = vlc_rename ( psz_idxTmp, p_sys->psz_indexPath);
+
+    if ( val < 0 )
+    {
+        vlc_unlink( psz_idxTmp );
+        msg_Err( p_access, "Error moving LiveHttp index file" );
+    }
+    else
+        msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , p_sys->psz_indexPath );
+
+    free( psz_idxTmp );
+    return 0;
+}
+
 /************************************************************************
  * updateIndexAndDel: If necessary, update index file & delete old segments
  ************************************************************************/
@@ -553,102 +978,29 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
     // First update index
     if ( p_sys->psz_indexPath )
     {
-        int val;
-        FILE *fp;
-        char *psz_idxTmp;
-        if ( asprintf( &psz_idxTmp, "%s.tmp", p_sys->psz_indexPath ) < 0)
+        size_t i_index;
+        char *psz_index = formatIndex( p_sys, i_firstseg, i_index_offset,
+                                       b_isend, &i_index );
+        if ( !psz_index )
             return -1;
 
-        fp = vlc_fopen( psz_idxTmp, "wt");
-        if ( !fp )
+        if ( p_sys->p_httpd_host )
         {
-            msg_Err( p_access, "cannot open index file `%s'", psz_idxTmp );
-            free( psz_idxTmp );
-            return -1;
-        }
-
-        if ( fprintf( fp, "#EXTM3U\n#EXT-X-TARGETDURATION:%zu\n#EXT-X-VERSION:3\n#EXT-X-ALLOW-CACHE:%s"
-                          "%s\n#EXT-X-MEDIA-SEQUENCE:%"PRIu32"\n", p_sys->i_seglen,
-                          p_sys->b_caching ? "YES" : "NO",
-                          p_sys->i_numsegs > 0 ? "" : b_isend ? "\n#EXT-X-PLAYLIST-TYPE:VOD" : "\n#EXT-X-PLAYLIST-TYPE:EVENT",
-                          i_firstseg ) < 0 )
-        {
-            free( psz_idxTmp );
-            fclose( fp );
-            return -1;
+            /* Clients see either the old or the new index, never a mix */
+            vlc_mutex_lock( &p_sys->lock );
+            char *psz_old = p_sys->psz_index;
+            p_sys->psz_index = psz_index;
+            p_sys->i_index = i_index;
+            vlc_mutex_unlock( &p_sys->lock );
+            free( psz_old );
         }
-        char *psz_current_uri=NULL;
-
-
-        for ( uint32_t i = i_firstseg; i <= p_sys->i_segment; i++ )
+        else
         {
-            //scale to i_index_offset..numsegs + i_index_offset
-            uint32_t index = i - i_firstseg + i_index_offset;
-
-            output_segment_t *segment = (output_segment_t *)vlc_array_item_at_index( p_sys->segments_t, index );
-            if( p_sys->key_uri &&
-                ( !psz_current_uri ||  strcmp( psz_current_uri, segment->psz_key_uri ) )
-              )
-            {
-                int ret = 0;
-                free( psz_current_uri );
-                psz_current_uri = strdup( segment->psz_key_uri );
-                if( p_sys->b_generate_iv )
-                {
-                    unsigned long long iv_hi = 0, iv_lo = 0;
-                    for( unsigned short i = 0; i < 8; i++ )
-                    {
-                        iv_hi |= segment->aes_ivs[i] & 0xff;
-                        iv_hi <<= 8;
-                        iv_lo |= segment->aes_ivs[8+i] & 0xff;
-                        iv_lo <<= 8;
-                    }
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
-                                   segment->psz_key_uri, iv_hi, iv_lo );
-
-                } else {
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
-                }
-                if( ret < 0 )
-                {
-                    free( psz_idxTmp );
-                    fclose( fp );
-                    return -1;
-                }
-            }
-
-            val = fprintf( fp, "#EXTINF:%s,\n%s\n", segment->psz_duration, segment->psz_uri);
+            int val = writeIndex( p_access, p_sys, psz_index, i_index );
+            free( psz_index );
             if ( val < 0 )
-            {
-                fclose( fp );
-                return -1;
-            }
-        }
-        free( psz_current_uri );
-
-        if ( b_isend )
-        {
-            if ( fputs ( STR_ENDLIST, fp ) < 0)
-            {
-                free( psz_idxTmp );
-                fclose( fp ) ;
                 return -1;
-            }
-
-        }
-        fclose( fp );
-
-        val = vlc_rename ( psz_idxTmp, p_sys->psz_indexPath);
-
-        if ( val < 0 )
-        {
-            vlc_unlink( psz_idxTmp );
-            msg_Err( p_access, "Error moving LiveHttp index file" );
         }
-        else
-            msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , p_sys->psz_indexPath );
-
-        free( psz_idxTmp );
     }
 
     // Then take care of deletion
@@ -661,7 +1013,7 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
          msg_Dbg( p_access, "Removing segment number %d", segment->i_segment_number );
          vlc_array_remove( p_sys->segments_t, 0 );
 
-         if ( segment->psz_filename )
+         if ( segment->psz_filename && !p_sys->p_httpd_host )
          {
              vlc_unlink( segment->psz_filename );
          }
@@ -679,7 +1031,7 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
  *****************************************************************************/
 static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
 {
-    if ( p_sys->i_handle >= 0 )
+    if ( p_sys->b_segment_open )
     {
         output_segment_t *segment = (output_segment_t *)vlc_array_item_at_index( p_sys->segments_t, vlc_array_count( p_sys->segments_t ) - 1 );
 
@@ -692,16 +1044,29 @@ static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sy
             if( err ) {
                msg_Err( p_access, "Couldn't encrypt 16 bytes: %s", gpg_strerror(err) );
             } else {
-            int ret = write( p_sys->i_handle, p_sys->stuffing_bytes, 16 );
-            if( ret != 16 )
+            block_t *p_stuffing = block_Alloc( 16 );
+            if( p_stuffing )
+                memcpy( p_stuffing->p_buffer, p_sys->stuffing_bytes, 16 );
+            if( !p_stuffing || segmentWrite( p_sys, p_stuffing ) != 16 )
                 msg_Err( p_access, "Couldn't write 16 bytes" );
+            if( p_stuffing )
+                block_Release( p_stuffing );
             }
             p_sys->stuffing_size = 0;
         }
 
-
-        close( p_sys->i_handle );
-        p_sys->i_handle = -1;
+        if( p_sys->p_httpd_host )
+        {
+            publishSegment( p_access, segment, p_sys->p_segdata );
+            p_sys->p_segdata = NULL;
+            p_sys->pp_segdata_last = &p_sys->p_segdata;
+        }
+        else
+        {
+            close( p_sys->i_handle );
+            p_sys->i_handle = -1;
+        }
+        p_sys->b_segment_open = false;
 
         if( ! ( us_asprintf( &segment->psz_duration, "%.2f", p_sys->f_seglen ) ) )
         {
@@ -763,7 +1128,7 @@ static void Close( vlc_object_t * p_this )
             }
             crypted = true;
         }
-        ssize_t val = write( p_sys->i_handle, p_sys->block_buffer->p_buffer, p_sys->block_buffer->i_buffer );
+        ssize_t val = segmentWrite( p_sys, p_sys->block_buffer );
         if ( val == -1 )
         {
            if ( errno == EINTR )
@@ -807,6 +1172,19 @@ static void Close( vlc_object_t * p_this )
     }
     vlc_array_destroy( p_sys->segments_t );
 
+    if( p_sys->p_init )
+        destroySegment( p_sys->p_init );
+    free( p_sys->psz_init_uri );
+
+    if( p_sys->p_httpd_host )
+    {
+        httpd_FileDelete( p_sys->p_index_file );
+        httpd_HostDelete( p_sys->p_httpd_host );
+    }
+    block_ChainRelease( p_sys->p_segdata );
+    free( p_sys->psz_index );
+    vlc_mutex_destroy( &p_sys->lock );
+
     free( p_sys->psz_indexUrl );
     free( p_sys->psz_indexPath );
     free( p_sys );
@@ -851,7 +1229,9 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
     memset( segment, 0 , sizeof( output_segment_t ) );
 
     segment->i_segment_number = i_newseg;
-    segment->psz_filename = formatSegmentPath( p_access->psz_path, i_newseg, true );
+    /* In memory mode, the "file name" is the URL path of the segment */
+    segment->psz_filename = formatSegmentPath( p_access->psz_path, i_newseg,
+                                               !p_sys->p_httpd_host );
     char *psz_idxFormat = p_sys->psz_indexUrl ? p_sys->psz_indexUrl : p_access->psz_path;
     segment->psz_uri = formatSegmentPath( psz_idxFormat , i_newseg, false );
 
@@ -861,9 +1241,10 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
         return -1;
     }
 
-    fd = vlc_open( segment->psz_filename, O_WRONLY | O_CREAT | O_LARGEFILE |
-                     O_TRUNC, 0666 );
-    if ( fd == -1 )
+    if ( p_sys->p_httpd_host )
+        fd = -1;
+    else if ( ( fd = vlc_open( segment->psz_filename, O_WRONLY | O_CREAT |
+                                O_LARGEFILE | O_TRUNC, 0666 ) ) == -1 )
     {
         msg_Err( p_access, "cannot open `%s' (%m)", segment->psz_filename );
         destroySegment( segment );
@@ -888,8 +1269,9 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
 
     p_sys->psz_cursegPath = strdup(segment->psz_filename);
     p_sys->i_handle = fd;
+    p_sys->b_segment_open = true;
     p_sys->i_segment = i_newseg;
-    return fd;
+    return 0;
 }
 
 /*****************************************************************************
@@ -910,13 +1292,25 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
             p_sys->block_buffer = NULL;
 
 
-            if( p_sys->i_handle > 0 &&
+            /* With fragmented MP4, what comes before the first fragment
+             * is the initialization segment */
+            if( p_sys->b_fmp4 && !p_sys->b_init && output )
+            {
+                if( storeInitSegment( p_access, p_sys, output ) )
+                {
+                    block_ChainRelease( p_buffer );
+                    return -1;
+                }
+                output = NULL;
+            }
+
+            if( p_sys->b_segment_open &&
                 ( p_buffer->i_dts - p_sys->i_opendts +
                   p_buffer->i_length * CLOCK_FREQ / INT64_C(1000000)
                 ) >= p_sys->i_seglenm )
                 closeCurrentSegment( p_access, p_sys, false );
 
-            if ( p_sys->i_handle < 0 )
+            if ( !p_sys->b_segment_open && ( !p_sys->b_fmp4 || p_sys->b_init ) )
             {
                 p_sys->i_opendts = output ? output->i_dts : p_buffer->i_dts;
                 //For first segment we can get negative duration otherwise...?
@@ -959,7 +1353,7 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
                     crypted=true;
 
                 }
-                ssize_t val = write( p_sys->i_handle, output->p_buffer, output->i_buffer );
+                ssize_t val = segmentWrite( p_sys, output );
                 if ( val == -1 )
                 {
                    if ( errno == EINTR )
@@ -305,6 +305,25 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
         }
 
         i_len += p_buffer->i_buffer;
+
+        /* A block that fits in a datagram, but not twice, would get a
+         * datagram of its own anyway: send it as is instead of copying it
+         * (the TS muxer hands over such groups of packets) */
+        if( !p_sys->p_buffer && p_buffer->i_buffer <= p_sys->i_mtu
+         && 2 * p_buffer->i_buffer > p_sys->i_mtu )
+        {
+            p_next = p_buffer->p_next;
+            p_buffer->p_next = NULL;
+            if( p_buffer->i_dts + p_sys->i_caching < now )
+            {
+                msg_Dbg( p_access, "late packet for udp input (%"PRId64 ")",
+                         now - p_buffer->i_dts - p_sys->i_caching );
+            }
+            block_FifoPut( p_sys->p_fifo, p_buffer );
+            p_buffer = p_next;
+            continue;
+        }
+
         while( p_buffer->i_buffer )
         {
             size_t i_payload_size = p_sys->i_mtu;
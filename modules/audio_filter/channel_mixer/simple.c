@@ -33,7 +33,16 @@
 #include <vlc_aout.h>
 #include <vlc_filter.h>
 #include <vlc_block.h>
+#include <vlc_cpu.h>
 #include <assert.h>
+#include <math.h>
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+# include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
 
 /*****************************************************************************
  * Module descriptor
@@ -52,18 +61,37 @@ vlc_module_end ()
 /*****************************************************************************
  * Local prototypes
  *****************************************************************************/
+typedef void (*load_t)( float *, const void *, size_t );
+typedef void (*store_t)( void *, const float *, size_t );
+
 struct filter_sys_t
 {
-    void (*pf_dowork)(filter_t *, block_t *, block_t * );
+    void (*pf_dowork)( filter_t *, const float *, float *, unsigned );
+    load_t  pf_load;  /**< to FL32, NULL if the input is FL32 */
+    store_t pf_store; /**< from FL32 with clipping, NULL if the output is FL32 */
+    unsigned i_in_size;  /**< bytes per input sample */
+    unsigned i_out_size; /**< bytes per output sample */
+    float *p_out_tmp;    /**< mixed chunk, after the input chunk in p_tmp */
+    float p_tmp[];       /**< converted input chunk */
 };
 
+/* The samples are converted and mixed by chunks that stay in the L1 cache,
+ * so that the whole conversion is done in a single pass over the buffer */
+#define CHUNK_FRAMES 256
+
 /*****************************************************************************
  * IsSupported: can we downmix?
  *****************************************************************************/
+static bool IsLinear( vlc_fourcc_t i_format )
+{
+    return i_format == VLC_CODEC_FL32 || i_format == VLC_CODEC_S16N ||
+           i_format == VLC_CODEC_S32N;
+}
+
 static bool IsSupported( const audio_format_t *p_input, const audio_format_t *p_output )
 {
-    if( p_input->i_format != VLC_CODEC_FL32 ||
-        p_input->i_format != p_output->i_format ||
+    /* The sample format can be converted at the same time */
+    if( !IsLinear( p_input->i_format ) || !IsLinear( p_output->i_format ) ||
         p_input->i_rate != p_output->i_rate )
     {
         return false;
@@ -111,10 +139,194 @@ static bool IsSupported( const audio_format_t *p_input, const audio_format_t *p_
 
 static block_t *Filter( filter_t *, block_t * );
 
-static void DoWork_7_x_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+/*****************************************************************************
+ * Sample format conversions
+ *****************************************************************************
+ * Every implementation gives the same samples: conversions to integers are
+ * clamped first, then rounded to nearest with ties to even, like lrintf()
+ * and cvtps2dq in the default rounding mode.
+ *****************************************************************************/
+#if defined(__ARM_NEON__)
+/* Converts to the nearest integer, NEON conversions truncate: the truncated
+ * value is moved away from zero if the remainder is above one half, or one
+ * half with an odd value. v must be within [-2^31, 2^31]. */
+static inline int32x4_t RoundNEON( float32x4_t v )
+{
+    const float32x4_t half = vdupq_n_f32( .5f );
+    int32x4_t t = vcvtq_s32_f32( v );
+    float32x4_t rem = vsubq_f32( v, vcvtq_f32_s32( t ) );
+
+    uint32x4_t away = vorrq_u32( vcagtq_f32( rem, half ),
+                                 vandq_u32( vceqq_f32( vabsq_f32( rem ), half ),
+                                            vtstq_s32( t, vdupq_n_s32( 1 ) ) ) );
+    int32x4_t step = vbslq_s32( vcltq_f32( rem, vdupq_n_f32( 0.f ) ),
+                                vdupq_n_s32( -1 ), vdupq_n_s32( 1 ) );
+    return vaddq_s32( t, vandq_s32( step, vreinterpretq_s32_u32( away ) ) );
+}
+#endif
+
+static void LoadS16( float *p_dst, const void *p_buf, size_t i_samples )
+{
+    const int16_t *p_src = p_buf;
+    size_t i = 0;
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+    if( vlc_CPU_SSE2() )
+    {
+        const __m128 scale = _mm_set1_ps( 1.f / 32768.f );
+        for( ; i + 8 <= i_samples; i += 8 )
+        {
+            __m128i v = _mm_loadu_si128( (const __m128i *)(p_src + i) );
+            __m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( v, v ), 16 );
+            __m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( v, v ), 16 );
+            _mm_storeu_ps( p_dst + i, _mm_mul_ps( _mm_cvtepi32_ps( lo ), scale ) );
+            _mm_storeu_ps( p_dst + i + 4,
+                           _mm_mul_ps( _mm_cvtepi32_ps( hi ), scale ) );
+        }
+    }
+#elif defined(__ARM_NEON__)
+    if( vlc_CPU_ARM_NEON() )
+        for( ; i + 8 <= i_samples; i += 8 )
+        {
+            int16x8_t v = vld1q_s16( p_src + i );
+            vst1q_f32( p_dst + i, vcvtq_n_f32_s32( vmovl_s16( vget_low_s16( v ) ), 15 ) );
+            vst1q_f32( p_dst + i + 4,
+                       vcvtq_n_f32_s32( vmovl_s16( vget_high_s16( v ) ), 15 ) );
+        }
+#endif
+    for( ; i < i_samples; i++ )
+        p_dst[i] = p_src[i] / 32768.f;
+}
+
+static void LoadS32( float *p_dst, const void *p_buf, size_t i_samples )
+{
+    const int32_t *p_src = p_buf;
+    size_t i = 0;
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+    if( vlc_CPU_SSE2() )
+    {
+        const __m128 scale = _mm_set1_ps( 1.f / 2147483648.f );
+        for( ; i + 4 <= i_samples; i += 4 )
+        {
+            __m128i v = _mm_loadu_si128( (const __m128i *)(p_src + i) );
+            _mm_storeu_ps( p_dst + i, _mm_mul_ps( _mm_cvtepi32_ps( v ), scale ) );
+        }
+    }
+#elif defined(__ARM_NEON__)
+    if( vlc_CPU_ARM_NEON() )
+    {
+        const float32x4_t scale = vdupq_n_f32( 1.f / 2147483648.f );
+        for( ; i + 4 <= i_samples; i += 4 )
+            vst1q_f32( p_dst + i,
+                       vmulq_f32( vcvtq_f32_s32( vld1q_s32( p_src + i ) ),
+                                  scale ) );
+    }
+#endif
+    for( ; i < i_samples; i++ )
+        p_dst[i] = p_src[i] / 2147483648.f;
+}
+
+static void StoreS16( void *p_buf, const float *p_src, size_t i_samples )
+{
+    int16_t *p_dst = p_buf;
+    size_t i = 0;
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+    if( vlc_CPU_SSE2() )
+    {
+        const __m128 scale = _mm_set1_ps( 32768.f );
+        const __m128 vmin = _mm_set1_ps( -32768.f );
+        const __m128 vmax = _mm_set1_ps( 32767.f );
+        for( ; i + 8 <= i_samples; i += 8 )
+        {
+            __m128 flo = _mm_mul_ps( _mm_loadu_ps( p_src + i ), scale );
+            __m128 fhi = _mm_mul_ps( _mm_loadu_ps( p_src + i + 4 ), scale );
+            __m128i lo = _mm_cvtps_epi32( _mm_min_ps( _mm_max_ps( flo, vmin ), vmax ) );
+            __m128i hi = _mm_cvtps_epi32( _mm_min_ps( _mm_max_ps( fhi, vmin ), vmax ) );
+            _mm_storeu_si128( (__m128i *)(p_dst + i), _mm_packs_epi32( lo, hi ) );
+        }
+    }
+#elif defined(__ARM_NEON__)
+    if( vlc_CPU_ARM_NEON() )
+    {
+        const float32x4_t vmin = vdupq_n_f32( -32768.f );
+        const float32x4_t vmax = vdupq_n_f32( 32767.f );
+        for( ; i + 8 <= i_samples; i += 8 )
+        {
+            float32x4_t flo = vmulq_n_f32( vld1q_f32( p_src + i ), 32768.f );
+            float32x4_t fhi = vmulq_n_f32( vld1q_f32( p_src + i + 4 ), 32768.f );
+            int32x4_t lo = RoundNEON( vminq_f32( vmaxq_f32( flo, vmin ), vmax ) );
+            int32x4_t hi = RoundNEON( vminq_f32( vmaxq_f32( fhi, vmin ), vmax ) );
+            vst1q_s16( p_dst + i, vcombine_s16( vmovn_s32( lo ), vmovn_s32( hi ) ) );
+        }
+    }
+#endif
+    for( ; i < i_samples; i++ )
+    {
+        float s = p_src[i] * 32768.f;
+        if( s >= 32767.f )
+            p_dst[i] = 32767;
+        else if( s <= -32768.f )
+            p_dst[i] = -32768;
+        else
+            p_dst[i] = lrintf( s );
+    }
+}
+
+static void StoreS32( void *p_buf, const float *p_src, size_t i_samples )
+{
+    int32_t *p_dst = p_buf;
+    size_t i = 0;
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+    if( vlc_CPU_SSE2() )
+    {
+        /* 2^31 and above convert to INT32_MIN, flipped to INT32_MAX */
+        const __m128 scale = _mm_set1_ps( 2147483648.f );
+        const __m128 vmin = _mm_set1_ps( -2147483648.f );
+        for( ; i + 4 <= i_samples; i += 4 )
+        {
+            __m128 f = _mm_max_ps( _mm_mul_ps( _mm_loadu_ps( p_src + i ),
+                                               scale ), vmin );
+            __m128i over = _mm_castps_si128( _mm_cmpge_ps( f, scale ) );
+            _mm_storeu_si128( (__m128i *)(p_dst + i),
+                              _mm_xor_si128( _mm_cvtps_epi32( f ), over ) );
+        }
+    }
+#elif defined(__ARM_NEON__)
+    if( vlc_CPU_ARM_NEON() )
+    {
+        /* 2^31 saturates to INT32_MAX */
+        const float32x4_t vmin = vdupq_n_f32( -2147483648.f );
+        const float32x4_t vmax = vdupq_n_f32( 2147483648.f );
+        for( ; i + 4 <= i_samples; i += 4 )
+        {
+            float32x4_t f = vmulq_n_f32( vld1q_f32( p_src + i ), 2147483648.f );
+            vst1q_s32( p_dst + i,
+                       RoundNEON( vminq_f32( vmaxq_f32( f, vmin ), vmax ) ) );
+        }
+    }
+#endif
+    for( ; i < i_samples; i++ )
+    {
+        float s = p_src[i] * 2147483648.f;
+        if( s >= 2147483647.f )
+            p_dst[i] = INT32_MAX;
+        else if( s <= -2147483648.f )
+            p_dst[i] = INT32_MIN;
+        else
+            p_dst[i] = lrintf( s );
+    }
+}
+
+/*****************************************************************************
+ * Mixing
+ *****************************************************************************/
+static void DoWork_7_x_to_2_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
+    for( unsigned i = i_frames; i--; )
     {
         float ctr = p_src[6] * 0.7071f;
         *p_dest++ = ctr + p_src[0] + p_src[2] / 4 + p_src[4] / 4;
@@ -126,13 +338,11 @@ static void DoWork_7_x_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t
     }
 }
 
-static void DoWork_6_1_to_2_0( filter_t *p_filter, block_t *p_in_buf,
-                               block_t *p_out_buf )
+static void DoWork_6_1_to_2_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
 {
     VLC_UNUSED(p_filter);
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+    for( unsigned i = i_frames; i--; )
     {
         float ctr = (p_src[2] + p_src[5]) * 0.7071f;
         *p_dest++ = p_src[0] + p_src[3] + ctr;
@@ -145,10 +355,10 @@ static void DoWork_6_1_to_2_0( filter_t *p_filter, block_t *p_in_buf,
     }
 }
 
-static void DoWork_5_x_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+static void DoWork_5_x_to_2_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
+    for( unsigned i = i_frames; i--; )
     {
         *p_dest++ = p_src[0] + 0.7071f * (p_src[4] + p_src[2]);
         *p_dest++ = p_src[1] + 0.7071f * (p_src[4] + p_src[3]);
@@ -159,11 +369,11 @@ static void DoWork_5_x_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t
     }
 }
 
-static void DoWork_4_0_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
+static void DoWork_4_0_to_2_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
     VLC_UNUSED(p_filter);
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+    for( unsigned i = i_frames; i--; )
     {
         *p_dest++ = p_src[2] + p_src[3] + 0.5f * p_src[0];
         *p_dest++ = p_src[2] + p_src[3] + 0.5f * p_src[1];
@@ -171,10 +381,10 @@ static void DoWork_4_0_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t
     }
 }
 
-static void DoWork_3_x_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+static void DoWork_3_x_to_2_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
+    for( unsigned i = i_frames; i--; )
     {
         *p_dest++ = p_src[2] + 0.5f * p_src[0];
         *p_dest++ = p_src[2] + 0.5f * p_src[1];
@@ -185,10 +395,10 @@ static void DoWork_3_x_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t
     }
 }
 
-static void DoWork_7_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+static void DoWork_7_x_to_1_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
+    for( unsigned i = i_frames; i--; )
     {
         *p_dest++ = p_src[6] + p_src[0] / 4 + p_src[1] / 4 + p_src[2] / 8 + p_src[3] / 8 + p_src[4] / 8 + p_src[5] / 8;
 
@@ -198,10 +408,10 @@ static void DoWork_7_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t
     }
 }
 
-static void DoWork_5_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+static void DoWork_5_x_to_1_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
+    for( unsigned i = i_frames; i--; )
     {
         *p_dest++ = 0.7071f * (p_src[0] + p_src[1]) + p_src[4]
                      + 0.5f * (p_src[2] + p_src[3]);
@@ -212,21 +422,21 @@ static void DoWork_5_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t
     }
 }
 
-static void DoWork_4_0_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
+static void DoWork_4_0_to_1_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
     VLC_UNUSED(p_filter);
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+    for( unsigned i = i_frames; i--; )
     {
         *p_dest++ = p_src[2] + p_src[3] + p_src[0] / 4 + p_src[1] / 4;
         p_src += 4;
     }
 }
 
-static void DoWork_3_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+static void DoWork_3_x_to_1_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
+    for( unsigned i = i_frames; i--; )
     {
         *p_dest++ = p_src[2] + p_src[0] / 4 + p_src[1] / 4;
 
@@ -236,11 +446,11 @@ static void DoWork_3_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t
     }
 }
 
-static void DoWork_2_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
+static void DoWork_2_x_to_1_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
     VLC_UNUSED(p_filter);
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+    for( unsigned i = i_frames; i--; )
     {
         *p_dest++ = p_src[0] / 2 + p_src[1] / 2;
 
@@ -248,10 +458,10 @@ static void DoWork_2_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t
     }
 }
 
-static void DoWork_7_x_to_4_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+static void DoWork_7_x_to_4_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
+    for( unsigned i = i_frames; i--; )
     {
         *p_dest++ = p_src[6] + 0.5f * p_src[0] + p_src[2] / 6;
         *p_dest++ = p_src[6] + 0.5f * p_src[1] + p_src[3] / 6;
@@ -264,10 +474,10 @@ static void DoWork_7_x_to_4_0( filter_t * p_filter,  block_t * p_in_buf, block_t
     }
 }
 
-static void DoWork_5_x_to_4_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+static void DoWork_5_x_to_4_0( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
+    for( unsigned i = i_frames; i--; )
     {
         float ctr = p_src[4] * 0.7071f;
         *p_dest++ = p_src[0] + ctr;
@@ -281,10 +491,10 @@ static void DoWork_5_x_to_4_0( filter_t * p_filter,  block_t * p_in_buf, block_t
     }
 }
 
-static void DoWork_7_x_to_5_x( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+static void DoWork_7_x_to_5_x( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
+    for( unsigned i = i_frames; i--; )
     {
         *p_dest++ = p_src[0];
         *p_dest++ = p_src[1];
@@ -301,11 +511,11 @@ static void DoWork_7_x_to_5_x( filter_t * p_filter,  block_t * p_in_buf, block_t
     }
 }
 
-static void DoWork_6_1_to_5_x( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
+static void DoWork_6_1_to_5_x( filter_t *p_filter, const float *p_src,
+                               float *p_dest, unsigned i_frames )
+{
     VLC_UNUSED(p_filter);
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
+    for( unsigned i = i_frames; i--; )
     {
         *p_dest++ = p_src[0];
         *p_dest++ = p_src[1];
@@ -338,9 +548,34 @@ static int OpenFilter( vlc_object_t *p_this )
     if( !IsSupported( &fmt_in, &fmt_out ) )
         return VLC_EGENERIC;
 
-    p_filter->p_sys = malloc( sizeof(*p_sys) );
+    /* Chunk buffers for the actual channel counts */
+    const unsigned i_input_nb = aout_FormatNbChannels( &fmt_in );
+    const unsigned i_output_nb = aout_FormatNbChannels( &fmt_out );
+    p_filter->p_sys = p_sys = malloc( sizeof(*p_sys) + CHUNK_FRAMES *
+                                      (i_input_nb + i_output_nb) * sizeof(float) );
     if( unlikely(!p_filter->p_sys) )
         return VLC_ENOMEM;
+    p_sys->p_out_tmp = p_sys->p_tmp + CHUNK_FRAMES * i_input_nb;
+
+    p_sys->pf_load = NULL;
+    p_sys->i_in_size = 4;
+    if( fmt_in.i_format == VLC_CODEC_S16N )
+    {
+        p_sys->pf_load = LoadS16;
+        p_sys->i_in_size = 2;
+    }
+    else if( fmt_in.i_format == VLC_CODEC_S32N )
+        p_sys->pf_load = LoadS32;
+
+    p_sys->pf_store = NULL;
+    p_sys->i_out_size = 4;
+    if( fmt_out.i_format == VLC_CODEC_S16N )
+    {
+        p_sys->pf_store = StoreS16;
+        p_sys->i_out_size = 2;
+    }
+    else if( fmt_out.i_format == VLC_CODEC_S32N )
+        p_sys->pf_store = StoreS32;
 
     p_filter->pf_audio_filter = Filter;
 
@@ -421,31 +656,58 @@ static block_t *Filter( filter_t *p_filter, block_t *p_block )
         return NULL;
     }
 
-    size_t i_out_size = p_block->i_nb_samples *
-      p_filter->fmt_out.audio.i_bitspersample *
-        p_filter->fmt_out.audio.i_channels / 8;
+    const unsigned i_input_nb = aout_FormatNbChannels( &p_filter->fmt_in.audio );
+    const unsigned i_output_nb = aout_FormatNbChannels( &p_filter->fmt_out.audio );
+    const size_t i_in_frame = i_input_nb * p_sys->i_in_size;
+    const size_t i_out_frame = i_output_nb * p_sys->i_out_size;
 
-    block_t *p_out = block_Alloc( i_out_size );
-    if( !p_out )
+    /* Downmixed frames usually fit in the input buffer */
+    block_t *p_out = p_block;
+    if( i_out_frame > i_in_frame )
     {
-        msg_Warn( p_filter, "can't get output buffer" );
-        block_Release( p_block );
-        return NULL;
+        p_out = block_Alloc( p_block->i_nb_samples * i_out_frame );
+        if( !p_out )
+        {
+            msg_Warn( p_filter, "can't get output buffer" );
+            block_Release( p_block );
+            return NULL;
+        }
+        block_CopyProperties( p_out, p_block );
     }
 
-    p_out->i_nb_samples = p_block->i_nb_samples;
-    p_out->i_dts = p_block->i_dts;
-    p_out->i_pts = p_block->i_pts;
-    p_out->i_length = p_block->i_length;
-
-    int i_input_nb = aout_FormatNbChannels( &p_filter->fmt_in.audio );
-    int i_output_nb = aout_FormatNbChannels( &p_filter->fmt_out.audio );
-    p_out->i_nb_samples = p_block->i_nb_samples;
-    p_out->i_buffer = p_block->i_buffer * i_output_nb / i_input_nb;
+    const uint8_t *p_src = p_block->p_buffer;
+    uint8_t *p_dst = p_out->p_buffer;
 
-    p_sys->pf_dowork( p_filter, p_block, p_out );
+    for( unsigned i = 0; i < p_block->i_nb_samples; i += CHUNK_FRAMES )
+    {
+        const unsigned i_frames = __MIN( CHUNK_FRAMES,
+                                         p_block->i_nb_samples - i );
+        const float *p_in = (const float *)p_src;
+        /* In place, the output of a chunk may overlap its own input */
+        float *p_mix = (p_sys->pf_store == NULL && p_out != p_block)
+                     ? (float *)p_dst : p_sys->p_out_tmp;
+
+        if( p_sys->pf_load != NULL )
+        {
+            p_sys->pf_load( p_sys->p_tmp, p_src, i_frames * i_input_nb );
+            p_in = p_sys->p_tmp;
+        }
+
+        p_sys->pf_dowork( p_filter, p_in, p_mix, i_frames );
+
+        if( p_sys->pf_store != NULL )
+            p_sys->pf_store( p_dst, p_mix, i_frames * i_output_nb );
+        else if( p_mix != (float *)p_dst )
+            memcpy( p_dst, p_mix, i_frames * i_out_frame );
+
+        p_src += i_frames * i_in_frame;
+        p_dst += i_frames * i_out_frame;
+    }
 
-    block_Release( p_block );
+    p_out->i_nb_samples = p_block->i_nb_samples;
+    p_out->i_buffer = p_block->i_nb_samples * i_out_frame;
+    if( p_out != p_block )
+        block_Release( p_block );
 
     return p_out;
 }
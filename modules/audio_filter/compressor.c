@@ -38,6 +38,14 @@
 
 #include <vlc_aout.h>
 #include <vlc_filter.h>
+#include <vlc_cpu.h>
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+# include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
 
 /*****************************************************************************
 * Local prototypes.
@@ -54,6 +62,7 @@
 #define DB_DEFAULT_CUBE
 #define RMS_BUF_SIZE    (960)
 #define LOOKAHEAD_SIZE  ((RMS_BUF_SIZE)<<1)
+#define CHUNK_SIZE      (256)
 
 #define LIN_INTERP(f,a,b) ((a) + (f) * ( (b) - (a) ))
 #define LIMIT(v,l,u)      (v < l ? l : ( v > u ? u : v ))
@@ -69,17 +78,16 @@ typedef struct
 
 typedef struct
 {
-    struct
-    {
-        float pf_vals[AOUT_CHAN_MAX];
-        float f_lev_in;
-
-    } p_buf[LOOKAHEAD_SIZE];
+    float pf_vals[LOOKAHEAD_SIZE * AOUT_CHAN_MAX]; /* Interleaved frames */
+    float pf_lev_in[LOOKAHEAD_SIZE];
     unsigned int i_pos;
     unsigned int i_count;
 
 } lookahead;
 
+typedef void (*peak_t)( float *, const float *, unsigned, unsigned );
+typedef void (*delay_t)( float *, float *, const float *, unsigned, unsigned );
+
 struct filter_sys_t
 {
     float f_amp;
@@ -106,6 +114,9 @@ struct filter_sys_t
     float f_ratio;
     float f_knee;
     float f_makeup_gain;
+
+    peak_t  pf_peak;  /* Peak levels of the frames */
+    delay_t pf_delay; /* Delay line and gain */
 };
 
 typedef union
@@ -131,7 +142,19 @@ static float    Max             ( float, float );
 static float    Clamp           ( float, float, float );
 static int      Round           ( float );
 static float    RmsEnvProcess   ( rms_env *, const float );
-static void     BufferProcess   ( float *, int, float, float, lookahead * );
+static void     PeakC           ( float *, const float *, unsigned, unsigned );
+static void     DelayC          ( float *, float *, const float *, unsigned,
+                                  unsigned );
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+static void     PeakSSE2        ( float *, const float *, unsigned, unsigned );
+static void     DelaySSE2       ( float *, float *, const float *, unsigned,
+                                  unsigned );
+#endif
+#if defined(__ARM_NEON__)
+static void     PeakNEON        ( float *, const float *, unsigned, unsigned );
+static void     DelayNEON       ( float *, float *, const float *, unsigned,
+                                  unsigned );
+#endif
 
 static int RMSPeakCallback      ( vlc_object_t *, char const *, vlc_value_t,
                                   vlc_value_t, void * );
@@ -233,6 +256,24 @@ static int Open( vlc_object_t *p_this )
     /* Initialize decibel lookup tables */
     DbInit( p_sys );
 
+    /* Select the sample processing functions */
+    p_sys->pf_peak  = PeakC;
+    p_sys->pf_delay = DelayC;
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+    if( vlc_CPU_SSE2() )
+    {
+        p_sys->pf_peak  = PeakSSE2;
+        p_sys->pf_delay = DelaySSE2;
+    }
+#endif
+#if defined(__ARM_NEON__)
+    if( vlc_CPU_ARM_NEON() )
+    {
+        p_sys->pf_peak  = PeakNEON;
+        p_sys->pf_delay = DelayNEON;
+    }
+#endif
+
     /* Restore the last saved settings */
     p_sys->f_rms_peak    = var_CreateGetFloat( p_aout, "compressor-rms-peak" );
     p_sys->f_attack      = var_CreateGetFloat( p_aout, "compressor-attack" );
@@ -340,95 +381,114 @@ static block_t * DoWork( filter_t * p_filter, block_t * p_in_buf )
     float f_ef_a     = f_ga * 0.25f;
     float f_ef_ai    = 1.0f - f_ef_a;
 
-    /* Process the current buffer */
-    for( int i = 0; i < i_samples; i++ )
+    /* Process the current buffer by chunks, which do not wrap around the
+     * lookahead buffer: the peak levels and the delay line are computed for
+     * all the channels of the chunk at once, only the envelopes are
+     * computed frame by frame */
+    for( int i_done = 0; i_done < i_samples; )
     {
-        float f_lev_in_old, f_lev_in_new;
+        float pf_lev[CHUNK_SIZE], pf_gain[CHUNK_SIZE];
+        unsigned i_frames = __MIN( CHUNK_SIZE, i_samples - i_done );
+        i_frames = __MIN( i_frames, p_la->i_count - p_la->i_pos );
 
-        /* Now, compress the pre-equalized audio (ported from sc4_1882
-         * plugin with a few modifications) */
+        /* Find the peak values of the current frames */
+        p_sys->pf_peak( pf_lev, pf_buf, i_frames, i_channels );
 
-        /* Fetch the old delayed buffer value */
-        f_lev_in_old = p_la->p_buf[p_la->i_pos].f_lev_in;
-
-        /* Find the peak value of current sample.  This becomes the new delayed
-         * buffer value that replaces the old one in the lookahead array */
-        f_lev_in_new = fabs( pf_buf[0] );
-        for( int i_chan = 1; i_chan < i_channels; i_chan++ )
+        for( unsigned i = 0; i < i_frames; i++ )
         {
-            f_lev_in_new = Max( f_lev_in_new, fabs( pf_buf[i_chan] ) );
-        }
-        p_la->p_buf[p_la->i_pos].f_lev_in = f_lev_in_new;
+            float f_lev_in_old, f_lev_in_new;
 
-        /* Add the square of the peak value to a running sum */
-        f_sum += f_lev_in_new * f_lev_in_new;
+            /* Now, compress the pre-equalized audio (ported from sc4_1882
+             * plugin with a few modifications) */
 
-        /* Update the RMS envelope */
-        if( f_amp > f_env_rms )
-        {
-            f_env_rms = f_env_rms * f_ga + f_amp * ( 1.0f - f_ga );
-        }
-        else
-        {
-            f_env_rms = f_env_rms * f_gr + f_amp * ( 1.0f - f_gr );
-        }
-        RoundToZero( &f_env_rms );
+            /* Fetch the old delayed buffer value */
+            f_lev_in_old = p_la->pf_lev_in[p_la->i_pos + i];
 
-        /* Update the peak envelope */
-        if( f_lev_in_old > f_env_peak )
-        {
-            f_env_peak = f_env_peak * f_ga + f_lev_in_old * ( 1.0f - f_ga );
-        }
-        else
-        {
-            f_env_peak = f_env_peak * f_gr + f_lev_in_old * ( 1.0f - f_gr );
-        }
-        RoundToZero( &f_env_peak );
+            /* The peak value of current sample becomes the new delayed
+             * buffer value that replaces the old one in the lookahead
+             * array */
+            f_lev_in_new = pf_lev[i];
+            p_la->pf_lev_in[p_la->i_pos + i] = f_lev_in_new;
 
-        /* Process the RMS value and update the output gain every 4 samples */
-        if( ( p_sys->i_count++ & 3 ) == 3 )
-        {
-            /* Process the RMS value by placing in the mean square value, and
-             * reset the running sum */
-            f_amp = RmsEnvProcess( p_rms, f_sum * 0.25f );
-            f_sum = 0.0f;
-            if( isnan( f_env_rms ) )
+            /* Add the square of the peak value to a running sum */
+            f_sum += f_lev_in_new * f_lev_in_new;
+
+            /* Update the RMS envelope */
+            if( f_amp > f_env_rms )
             {
-                /* This can happen sometimes, but I don't know why. */
-                f_env_rms = 0.0f;
+                f_env_rms = f_env_rms * f_ga + f_amp * ( 1.0f - f_ga );
             }
-
-            /* Find the superposition of the RMS and peak envelopes */
-            f_env = LIN_INTERP( f_rms_peak, f_env_rms, f_env_peak );
-
-            /* Update the output gain */
-            if( f_env <= f_knee_min )
+            else
             {
-                /* Gain below the knee (and below the threshold) */
-                f_gain_out = 1.0f;
+                f_env_rms = f_env_rms * f_gr + f_amp * ( 1.0f - f_gr );
             }
-            else if( f_env < f_knee_max )
+            RoundToZero( &f_env_rms );
+
+            /* Update the peak envelope */
+            if( f_lev_in_old > f_env_peak )
             {
-                /* Gain within the knee */
-                const float f_x = -( f_threshold
-                                   - f_knee - Lin2Db( f_env, p_sys ) ) / f_knee;
-                f_gain_out = Db2Lin( -f_knee * f_rs * f_x * f_x * 0.25f,
-                                      p_sys );
+                f_env_peak = f_env_peak * f_ga + f_lev_in_old * ( 1.0f - f_ga );
             }
             else
             {
-                /* Gain above the knee (and above the threshold) */
-                f_gain_out = Db2Lin( ( f_threshold - Lin2Db( f_env, p_sys ) )
-                                     * f_rs, p_sys );
+                f_env_peak = f_env_peak * f_gr + f_lev_in_old * ( 1.0f - f_gr );
+            }
+            RoundToZero( &f_env_peak );
+
+            /* Process the RMS value and update the output gain every 4
+             * samples */
+            if( ( p_sys->i_count++ & 3 ) == 3 )
+            {
+                /* Process the RMS value by placing in the mean square value,
+                 * and reset the running sum */
+                f_amp = RmsEnvProcess( p_rms, f_sum * 0.25f );
+                f_sum = 0.0f;
+                if( isnan( f_env_rms ) )
+                {
+                    /* This can happen sometimes, but I don't know why. */
+                    f_env_rms = 0.0f;
+                }
+
+                /* Find the superposition of the RMS and peak envelopes */
+                f_env = LIN_INTERP( f_rms_peak, f_env_rms, f_env_peak );
+
+                /* Update the output gain */
+                if( f_env <= f_knee_min )
+                {
+                    /* Gain below the knee (and below the threshold) */
+                    f_gain_out = 1.0f;
+                }
+                else if( f_env < f_knee_max )
+                {
+                    /* Gain within the knee */
+                    const float f_x = -( f_threshold
+                                       - f_knee - Lin2Db( f_env, p_sys ) )
+                                    / f_knee;
+                    f_gain_out = Db2Lin( -f_knee * f_rs * f_x * f_x * 0.25f,
+                                          p_sys );
+                }
+                else
+                {
+                    /* Gain above the knee (and above the threshold) */
+                    f_gain_out = Db2Lin( ( f_threshold
+                                         - Lin2Db( f_env, p_sys ) ) * f_rs,
+                                         p_sys );
+                }
             }
+
+            /* Find the total gain */
+            f_gain = f_gain * f_ef_a + f_gain_out * f_ef_ai;
+            pf_gain[i] = f_gain * f_mug;
         }
 
-        /* Find the total gain */
-        f_gain = f_gain * f_ef_a + f_gain_out * f_ef_ai;
+        /* Write the compressed delayed frames to the output, and store the
+         * current ones in the lookahead buffer */
+        p_sys->pf_delay( pf_buf, &p_la->pf_vals[p_la->i_pos * i_channels],
+                         pf_gain, i_frames, i_channels );
 
-        /* Write the resulting buffer to the output */
-        BufferProcess( pf_buf, i_channels, f_gain, f_mug, p_la );
-        pf_buf += i_channels;
+        p_la->i_pos = ( p_la->i_pos + i_frames ) % p_la->i_count;
+        pf_buf += i_frames * i_channels;
+        i_done += i_frames;
     }
 
     /* Update the internal parameters */
@@ -604,29 +664,206 @@ static float RmsEnvProcess( rms_env * p_r, const float f_x )
     return sqrt( p_r->f_sum / p_r->i_count );
 }
 
-/* Output the compressed delayed buffer and store the current buffer.  Uses a
- * circular array, just like the one used in calculating the RMS of the buffer
- */
-static void BufferProcess( float * pf_buf, int i_channels, float f_gain,
-                           float f_mug, lookahead * p_la )
+/* Find the peak value of each frame */
+static void PeakC( float *pf_lev, const float *pf_buf, unsigned i_frames,
+                   unsigned i_channels )
 {
-    /* Loop through every channel */
-    for( int i_chan = 0; i_chan < i_channels; i_chan++ )
+    for( unsigned i = 0; i < i_frames; i++ )
     {
-        float f_x = pf_buf[i_chan]; /* Current buffer value */
+        float f_lev = fabs( pf_buf[0] );
+        for( unsigned i_chan = 1; i_chan < i_channels; i_chan++ )
+        {
+            f_lev = Max( f_lev, fabs( pf_buf[i_chan] ) );
+        }
+        pf_lev[i] = f_lev;
+        pf_buf += i_channels;
+    }
+}
 
-        /* Output the compressed delayed buffer value */
-        pf_buf[i_chan] = p_la->p_buf[p_la->i_pos].pf_vals[i_chan]
-                       * f_gain * f_mug;
+/* Output the compressed delayed frames and store the current ones in the
+ * delay line, which is a part of the circular lookahead array */
+static void DelayC( float *pf_buf, float *pf_delay, const float *pf_gain,
+                    unsigned i_frames, unsigned i_channels )
+{
+    for( unsigned i = 0; i < i_frames; i++ )
+    {
+        for( unsigned i_chan = 0; i_chan < i_channels; i_chan++ )
+        {
+            float f_x = pf_buf[i_chan]; /* Current buffer value */
+
+            /* Output the compressed delayed buffer value */
+            pf_buf[i_chan] = pf_delay[i_chan] * pf_gain[i];
 
-        /* Update the delayed buffer value */
-        p_la->p_buf[p_la->i_pos].pf_vals[i_chan] = f_x;
+            /* Update the delayed buffer value */
+            pf_delay[i_chan] = f_x;
+        }
+        pf_buf += i_channels;
+        pf_delay += i_channels;
     }
+}
 
-    /* Go to the next delayed buffer value for the next run */
-    p_la->i_pos = ( p_la->i_pos + 1 ) % ( p_la->i_count );
+/* The vector versions process the stereo frames by pairs, and the other
+ * layouts by groups of 4 channels. */
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+__attribute__((__target__("sse2")))
+static void PeakSSE2( float *pf_lev, const float *pf_buf, unsigned i_frames,
+                      unsigned i_channels )
+{
+    const __m128 abs_mask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+    unsigned i = 0;
+
+    if( i_channels == 2 )
+    {
+        for( ; i + 2 <= i_frames; i += 2 )
+        {
+            __m128 v = _mm_and_ps( _mm_loadu_ps( pf_buf ), abs_mask );
+            v = _mm_max_ps( v, _mm_shuffle_ps( v, v, _MM_SHUFFLE(2, 3, 0, 1) ) );
+            pf_lev[i] = _mm_cvtss_f32( v );
+            pf_lev[i + 1] = _mm_cvtss_f32( _mm_movehl_ps( v, v ) );
+            pf_buf += 4;
+        }
+    }
+
+    for( ; i < i_frames; i++ )
+    {
+        __m128 m = _mm_setzero_ps();
+        unsigned i_chan = 0;
+
+        for( ; i_chan + 4 <= i_channels; i_chan += 4 )
+            m = _mm_max_ps( m, _mm_and_ps( _mm_loadu_ps( &pf_buf[i_chan] ),
+                                           abs_mask ) );
+        m = _mm_max_ps( m, _mm_movehl_ps( m, m ) );
+        m = _mm_max_ss( m, _mm_shuffle_ps( m, m, _MM_SHUFFLE(1, 1, 1, 1) ) );
+
+        float f_lev = _mm_cvtss_f32( m );
+        for( ; i_chan < i_channels; i_chan++ )
+            f_lev = __MAX( f_lev, fabsf( pf_buf[i_chan] ) );
+        pf_lev[i] = f_lev;
+        pf_buf += i_channels;
+    }
+}
+
+__attribute__((__target__("sse2")))
+static void DelaySSE2( float *pf_buf, float *pf_delay, const float *pf_gain,
+                       unsigned i_frames, unsigned i_channels )
+{
+    unsigned i = 0;
+
+    if( i_channels == 2 )
+    {
+        for( ; i + 2 <= i_frames; i += 2 )
+        {
+            __m128 g = _mm_set_ps( pf_gain[i + 1], pf_gain[i + 1],
+                                   pf_gain[i], pf_gain[i] );
+            __m128 x = _mm_loadu_ps( pf_buf );
+            _mm_storeu_ps( pf_buf, _mm_mul_ps( _mm_loadu_ps( pf_delay ), g ) );
+            _mm_storeu_ps( pf_delay, x );
+            pf_buf += 4;
+            pf_delay += 4;
+        }
+    }
+
+    for( ; i < i_frames; i++ )
+    {
+        const __m128 g = _mm_set1_ps( pf_gain[i] );
+        unsigned i_chan = 0;
+
+        for( ; i_chan + 4 <= i_channels; i_chan += 4 )
+        {
+            __m128 x = _mm_loadu_ps( &pf_buf[i_chan] );
+            _mm_storeu_ps( &pf_buf[i_chan],
+                           _mm_mul_ps( _mm_loadu_ps( &pf_delay[i_chan] ), g ) );
+            _mm_storeu_ps( &pf_delay[i_chan], x );
+        }
+        for( ; i_chan < i_channels; i_chan++ )
+        {
+            float f_x = pf_buf[i_chan];
+            pf_buf[i_chan] = pf_delay[i_chan] * pf_gain[i];
+            pf_delay[i_chan] = f_x;
+        }
+        pf_buf += i_channels;
+        pf_delay += i_channels;
+    }
+}
+#endif
+
+#if defined(__ARM_NEON__)
+static void PeakNEON( float *pf_lev, const float *pf_buf, unsigned i_frames,
+                      unsigned i_channels )
+{
+    unsigned i = 0;
+
+    if( i_channels == 2 )
+    {
+        for( ; i + 2 <= i_frames; i += 2 )
+        {
+            float32x4_t v = vabsq_f32( vld1q_f32( pf_buf ) );
+            float32x2_t m = vpmax_f32( vget_low_f32( v ), vget_high_f32( v ) );
+            vst1_f32( &pf_lev[i], m );
+            pf_buf += 4;
+        }
+    }
+
+    for( ; i < i_frames; i++ )
+    {
+        float32x4_t m = vdupq_n_f32( 0.f );
+        unsigned i_chan = 0;
+
+        for( ; i_chan + 4 <= i_channels; i_chan += 4 )
+            m = vmaxq_f32( m, vabsq_f32( vld1q_f32( &pf_buf[i_chan] ) ) );
+
+        float32x2_t h = vpmax_f32( vget_low_f32( m ), vget_high_f32( m ) );
+        float f_lev = vget_lane_f32( vpmax_f32( h, h ), 0 );
+        for( ; i_chan < i_channels; i_chan++ )
+            f_lev = __MAX( f_lev, fabsf( pf_buf[i_chan] ) );
+        pf_lev[i] = f_lev;
+        pf_buf += i_channels;
+    }
 }
 
+static void DelayNEON( float *pf_buf, float *pf_delay, const float *pf_gain,
+                       unsigned i_frames, unsigned i_channels )
+{
+    unsigned i = 0;
+
+    if( i_channels == 2 )
+    {
+        for( ; i + 2 <= i_frames; i += 2 )
+        {
+            float32x4_t g = vcombine_f32( vdup_n_f32( pf_gain[i] ),
+                                          vdup_n_f32( pf_gain[i + 1] ) );
+            float32x4_t x = vld1q_f32( pf_buf );
+            vst1q_f32( pf_buf, vmulq_f32( vld1q_f32( pf_delay ), g ) );
+            vst1q_f32( pf_delay, x );
+            pf_buf += 4;
+            pf_delay += 4;
+        }
+    }
+
+    for( ; i < i_frames; i++ )
+    {
+        const float32x4_t g = vdupq_n_f32( pf_gain[i] );
+        unsigned i_chan = 0;
+
+        for( ; i_chan + 4 <= i_channels; i_chan += 4 )
+        {
+            float32x4_t x = vld1q_f32( &pf_buf[i_chan] );
+            vst1q_f32( &pf_buf[i_chan],
+                       vmulq_f32( vld1q_f32( &pf_delay[i_chan] ), g ) );
+            vst1q_f32( &pf_delay[i_chan], x );
+        }
+        for( ; i_chan < i_channels; i_chan++ )
+        {
+            float f_x = pf_buf[i_chan];
+            pf_buf[i_chan] = pf_delay[i_chan] * pf_gain[i];
+            pf_delay[i_chan] = f_x;
+        }
+        pf_buf += i_channels;
+        pf_delay += i_channels;
+    }
+}
+#endif
+
 /*****************************************************************************
  * Callback functions
  *****************************************************************************/
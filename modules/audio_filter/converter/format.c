@@ -68,13 +68,13 @@ static int Open(vlc_object_t *object)
     es_format_t       *dst = &filter->fmt_out;
 
     if (!AOUT_FMTS_SIMILAR(&src->audio, &dst->audio))
-        return VLC_EGENERIC;
+        return VLC_ENOTSUP;
     if (src->i_codec == dst->i_codec)
-        return VLC_EGENERIC;
+        return VLC_ENOTSUP;
 
     filter->pf_audio_filter = FindConversion(src->i_codec, dst->i_codec);
     if (filter->pf_audio_filter == NULL)
-        return VLC_EGENERIC;
+        return VLC_ENOTSUP;
 
     msg_Dbg(filter, "%4.4s->%4.4s, bits per sample: %i->%i",
             (char *)&src->i_codec, (char *)&dst->i_codec,
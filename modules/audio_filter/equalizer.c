@@ -37,11 +37,18 @@
 
 #include <vlc_aout.h>
 #include <vlc_filter.h>
+#include <vlc_cpu.h>
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+# include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
 
 #include "equalizer_presets.h"
 
 /* TODO:
- *  - optimize a bit (you can hardly do slower ;)
  *  - add tables for more bands (15 and 32 would be cool), maybe with auto coeffs
  *    computation (not too hard once the Q is found).
  *  - support for external preset
@@ -101,11 +108,15 @@ vlc_module_end ()
 /*****************************************************************************
  * Local prototypes
  *****************************************************************************/
+/* The bands are filtered in parallel by vectors of 4, the extra bands have
+ * null coefficients */
+#define EQZ_BANDS_PAD ((EQZ_BANDS_MAX + 3) & ~3)
+
 struct filter_sys_t
 {
     /* Filter static config */
     int i_band;
-    float *f_alpha;
+    float *f_alpha; /* EQZ_BANDS_PAD coefficients */
     float *f_beta;
     float *f_gamma;
 
@@ -118,13 +129,17 @@ struct filter_sys_t
     float f_gamp;   /* Global preamp */
     bool b_2eqz;
 
-    /* Filter state */
+    /* Filter state: x[ch][0] and y[ch][0][band] are the previous input and
+     * outputs, x[ch][1] and y[ch][1][band] the ones before */
     float x[32][2];
-    float y[32][128][2];
+    float y[32][2][EQZ_BANDS_PAD];
 
     /* Second filter state */
     float x2[32][2];
-    float y2[32][128][2];
+    float y2[32][2][EQZ_BANDS_PAD];
+
+    void (*pf_filter)( filter_sys_t *, float *, const float *,
+                       unsigned, unsigned );
 
     vlc_mutex_t lock;
 };
@@ -136,6 +151,17 @@ static int  EqzInit( filter_t *, int );
 static void EqzFilter( filter_t *, float *, float *, int, int );
 static void EqzClean( filter_t * );
 
+static void EqzFilterC( filter_sys_t *, float *, const float *,
+                        unsigned, unsigned );
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+static void EqzFilterSSE2( filter_sys_t *, float *, const float *,
+                           unsigned, unsigned );
+#endif
+#if defined(__ARM_NEON__)
+static void EqzFilterNEON( filter_sys_t *, float *, const float *,
+                           unsigned, unsigned );
+#endif
+
 static int PresetCallback ( vlc_object_t *, char const *, vlc_value_t,
                             vlc_value_t, void * );
 static int PreampCallback ( vlc_object_t *, char const *, vlc_value_t,
@@ -297,7 +323,7 @@ static int EqzInit( filter_t *p_filter, int i_rate )
 {
     filter_sys_t *p_sys = p_filter->p_sys;
     eqz_config_t cfg;
-    int i, ch;
+    int i;
     vlc_value_t val1, val2, val3;
     vlc_object_t *p_aout = p_filter->p_parent;
     int i_ret = VLC_ENOMEM;
@@ -307,9 +333,9 @@ static int EqzInit( filter_t *p_filter, int i_rate )
 
     /* Create the static filter config */
     p_sys->i_band = cfg.i_band;
-    p_sys->f_alpha = malloc( p_sys->i_band * sizeof(float) );
-    p_sys->f_beta  = malloc( p_sys->i_band * sizeof(float) );
-    p_sys->f_gamma = malloc( p_sys->i_band * sizeof(float) );
+    p_sys->f_alpha = calloc( EQZ_BANDS_PAD, sizeof(float) );
+    p_sys->f_beta  = calloc( EQZ_BANDS_PAD, sizeof(float) );
+    p_sys->f_gamma = calloc( EQZ_BANDS_PAD, sizeof(float) );
     if( !p_sys->f_alpha || !p_sys->f_beta || !p_sys->f_gamma )
         goto error;
 
@@ -323,31 +349,25 @@ static int EqzInit( filter_t *p_filter, int i_rate )
     /* Filter dyn config */
     p_sys->b_2eqz = false;
     p_sys->f_gamp = 1.0f;
-    p_sys->f_amp  = malloc( p_sys->i_band * sizeof(float) );
+    p_sys->f_amp  = calloc( EQZ_BANDS_PAD, sizeof(float) );
     if( !p_sys->f_amp )
         goto error;
 
-    for( i = 0; i < p_sys->i_band; i++ )
-    {
-        p_sys->f_amp[i] = 0.0f;
-    }
-
     /* Filter state */
-    for( ch = 0; ch < 32; ch++ )
-    {
-        p_sys->x[ch][0]  =
-        p_sys->x[ch][1]  =
-        p_sys->x2[ch][0] =
-        p_sys->x2[ch][1] = 0.0f;
-
-        for( i = 0; i < p_sys->i_band; i++ )
-        {
-            p_sys->y[ch][i][0]  =
-            p_sys->y[ch][i][1]  =
-            p_sys->y2[ch][i][0] =
-            p_sys->y2[ch][i][1] = 0.0f;
-        }
-    }
+    memset( p_sys->x, 0, sizeof(p_sys->x) );
+    memset( p_sys->y, 0, sizeof(p_sys->y) );
+    memset( p_sys->x2, 0, sizeof(p_sys->x2) );
+    memset( p_sys->y2, 0, sizeof(p_sys->y2) );
+
+    p_sys->pf_filter = EqzFilterC;
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+    if( vlc_CPU_SSE2() )
+        p_sys->pf_filter = EqzFilterSSE2;
+#endif
+#if defined(__ARM_NEON__)
+    if( vlc_CPU_ARM_NEON() )
+        p_sys->pf_filter = EqzFilterNEON;
+#endif
 
     p_sys->psz_newbands = NULL;
 
@@ -419,9 +439,18 @@ static void EqzFilter( filter_t *p_filter, float *out, float *in,
                        int i_samples, int i_channels )
 {
     filter_sys_t *p_sys = p_filter->p_sys;
-    int i, ch, j;
 
     vlc_mutex_lock( &p_sys->lock );
+    p_sys->pf_filter( p_sys, out, in, i_samples, i_channels );
+    vlc_mutex_unlock( &p_sys->lock );
+}
+
+static void EqzFilterC( filter_sys_t *p_sys, float *out, const float *in,
+                        unsigned i_samples, unsigned i_channels )
+{
+    unsigned i, ch;
+    int j;
+
     for( i = 0; i < i_samples; i++ )
     {
         for( ch = 0; ch < i_channels; ch++ )
@@ -432,11 +461,11 @@ static void EqzFilter( filter_t *p_filter, float *out, float *in,
             for( j = 0; j < p_sys->i_band; j++ )
             {
                 float y = p_sys->f_alpha[j] * ( x - p_sys->x[ch][1] ) +
-                          p_sys->f_gamma[j] * p_sys->y[ch][j][0] -
-                          p_sys->f_beta[j]  * p_sys->y[ch][j][1];
+                          p_sys->f_gamma[j] * p_sys->y[ch][0][j] -
+                          p_sys->f_beta[j]  * p_sys->y[ch][1][j];
 
-                p_sys->y[ch][j][1] = p_sys->y[ch][j][0];
-                p_sys->y[ch][j][0] = y;
+                p_sys->y[ch][1][j] = p_sys->y[ch][0][j];
+                p_sys->y[ch][0][j] = y;
 
                 o += y * p_sys->f_amp[j];
             }
@@ -451,11 +480,11 @@ static void EqzFilter( filter_t *p_filter, float *out, float *in,
                 for( j = 0; j < p_sys->i_band; j++ )
                 {
                     float y = p_sys->f_alpha[j] * ( x2 - p_sys->x2[ch][1] ) +
-                              p_sys->f_gamma[j] * p_sys->y2[ch][j][0] -
-                              p_sys->f_beta[j]  * p_sys->y2[ch][j][1];
+                              p_sys->f_gamma[j] * p_sys->y2[ch][0][j] -
+                              p_sys->f_beta[j]  * p_sys->y2[ch][1][j];
 
-                    p_sys->y2[ch][j][1] = p_sys->y2[ch][j][0];
-                    p_sys->y2[ch][j][0] = y;
+                    p_sys->y2[ch][1][j] = p_sys->y2[ch][0][j];
+                    p_sys->y2[ch][0][j] = y;
 
                     o += y * p_sys->f_amp[j];
                 }
@@ -475,8 +504,242 @@ static void EqzFilter( filter_t *p_filter, float *out, float *in,
         in  += i_channels;
         out += i_channels;
     }
-    vlc_mutex_unlock( &p_sys->lock );
+
+    /* The filters ring for a long time after the end of the signal: flush
+     * their state before it becomes denormal, which is very slow to
+     * compute with. */
+    for( ch = 0; ch < i_channels; ch++ )
+        for( j = 0; j < EQZ_BANDS_PAD; j++ )
+        {
+            if( fabsf( p_sys->y[ch][0][j] ) < 1e-20f &&
+                fabsf( p_sys->y[ch][1][j] ) < 1e-20f )
+                p_sys->y[ch][0][j] = p_sys->y[ch][1][j] = 0.0f;
+            if( fabsf( p_sys->y2[ch][0][j] ) < 1e-20f &&
+                fabsf( p_sys->y2[ch][1][j] ) < 1e-20f )
+                p_sys->y2[ch][0][j] = p_sys->y2[ch][1][j] = 0.0f;
+        }
+}
+
+/* The vector versions filter one channel at a time, all the bands at once,
+ * so that the state of the filters stays in registers. */
+#define EQZ_VECS (EQZ_BANDS_PAD / 4)
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+__attribute__((__target__("sse2")))
+static inline float EqzSumSSE2( __m128 v )
+{
+    v = _mm_add_ps( v, _mm_movehl_ps( v, v ) );
+    v = _mm_add_ss( v, _mm_shuffle_ps( v, v, _MM_SHUFFLE(1, 1, 1, 1) ) );
+    return _mm_cvtss_f32( v );
+}
+
+__attribute__((__target__("sse2")))
+static inline float EqzBandsSSE2( const __m128 *alpha, const __m128 *beta,
+                                  const __m128 *gamma, const __m128 *amp,
+                                  __m128 *y0, __m128 *y1, float f_dx )
+{
+    const __m128 dx = _mm_set1_ps( f_dx );
+    __m128 o = _mm_setzero_ps();
+
+    for( unsigned v = 0; v < EQZ_VECS; v++ )
+    {
+        __m128 y = _mm_sub_ps( _mm_add_ps( _mm_mul_ps( alpha[v], dx ),
+                                           _mm_mul_ps( gamma[v], y0[v] ) ),
+                               _mm_mul_ps( beta[v], y1[v] ) );
+        y1[v] = y0[v];
+        y0[v] = y;
+        o = _mm_add_ps( o, _mm_mul_ps( y, amp[v] ) );
+    }
+    return EqzSumSSE2( o );
+}
+
+/* Filters n channels at once, to interleave the latencies of their
+ * recursions */
+__attribute__((__target__("sse2"), __always_inline__))
+static inline void EqzChannelsSSE2( filter_sys_t *p_sys, float *out,
+                                    const float *in, unsigned i_samples,
+                                    unsigned i_channels, unsigned ch,
+                                    const unsigned n )
+{
+    __m128 alpha[EQZ_VECS], beta[EQZ_VECS], gamma[EQZ_VECS], amp[EQZ_VECS];
+    __m128 y0[2][EQZ_VECS], y1[2][EQZ_VECS], z0[2][EQZ_VECS], z1[2][EQZ_VECS];
+    float x0[2], x1[2], w0[2], w1[2];
+    const float f_gamp = p_sys->f_gamp;
+    const bool b_2eqz = p_sys->b_2eqz;
+
+    for( unsigned v = 0; v < EQZ_VECS; v++ )
+    {
+        alpha[v] = _mm_loadu_ps( &p_sys->f_alpha[4 * v] );
+        beta[v]  = _mm_loadu_ps( &p_sys->f_beta[4 * v] );
+        gamma[v] = _mm_loadu_ps( &p_sys->f_gamma[4 * v] );
+        amp[v]   = _mm_loadu_ps( &p_sys->f_amp[4 * v] );
+    }
+
+    for( unsigned c = 0; c < n; c++ )
+    {
+        x0[c] = p_sys->x[ch + c][0];
+        x1[c] = p_sys->x[ch + c][1];
+        w0[c] = p_sys->x2[ch + c][0];
+        w1[c] = p_sys->x2[ch + c][1];
+        for( unsigned v = 0; v < EQZ_VECS; v++ )
+        {
+            y0[c][v] = _mm_loadu_ps( &p_sys->y[ch + c][0][4 * v] );
+            y1[c][v] = _mm_loadu_ps( &p_sys->y[ch + c][1][4 * v] );
+            z0[c][v] = _mm_loadu_ps( &p_sys->y2[ch + c][0][4 * v] );
+            z1[c][v] = _mm_loadu_ps( &p_sys->y2[ch + c][1][4 * v] );
+        }
+    }
+
+    for( unsigned i = 0; i < i_samples; i++ )
+    {
+        const float *p_in = &in[i * i_channels + ch];
+        float *p_out = &out[i * i_channels + ch];
+
+        for( unsigned c = 0; c < n; c++ )
+        {
+            const float x = p_in[c];
+            float o = EqzBandsSSE2( alpha, beta, gamma, amp, y0[c], y1[c],
+                                    x - x1[c] );
+            x1[c] = x0[c];
+            x0[c] = x;
+
+            if( b_2eqz )
+            {
+                const float x2 = EQZ_IN_FACTOR * x + o;
+                o = EqzBandsSSE2( alpha, beta, gamma, amp, z0[c], z1[c],
+                                  x2 - w1[c] );
+                w1[c] = w0[c];
+                w0[c] = x2;
+                p_out[c] = f_gamp * ( EQZ_IN_FACTOR * x2 + o );
+            }
+            else
+                p_out[c] = f_gamp * ( EQZ_IN_FACTOR * x + o );
+        }
+    }
+
+    for( unsigned c = 0; c < n; c++ )
+    {
+        for( unsigned v = 0; v < EQZ_VECS; v++ )
+        {
+            _mm_storeu_ps( &p_sys->y[ch + c][0][4 * v], y0[c][v] );
+            _mm_storeu_ps( &p_sys->y[ch + c][1][4 * v], y1[c][v] );
+            _mm_storeu_ps( &p_sys->y2[ch + c][0][4 * v], z0[c][v] );
+            _mm_storeu_ps( &p_sys->y2[ch + c][1][4 * v], z1[c][v] );
+        }
+        p_sys->x[ch + c][0] = x0[c];
+        p_sys->x[ch + c][1] = x1[c];
+        p_sys->x2[ch + c][0] = w0[c];
+        p_sys->x2[ch + c][1] = w1[c];
+    }
+}
+
+__attribute__((__target__("sse2")))
+static void EqzFilterSSE2( filter_sys_t *p_sys, float *out, const float *in,
+                           unsigned i_samples, unsigned i_channels )
+{
+    unsigned ch = 0;
+
+    /* Flush the denormals to zero */
+    const unsigned i_csr = _mm_getcsr();
+    _mm_setcsr( i_csr | 0x8040 );
+
+    for( ; ch + 2 <= i_channels; ch += 2 )
+        EqzChannelsSSE2( p_sys, out, in, i_samples, i_channels, ch, 2 );
+    if( ch < i_channels )
+        EqzChannelsSSE2( p_sys, out, in, i_samples, i_channels, ch, 1 );
+
+    _mm_setcsr( i_csr );
+}
+#endif
+
+#if defined(__ARM_NEON__)
+static inline float EqzBandsNEON( const float32x4_t *alpha,
+                                  const float32x4_t *beta,
+                                  const float32x4_t *gamma,
+                                  const float32x4_t *amp,
+                                  float32x4_t *y0, float32x4_t *y1, float f_dx )
+{
+    const float32x4_t dx = vdupq_n_f32( f_dx );
+    float32x4_t o = vdupq_n_f32( 0.f );
+
+    for( unsigned v = 0; v < EQZ_VECS; v++ )
+    {
+        float32x4_t y = vmulq_f32( alpha[v], dx );
+        y = vmlaq_f32( y, gamma[v], y0[v] );
+        y = vmlsq_f32( y, beta[v], y1[v] );
+        y1[v] = y0[v];
+        y0[v] = y;
+        o = vmlaq_f32( o, y, amp[v] );
+    }
+
+    float32x2_t s = vadd_f32( vget_low_f32( o ), vget_high_f32( o ) );
+    return vget_lane_f32( vpadd_f32( s, s ), 0 );
+}
+
+/* NEON arithmetic always flushes the denormals to zero */
+static void EqzFilterNEON( filter_sys_t *p_sys, float *out, const float *in,
+                           unsigned i_samples, unsigned i_channels )
+{
+    float32x4_t alpha[EQZ_VECS], beta[EQZ_VECS], gamma[EQZ_VECS];
+    float32x4_t amp[EQZ_VECS];
+    const float f_gamp = p_sys->f_gamp;
+    const bool b_2eqz = p_sys->b_2eqz;
+
+    for( unsigned v = 0; v < EQZ_VECS; v++ )
+    {
+        alpha[v] = vld1q_f32( &p_sys->f_alpha[4 * v] );
+        beta[v]  = vld1q_f32( &p_sys->f_beta[4 * v] );
+        gamma[v] = vld1q_f32( &p_sys->f_gamma[4 * v] );
+        amp[v]   = vld1q_f32( &p_sys->f_amp[4 * v] );
+    }
+
+    for( unsigned ch = 0; ch < i_channels; ch++ )
+    {
+        float32x4_t y0[EQZ_VECS], y1[EQZ_VECS], z0[EQZ_VECS], z1[EQZ_VECS];
+        float x0 = p_sys->x[ch][0], x1 = p_sys->x[ch][1];
+        float w0 = p_sys->x2[ch][0], w1 = p_sys->x2[ch][1];
+
+        for( unsigned v = 0; v < EQZ_VECS; v++ )
+        {
+            y0[v] = vld1q_f32( &p_sys->y[ch][0][4 * v] );
+            y1[v] = vld1q_f32( &p_sys->y[ch][1][4 * v] );
+            z0[v] = vld1q_f32( &p_sys->y2[ch][0][4 * v] );
+            z1[v] = vld1q_f32( &p_sys->y2[ch][1][4 * v] );
+        }
+
+        for( unsigned i = 0; i < i_samples; i++ )
+        {
+            const float x = in[i * i_channels + ch];
+            float o = EqzBandsNEON( alpha, beta, gamma, amp, y0, y1, x - x1 );
+            x1 = x0;
+            x0 = x;
+
+            if( b_2eqz )
+            {
+                const float x2 = EQZ_IN_FACTOR * x + o;
+                o = EqzBandsNEON( alpha, beta, gamma, amp, z0, z1, x2 - w1 );
+                w1 = w0;
+                w0 = x2;
+                out[i * i_channels + ch] = f_gamp * ( EQZ_IN_FACTOR * x2 + o );
+            }
+            else
+                out[i * i_channels + ch] = f_gamp * ( EQZ_IN_FACTOR * x + o );
+        }
+
+        for( unsigned v = 0; v < EQZ_VECS; v++ )
+        {
+            vst1q_f32( &p_sys->y[ch][0][4 * v], y0[v] );
+            vst1q_f32( &p_sys->y[ch][1][4 * v], y1[v] );
+            vst1q_f32( &p_sys->y2[ch][0][4 * v], z0[v] );
+            vst1q_f32( &p_sys->y2[ch][1][4 * v], z1[v] );
+        }
+        p_sys->x[ch][0] = x0;
+        p_sys->x[ch][1] = x1;
+        p_sys->x2[ch][0] = w0;
+        p_sys->x2[ch][1] = w1;
+    }
 }
+#endif
 
 static void EqzClean( filter_t *p_filter )
 {
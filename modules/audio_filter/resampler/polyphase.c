@@ -0,0 +1,719 @@
+/*****************************************************************************
+ * polyphase.c : polyphase filter bank resampler
+ *****************************************************************************
+ * Copyright (C) 2026 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble:
+ *
+ * Each output frame is the dot product of a Kaiser-windowed sinc filter with
+ * the surrounding input frames. The filter is precomputed for every phase:
+ * - when the ratio of the rates is a fraction with a small denominator
+ *   (44.1 <-> 48 kHz, 48 <-> 96 kHz...), there is one row per output phase,
+ * - otherwise, or when the input rate is adjusted on the fly, rows are
+ *   interpolated linearly from a finer bank.
+ * Dot products run on all the channels of the interleaved frames at once.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <math.h>
+
+#include <vlc_common.h>
+#include <vlc_aout.h>
+#include <vlc_filter.h>
+#include <vlc_plugin.h>
+#include <vlc_cpu.h>
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+# include <emmintrin.h>
+#endif
+#if defined(HAVE_AVX_INTRINSICS)
+# include <immintrin.h>
+#endif
+#if defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
+
+#define QUALITY_TEXT N_("Resampling quality")
+#define QUALITY_LONGTEXT N_( \
+    "Resampling quality (0 = worst and fastest, 4 = best and slowest). " \
+    "Higher levels use longer filters with a sharper cut-off.")
+
+static int Open (vlc_object_t *);
+static int OpenResampler (vlc_object_t *);
+static void Close (vlc_object_t *);
+
+vlc_module_begin ()
+    set_shortname (N_("Polyphase resampler"))
+    set_description (N_("Polyphase filter bank resampler"))
+    set_category (CAT_AUDIO)
+    set_subcategory (SUBCAT_AUDIO_MISC)
+    add_integer_with_range ("polyphase-quality", 2, 0, 4,
+                            QUALITY_TEXT, QUALITY_LONGTEXT, true)
+    set_capability ("audio converter", 60)
+    set_callbacks (Open, Close)
+
+    add_submodule ()
+    set_capability ("audio resampler", 60)
+    set_callbacks (OpenResampler, Close)
+vlc_module_end ()
+
+static const struct
+{
+    unsigned taps;    /**< filter length at or above unity ratio */
+    unsigned phases;  /**< rows of the interpolated bank */
+    double   beta;    /**< Kaiser window shape */
+    double   cutoff;  /**< relative to the lowest Nyquist frequency */
+} qualities[] = {
+    { 16,   64,  5.0, 0.80 },
+    { 24,  128,  6.0, 0.85 },
+    { 32,  256,  7.0, 0.88 },
+    { 48,  512,  8.5, 0.91 },
+    { 64, 1024, 10.0, 0.93 },
+};
+
+#define MAX_TAPS         256
+#define MAX_EXACT_PHASES 1024
+/* Frames read past the last one by the dot products */
+#define PADDING          8
+
+typedef void (*dot_t) (float *, const float *, const float *,
+                       unsigned, unsigned);
+
+enum
+{
+    MODE_COPY,   /**< same rates, integer position: no filtering */
+    MODE_EXACT,  /**< nominal rates: one row per phase */
+    MODE_INTERP, /**< any rate: interpolated rows */
+};
+
+struct filter_sys_t
+{
+    dot_t    dot;
+    unsigned channels;
+    unsigned taps;     /**< multiple of 8 */
+    unsigned stride;   /**< floats per bank row */
+    double   cutoff;   /**< relative to the input Nyquist frequency */
+    double   beta;
+
+    float    *exact;   /**< one row per phase of the nominal ratio, or NULL */
+    unsigned exact_phases;
+    unsigned exact_step;
+    float    *interp;  /**< interp_phases + 1 rows, built on demand */
+    unsigned interp_phases;
+    float    *coefs;   /**< interpolated row */
+
+    unsigned nominal;  /**< input rate the filter was created for */
+    unsigned rate;     /**< input rate of the last block */
+    int      mode;
+    uint64_t den;      /**< phase denominator */
+    unsigned step_int;
+    uint64_t step_frac;
+
+    float    *buf;     /**< history then input frames */
+    size_t   size;     /**< allocated floats */
+    size_t   frames;
+    size_t   pos;      /**< first frame of the next output */
+    uint64_t frac;     /**< phase of the next output, over den */
+
+    bool     b_first;
+    date_t   end_date;
+};
+
+/*****************************************************************************
+ * Dot products: out[c] = sum over t of coefs[t] * in[t * channels + c]
+ * For one or two channels, the coefficients are repeated for each channel
+ * so that the frames can be processed as a flat array.
+ *****************************************************************************/
+static void DotC (float *restrict out, const float *restrict in,
+                  const float *restrict coefs, unsigned taps,
+                  unsigned channels)
+{
+    if (channels == 1)
+    {
+        float acc = 0.f;
+        for (unsigned t = 0; t < taps; t++)
+            acc += coefs[t] * in[t];
+        out[0] = acc;
+        return;
+    }
+    if (channels == 2)
+    {
+        float left = 0.f, right = 0.f;
+        for (unsigned k = 0; k < 2 * taps; k += 2)
+        {
+            left += coefs[k] * in[k];
+            right += coefs[k + 1] * in[k + 1];
+        }
+        out[0] = left;
+        out[1] = right;
+        return;
+    }
+
+    float acc[AOUT_CHAN_MAX] = { 0.f };
+    for (unsigned t = 0; t < taps; t++, in += channels)
+        for (unsigned c = 0; c < channels; c++)
+            acc[c] += coefs[t] * in[c];
+    memcpy (out, acc, channels * sizeof (*out));
+}
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+__attribute__((__target__("sse2")))
+static void DotSSE2 (float *restrict out, const float *restrict in,
+                     const float *restrict coefs, unsigned taps,
+                     unsigned channels)
+{
+    if (channels <= 2)
+    {
+        const unsigned n = taps * channels;
+        __m128 acc0 = _mm_setzero_ps (), acc1 = _mm_setzero_ps ();
+        __m128 acc2 = _mm_setzero_ps (), acc3 = _mm_setzero_ps ();
+        unsigned k = 0;
+
+        for (; k + 16 <= n; k += 16)
+        {
+            acc0 = _mm_add_ps (acc0, _mm_mul_ps (_mm_load_ps (coefs + k),
+                                                 _mm_loadu_ps (in + k)));
+            acc1 = _mm_add_ps (acc1, _mm_mul_ps (_mm_load_ps (coefs + k + 4),
+                                                 _mm_loadu_ps (in + k + 4)));
+            acc2 = _mm_add_ps (acc2, _mm_mul_ps (_mm_load_ps (coefs + k + 8),
+                                                 _mm_loadu_ps (in + k + 8)));
+            acc3 = _mm_add_ps (acc3, _mm_mul_ps (_mm_load_ps (coefs + k + 12),
+                                                 _mm_loadu_ps (in + k + 12)));
+        }
+        if (k < n)
+        {
+            acc0 = _mm_add_ps (acc0, _mm_mul_ps (_mm_load_ps (coefs + k),
+                                                 _mm_loadu_ps (in + k)));
+            acc1 = _mm_add_ps (acc1, _mm_mul_ps (_mm_load_ps (coefs + k + 4),
+                                                 _mm_loadu_ps (in + k + 4)));
+        }
+        acc0 = _mm_add_ps (_mm_add_ps (acc0, acc1), _mm_add_ps (acc2, acc3));
+        acc0 = _mm_add_ps (acc0, _mm_movehl_ps (acc0, acc0));
+        if (channels == 1)
+            _mm_store_ss (out, _mm_add_ss (acc0, _mm_shuffle_ps (acc0, acc0,
+                                                                 1)));
+        else
+            _mm_storel_pi ((__m64 *)out, acc0);
+        return;
+    }
+
+    /* One vector per group of 4 channels */
+    const unsigned groups = (channels + 3) / 4;
+    __m128 acc[3] = { _mm_setzero_ps (), _mm_setzero_ps (), _mm_setzero_ps () };
+    float tmp[12];
+
+    for (unsigned t = 0; t < taps; t++, in += channels)
+    {
+        const __m128 c = _mm_set1_ps (coefs[t]);
+        for (unsigned g = 0; g < groups; g++)
+            acc[g] = _mm_add_ps (acc[g],
+                                 _mm_mul_ps (c, _mm_loadu_ps (in + 4 * g)));
+    }
+    for (unsigned g = 0; g < groups; g++)
+        _mm_storeu_ps (tmp + 4 * g, acc[g]);
+    memcpy (out, tmp, channels * sizeof (*out));
+}
+#endif
+
+#if defined(HAVE_AVX_INTRINSICS)
+__attribute__((__target__("avx")))
+static void DotAVX (float *restrict out, const float *restrict in,
+                    const float *restrict coefs, unsigned taps,
+                    unsigned channels)
+{
+    if (channels <= 2)
+    {
+        const unsigned n = taps * channels;
+        __m256 acc = _mm256_setzero_ps (), acc1 = _mm256_setzero_ps ();
+        unsigned k = 0;
+
+        for (; k + 16 <= n; k += 16)
+        {
+            acc = _mm256_add_ps (acc, _mm256_mul_ps (_mm256_load_ps (coefs + k),
+                                                     _mm256_loadu_ps (in + k)));
+            acc1 = _mm256_add_ps (acc1,
+                                  _mm256_mul_ps (_mm256_load_ps (coefs + k + 8),
+                                                 _mm256_loadu_ps (in + k + 8)));
+        }
+        if (k < n)
+            acc = _mm256_add_ps (acc, _mm256_mul_ps (_mm256_load_ps (coefs + k),
+                                                     _mm256_loadu_ps (in + k)));
+        acc = _mm256_add_ps (acc, acc1);
+
+        __m128 v = _mm_add_ps (_mm256_castps256_ps128 (acc),
+                               _mm256_extractf128_ps (acc, 1));
+        v = _mm_add_ps (v, _mm_movehl_ps (v, v));
+        if (channels == 1)
+            _mm_store_ss (out, _mm_add_ss (v, _mm_shuffle_ps (v, v, 1)));
+        else
+            _mm_storel_pi ((__m64 *)out, v);
+        return;
+    }
+
+    /* One vector per group of 8 channels */
+    const unsigned groups = (channels + 7) / 8;
+    __m256 acc[2] = { _mm256_setzero_ps (), _mm256_setzero_ps () };
+    float tmp[16];
+
+    for (unsigned t = 0; t < taps; t++, in += channels)
+    {
+        const __m256 c = _mm256_set1_ps (coefs[t]);
+        for (unsigned g = 0; g < groups; g++)
+            acc[g] = _mm256_add_ps (acc[g], _mm256_mul_ps (c,
+                                          _mm256_loadu_ps (in + 8 * g)));
+    }
+    for (unsigned g = 0; g < groups; g++)
+        _mm256_storeu_ps (tmp + 8 * g, acc[g]);
+    memcpy (out, tmp, channels * sizeof (*out));
+}
+#endif
+
+#if defined(__ARM_NEON__)
+static void DotNEON (float *restrict out, const float *restrict in,
+                     const float *restrict coefs, unsigned taps,
+                     unsigned channels)
+{
+    if (channels <= 2)
+    {
+        float32x4_t acc0 = vdupq_n_f32 (0.f), acc1 = vdupq_n_f32 (0.f);
+
+        for (unsigned k = 0; k < taps * channels; k += 8)
+        {
+            acc0 = vmlaq_f32 (acc0, vld1q_f32 (coefs + k), vld1q_f32 (in + k));
+            acc1 = vmlaq_f32 (acc1, vld1q_f32 (coefs + k + 4),
+                              vld1q_f32 (in + k + 4));
+        }
+        acc0 = vaddq_f32 (acc0, acc1);
+
+        float32x2_t v = vadd_f32 (vget_low_f32 (acc0), vget_high_f32 (acc0));
+        if (channels == 1)
+            out[0] = vget_lane_f32 (vpadd_f32 (v, v), 0);
+        else
+            vst1_f32 (out, v);
+        return;
+    }
+
+    /* One vector per group of 4 channels */
+    const unsigned groups = (channels + 3) / 4;
+    float32x4_t acc[3] = { vdupq_n_f32 (0.f), vdupq_n_f32 (0.f),
+                           vdupq_n_f32 (0.f) };
+    float tmp[12];
+
+    for (unsigned t = 0; t < taps; t++, in += channels)
+        for (unsigned g = 0; g < groups; g++)
+            acc[g] = vmlaq_n_f32 (acc[g], vld1q_f32 (in + 4 * g), coefs[t]);
+    for (unsigned g = 0; g < groups; g++)
+        vst1q_f32 (tmp + 4 * g, acc[g]);
+    memcpy (out, tmp, channels * sizeof (*out));
+}
+#endif
+
+static dot_t GetDot (void)
+{
+#if defined(HAVE_AVX_INTRINSICS)
+    if (vlc_CPU_AVX ())
+        return DotAVX;
+#endif
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+    if (vlc_CPU_SSE2 ())
+        return DotSSE2;
+#endif
+#if defined(__ARM_NEON__)
+    if (vlc_CPU_ARM_NEON ())
+        return DotNEON;
+#endif
+    return DotC;
+}
+
+/*****************************************************************************
+ * Filter banks
+ *****************************************************************************/
+static double BesselI0 (double x)
+{
+    double sum = 1., term = 1.;
+
+    for (unsigned k = 1; k < 64 && term > sum * 1e-12; k++)
+    {
+        double f = x / (2. * k);
+        term *= f * f;
+        sum += term;
+    }
+    return sum;
+}
+
+/**
+ * Computes the row of the bank centered phase frames after the middle of
+ * the filter, normalized for unity gain at DC.
+ */
+static void BuildRow (const filter_sys_t *sys, float *row, double phase)
+{
+    const unsigned expand = sys->stride / sys->taps;
+    const double half = sys->taps / 2.;
+    const double center = half - 1. + phase;
+    const double i0beta = BesselI0 (sys->beta);
+    double h[MAX_TAPS], sum = 0.;
+
+    for (unsigned t = 0; t < sys->taps; t++)
+    {
+        double x = t - center;
+        double w = x / half;
+        double sinc = sys->cutoff;
+
+        w = (fabs (w) <= 1.) ? BesselI0 (sys->beta * sqrt (1. - w * w))
+                               / i0beta : 0.;
+        if (x != 0.)
+            sinc = sin (M_PI * sys->cutoff * x) / (M_PI * x);
+        h[t] = sinc * w;
+        sum += h[t];
+    }
+
+    for (unsigned t = 0; t < sys->taps; t++)
+        for (unsigned c = 0; c < expand; c++)
+            row[t * expand + c] = h[t] / sum;
+}
+
+static float *BuildBank (const filter_sys_t *sys, unsigned rows,
+                         unsigned phases)
+{
+    float *bank = vlc_memalign (32, rows * sys->stride * sizeof (*bank));
+    if (unlikely(bank == NULL))
+        return NULL;
+
+    for (unsigned i = 0; i < rows; i++)
+        BuildRow (sys, bank + i * sys->stride, (double)i / phases);
+    return bank;
+}
+
+static unsigned gcd (unsigned a, unsigned b)
+{
+    while (b != 0)
+    {
+        unsigned c = a % b;
+        a = b;
+        b = c;
+    }
+    return a;
+}
+
+/**
+ * Selects the bank and phase step for a new input rate. The phase of the
+ * next output is carried over, rounded to the new denominator.
+ */
+static int SetRate (filter_t *filter, unsigned rate)
+{
+    filter_sys_t *sys = filter->p_sys;
+    const unsigned out_rate = filter->fmt_out.audio.i_rate;
+    uint64_t den, step;
+
+    /* Copying only works from an integer position */
+    if (rate == out_rate && sys->frac == 0)
+    {
+        sys->mode = MODE_COPY;
+        den = 1;
+        step = 1;
+    }
+    else
+    if (rate == sys->nominal && sys->exact != NULL)
+    {
+        sys->mode = MODE_EXACT;
+        den = sys->exact_phases;
+        step = sys->exact_step;
+    }
+    else
+    {
+        if (sys->interp == NULL)
+        {
+            sys->interp = BuildBank (sys, sys->interp_phases + 1,
+                                     sys->interp_phases);
+            if (unlikely(sys->interp == NULL))
+                return VLC_ENOMEM;
+        }
+        sys->mode = MODE_INTERP;
+        den = UINT64_C(1) << 32;
+        step = ((uint64_t)rate << 32) / out_rate;
+    }
+
+    sys->frac = (sys->frac * den + sys->den / 2) / sys->den;
+    if (sys->frac >= den)
+    {
+        sys->frac -= den;
+        sys->pos++;
+    }
+    sys->den = den;
+    sys->step_int = step / den;
+    sys->step_frac = step % den;
+    sys->rate = rate;
+    return VLC_SUCCESS;
+}
+
+/* Restarts from silence, with the first input frame in the middle of
+ * the filter */
+static void Reset (filter_sys_t *sys)
+{
+    sys->frames = sys->taps / 2 - 1;
+    sys->pos = 0;
+    sys->frac = 0;
+    memset (sys->buf, 0, sys->frames * sys->channels * sizeof (*sys->buf));
+}
+
+static block_t *Resample (filter_t *, block_t *);
+
+static int OpenResampler (vlc_object_t *obj)
+{
+    filter_t *filter = (filter_t *)obj;
+
+    /* Cannot convert format */
+    if (filter->fmt_in.audio.i_format != filter->fmt_out.audio.i_format
+    /* Cannot remix */
+     || filter->fmt_in.audio.i_physical_channels
+                                  != filter->fmt_out.audio.i_physical_channels
+     || filter->fmt_in.audio.i_original_channels
+                                  != filter->fmt_out.audio.i_original_channels
+     || filter->fmt_in.audio.i_format != VLC_CODEC_FL32)
+        return VLC_EGENERIC;
+
+    const unsigned channels = aout_FormatNbChannels (&filter->fmt_in.audio);
+    const unsigned in_rate = filter->fmt_in.audio.i_rate;
+    const unsigned out_rate = filter->fmt_out.audio.i_rate;
+    if (channels == 0 || channels > AOUT_CHAN_MAX
+     || in_rate == 0 || out_rate == 0)
+        return VLC_EGENERIC;
+
+    unsigned q = var_InheritInteger (obj, "polyphase-quality");
+    if (unlikely(q >= ARRAY_SIZE(qualities)))
+        q = 2;
+
+    filter_sys_t *sys = calloc (1, sizeof (*sys));
+    if (unlikely(sys == NULL))
+        return VLC_ENOMEM;
+    filter->p_sys = sys;
+
+    /* When decimating, the cut-off moves down and the filter gets longer
+     * to keep the same transition band, relative to the output rate */
+    double ratio = (double)out_rate / in_rate;
+    unsigned taps = qualities[q].taps;
+    if (ratio < 1.)
+        taps = __MIN (ceil (taps / ratio), MAX_TAPS);
+    sys->taps = (taps + 7) & ~7;
+    sys->channels = channels;
+    sys->stride = sys->taps * (channels <= 2 ? channels : 1);
+    sys->cutoff = qualities[q].cutoff * __MIN (ratio, 1.);
+    sys->beta = qualities[q].beta;
+    sys->interp_phases = qualities[q].phases;
+    sys->dot = GetDot ();
+
+    /* Exact bank for the nominal ratio, if it is small enough */
+    unsigned g = gcd (in_rate, out_rate);
+    sys->nominal = in_rate;
+    sys->exact_phases = out_rate / g;
+    sys->exact_step = in_rate / g;
+    if (in_rate != out_rate && sys->exact_phases <= MAX_EXACT_PHASES)
+    {
+        sys->exact = BuildBank (sys, sys->exact_phases, sys->exact_phases);
+        if (unlikely(sys->exact == NULL))
+            goto error;
+    }
+
+    sys->coefs = vlc_memalign (32, sys->stride * sizeof (*sys->coefs));
+    sys->size = (sys->taps + PADDING) * channels;
+    sys->buf = malloc (sys->size * sizeof (*sys->buf));
+    if (unlikely(sys->coefs == NULL || sys->buf == NULL))
+        goto error;
+
+    sys->den = 1;
+    Reset (sys);
+    if (SetRate (filter, in_rate))
+        goto error;
+
+    sys->b_first = true;
+    date_Init (&sys->end_date, out_rate, 1);
+
+    msg_Dbg (obj, "%u to %u Hz, %u channels, %u taps, %s bank", in_rate,
+             out_rate, channels, sys->taps,
+             (sys->exact != NULL) ? "exact" : "interpolated");
+    filter->pf_audio_filter = Resample;
+    return VLC_SUCCESS;
+
+error:
+    Close (obj);
+    return VLC_ENOMEM;
+}
+
+static int Open (vlc_object_t *obj)
+{
+    filter_t *filter = (filter_t *)obj;
+
+    /* Will change rate */
+    if (filter->fmt_in.audio.i_rate == filter->fmt_out.audio.i_rate)
+        return VLC_EGENERIC;
+    return OpenResampler (obj);
+}
+
+static void Close (vlc_object_t *obj)
+{
+    filter_t *filter = (filter_t *)obj;
+    filter_sys_t *sys = filter->p_sys;
+
+    free (sys->buf);
+    vlc_free (sys->coefs);
+    vlc_free (sys->interp);
+    vlc_free (sys->exact);
+    free (sys);
+}
+
+static block_t *Resample (filter_t *filter, block_t *in)
+{
+    filter_sys_t *sys = filter->p_sys;
+    const unsigned channels = sys->channels;
+    const unsigned taps = sys->taps;
+    const unsigned rate = filter->fmt_in.audio.i_rate;
+    block_t *out = NULL;
+
+    if (in->i_flags & BLOCK_FLAG_DISCONTINUITY)
+    {
+        Reset (sys);
+        sys->b_first = true;
+    }
+    if (sys->b_first)
+    {
+        date_Set (&sys->end_date, in->i_pts);
+        sys->b_first = false;
+    }
+
+    /* The input rate is adjusted by the audio output to compensate drift */
+    if (rate != sys->rate && SetRate (filter, rate))
+        goto error;
+
+    /* Append the input to the history */
+    size_t frames = sys->frames + in->i_nb_samples;
+    if ((frames + PADDING) * channels > sys->size)
+    {
+        size_t size = (frames + PADDING) * channels;
+        float *buf = realloc (sys->buf, size * sizeof (*buf));
+        if (unlikely(buf == NULL))
+            goto error;
+        sys->buf = buf;
+        sys->size = size;
+    }
+    memcpy (sys->buf + sys->frames * channels, in->p_buffer,
+            in->i_nb_samples * channels * sizeof (float));
+    sys->frames = frames;
+
+    size_t pos = sys->pos;
+    uint64_t frac = sys->frac;
+    size_t max = (pos < frames)
+               ? (uint64_t)(frames - pos) * filter->fmt_out.audio.i_rate
+                 / rate + 2 : 0;
+    unsigned n = 0;
+
+    out = block_Alloc (max * channels * sizeof (float));
+    if (unlikely(out == NULL))
+        goto error;
+
+    float *dst = (float *)out->p_buffer;
+
+    switch (sys->mode)
+    {
+        case MODE_COPY:
+            if (pos + taps <= frames)
+            {
+                n = frames - taps + 1 - pos;
+                memcpy (dst, sys->buf + (pos + taps / 2 - 1) * channels,
+                        n * channels * sizeof (float));
+                pos += n;
+            }
+            break;
+
+        case MODE_EXACT:
+            while (pos + taps <= frames && n < max)
+            {
+                sys->dot (dst, sys->buf + pos * channels,
+                          sys->exact + frac * sys->stride, taps, channels);
+                dst += channels;
+                n++;
+
+                frac += sys->step_frac;
+                if (frac >= sys->den)
+                {
+                    frac -= sys->den;
+                    pos++;
+                }
+                pos += sys->step_int;
+            }
+            break;
+
+        case MODE_INTERP:
+            while (pos + taps <= frames && n < max)
+            {
+                uint64_t phase = frac * sys->interp_phases;
+                const float *r0 = sys->interp + (phase >> 32) * sys->stride;
+                const float *r1 = r0 + sys->stride;
+                const float w = (uint32_t)phase * (1.f / 4294967296.f);
+
+                for (unsigned k = 0; k < sys->stride; k++)
+                    sys->coefs[k] = r0[k] + w * (r1[k] - r0[k]);
+                sys->dot (dst, sys->buf + pos * channels, sys->coefs, taps,
+                          channels);
+                dst += channels;
+                n++;
+
+                frac += sys->step_frac;
+                if (frac >= sys->den)
+                {
+                    frac -= sys->den;
+                    pos++;
+                }
+                pos += sys->step_int;
+            }
+            break;
+    }
+
+    /* Keep the frames needed by the next outputs */
+    if (pos < frames)
+    {
+        memmove (sys->buf, sys->buf + pos * channels,
+                 (frames - pos) * channels * sizeof (float));
+        sys->frames = frames - pos;
+        sys->pos = 0;
+    }
+    else
+    {
+        sys->frames = 0;
+        sys->pos = pos - frames;
+    }
+    sys->frac = frac;
+
+    if (n == 0)
+    {
+        block_Release (out);
+        out = NULL;
+        goto error;
+    }
+
+    out->i_buffer = n * channels * sizeof (float);
+    out->i_nb_samples = n;
+    out->i_pts = date_Get (&sys->end_date);
+    out->i_length = date_Increment (&sys->end_date, n) - out->i_pts;
+error:
+    block_Release (in);
+    return out;
+}
@@ -32,10 +32,19 @@
 #include <vlc_plugin.h>
 #include <vlc_aout.h>
 #include <vlc_filter.h>
+#include <vlc_cpu.h>
 
+#include <math.h>
 #include <string.h> /* for memset */
 #include <limits.h> /* form INT_MIN */
 
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+# include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -43,6 +52,25 @@ static int  Open( vlc_object_t * );
 static void Close( vlc_object_t * );
 static block_t *DoWork( filter_t *, block_t * );
 
+enum
+{
+    SEARCH_EXACT,
+    SEARCH_FAST,
+    SEARCH_FFT,
+};
+
+static const int pi_search_modes[] = { SEARCH_EXACT, SEARCH_FAST, SEARCH_FFT };
+static const char *const ppsz_search_modes[] = {
+    N_("Exact"), N_("Fast (coarse to fine)"), N_("FFT correlation"),
+};
+
+#define SEARCH_MODE_TEXT N_("Search mode")
+#define SEARCH_MODE_LONGTEXT N_("Exact searches every overlap position. " \
+    "Fast searches a coarse grid first, then refines around the best " \
+    "position, which is much less CPU intensive, at a small cost in " \
+    "quality. FFT correlation is exact but for the rounding, and faster " \
+    "with long overlap and search lengths.")
+
 vlc_module_begin ()
     set_description( N_("Audio tempo scaler synched with rate") )
     set_shortname( N_("Scaletempo") )
@@ -56,6 +84,9 @@ vlc_module_begin ()
         N_("Overlap Length"), N_("Percentage of stride to overlap"), true )
     add_integer_with_range( "scaletempo-search", 14, 0, 200,
         N_("Search Length"), N_("Length in milliseconds to search for best overlap position"), true )
+    add_integer( "scaletempo-search-mode", SEARCH_EXACT,
+        SEARCH_MODE_TEXT, SEARCH_MODE_LONGTEXT, true )
+        change_integer_list( pi_search_modes, ppsz_search_modes )
 
     set_callbacks( Open, Close )
 vlc_module_end ()
@@ -84,6 +115,7 @@ struct filter_sys_t
     unsigned  ms_stride;
     double    percent_overlap;
     unsigned  ms_search;
+    int       search_mode;
     /* audio format */
     unsigned  samples_per_frame;  /* AKA number of channels */
     unsigned  bytes_per_sample;
@@ -111,8 +143,28 @@ struct filter_sys_t
     void     *buf_pre_corr;
     void     *table_window;
     unsigned(*best_overlap_offset)( filter_t *p_filter );
+    /* vectorized search */
+    float    *buf_planar;         /* search window, one plane per channel */
+    unsigned  frames_planar;      /* frames per plane */
+    void    (*correlate)( const float *pre_corr, const float *planar,
+                          unsigned frames_planar, unsigned samples_per_frame,
+                          unsigned frames_pre_corr, float *corr );
+    /* fast search */
+    float    *buf_coarse;         /* averaged planes */
+    unsigned  frames_coarse;
+    float    *buf_pre_corr_coarse;
+    /* FFT search */
+    unsigned  fft_size;
+    float    *fft_twiddles;       /* fft_size / 2 complex roots of unity */
+    float    *fft_sum;            /* fft_size complex */
+    float    *fft_work;           /* fft_size complex */
 };
 
+/* Number of consecutive offsets correlated at once by the vector code */
+#define CORR_BLOCK 16
+/* Grid step of the fast search, in frames */
+#define COARSE_STEP 4
+
 /*****************************************************************************
  * best_overlap_offset: calculate best offset for overlap
  *****************************************************************************/
@@ -150,6 +202,296 @@ static unsigned best_overlap_offset_float( filter_t *p_filter )
     return best_off * p->bytes_per_frame;
 }
 
+/*****************************************************************************
+ * Vectorized search
+ *****************************************************************************
+ * The correlations are computed for CORR_BLOCK consecutive offsets at once,
+ * one offset per lane. Each lane adds the products in the same order as
+ * best_overlap_offset_float(), so that the results are exactly the same.
+ * The channels of the search window are stored in separate planes first, so
+ * that the samples of consecutive offsets are contiguous.
+ *****************************************************************************/
+static void fill_planar( filter_sys_t *p, unsigned frames )
+{
+    const unsigned spf = p->samples_per_frame;
+    const float *pin = (const float *)p->buf_queue + spf; /* from frame 1 */
+    unsigned frames_queue = p->bytes_queue_max / p->bytes_per_frame - 1;
+    unsigned n = __MIN( frames, frames_queue );
+
+    for( unsigned c = 0; c < spf; c++ ) {
+        float *pp = p->buf_planar + c * p->frames_planar;
+        for( unsigned i = 0; i < n; i++ )
+            pp[i] = pin[i * spf + c];
+        memset( pp + n, 0, ( p->frames_planar - n ) * sizeof(float) );
+    }
+}
+
+static void pre_correlate( filter_sys_t *p )
+{
+    float *pw  = p->table_window;
+    float *po  = (float *)p->buf_overlap + p->samples_per_frame;
+    float *ppc = p->buf_pre_corr;
+    for( unsigned i = p->samples_per_frame; i < p->samples_overlap; i++ )
+        *ppc++ = *pw++ * *po++;
+}
+
+static void correlate_c( const float *ppc, const float *planar,
+                         unsigned frames_planar, unsigned spf,
+                         unsigned frames_pre_corr, float *corr )
+{
+    for( unsigned k = 0; k < CORR_BLOCK; k++ )
+        corr[k] = 0;
+    for( unsigned f = 0; f < frames_pre_corr; f++ )
+        for( unsigned c = 0; c < spf; c++ ) {
+            const float w = *ppc++;
+            const float *pp = planar + c * frames_planar + f;
+            for( unsigned k = 0; k < CORR_BLOCK; k++ )
+                corr[k] += w * pp[k];
+        }
+}
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+__attribute__((__target__("sse2")))
+static void correlate_sse2( const float *ppc, const float *planar,
+                            unsigned frames_planar, unsigned spf,
+                            unsigned frames_pre_corr, float *corr )
+{
+    __m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps();
+    __m128 c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+
+    for( unsigned f = 0; f < frames_pre_corr; f++ )
+        for( unsigned c = 0; c < spf; c++ ) {
+            const __m128 w = _mm_set1_ps( *ppc++ );
+            const float *pp = planar + c * frames_planar + f;
+            c0 = _mm_add_ps( c0, _mm_mul_ps( w, _mm_loadu_ps( pp ) ) );
+            c1 = _mm_add_ps( c1, _mm_mul_ps( w, _mm_loadu_ps( pp + 4 ) ) );
+            c2 = _mm_add_ps( c2, _mm_mul_ps( w, _mm_loadu_ps( pp + 8 ) ) );
+            c3 = _mm_add_ps( c3, _mm_mul_ps( w, _mm_loadu_ps( pp + 12 ) ) );
+        }
+    _mm_storeu_ps( corr, c0 );
+    _mm_storeu_ps( corr + 4, c1 );
+    _mm_storeu_ps( corr + 8, c2 );
+    _mm_storeu_ps( corr + 12, c3 );
+}
+#endif
+
+#if defined(__ARM_NEON__)
+static void correlate_neon( const float *ppc, const float *planar,
+                            unsigned frames_planar, unsigned spf,
+                            unsigned frames_pre_corr, float *corr )
+{
+    float32x4_t c0 = vdupq_n_f32( 0.f ), c1 = c0, c2 = c0, c3 = c0;
+
+    /* Multiplications and additions are rounded separately, as in C */
+    for( unsigned f = 0; f < frames_pre_corr; f++ )
+        for( unsigned c = 0; c < spf; c++ ) {
+            const float32x4_t w = vdupq_n_f32( *ppc++ );
+            const float *pp = planar + c * frames_planar + f;
+            c0 = vaddq_f32( c0, vmulq_f32( w, vld1q_f32( pp ) ) );
+            c1 = vaddq_f32( c1, vmulq_f32( w, vld1q_f32( pp + 4 ) ) );
+            c2 = vaddq_f32( c2, vmulq_f32( w, vld1q_f32( pp + 8 ) ) );
+            c3 = vaddq_f32( c3, vmulq_f32( w, vld1q_f32( pp + 12 ) ) );
+        }
+    vst1q_f32( corr, c0 );
+    vst1q_f32( corr + 4, c1 );
+    vst1q_f32( corr + 8, c2 );
+    vst1q_f32( corr + 12, c3 );
+}
+#endif
+
+static unsigned best_overlap_offset_vector( filter_t *p_filter )
+{
+    filter_sys_t *p = p_filter->p_sys;
+    const unsigned frames_pre_corr = p->samples_overlap / p->samples_per_frame - 1;
+    float best_corr = INT_MIN;
+    unsigned best_off = 0;
+
+    pre_correlate( p );
+    fill_planar( p, p->frames_planar );
+
+    for( unsigned off = 0; off < p->frames_search; off += CORR_BLOCK ) {
+        float corr[CORR_BLOCK];
+        unsigned n = __MIN( CORR_BLOCK, p->frames_search - off );
+
+        p->correlate( p->buf_pre_corr, p->buf_planar + off, p->frames_planar,
+                      p->samples_per_frame, frames_pre_corr, corr );
+        for( unsigned k = 0; k < n; k++ ) {
+            if( corr[k] > best_corr ) {
+                best_corr = corr[k];
+                best_off  = off + k;
+            }
+        }
+    }
+
+    return best_off * p->bytes_per_frame;
+}
+
+/*****************************************************************************
+ * Fast search: the search window and the overlap are averaged over
+ * COARSE_STEP frames first, to find the best offset among every COARSE_STEP
+ * offsets. Then all the offsets around it are searched.
+ *****************************************************************************/
+static unsigned best_overlap_offset_fast( filter_t *p_filter )
+{
+    filter_sys_t *p = p_filter->p_sys;
+    const unsigned spf = p->samples_per_frame;
+    const unsigned frames_pre_corr = p->samples_overlap / spf - 1;
+    const unsigned frames_pre_corr_coarse = frames_pre_corr / COARSE_STEP;
+    const unsigned frames_search_coarse =
+        ( p->frames_search + COARSE_STEP - 1 ) / COARSE_STEP;
+    const float *ppc = p->buf_pre_corr;
+    float *ppcc = p->buf_pre_corr_coarse;
+    float best_corr = INT_MIN;
+    unsigned best_off = 0;
+
+    pre_correlate( p );
+    fill_planar( p, p->frames_planar );
+
+    for( unsigned c = 0; c < spf; c++ ) {
+        const float *pp = p->buf_planar + c * p->frames_planar;
+        float *pc = p->buf_coarse + c * p->frames_coarse;
+        unsigned n = __MIN( p->frames_coarse, p->frames_planar / COARSE_STEP );
+
+        for( unsigned i = 0; i < n; i++, pp += COARSE_STEP ) {
+            float sum = 0;
+            for( unsigned j = 0; j < COARSE_STEP; j++ )
+                sum += pp[j];
+            pc[i] = sum;
+        }
+        memset( pc + n, 0, ( p->frames_coarse - n ) * sizeof(float) );
+
+        for( unsigned f = 0; f < frames_pre_corr_coarse; f++ ) {
+            float sum = 0;
+            for( unsigned j = 0; j < COARSE_STEP; j++ )
+                sum += ppc[( f * COARSE_STEP + j ) * spf + c];
+            ppcc[f * spf + c] = sum;
+        }
+    }
+
+    for( unsigned off = 0; off < frames_search_coarse; off += CORR_BLOCK ) {
+        float corr[CORR_BLOCK];
+        unsigned n = __MIN( CORR_BLOCK, frames_search_coarse - off );
+
+        p->correlate( ppcc, p->buf_coarse + off, p->frames_coarse, spf,
+                      frames_pre_corr_coarse, corr );
+        for( unsigned k = 0; k < n; k++ ) {
+            if( corr[k] > best_corr ) {
+                best_corr = corr[k];
+                best_off  = ( off + k ) * COARSE_STEP;
+            }
+        }
+    }
+
+    /* The block of offsets must fit in the planes */
+    const unsigned lo = best_off >= COARSE_STEP - 1 ? best_off - ( COARSE_STEP - 1 ) : 0;
+    const unsigned hi = __MIN( best_off + COARSE_STEP - 1, p->frames_search - 1 );
+    const unsigned first = __MIN( lo, p->frames_planar - frames_pre_corr - CORR_BLOCK );
+    float corr[CORR_BLOCK];
+
+    p->correlate( ppc, p->buf_planar + first, p->frames_planar, spf,
+                  frames_pre_corr, corr );
+    best_corr = INT_MIN;
+    for( unsigned off = lo; off <= hi; off++ ) {
+        if( corr[off - first] > best_corr ) {
+            best_corr = corr[off - first];
+            best_off  = off;
+        }
+    }
+
+    return best_off * p->bytes_per_frame;
+}
+
+/*****************************************************************************
+ * FFT search: the correlations with all the offsets are the inverse transform
+ * of the product of the transforms of the search window and of the
+ * (conjugated) overlap, summed over the channels. Both real signals of a
+ * channel are transformed at once, as the real and imaginary parts of a
+ * complex signal.
+ *****************************************************************************/
+static void fft( const float *twiddles, float *buf, unsigned size, bool inverse )
+{
+    /* Bit reversal permutation */
+    for( unsigned i = 1, j = 0; i < size; i++ ) {
+        unsigned bit = size >> 1;
+        for( ; j & bit; bit >>= 1 )
+            j ^= bit;
+        j ^= bit;
+        if( i < j ) {
+            float re = buf[2 * i], im = buf[2 * i + 1];
+            buf[2 * i]     = buf[2 * j];
+            buf[2 * i + 1] = buf[2 * j + 1];
+            buf[2 * j]     = re;
+            buf[2 * j + 1] = im;
+        }
+    }
+
+    /* Radix-2 butterflies */
+    for( unsigned len = 2; len <= size; len <<= 1 ) {
+        const unsigned step = size / len;
+        for( unsigned i = 0; i < size; i += len )
+            for( unsigned k = 0; k < len / 2; k++ ) {
+                float wr = twiddles[2 * k * step];
+                float wi = inverse ? -twiddles[2 * k * step + 1]
+                                   :  twiddles[2 * k * step + 1];
+                float *a = buf + 2 * ( i + k );
+                float *b = buf + 2 * ( i + k + len / 2 );
+                float tr = b[0] * wr - b[1] * wi;
+                float ti = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+    }
+}
+
+static unsigned best_overlap_offset_fft( filter_t *p_filter )
+{
+    filter_sys_t *p = p_filter->p_sys;
+    const unsigned spf = p->samples_per_frame;
+    const unsigned frames_pre_corr = p->samples_overlap / spf - 1;
+    const unsigned size = p->fft_size;
+    const float *ppc = p->buf_pre_corr;
+    float *z = p->fft_work;
+    float best_corr = INT_MIN;
+    unsigned best_off = 0;
+
+    pre_correlate( p );
+    fill_planar( p, p->frames_search + frames_pre_corr );
+    memset( p->fft_sum, 0, 2 * size * sizeof(float) );
+
+    for( unsigned c = 0; c < spf; c++ ) {
+        const float *pp = p->buf_planar + c * p->frames_planar;
+
+        memset( z, 0, 2 * size * sizeof(float) );
+        for( unsigned i = 0; i < p->frames_search + frames_pre_corr; i++ )
+            z[2 * i] = pp[i];
+        for( unsigned f = 0; f < frames_pre_corr; f++ )
+            z[2 * f + 1] = ppc[f * spf + c];
+        fft( p->fft_twiddles, z, size, false );
+
+        /* X = (Z[k] + Z*[N-k]) / 2, Y = (Z[k] - Z*[N-k]) / 2i, and the sum
+         * of X * conj(Y), but for a constant factor */
+        for( unsigned k = 0; k < size; k++ ) {
+            const unsigned n = ( size - k ) & ( size - 1 );
+            float xr = z[2 * k] + z[2 * n], xi = z[2 * k + 1] - z[2 * n + 1];
+            float yr = z[2 * k + 1] + z[2 * n + 1], yi = z[2 * n] - z[2 * k];
+            p->fft_sum[2 * k]     += xr * yr + xi * yi;
+            p->fft_sum[2 * k + 1] += xi * yr - xr * yi;
+        }
+    }
+    fft( p->fft_twiddles, p->fft_sum, size, true );
+
+    for( unsigned off = 0; off < p->frames_search; off++ ) {
+        if( p->fft_sum[2 * off] > best_corr ) {
+            best_corr = p->fft_sum[2 * off];
+            best_off  = off;
+        }
+    }
+
+    return best_off * p->bytes_per_frame;
+}
+
 /*****************************************************************************
  * output_overlap: blend end of previous stride with beginning of current stride
  *****************************************************************************/
@@ -272,6 +614,77 @@ static size_t calculate_output_buffer_size( filter_t        *p_filter,
     return bytes_out;
 }
 
+/*****************************************************************************
+ * setup_search: selects the best overlap search function
+ *****************************************************************************/
+static int setup_search( filter_t *p_filter, unsigned frames_overlap )
+{
+    filter_sys_t *p = p_filter->p_sys;
+    const unsigned frames_pre_corr = frames_overlap - 1;
+
+    p->correlate = NULL;
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+    if( vlc_CPU_SSE2() )
+        p->correlate = correlate_sse2;
+#endif
+#if defined(__ARM_NEON__)
+    if( vlc_CPU_ARM_NEON() )
+        p->correlate = correlate_neon;
+#endif
+    /* Without SIMD, the exact search stays on the original code */
+    if( p->correlate == NULL && p->search_mode == SEARCH_EXACT )
+        return VLC_SUCCESS;
+    if( p->correlate == NULL )
+        p->correlate = correlate_c;
+
+    /* Enough frames for the last block of offsets */
+    p->frames_planar = ( p->frames_search + CORR_BLOCK - 1 )
+                     / CORR_BLOCK * CORR_BLOCK + frames_pre_corr;
+    p->buf_planar = malloc( p->frames_planar * p->samples_per_frame
+                            * sizeof(float) );
+    if( !p->buf_planar )
+        return VLC_ENOMEM;
+
+    switch( p->search_mode ) {
+    case SEARCH_FAST:
+        p->frames_coarse = ( p->frames_search / COARSE_STEP + CORR_BLOCK )
+                         / CORR_BLOCK * CORR_BLOCK
+                         + frames_pre_corr / COARSE_STEP;
+        p->buf_coarse = malloc( p->frames_coarse * p->samples_per_frame
+                                * sizeof(float) );
+        p->buf_pre_corr_coarse = malloc( __MAX( frames_pre_corr / COARSE_STEP, 1 )
+                                         * p->samples_per_frame
+                                         * sizeof(float) );
+        if( !p->buf_coarse || !p->buf_pre_corr_coarse )
+            return VLC_ENOMEM;
+        p->best_overlap_offset = best_overlap_offset_fast;
+        break;
+
+    case SEARCH_FFT:
+        /* Linear correlation: no wrap around within the searched offsets */
+        p->fft_size = 1;
+        while( p->fft_size < p->frames_search + frames_pre_corr )
+            p->fft_size <<= 1;
+        p->fft_twiddles = malloc( p->fft_size * sizeof(float) );
+        p->fft_sum      = malloc( 2 * p->fft_size * sizeof(float) );
+        p->fft_work     = malloc( 2 * p->fft_size * sizeof(float) );
+        if( !p->fft_twiddles || !p->fft_sum || !p->fft_work )
+            return VLC_ENOMEM;
+        for( unsigned i = 0; i < p->fft_size / 2; i++ ) {
+            double theta = -2. * M_PI * i / p->fft_size;
+            p->fft_twiddles[2 * i]     = cos( theta );
+            p->fft_twiddles[2 * i + 1] = sin( theta );
+        }
+        p->best_overlap_offset = best_overlap_offset_fft;
+        break;
+
+    default:
+        p->best_overlap_offset = best_overlap_offset_vector;
+        break;
+    }
+    return VLC_SUCCESS;
+}
+
 /*****************************************************************************
  * reinit_buffers: reinitializes buffers in p_filter->p_sys
  *****************************************************************************/
@@ -338,6 +751,9 @@ static int reinit_buffers( filter_t *p_filter )
                 *pw++ = v;
         }
         p->best_overlap_offset = best_overlap_offset_float;
+
+        if( setup_search( p_filter, frames_overlap ) != VLC_SUCCESS )
+            return VLC_ENOMEM;
     }
 
     unsigned new_size = ( p->frames_search + frames_stride + frames_overlap ) * p->bytes_per_frame;
@@ -367,13 +783,15 @@ static int reinit_buffers( filter_t *p_filter )
     p->frames_stride_scaled = p->bytes_stride_scaled / p->bytes_per_frame;
 
     msg_Dbg( VLC_OBJECT(p_filter),
-             "%.3f scale, %.3f stride_in, %i stride_out, %i standing, %i overlap, %i search, %i queue, %s mode",
+             "%.3f scale, %.3f stride_in, %i stride_out, %i standing, %i overlap, %i search (%s), %i queue, %s mode",
              p->scale,
              p->frames_stride_scaled,
              (int)( p->bytes_stride / p->bytes_per_frame ),
              (int)( p->bytes_standing / p->bytes_per_frame ),
              (int)( p->bytes_overlap / p->bytes_per_frame ),
              p->frames_search,
+             p->best_overlap_offset == best_overlap_offset_fast ? "fast" :
+             p->best_overlap_offset == best_overlap_offset_fft ? "fft" : "exact",
              (int)( p->bytes_queue_max / p->bytes_per_frame ),
              "fl32");
 
@@ -407,6 +825,7 @@ static int Open( vlc_object_t *p_this )
     p_sys->ms_stride       = var_InheritInteger( p_this, "scaletempo-stride" );
     p_sys->percent_overlap = var_InheritFloat( p_this, "scaletempo-overlap" );
     p_sys->ms_search       = var_InheritInteger( p_this, "scaletempo-search" );
+    p_sys->search_mode     = var_InheritInteger( p_this, "scaletempo-search-mode" );
 
     msg_Dbg( p_this, "params: %i stride, %.3f overlap, %i search",
              p_sys->ms_stride, p_sys->percent_overlap, p_sys->ms_search );
@@ -416,6 +835,12 @@ static int Open( vlc_object_t *p_this )
     p_sys->table_blend    = NULL;
     p_sys->buf_pre_corr   = NULL;
     p_sys->table_window   = NULL;
+    p_sys->buf_planar     = NULL;
+    p_sys->buf_coarse     = NULL;
+    p_sys->buf_pre_corr_coarse = NULL;
+    p_sys->fft_twiddles   = NULL;
+    p_sys->fft_sum        = NULL;
+    p_sys->fft_work       = NULL;
     p_sys->bytes_overlap  = 0;
     p_sys->bytes_queued   = 0;
     p_sys->bytes_to_slide = 0;
@@ -442,6 +867,12 @@ static void Close( vlc_object_t *p_this )
     free( p_sys->table_blend );
     free( p_sys->buf_pre_corr );
     free( p_sys->table_window );
+    free( p_sys->buf_planar );
+    free( p_sys->buf_coarse );
+    free( p_sys->buf_pre_corr_coarse );
+    free( p_sys->fft_twiddles );
+    free( p_sys->fft_sum );
+    free( p_sys->fft_work );
     free( p_sys );
 }
 
@@ -268,7 +268,7 @@ static int OpenDecoder( vlc_object_t *p_this )
     if( !GetFfmpegCodec( p_dec->fmt_in.i_codec, &i_cat, &i_codec_id,
                              &psz_namecodec ) )
     {
-        return VLC_EGENERIC;
+        return VLC_ENOTSUP;
     }
 
     /* Initialization must be done before avcodec_find_decoder() */
@@ -49,6 +49,22 @@
     "\"Fast Start\" files are optimized for downloads and allow the user " \
     "to start previewing the file while it is downloading.")
 
+#define FRAGMENTED_TEXT N_("Fragmented MP4")
+#define FRAGMENTED_LONGTEXT N_( \
+    "Write the samples in movie fragments as they come, instead of indexing " \
+    "them all at the end. Memory usage stays bounded, the output does not " \
+    "need to be seekable and the file can be played up to its last fragment.")
+
+#define FRAGDURATION_TEXT N_("Fragment duration (ms)")
+#define FRAGDURATION_LONGTEXT N_( \
+    "Minimum duration of a movie fragment. Fragments start on video " \
+    "key frames.")
+
+#define MFRA_TEXT N_("Write fragment index")
+#define MFRA_LONGTEXT N_( \
+    "Write a movie fragment random access index (mfra) at the end of " \
+    "fragmented files.")
+
 static int  Open   ( vlc_object_t * );
 static void Close  ( vlc_object_t * );
 
@@ -63,6 +79,12 @@ vlc_module_begin ()
     add_bool( SOUT_CFG_PREFIX "faststart", true,
               FASTSTART_TEXT, FASTSTART_LONGTEXT,
               true )
+    add_bool( SOUT_CFG_PREFIX "fragmented", false,
+              FRAGMENTED_TEXT, FRAGMENTED_LONGTEXT, true )
+    add_integer( SOUT_CFG_PREFIX "fragment-duration", 2000,
+                 FRAGDURATION_TEXT, FRAGDURATION_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "mfra", true,
+              MFRA_TEXT, MFRA_LONGTEXT, true )
     set_capability( "sout mux", 5 )
     add_shortcut( "mp4", "mov", "3gp" )
     set_callbacks( Open, Close )
@@ -72,7 +94,7 @@ vlc_module_end ()
  * Exported prototypes
  *****************************************************************************/
 static const char *const ppsz_sout_options[] = {
-    "faststart", NULL
+    "faststart", "fragmented", "fragment-duration", "mfra", NULL
 };
 
 static int Control( sout_mux_t *, int, va_list );
@@ -94,6 +116,15 @@ typedef struct
 
 } mp4_entry_t;
 
+/* Random access point of a fragmented file (mfra) */
+typedef struct
+{
+    uint64_t i_time;
+    uint64_t i_moof_pos;
+    uint32_t i_traf;
+
+} mp4_fragindex_t;
+
 typedef struct
 {
     es_format_t   fmt;
@@ -116,6 +147,20 @@ typedef struct
     /* for spu */
     int64_t i_last_dts;
 
+    /* fragmented mode: samples of the pending fragment (entry[] holds
+     * their index), and decode time in microseconds and timescale units */
+    block_t  *p_frag;
+    block_t  **pp_frag_last;
+    size_t   i_frag_size;
+    bool     b_frag_started;
+    int64_t  i_frag_dts;
+    uint64_t i_frag_dts_q;
+    int      i_trun_offset_pos;
+
+    unsigned int    i_fragindex_count;
+    unsigned int    i_fragindex_max;
+    mp4_fragindex_t *fragindex;
+
 } mp4_stream_t;
 
 struct sout_mux_sys_t
@@ -132,6 +177,15 @@ struct sout_mux_sys_t
 
     int          i_nb_streams;
     mp4_stream_t **pp_streams;
+
+    /* fragmented mode */
+    bool     b_fragmented;
+    bool     b_mfra;
+    bool     b_header_sent;
+    bool     b_has_video;
+    mtime_t  i_frag_duration;
+    mtime_t  i_frag_start;
+    uint32_t i_frag_seq;
 };
 
 typedef struct bo_t
@@ -169,6 +223,10 @@ static block_t *bo_to_sout( bo_t *box );
 
 static bo_t *GetMoovBox( sout_mux_t *p_mux );
 
+static void FragmentAddSample( sout_mux_t *, mp4_stream_t *, block_t * );
+static void FragmentFlush( sout_mux_t * );
+static bo_t *GetMfraBox( sout_mux_t * );
+
 static block_t *ConvertSUBT( block_t *);
 static block_t *ConvertAVC1( block_t * );
 
@@ -199,6 +257,23 @@ static int Open( vlc_object_t *p_this )
     p_sys->b_3gp        = p_mux->psz_mux && !strcmp( p_mux->psz_mux, "3gp" );
     p_sys->i_dts_start  = 0;
 
+    p_sys->b_fragmented = var_GetBool( p_mux, SOUT_CFG_PREFIX "fragmented" );
+    if( p_sys->b_fragmented && p_sys->b_mov )
+    {
+        msg_Warn( p_mux, "fragments are not supported in mov files" );
+        p_sys->b_fragmented = false;
+    }
+    p_sys->b_mfra = var_GetBool( p_mux, SOUT_CFG_PREFIX "mfra" );
+    p_sys->b_header_sent = false;
+    p_sys->b_has_video = false;
+    p_sys->i_frag_duration = INT64_C(1000) *
+        __MAX( var_GetInteger( p_mux, SOUT_CFG_PREFIX "fragment-duration" ), 1 );
+    p_sys->i_frag_start = VLC_TS_INVALID;
+    p_sys->i_frag_seq = 0;
+
+    /* FIXME FIXME
+     * Quicktime actually doesn't like the 64 bits extensions !!! */
+    p_sys->b_64_ext = false;
 
     if( !p_sys->b_mov )
     {
@@ -211,18 +286,29 @@ static int Open( vlc_object_t *p_this )
         else bo_add_fourcc( box, "mp41" );
         bo_add_fourcc( box, "avc1" );
         bo_add_fourcc( box, "qt  " );
+        if( p_sys->b_fragmented )
+        {
+            bo_add_fourcc( box, "iso5" );
+            bo_add_fourcc( box, "dash" );
+        }
         box_fix( box );
 
         p_sys->i_pos += box->i_buffer;
         p_sys->i_mdat_pos = p_sys->i_pos;
 
+        if( p_sys->b_fragmented )
+        {
+            /* Start of the initialization segment */
+            block_t *p_ftyp = bo_to_sout( box );
+            box_free( box );
+            p_ftyp->i_flags |= BLOCK_FLAG_HEADER;
+            sout_AccessOutWrite( p_mux->p_access, p_ftyp );
+            return VLC_SUCCESS;
+        }
+
         box_send( p_mux, box );
     }
 
-    /* FIXME FIXME
-     * Quicktime actually doesn't like the 64 bits extensions !!! */
-    p_sys->b_64_ext = false;
-
     /* Now add mdat header */
     box = box_new( "mdat" );
     bo_add_64be  ( box, 0 ); // enough to store an extended size
@@ -250,6 +336,20 @@ static void Close( vlc_object_t * p_this )
 
     msg_Dbg( p_mux, "Close" );
 
+    if( p_sys->b_fragmented )
+    {
+        if( !p_sys->b_header_sent )
+        {
+            moov = GetMoovBox( p_mux );
+            p_sys->i_pos += moov->i_buffer;
+            box_send( p_mux, moov );
+        }
+        FragmentFlush( p_mux );
+        if( p_sys->b_mfra )
+            box_send( p_mux, GetMfraBox( p_mux ) );
+        goto cleanup;
+    }
+
     /* Update mdat size */
     bo_init( &bo, 0, NULL, true );
     if( p_sys->i_pos - p_sys->i_mdat_pos >= (((uint64_t)1)<<32) )
@@ -348,12 +448,15 @@ static void Close( vlc_object_t * p_this )
     sout_AccessOutSeek( p_mux->p_access, i_moov_pos );
     box_send( p_mux, moov );
 
+cleanup:
     /* Clean-up */
     for( i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
     {
         mp4_stream_t *p_stream = p_sys->pp_streams[i_trak];
 
         es_format_Clean( &p_stream->fmt );
+        block_ChainRelease( p_stream->p_frag );
+        free( p_stream->fragindex );
         free( p_stream->entry );
         free( p_stream );
     }
@@ -366,7 +469,6 @@ static void Close( vlc_object_t * p_this )
  *****************************************************************************/
 static int Control( sout_mux_t *p_mux, int i_query, va_list args )
 {
-    VLC_UNUSED(p_mux);
     bool *pb_bool;
 
     switch( i_query )
@@ -381,7 +483,16 @@ static int Control( sout_mux_t *p_mux, int i_query, va_list args )
             *pb_bool = true;
             return VLC_SUCCESS;
 
-        case MUX_GET_MIME:   /* Not needed, as not streamable */
+        case MUX_GET_MIME:
+        {
+            /* Only fragmented files are streamable */
+            if( !p_mux->p_sys->b_fragmented )
+                return VLC_EGENERIC;
+            char **ppsz = (char**)va_arg( args, char ** );
+            *ppsz = strdup( "video/mp4" );
+            return VLC_SUCCESS;
+        }
+
         default:
             return VLC_EGENERIC;
     }
@@ -413,6 +524,11 @@ static int AddStream( sout_mux_t *p_mux, sout_input_t *p_input )
         case VLC_CODEC_YUYV:
             break;
         case VLC_CODEC_SUBT:
+            if( p_sys->b_fragmented )
+            {
+                msg_Err( p_mux, "subtitles are not supported in fragmented mp4" );
+                return VLC_EGENERIC;
+            }
             msg_Warn( p_mux, "subtitle track added like in .mov (even when creating .mp4)" );
             break;
         default:
@@ -433,6 +549,15 @@ static int AddStream( sout_mux_t *p_mux, sout_input_t *p_input )
         calloc( p_stream->i_entry_max, sizeof( mp4_entry_t ) );
     p_stream->i_dts_start   = 0;
     p_stream->i_duration    = 0;
+    p_stream->p_frag        = NULL;
+    p_stream->pp_frag_last  = &p_stream->p_frag;
+    p_stream->i_frag_size   = 0;
+    p_stream->b_frag_started = false;
+    p_stream->i_frag_dts    = 0;
+    p_stream->i_frag_dts_q  = 0;
+    p_stream->i_fragindex_count = 0;
+    p_stream->i_fragindex_max   = 0;
+    p_stream->fragindex     = NULL;
 
     p_input->p_sys          = p_stream;
 
@@ -515,6 +640,12 @@ again:
             }
         }
 
+        if( p_sys->b_fragmented )
+        {
+            FragmentAddSample( p_mux, p_stream, p_data );
+            continue;
+        }
+
         /* Save starting time */
         if( p_stream->i_entry_count == 0 )
         {
@@ -614,6 +745,273 @@ again:
     return( VLC_SUCCESS );
 }
 
+/*****************************************************************************
+ * Fragmented mode:
+ *****************************************************************************
+ * Samples are queued per stream until the fragment is long enough and a
+ * video key frame comes. They are then written as a moof box, indexing them
+ * with one traf/trun per stream, followed by a mdat box. Memory usage is
+ * thus bounded by the fragment duration.
+ *****************************************************************************/
+static uint32_t GetTimescale( mp4_stream_t *p_stream )
+{
+    /* Must match the mdhd box */
+    if( p_stream->fmt.i_cat == AUDIO_ES )
+        return p_stream->fmt.audio.i_rate;
+    return 1001;
+}
+
+static bool IsSyncSample( mp4_stream_t *p_stream, unsigned int i_flags )
+{
+    return p_stream->fmt.i_cat != VIDEO_ES || ( i_flags & BLOCK_FLAG_TYPE_I );
+}
+
+static void FragmentAddSample( sout_mux_t *p_mux, mp4_stream_t *p_stream,
+                               block_t *p_data )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+
+    if( !p_sys->b_header_sent )
+    {
+        /* All the streams are known by now (see MUX_GET_ADD_STREAM_WAIT) */
+        for( int i = 0; i < p_sys->i_nb_streams; i++ )
+            if( p_sys->pp_streams[i]->fmt.i_cat == VIDEO_ES )
+                p_sys->b_has_video = true;
+
+        bo_t *moov = GetMoovBox( p_mux );
+        p_sys->i_pos += moov->i_buffer;
+        box_send( p_mux, moov );
+        p_sys->b_header_sent = true;
+        p_sys->i_dts_start = p_data->i_dts;
+    }
+
+    if( p_sys->i_frag_start == VLC_TS_INVALID )
+        p_sys->i_frag_start = p_data->i_dts;
+    else
+    {
+        mtime_t i_frag_length = p_data->i_dts - p_sys->i_frag_start;
+
+        /* Cut on key frames, unless they are much too far apart */
+        if( ( i_frag_length >= p_sys->i_frag_duration &&
+              ( !p_sys->b_has_video ||
+                ( p_stream->fmt.i_cat == VIDEO_ES &&
+                  ( p_data->i_flags & BLOCK_FLAG_TYPE_I ) ) ) ) ||
+            i_frag_length >= 4 * p_sys->i_frag_duration )
+        {
+            FragmentFlush( p_mux );
+            p_sys->i_frag_start = p_data->i_dts;
+        }
+    }
+
+    if( !p_stream->b_frag_started )
+    {
+        /* Streams starting late are shifted by their decode time */
+        p_stream->b_frag_started = true;
+        p_stream->i_frag_dts = __MAX( p_data->i_dts - p_sys->i_dts_start, 0 );
+        p_stream->i_frag_dts_q = p_stream->i_frag_dts *
+                                 GetTimescale( p_stream ) / INT64_C(1000000);
+        p_stream->i_dts_start = p_data->i_dts;
+    }
+
+    mp4_entry_t *p_entry = &p_stream->entry[p_stream->i_entry_count];
+    p_entry->i_pos     = p_stream->i_frag_size;
+    p_entry->i_size    = p_data->i_buffer;
+    p_entry->i_pts_dts = __MAX( p_data->i_pts - p_data->i_dts, 0 );
+    p_entry->i_length  = p_data->i_length;
+    p_entry->i_flags   = p_data->i_flags;
+
+    p_stream->i_entry_count++;
+    if( p_stream->i_entry_count >= p_stream->i_entry_max - 1 )
+    {
+        p_stream->i_entry_max += 1000;
+        p_stream->entry = xrealloc( p_stream->entry,
+                     p_stream->i_entry_max * sizeof( mp4_entry_t ) );
+    }
+
+    p_stream->i_frag_size += p_data->i_buffer;
+    p_stream->i_last_dts = p_data->i_dts;
+    p_stream->i_duration = p_stream->i_last_dts - p_stream->i_dts_start +
+                           p_data->i_length;
+    block_ChainLastAppend( &p_stream->pp_frag_last, p_data );
+}
+
+static void FragmentFlush( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    uint64_t i_moof_pos = p_sys->i_pos;
+    uint64_t i_mdat_size = 8;
+    uint32_t i_traf = 0;
+    bool b_sync = true;
+    bo_t *moof, *mfhd;
+
+    for( int i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
+        i_mdat_size += p_sys->pp_streams[i_trak]->i_frag_size;
+    if( i_mdat_size == 8 )
+        return;
+
+    moof = box_new( "moof" );
+
+    mfhd = box_full_new( "mfhd", 0, 0 );
+    bo_add_32be( mfhd, ++p_sys->i_frag_seq );   // sequence-number
+    box_fix( mfhd );
+    box_gather( moof, mfhd );
+
+    for( int i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
+    {
+        mp4_stream_t *p_stream = p_sys->pp_streams[i_trak];
+        uint32_t i_timescale = GetTimescale( p_stream );
+        bo_t *traf, *tfhd, *tfdt, *trun;
+
+        if( p_stream->i_entry_count == 0 )
+            continue;
+
+        if( !IsSyncSample( p_stream, p_stream->entry[0].i_flags ) )
+            b_sync = false;
+
+        /* Remember the random access points for the mfra box */
+        i_traf++;
+        if( p_sys->b_mfra &&
+            IsSyncSample( p_stream, p_stream->entry[0].i_flags ) )
+        {
+            if( p_stream->i_fragindex_count >= p_stream->i_fragindex_max )
+            {
+                p_stream->i_fragindex_max += 100;
+                p_stream->fragindex = xrealloc( p_stream->fragindex,
+                    p_stream->i_fragindex_max * sizeof( mp4_fragindex_t ) );
+            }
+            mp4_fragindex_t *p_idx =
+                &p_stream->fragindex[p_stream->i_fragindex_count++];
+            p_idx->i_time     = p_stream->i_frag_dts_q;
+            p_idx->i_moof_pos = i_moof_pos;
+            p_idx->i_traf     = i_traf;
+        }
+
+        traf = box_new( "traf" );
+
+        /* default-base-is-moof */
+        tfhd = box_full_new( "tfhd", 0, 0x020000 );
+        bo_add_32be( tfhd, p_stream->i_track_id );
+        box_fix( tfhd );
+        box_gather( traf, tfhd );
+
+        tfdt = box_full_new( "tfdt", 1, 0 );
+        bo_add_64be( tfdt, p_stream->i_frag_dts_q );  // base-media-decode-time
+        box_fix( tfdt );
+        box_gather( traf, tfdt );
+
+        /* data-offset, sample duration, size, flags and composition offset */
+        trun = box_full_new( "trun", 0, 0x000f01 );
+        bo_add_32be( trun, p_stream->i_entry_count );
+        bo_add_32be( trun, 0 );     // data-offset (fixed later)
+        for( unsigned int i = 0; i < p_stream->i_entry_count; i++ )
+        {
+            mp4_entry_t *p_entry = &p_stream->entry[i];
+
+            /* Quantize the duration without accumulating rounding errors */
+            int64_t i_dts_deq = p_stream->i_frag_dts_q * INT64_C(1000000) /
+                                i_timescale;
+            int64_t i_delta = p_entry->i_length + p_stream->i_frag_dts - i_dts_deq;
+            uint32_t i_length_q = i_delta * i_timescale / INT64_C(1000000);
+
+            p_stream->i_frag_dts += p_entry->i_length;
+            p_stream->i_frag_dts_q += i_length_q;
+
+            bo_add_32be( trun, i_length_q );            // sample-duration
+            bo_add_32be( trun, p_entry->i_size );       // sample-size
+            if( IsSyncSample( p_stream, p_entry->i_flags ) )
+                bo_add_32be( trun, 0x02000000 );        // depends on no other
+            else
+                bo_add_32be( trun, 0x01010000 );        // non sync sample
+            bo_add_32be( trun, p_entry->i_pts_dts * i_timescale /
+                               INT64_C(1000000) );      // composition-offset
+        }
+        box_fix( trun );
+        p_stream->i_trun_offset_pos = moof->i_buffer + traf->i_buffer + 16;
+        box_gather( traf, trun );
+
+        box_fix( traf );
+        box_gather( moof, traf );
+    }
+    box_fix( moof );
+
+    /* Samples follow the mdat header, in the traf order */
+    uint64_t i_offset = moof->i_buffer + 8;
+    for( int i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
+    {
+        mp4_stream_t *p_stream = p_sys->pp_streams[i_trak];
+
+        if( p_stream->i_entry_count == 0 )
+            continue;
+        bo_fix_32be( moof, p_stream->i_trun_offset_pos, i_offset );
+        i_offset += p_stream->i_frag_size;
+    }
+
+    block_t *p_moof = bo_to_sout( moof );
+    box_free( moof );
+    p_moof->i_dts = p_sys->i_frag_start;
+    /* Fragments starting with key frames are segment boundaries */
+    if( b_sync )
+        p_moof->i_flags |= BLOCK_FLAG_HEADER;
+
+    bo_t bo;
+    bo_init( &bo, 0, NULL, true );
+    bo_add_32be  ( &bo, i_mdat_size );
+    bo_add_fourcc( &bo, "mdat" );
+    p_moof->p_next = bo_to_sout( &bo );
+    free( bo.p_buffer );
+
+    p_sys->i_pos += p_moof->i_buffer + i_mdat_size;
+    sout_AccessOutWrite( p_mux->p_access, p_moof );
+
+    for( int i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
+    {
+        mp4_stream_t *p_stream = p_sys->pp_streams[i_trak];
+
+        if( p_stream->p_frag )
+            sout_AccessOutWrite( p_mux->p_access, p_stream->p_frag );
+        p_stream->p_frag = NULL;
+        p_stream->pp_frag_last = &p_stream->p_frag;
+        p_stream->i_frag_size = 0;
+        p_stream->i_entry_count = 0;
+    }
+}
+
+static bo_t *GetMfraBox( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    bo_t *mfra, *mfro;
+
+    mfra = box_new( "mfra" );
+
+    for( int i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
+    {
+        mp4_stream_t *p_stream = p_sys->pp_streams[i_trak];
+        bo_t *tfra = box_full_new( "tfra", 1, 0 );
+
+        bo_add_32be( tfra, p_stream->i_track_id );
+        bo_add_32be( tfra, 0x3f );  // 32 bits traf, trun and sample numbers
+        bo_add_32be( tfra, p_stream->i_fragindex_count );
+        for( unsigned int i = 0; i < p_stream->i_fragindex_count; i++ )
+        {
+            bo_add_64be( tfra, p_stream->fragindex[i].i_time );
+            bo_add_64be( tfra, p_stream->fragindex[i].i_moof_pos );
+            bo_add_32be( tfra, p_stream->fragindex[i].i_traf );
+            bo_add_32be( tfra, 1 ); // trun-number
+            bo_add_32be( tfra, 1 ); // sample-number
+        }
+        box_fix( tfra );
+        box_gather( mfra, tfra );
+    }
+
+    mfro = box_full_new( "mfro", 0, 0 );
+    bo_add_32be( mfro, mfra->i_buffer + 16 );   // size of mfra
+    box_fix( mfro );
+    box_gather( mfra, mfro );
+
+    box_fix( mfra );
+    return mfra;
+}
+
 /*****************************************************************************
  *
  *****************************************************************************/
@@ -633,6 +1031,11 @@ static block_t *ConvertSUBT( block_t *p_block )
 
 static block_t *ConvertAVC1( block_t *p_block )
 {
+    /* The start codes are rewritten in place */
+    p_block = block_Unshare( p_block );
+    if( p_block == NULL )
+        return NULL;
+
     uint8_t *last = p_block->p_buffer;  /* Assume it starts with 0x00000001 */
     uint8_t *dat  = &p_block->p_buffer[4];
     uint8_t *end = &p_block->p_buffer[p_block->i_buffer];
@@ -1702,7 +2105,11 @@ static bo_t *GetMoovBox( sout_mux_t *p_mux )
         box_fix( elst );
         box_gather( edts, elst );
         box_fix( edts );
-        box_gather( trak, edts );
+        /* Fragments carry their own decode time (tfdt) */
+        if( p_sys->b_fragmented )
+            box_free( edts );
+        else
+            box_gather( trak, edts );
 
         /* *** add /moov/trak/mdia *** */
         mdia = box_new( "mdia" );
@@ -1882,6 +2289,27 @@ static bo_t *GetMoovBox( sout_mux_t *p_mux )
         box_gather( moov, trak );
     }
 
+    /* Announce the movie fragments */
+    if( p_sys->b_fragmented )
+    {
+        bo_t *mvex = box_new( "mvex" );
+
+        for( i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
+        {
+            bo_t *trex = box_full_new( "trex", 0, 0 );
+
+            bo_add_32be( trex, p_sys->pp_streams[i_trak]->i_track_id );
+            bo_add_32be( trex, 1 );     // sample-description-index
+            bo_add_32be( trex, 0 );     // default-sample-duration
+            bo_add_32be( trex, 0 );     // default-sample-size
+            bo_add_32be( trex, 0 );     // default-sample-flags
+            box_fix( trex );
+            box_gather( mvex, trex );
+        }
+        box_fix( mvex );
+        box_gather( moov, mvex );
+    }
+
     /* Add user data tags */
     box_gather( moov, GetUdtaTag( p_mux ) );
 
@@ -168,6 +168,11 @@ static void    Close  ( vlc_object_t * );
 #define CU_LONGTEXT N_("CSA encryption key used. It can be the odd/first/1 " \
   "(default) or the even/second/2 one.")
 
+#define MUXRATE_TEXT N_("Mux rate (bits/s)")
+#define MUXRATE_LONGTEXT N_("Produce a constant bitrate stream at this rate, " \
+  "padded with null packets, with PCRs matching their exact position in " \
+  "the stream. 0 keeps the variable bitrate output.")
+
 #define CPKT_TEXT N_("Packet size in bytes to encrypt")
 #define CPKT_LONGTEXT N_("Size of the TS packet to encrypt. " \
     "The encryption routines subtract the TS-header from the value before " \
@@ -176,6 +181,7 @@ static void    Close  ( vlc_object_t * );
 #define SOUT_CFG_PREFIX "sout-ts-"
 #define MAX_PMT 64       /* Maximum number of programs. FIXME: I just chose an arbitrary number. Where is the maximum in the spec? */
 #define MAX_PMT_PID 64       /* Maximum pids in each pmt.  FIXME: I just chose an arbitrary number. Where is the maximum in the spec? */
+#define BUFFER_STATS_UNITS 64 /* Access units tracked by the buffer statistics */
 
 vlc_module_begin ()
     set_description( N_("TS muxer (libdvbpsi)") )
@@ -204,6 +210,8 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "bmin", 0, BMIN_TEXT, BMIN_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "bmax", 0, BMAX_TEXT, BMAX_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "dts-delay", 400, DTS_TEXT, DTS_LONGTEXT, true)
+    add_integer_with_range( SOUT_CFG_PREFIX "muxrate", 0, 0, 100000000,
+                            MUXRATE_TEXT, MUXRATE_LONGTEXT, true )
 
     add_bool( SOUT_CFG_PREFIX "crypt-audio", true, ACRYPT_TEXT, ACRYPT_LONGTEXT, true)
     add_bool( SOUT_CFG_PREFIX "crypt-video", true, VCRYPT_TEXT, VCRYPT_LONGTEXT, true)
@@ -222,7 +230,7 @@ static const char *const ppsz_sout_options[] = {
     "pid-video", "pid-audio", "pid-spu", "pid-pmt", "tsid",
     "netid", "sdtdesc",
     "es-id-pid", "shaping", "pcr", "bmin", "bmax", "use-key-frames",
-    "dts-delay", "csa-ck", "csa2-ck", "csa-use", "csa-pkt", "crypt-audio", "crypt-video",
+    "dts-delay", "muxrate", "csa-ck", "csa2-ck", "csa-use", "csa-pkt", "crypt-audio", "crypt-video",
     "muxpmt", "program-pmt", "alignment",
     NULL
 };
@@ -333,8 +341,42 @@ typedef struct ts_stream_t
     int                 i_pes_used;
     bool                b_key_frame;
 
+    /* Decoder buffer statistics: payload delivered and not decoded yet, by
+     * decoding date. They are only reported, the output is not scheduled
+     * after them. */
+    struct
+    {
+        mtime_t         i_dts;
+        int             i_size;
+    } buffer[BUFFER_STATS_UNITS];
+    int                 i_buffer_first;
+    int                 i_buffer_count;
+    int                 i_buffer_level;
+    int                 i_buffer_peak;
+    unsigned            i_buffer_late;
+
 } ts_stream_t;
 
+typedef struct
+{
+    uint64_t        i_packets;
+    uint64_t        i_null_packets;
+    unsigned        i_overflows;    /* windows exceeding the mux rate */
+
+    uint64_t        i_pcrs;
+    int64_t         i_pcr_last;     /* 27 MHz */
+    int64_t         i_pcr_bytes;    /* bytes since the last PCR */
+    int64_t         i_pcr_delta;    /* previous PCR interval, 27 MHz */
+    int64_t         i_pcr_delta_bytes;
+    int64_t         i_pcr_interval_sum;
+    int64_t         i_pcr_interval_max;
+    unsigned        i_pcr_interval_errors;
+    int64_t         i_pcr_jitter_max;
+    unsigned        i_pcr_jitter_errors;
+
+    mtime_t         i_next_report;
+} ts_stats_t;
+
 struct sout_mux_sys_t
 {
     int             i_pcr_pid;
@@ -371,6 +413,11 @@ struct sout_mux_sys_t
     ts_stream_t     sdt;
     dvbpsi_pmt_t    *dvbpmt;
 
+    /* PSI tables, packetized once and reused until an ES changes */
+    block_t         *p_pat_ts;
+    block_t         *p_pmt_ts[MAX_PMT];
+    block_t         *p_sdt_ts;
+
     /* for TS building */
     int64_t         i_bitrate_min;
     int64_t         i_bitrate_max;
@@ -384,6 +431,18 @@ struct sout_mux_sys_t
 
     mtime_t         i_pcr;  /* last PCR emited */
 
+    size_t          i_write_size; /* TS packets gathered per output block */
+
+    /* constant bitrate */
+    int64_t         i_mux_rate;     /* bits/s, 0 for variable bitrate */
+    int64_t         i_cbr_origin;   /* date of slot 0, 27 MHz */
+    int64_t         i_cbr_slot;     /* next slot, -1 before the first one */
+    mtime_t         i_cbr_pcr_date; /* slot date of the last PCR */
+    int             i_cbr_pcr_pid;
+    int             i_cbr_pcr_cc;   /* last continuity counter on that pid */
+
+    ts_stats_t      stats;
+
     csa_t           *csa;
     int             i_csa_pkt_size;
     bool            b_crypt_audio;
@@ -445,9 +504,14 @@ static void TSDate      ( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
                           mtime_t i_pcr_length, mtime_t i_pcr_dts );
 static void GetPAT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
 static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
+static void FlushPMT( sout_mux_sys_t *p_sys );
+
+static void TSDateCBR   ( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+                          mtime_t i_pcr_length, mtime_t i_pcr_dts );
+static void TSStatsReport( sout_mux_t *p_mux );
 
 static block_t *TSNew( sout_mux_t *p_mux, ts_stream_t *p_stream, bool b_pcr );
-static void TSSetPCR( block_t *p_ts, mtime_t i_dts );
+static void TSSetPCR( block_t *p_ts, int64_t i_pcr );
 
 static csa_t *csaSetup( vlc_object_t *p_this )
 {
@@ -727,6 +791,18 @@ static int Open( vlc_object_t *p_this )
 
     p_sys->b_use_key_frames = var_GetBool( p_mux, SOUT_CFG_PREFIX "use-key-frames" );
 
+    /* Hand TS packets to the access output by groups fitting in one
+     * datagram (7 with the default MTU), so that they can be sent as is */
+    int64_t i_mtu = var_InheritInteger( p_mux, "mtu" );
+    p_sys->i_write_size = 188 * VLC_CLIP( i_mtu / 188, 1, 7 );
+
+    p_sys->i_mux_rate = var_GetInteger( p_mux, SOUT_CFG_PREFIX "muxrate" );
+    p_sys->i_cbr_slot = -1;
+    p_sys->i_cbr_pcr_pid = 0x1fff;
+    if( p_sys->i_mux_rate > 0 )
+        msg_Dbg( p_mux, "constant bitrate: %"PRId64" bits/s",
+                 p_sys->i_mux_rate );
+
     p_sys->csa = csaSetup(p_this);
 
     return VLC_SUCCESS;
@@ -760,6 +836,10 @@ static void Close( vlc_object_t * p_this )
         free( p_sys->sdt_descriptors[i].psz_provider );
     }
 
+    TSStatsReport( p_mux );
+
+    block_ChainRelease( p_sys->p_pat_ts );
+    FlushPMT( p_sys );
     free( p_sys->dvbpmt );
     free( p_sys );
 }
@@ -1083,6 +1163,7 @@ static int AddStream( sout_mux_t *p_mux, sout_input_t *p_input )
 
     /* We only change PMT version (PAT isn't changed) */
     p_sys->i_pmt_version_number = ( p_sys->i_pmt_version_number + 1 )%32;
+    FlushPMT( p_sys );
 
     /* Update pcr_pid */
     if( p_input->p_fmt->i_cat != SPU_ES &&
@@ -1117,6 +1198,8 @@ static int DelStream( sout_mux_t *p_mux, sout_input_t *p_input )
     int              pid;
 
     msg_Dbg( p_mux, "removing input pid=%d", p_stream->i_pid );
+    msg_Dbg( p_mux, "pid %d: decoder buffer peak %d bytes, %u late packets",
+             p_stream->i_pid, p_stream->i_buffer_peak, p_stream->i_buffer_late );
 
     if( p_sys->i_pcr_pid == p_stream->i_pid )
     {
@@ -1189,6 +1272,7 @@ static int DelStream( sout_mux_t *p_mux, sout_input_t *p_input )
     /* We only change PMT version (PAT isn't changed) */
     p_sys->i_pmt_version_number++;
     p_sys->i_pmt_version_number %= 32;
+    FlushPMT( p_sys );
 
     return VLC_SUCCESS;
 }
@@ -1545,7 +1629,10 @@ static bool MuxStreams(sout_mux_t *p_mux )
     }
 
     /* 4: date and send */
-    TSSchedule( p_mux, &chain_ts, i_pcr_length, i_pcr_dts );
+    if( p_sys->i_mux_rate > 0 )
+        TSDateCBR( p_mux, &chain_ts, i_pcr_length, i_pcr_dts );
+    else
+        TSSchedule( p_mux, &chain_ts, i_pcr_length, i_pcr_dts );
     return false;
 }
 
@@ -1688,6 +1775,248 @@ static block_t *Add_ADTS( block_t *p_data, es_format_t *p_fmt )
     return p_new_block;
 }
 
+/* Updates the decoder buffer statistics of a stream with a packet arriving
+ * at i_arrival and decoded at i_decode */
+static void TSStatsBuffer( ts_stream_t *p_stream, mtime_t i_arrival,
+                           mtime_t i_decode, int i_size )
+{
+    while( p_stream->i_buffer_count > 0 &&
+           p_stream->buffer[p_stream->i_buffer_first].i_dts <= i_arrival )
+    {
+        p_stream->i_buffer_level -=
+            p_stream->buffer[p_stream->i_buffer_first].i_size;
+        p_stream->i_buffer_first = ( p_stream->i_buffer_first + 1 )
+                                   % BUFFER_STATS_UNITS;
+        p_stream->i_buffer_count--;
+    }
+
+    if( i_decode < i_arrival )
+    {
+        p_stream->i_buffer_late++;
+        return;
+    }
+
+    int i_last = ( p_stream->i_buffer_first + p_stream->i_buffer_count
+                   + BUFFER_STATS_UNITS - 1 ) % BUFFER_STATS_UNITS;
+    if( p_stream->i_buffer_count == 0 ||
+        ( p_stream->buffer[i_last].i_dts != i_decode &&
+          p_stream->i_buffer_count < BUFFER_STATS_UNITS ) )
+    {
+        i_last = ( i_last + 1 ) % BUFFER_STATS_UNITS;
+        p_stream->buffer[i_last].i_size = 0;
+        p_stream->i_buffer_count++;
+    }
+    /* When full, the data is merged with the last access unit: it is kept
+     * a little longer than needed */
+    p_stream->buffer[i_last].i_dts = __MAX( p_stream->buffer[i_last].i_dts,
+                                            i_decode );
+    p_stream->buffer[i_last].i_size += i_size;
+
+    p_stream->i_buffer_level += i_size;
+    if( p_stream->i_buffer_level > p_stream->i_buffer_peak )
+        p_stream->i_buffer_peak = p_stream->i_buffer_level;
+}
+
+static void TSStatsPCR( ts_stats_t *p_stats, int64_t i_pcr )
+{
+    if( p_stats->i_pcrs++ > 0 )
+    {
+        int64_t i_delta = i_pcr - p_stats->i_pcr_last;
+
+        if( i_delta <= 0 || i_delta > 27000000 )
+        {
+            /* discontinuity */
+            p_stats->i_pcr_delta = 0;
+        }
+        else
+        {
+            p_stats->i_pcr_interval_sum += i_delta;
+            if( i_delta > p_stats->i_pcr_interval_max )
+                p_stats->i_pcr_interval_max = i_delta;
+            if( i_delta > 40 * 27000 ) /* ETSI TR 101 290 */
+                p_stats->i_pcr_interval_errors++;
+
+            /* Compare with the PCR a receiver expects from the previous
+             * interval, assuming a constant rate */
+            if( p_stats->i_pcr_delta > 0 && p_stats->i_pcr_delta_bytes > 0 )
+            {
+                int64_t i_jitter = i_delta - p_stats->i_pcr_delta *
+                    p_stats->i_pcr_bytes / p_stats->i_pcr_delta_bytes;
+                i_jitter = i_jitter < 0 ? -i_jitter : i_jitter;
+                if( i_jitter > p_stats->i_pcr_jitter_max )
+                    p_stats->i_pcr_jitter_max = i_jitter;
+                if( i_jitter * 1000 > 500 * 27 ) /* 500 ns */
+                    p_stats->i_pcr_jitter_errors++;
+            }
+            p_stats->i_pcr_delta = i_delta;
+            p_stats->i_pcr_delta_bytes = p_stats->i_pcr_bytes;
+        }
+    }
+    p_stats->i_pcr_last = i_pcr;
+    p_stats->i_pcr_bytes = 0;
+}
+
+static void TSStatsReport( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    const ts_stats_t *p_stats = &p_sys->stats;
+
+    msg_Dbg( p_mux, "%"PRIu64" packets (%"PRIu64" null), %u windows over "
+             "the mux rate", p_stats->i_packets, p_stats->i_null_packets,
+             p_stats->i_overflows );
+    if( p_stats->i_pcrs > 1 )
+        msg_Dbg( p_mux, "%"PRIu64" PCRs, interval %"PRId64"/%"PRId64" us "
+                 "(%u over 40 ms), jitter up to %"PRId64" ns (%u over 500 ns)",
+                 p_stats->i_pcrs,
+                 p_stats->i_pcr_interval_sum / 27 /
+                     (int64_t)( p_stats->i_pcrs - 1 ),
+                 p_stats->i_pcr_interval_max / 27,
+                 p_stats->i_pcr_interval_errors,
+                 p_stats->i_pcr_jitter_max * 1000 / 27,
+                 p_stats->i_pcr_jitter_errors );
+
+    for( int i = 0; i < p_mux->i_nb_inputs; i++ )
+    {
+        const ts_stream_t *p_stream = p_mux->pp_inputs[i]->p_sys;
+        msg_Dbg( p_mux, "pid %d: decoder buffer %d bytes (peak %d), "
+                 "%u late packets", p_stream->i_pid, p_stream->i_buffer_level,
+                 p_stream->i_buffer_peak, p_stream->i_buffer_late );
+    }
+}
+
+/* Whether a PID carries program specific information */
+static bool TSIsPSI( const sout_mux_sys_t *p_sys, int i_pid )
+{
+    if( i_pid == 0 || i_pid == p_sys->sdt.i_pid )
+        return true;
+    for( unsigned i = 0; i < p_sys->i_num_pmt; i++ )
+        if( i_pid == p_sys->pmt[i].i_pid )
+            return true;
+    return false;
+}
+
+/* Writes a packet, gathered with the previous ones in *pp_out, or the
+ * pending gathered packets if p_ts is NULL */
+static void TSWrite( sout_mux_t *p_mux, block_t **pp_out, block_t *p_ts )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+
+    if( p_ts == NULL )
+    {
+        if( *pp_out != NULL )
+            sout_AccessOutWrite( p_mux->p_access, *pp_out );
+        *pp_out = NULL;
+        return;
+    }
+
+    int i_pid = ( ( p_ts->p_buffer[1] & 0x1f ) << 8 ) | p_ts->p_buffer[2];
+
+    if( p_sys->i_write_size <= 188 )
+    {
+        sout_AccessOutWrite( p_mux->p_access, p_ts );
+        return;
+    }
+
+    /* Gather the packets in contiguous blocks. A header packet starts a
+     * new block, so that the access output can still split on it, and a
+     * block never carries more than one PCR. A header block only holds the
+     * PSI packets following the header packet, as the access output may
+     * keep it for the new clients. */
+    block_t *p_out = *pp_out;
+    if( p_out != NULL &&
+        ( p_out->i_buffer + 188 > p_sys->i_write_size ||
+          ( p_ts->i_flags & BLOCK_FLAG_HEADER ) ||
+          ( ( p_out->i_flags & BLOCK_FLAG_HEADER ) &&
+            !TSIsPSI( p_sys, i_pid ) ) ||
+          ( p_ts->i_flags & p_out->i_flags & BLOCK_FLAG_CLOCK ) ) )
+    {
+        sout_AccessOutWrite( p_mux->p_access, p_out );
+        p_out = NULL;
+    }
+
+    if( p_out == NULL )
+    {
+        p_out = block_Alloc( p_sys->i_write_size );
+        if( p_out == NULL )
+        {
+            *pp_out = NULL;
+            sout_AccessOutWrite( p_mux->p_access, p_ts );
+            return;
+        }
+        p_out->i_buffer = 0;
+        p_out->i_flags  = p_ts->i_flags;
+        p_out->i_dts    = p_ts->i_dts;
+        p_out->i_pts    = p_ts->i_pts;
+        p_out->i_length = 0;
+    }
+
+    memcpy( &p_out->p_buffer[p_out->i_buffer], p_ts->p_buffer, 188 );
+    p_out->i_buffer += 188;
+    p_out->i_length += p_ts->i_length;
+    p_out->i_flags  |= p_ts->i_flags & BLOCK_FLAG_CLOCK;
+    block_Release( p_ts );
+    *pp_out = p_out;
+}
+
+/* Accounts for, scrambles and writes a dated packet. i_decode is the
+ * decoding date of the data it carries, if any. */
+static void TSEmit( sout_mux_t *p_mux, block_t **pp_out, block_t *p_ts,
+                    mtime_t i_decode )
+{
+    sout_mux_sys_t  *p_sys = p_mux->p_sys;
+    ts_stats_t      *p_stats = &p_sys->stats;
+    const uint8_t   *p = p_ts->p_buffer;
+    int i_pid = ( ( p[1] & 0x1f ) << 8 ) | p[2];
+
+    p_stats->i_packets++;
+    if( i_pid == 0x1fff )
+        p_stats->i_null_packets++;
+
+    if( p_ts->i_flags & BLOCK_FLAG_CLOCK )
+    {
+        int64_t i_base = ( (int64_t)p[6] << 25 ) | ( p[7] << 17 ) |
+                         ( p[8] << 9 ) | ( p[9] << 1 ) | ( p[10] >> 7 );
+        TSStatsPCR( p_stats, i_base * 300 + ( ( p[10] & 0x01 ) << 8 ) + p[11] );
+    }
+    p_stats->i_pcr_bytes += 188;
+
+    if( i_decode > VLC_TS_INVALID && ( p[3] & 0x10 ) )
+    {
+        int i_size = 184;
+        if( p[3] & 0x20 )
+            i_size -= p[4] + 1;
+        for( int i = 0; i < p_mux->i_nb_inputs; i++ )
+        {
+            ts_stream_t *p_stream = p_mux->pp_inputs[i]->p_sys;
+            if( p_stream->i_pid == i_pid )
+            {
+                TSStatsBuffer( p_stream, p_ts->i_dts,
+                               i_decode + p_sys->i_dts_delay, i_size );
+                break;
+            }
+        }
+    }
+
+    if( p_ts->i_dts >= p_stats->i_next_report )
+    {
+        if( p_stats->i_next_report > 0 )
+            TSStatsReport( p_mux );
+        p_stats->i_next_report = p_ts->i_dts + 10 * CLOCK_FREQ;
+    }
+
+    if( p_ts->i_flags & BLOCK_FLAG_SCRAMBLED )
+    {
+        vlc_mutex_lock( &p_sys->csa_lock );
+        csa_Encrypt( p_sys->csa, p_ts->p_buffer, p_sys->i_csa_pkt_size );
+        vlc_mutex_unlock( &p_sys->csa_lock );
+    }
+
+    /* latency */
+    p_ts->i_dts += p_sys->i_shaping_delay * 3 / 2;
+
+    TSWrite( p_mux, pp_out, p_ts );
+}
+
 static void TSSchedule( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
                         mtime_t i_pcr_length, mtime_t i_pcr_dts )
 {
@@ -1769,11 +2098,14 @@ static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
         i_pcr_length = i_packet_count;
     }
 
+    block_t *p_out = NULL;
+
     /* msg_Dbg( p_mux, "real pck=%d", i_packet_count ); */
     for (int i = 0; i < i_packet_count; i++ )
     {
         block_t *p_ts = BufferChainGet( p_chain_ts );
         mtime_t i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
+        mtime_t i_decode = p_ts->i_dts;
 
         p_ts->i_dts    = i_new_dts;
         p_ts->i_length = i_pcr_length / i_packet_count;
@@ -1781,20 +2113,156 @@ static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
         if( p_ts->i_flags & BLOCK_FLAG_CLOCK )
         {
             /* msg_Dbg( p_mux, "pcr=%lld ms", p_ts->i_dts / 1000 ); */
-            TSSetPCR( p_ts, p_ts->i_dts - p_sys->i_dts_delay );
+            TSSetPCR( p_ts, ( p_ts->i_dts - p_sys->i_dts_delay ) * 27 );
         }
-        if( p_ts->i_flags & BLOCK_FLAG_SCRAMBLED )
+
+        TSEmit( p_mux, &p_out, p_ts, i_decode );
+    }
+    TSWrite( p_mux, &p_out, NULL );
+}
+
+/*
+ * Constant bitrate output: the stream is cut into slots of one packet at
+ * the mux rate, counted from an origin. The packets of each window are
+ * spread over the slots of the window and the other slots get null
+ * packets, or a PCR when the last one is getting too old. PCRs are computed
+ * from the position of their last byte, so they are exact whatever the
+ * input looks like.
+ */
+#define CBR_PERIOD (INT64_C(188 * 8) * 27000000) /* mux_rate slots, 27 MHz */
+
+/* Date, in 27 MHz units, of the given byte of a slot */
+static int64_t TSSlotClock( const sout_mux_sys_t *p_sys, int64_t i_slot,
+                            int i_byte )
+{
+    return p_sys->i_cbr_origin +
+           ( i_slot * 188 + i_byte ) * 8 * INT64_C(27000000) / p_sys->i_mux_rate;
+}
+
+static block_t *TSNewNull( void )
+{
+    block_t *p_ts = block_Alloc( 188 );
+    if( p_ts == NULL )
+        return NULL;
+
+    p_ts->p_buffer[0] = 0x47;
+    p_ts->p_buffer[1] = 0x1f;
+    p_ts->p_buffer[2] = 0xff;
+    p_ts->p_buffer[3] = 0x10;
+    memset( &p_ts->p_buffer[4], 0xff, 184 );
+    return p_ts;
+}
+
+/* Adaptation field only packet carrying a PCR */
+static block_t *TSNewPCR( int i_pid, int i_continuity_counter )
+{
+    block_t *p_ts = block_Alloc( 188 );
+    if( p_ts == NULL )
+        return NULL;
+
+    p_ts->p_buffer[0] = 0x47;
+    p_ts->p_buffer[1] = ( i_pid >> 8 )&0x1f;
+    p_ts->p_buffer[2] = i_pid & 0xff;
+    /* the continuity counter is not incremented without payload */
+    p_ts->p_buffer[3] = 0x20 | i_continuity_counter;
+    p_ts->p_buffer[4] = 183;
+    p_ts->p_buffer[5] = 0x10;
+    p_ts->p_buffer[10] = 0x7e;
+    p_ts->p_buffer[11] = 0;
+    memset( &p_ts->p_buffer[12], 0xff, 188 - 12 );
+    p_ts->i_flags |= BLOCK_FLAG_CLOCK;
+    return p_ts;
+}
+
+static void TSDateCBR( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+                       mtime_t i_pcr_length, mtime_t i_pcr_dts )
+{
+    sout_mux_sys_t  *p_sys = p_mux->p_sys;
+    const int i_packet_count = p_chain_ts->i_depth;
+    const mtime_t i_end = i_pcr_dts + i_pcr_length;
+    block_t *p_out = NULL;
+
+    /* Keep the slot numbers small enough for TSSlotClock() */
+    if( p_sys->i_cbr_slot >= p_sys->i_mux_rate )
+    {
+        p_sys->i_cbr_origin += CBR_PERIOD;
+        p_sys->i_cbr_slot -= p_sys->i_mux_rate;
+    }
+
+    /* (Re)start the slots when the input goes too far away from them */
+    mtime_t i_slot_date = p_sys->i_cbr_slot < 0 ? 0 :
+                          TSSlotClock( p_sys, p_sys->i_cbr_slot, 0 ) / 27;
+    if( p_sys->i_cbr_slot < 0 ||
+        i_slot_date < i_pcr_dts - p_sys->i_shaping_delay ||
+        i_slot_date > i_end + p_sys->i_shaping_delay )
+    {
+        if( p_sys->i_cbr_slot >= 0 )
+            msg_Warn( p_mux, "constant bitrate clock reset (%"PRId64" us)",
+                      i_pcr_dts - i_slot_date );
+        p_sys->i_cbr_origin = i_pcr_dts * 27;
+        p_sys->i_cbr_slot = 0;
+    }
+
+    /* Slots before the end of the window */
+    int64_t i_slots = 0;
+    if( i_end * 27 > p_sys->i_cbr_origin )
+        i_slots = ( ( i_end * 27 - p_sys->i_cbr_origin ) * p_sys->i_mux_rate
+                    + CBR_PERIOD - 1 ) / CBR_PERIOD - p_sys->i_cbr_slot;
+    if( i_slots < i_packet_count )
+    {
+        if( p_sys->stats.i_overflows++ == 0 )
+            msg_Warn( p_mux, "mux rate exceeded (%d packets for %"PRId64
+                      " slots), the output is late", i_packet_count,
+                      __MAX( i_slots, 0 ) );
+        i_slots = i_packet_count;
+    }
+
+    if( p_sys->i_cbr_pcr_pid != p_sys->i_pcr_pid )
+    {
+        p_sys->i_cbr_pcr_pid = p_sys->i_pcr_pid;
+        p_sys->i_cbr_pcr_cc = -1;
+    }
+
+    const mtime_t i_slot_length = INT64_C(188 * 8 * 1000000) / p_sys->i_mux_rate;
+    for( int64_t i = 0, j = 0; i < i_slots; i++, p_sys->i_cbr_slot++ )
+    {
+        const mtime_t i_date = TSSlotClock( p_sys, p_sys->i_cbr_slot, 0 ) / 27;
+        mtime_t i_decode = VLC_TS_INVALID;
+        block_t *p_ts;
+
+        /* packet j goes in the first slot at or after j * i_slots / i_count */
+        if( j < i_packet_count && j * i_slots <= i * i_packet_count )
         {
-            vlc_mutex_lock( &p_sys->csa_lock );
-            csa_Encrypt( p_sys->csa, p_ts->p_buffer, p_sys->i_csa_pkt_size );
-            vlc_mutex_unlock( &p_sys->csa_lock );
+            p_ts = BufferChainGet( p_chain_ts );
+            i_decode = p_ts->i_dts;
+            j++;
         }
+        else if( p_sys->i_cbr_pcr_cc >= 0 &&
+                 i_date - p_sys->i_cbr_pcr_date >= p_sys->i_pcr_delay )
+            p_ts = TSNewPCR( p_sys->i_cbr_pcr_pid, p_sys->i_cbr_pcr_cc );
+        else
+            p_ts = TSNewNull();
+        if( p_ts == NULL )
+            continue;
 
-        /* latency */
-        p_ts->i_dts += p_sys->i_shaping_delay * 3 / 2;
+        p_ts->i_dts    = i_date;
+        p_ts->i_length = i_slot_length;
 
-        sout_AccessOutWrite( p_mux->p_access, p_ts );
+        int i_pid = ( ( p_ts->p_buffer[1] & 0x1f ) << 8 ) | p_ts->p_buffer[2];
+        if( i_pid == p_sys->i_cbr_pcr_pid && ( p_ts->p_buffer[3] & 0x10 ) )
+            p_sys->i_cbr_pcr_cc = p_ts->p_buffer[3] & 0x0f;
+
+        if( p_ts->i_flags & BLOCK_FLAG_CLOCK )
+        {
+            /* the PCR base ends in the 11th byte of the packet */
+            TSSetPCR( p_ts, TSSlotClock( p_sys, p_sys->i_cbr_slot, 11 )
+                            - p_sys->i_dts_delay * 27 );
+            p_sys->i_cbr_pcr_date = i_date;
+        }
+
+        TSEmit( p_mux, &p_out, p_ts, i_decode );
     }
+    TSWrite( p_mux, &p_out, NULL );
 }
 
 static block_t *TSNew( sout_mux_t *p_mux, ts_stream_t *p_stream,
@@ -1913,15 +2381,18 @@ static block_t *TSNew( sout_mux_t *p_mux, ts_stream_t *p_stream,
     return p_ts;
 }
 
-static void TSSetPCR( block_t *p_ts, mtime_t i_dts )
+/* Writes a PCR in 27 MHz units: 90 kHz base and 300 ticks extension */
+static void TSSetPCR( block_t *p_ts, int64_t i_pcr )
 {
-    mtime_t i_pcr = 9 * i_dts / 100;
-
-    p_ts->p_buffer[6]  = ( i_pcr >> 25 )&0xff;
-    p_ts->p_buffer[7]  = ( i_pcr >> 17 )&0xff;
-    p_ts->p_buffer[8]  = ( i_pcr >> 9  )&0xff;
-    p_ts->p_buffer[9]  = ( i_pcr >> 1  )&0xff;
-    p_ts->p_buffer[10]|= ( i_pcr << 7  )&0x80;
+    int64_t i_base = i_pcr / 300;
+    int     i_ext  = i_pcr % 300;
+
+    p_ts->p_buffer[6]  = ( i_base >> 25 )&0xff;
+    p_ts->p_buffer[7]  = ( i_base >> 17 )&0xff;
+    p_ts->p_buffer[8]  = ( i_base >> 9  )&0xff;
+    p_ts->p_buffer[9]  = ( i_base >> 1  )&0xff;
+    p_ts->p_buffer[10] = ( ( i_base << 7 )&0x80 ) | 0x7e | ( i_ext >> 8 );
+    p_ts->p_buffer[11] = i_ext & 0xff;
 }
 
 static void PEStoTS( sout_buffer_chain_t *c, block_t *p_pes,
@@ -2038,14 +2509,66 @@ error:
     return NULL;
 }
 
+/* Packetizes PSI sections once, for PSIInsert() to copy them later on */
+static block_t *PSIPacketize( block_t *p_sections, ts_stream_t *p_stream )
+{
+    sout_buffer_chain_t chain;
+    int i_continuity_counter = p_stream->i_continuity_counter;
+
+    if( p_sections == NULL )
+        return NULL;
+
+    BufferChainInit( &chain );
+    PEStoTS( &chain, p_sections, p_stream );
+    p_stream->i_continuity_counter = i_continuity_counter;
+
+    return chain.p_first;
+}
+
+static void PSIInsert( sout_buffer_chain_t *c, const block_t *p_psi,
+                       ts_stream_t *p_stream )
+{
+    for( ; p_psi != NULL; p_psi = p_psi->p_next )
+    {
+        block_t *p_ts = block_Alloc( 188 );
+        if( p_ts == NULL )
+            return;
+
+        memcpy( p_ts->p_buffer, p_psi->p_buffer, 188 );
+        p_ts->p_buffer[3] = ( p_ts->p_buffer[3] & 0xf0 ) |
+                            p_stream->i_continuity_counter;
+        p_stream->i_continuity_counter = (p_stream->i_continuity_counter+1)%16;
+
+        BufferChainAppend( c, p_ts );
+    }
+}
+
+/* Forgets the PMT and SDT packets, they will be regenerated on next use */
+static void FlushPMT( sout_mux_sys_t *p_sys )
+{
+    for( unsigned i = 0; i < p_sys->i_num_pmt; i++ )
+    {
+        block_ChainRelease( p_sys->p_pmt_ts[i] );
+        p_sys->p_pmt_ts[i] = NULL;
+    }
+    block_ChainRelease( p_sys->p_sdt_ts );
+    p_sys->p_sdt_ts = NULL;
+}
+
 static void GetPAT( sout_mux_t *p_mux,
                     sout_buffer_chain_t *c )
 {
     sout_mux_sys_t       *p_sys = p_mux->p_sys;
-    block_t              *p_pat;
     dvbpsi_pat_t         pat;
     dvbpsi_psi_section_t *p_section;
 
+    /* The PAT only depends on the settings */
+    if( p_sys->p_pat_ts != NULL )
+    {
+        PSIInsert( c, p_sys->p_pat_ts, &p_sys->pat );
+        return;
+    }
+
     dvbpsi_InitPAT( &pat, p_sys->i_tsid, p_sys->i_pat_version_number,
                     1 );      /* b_current_next */
     /* add all programs */
@@ -2058,9 +2581,9 @@ static void GetPAT( sout_mux_t *p_mux,
 #else
     p_section = dvbpsi_GenPATSections( &pat, 0 /* max program per section */ );
 #endif
-    p_pat = WritePSISection( p_section );
-
-    PEStoTS( c, p_pat, &p_sys->pat );
+    p_sys->p_pat_ts = PSIPacketize( WritePSISection( p_section ),
+                                    &p_sys->pat );
+    PSIInsert( c, p_sys->p_pat_ts, &p_sys->pat );
 
     dvbpsi_DeletePSISections( p_section );
     dvbpsi_EmptyPAT( &pat );
@@ -2211,7 +2734,7 @@ static void GetPMTmpeg4(sout_mux_t *p_mux)
     dvbpsi_PMTAddDescriptor(&p_sys->dvbpmt[0], 0x1d, bits.i_data, bits.p_data);
 }
 
-static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c )
+static void BuildPMT( sout_mux_t *p_mux )
 {
     sout_mux_sys_t *p_sys = p_mux->p_sys;
 
@@ -2406,8 +2929,8 @@ static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c )
 #else
         sect = dvbpsi_GenPMTSections( &p_sys->dvbpmt[i] );
 #endif
-        block_t *pmt = WritePSISection( sect );
-        PEStoTS( c, pmt, &p_sys->pmt[i] );
+        p_sys->p_pmt_ts[i] = PSIPacketize( WritePSISection( sect ),
+                                           &p_sys->pmt[i] );
         dvbpsi_DeletePSISections(sect);
         dvbpsi_EmptyPMT( &p_sys->dvbpmt[i] );
     }
@@ -2420,9 +2943,23 @@ static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c )
 #else
         sect = dvbpsi_GenSDTSections( &sdt );
 #endif
-        block_t *p_sdt = WritePSISection( sect );
-        PEStoTS( c, p_sdt, &p_sys->sdt );
+        p_sys->p_sdt_ts = PSIPacketize( WritePSISection( sect ),
+                                        &p_sys->sdt );
         dvbpsi_DeletePSISections( sect );
         dvbpsi_EmptySDT( &sdt );
     }
 }
+
+static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+
+    /* The PMT and SDT only change when an ES is added or removed */
+    if( p_sys->p_pmt_ts[0] == NULL )
+        BuildPMT( p_mux );
+
+    for (unsigned i = 0; i < p_sys->i_num_pmt; i++ )
+        PSIInsert( c, p_sys->p_pmt_ts[i], &p_sys->pmt[i] );
+    if( p_sys->b_sdt )
+        PSIInsert( c, p_sys->p_sdt_ts, &p_sys->sdt );
+}
@@ -128,7 +128,7 @@ static int Open( vlc_object_t *p_this )
     decoder_sys_t *p_sys;
 
     if( p_dec->fmt_in.i_codec != VLC_CODEC_FLAC )
-        return VLC_EGENERIC;
+        return VLC_ENOTSUP;
 
     /* */
     p_dec->p_sys = p_sys = malloc(sizeof(*p_sys));
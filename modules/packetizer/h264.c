@@ -190,10 +190,10 @@ static int Open( vlc_object_t *p_this )
     int i;
 
     if( p_dec->fmt_in.i_codec != VLC_CODEC_H264 )
-        return VLC_EGENERIC;
+        return VLC_ENOTSUP;
     if( p_dec->fmt_in.i_original_fourcc == VLC_FOURCC( 'a', 'v', 'c', '1') &&
         p_dec->fmt_in.i_extra < 7 )
-        return VLC_EGENERIC;
+        return VLC_ENOTSUP;
 
     /* Allocate the memory needed to store the decoder's structure */
     if( ( p_dec->p_sys = p_sys = malloc( sizeof(decoder_sys_t) ) ) == NULL )
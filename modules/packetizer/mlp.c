@@ -113,7 +113,7 @@ static int Open( vlc_object_t *p_this )
 
     if( p_dec->fmt_in.i_codec != VLC_CODEC_MLP &&
         p_dec->fmt_in.i_codec != VLC_CODEC_TRUEHD )
-        return VLC_EGENERIC;
+        return VLC_ENOTSUP;
 
     /* */
     p_dec->p_sys = p_sys = malloc( sizeof(*p_sys) );
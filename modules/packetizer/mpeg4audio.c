@@ -186,7 +186,7 @@ static int OpenPacketizer( vlc_object_t *p_this )
 
     if( p_dec->fmt_in.i_codec != VLC_CODEC_MP4A )
     {
-        return VLC_EGENERIC;
+        return VLC_ENOTSUP;
     }
 
     /* Allocate the memory needed to store the decoder's structure */
@@ -154,7 +154,7 @@ static int Open( vlc_object_t *p_this )
     decoder_sys_t *p_sys;
 
     if( p_dec->fmt_in.i_codec != VLC_CODEC_MPGV )
-        return VLC_EGENERIC;
+        return VLC_ENOTSUP;
 
     es_format_Init( &p_dec->fmt_out, VIDEO_ES, VLC_CODEC_MPGV );
     p_dec->fmt_out.i_original_fourcc = p_dec->fmt_in.i_original_fourcc;
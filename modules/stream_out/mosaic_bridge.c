@@ -381,6 +381,7 @@ static sout_stream_id_t * Add( sout_stream_t *p_stream, es_format_t *p_fmt )
     p_es->p_picture = NULL;
     p_es->pp_last = &p_es->p_picture;
     p_es->b_empty = false;
+    p_es->i_pushed = 0;
 
     vlc_global_unlock( VLC_MOSAIC_MUTEX );
 
@@ -506,6 +507,7 @@ static void PushPicture( sout_stream_t *p_stream, picture_t *p_picture )
     *p_es->pp_last = p_picture;
     p_picture->p_next = NULL;
     p_es->pp_last = &p_picture->p_next;
+    p_es->i_pushed++;
 
     vlc_global_unlock( VLC_MOSAIC_MUTEX );
 }
@@ -522,6 +524,11 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_t *id,
         return VLC_SUCCESS;
     }
 
+    /* The decoder may modify its input in place */
+    p_buffer = block_Unshare( p_buffer );
+    if( unlikely(p_buffer == NULL) )
+        return VLC_ENOMEM;
+
     while ( (p_pic = p_sys->p_decoder->pf_decode_video( p_sys->p_decoder,
                                                         &p_buffer )) )
     {
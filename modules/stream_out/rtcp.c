@@ -206,10 +206,14 @@ void SendRTCP (rtcp_sender_t *restrict rtcp, const block_t *rtp)
      || (rtp->i_buffer < 12)) /* too short RTP packet */
         return;
 
-    /* Updates statistics */
+    /* Updates statistics (the payload may follow in other blocks) */
+    size_t len = 0;
+    for (const block_t *b = rtp; b != NULL; b = b->p_next)
+        len += b->i_buffer;
+
     rtcp->packets++;
-    rtcp->bytes += rtp->i_buffer;
-    rtcp->counter += rtp->i_buffer;
+    rtcp->bytes += len;
+    rtcp->counter += len;
 
     /* 1.25% rate limit */
     if ((rtcp->counter / 80) < rtcp->length)
@@ -1394,54 +1394,190 @@ static int  HttpCallback( httpd_file_sys_t *p_args,
 /****************************************************************************
  * RTP send
  ****************************************************************************/
-static void* ThreadSend( void *data )
+/* Maximum number of packets handed to the kernel at once */
+#define RTP_BATCH 32
+
+/**
+ * A packet made of several blocks (headers and payload slices). The FIFO
+ * would queue each block of a chain as a separate entry, so such a packet
+ * is queued as a single block wrapping the chain.
+ */
+typedef struct
+{
+    block_t  self;
+    block_t *chain;
+} rtp_packet_t;
+
+static void rtp_packet_Release( block_t *block )
+{
+    rtp_packet_t *pkt = (rtp_packet_t *)block;
+
+    block_ChainRelease( pkt->chain );
+    free( pkt );
+}
+
+/** Returns the blocks of a packet dequeued from the FIFO */
+static block_t *rtp_packet_Unwrap( block_t *block )
+{
+    if( block == NULL || block->pf_release != rtp_packet_Release )
+        return block;
+
+    rtp_packet_t *pkt = (rtp_packet_t *)block;
+    block_t *chain = pkt->chain;
+
+    free( pkt );
+    return chain;
+}
+
+/** Makes a packet ready to be sent, or returns NULL to drop it */
+static block_t *rtp_prepare( sout_stream_id_t *id, block_t *out )
+{
+#ifdef _WIN32
+    /* No scatter-gather send */
+    out = block_ChainGather( out );
+#endif
+#ifdef HAVE_SRTP
+    if( id->srtp )
+    {   /* FIXME: this is awfully inefficient */
+        out = block_ChainGather( out );
+
+        size_t len = out->i_buffer;
+        out = block_Realloc( out, 0, len + 10 );
+        out->i_buffer = len;
+
+        int canc = vlc_savecancel ();
+        int val = srtp_send( id->srtp, out->p_buffer, &len, len + 10 );
+        vlc_restorecancel (canc);
+        if( val )
+        {
+            errno = val;
+            msg_Dbg( id->p_stream, "SRTP sending error: %m" );
+            block_Release( out );
+            out = NULL;
+        }
+        else
+            out->i_buffer = len;
+    }
+#else
+    (void) id;
+#endif
+    return out;
+}
+
+/** Sends some packets on a socket, returns how many were sent, or -1 */
+static int rtp_sendmsgs( int fd, struct msghdr *msgv, unsigned msgc )
+{
+#if defined (_WIN32)
+    (void) msgc;
+    return send( fd, msgv->msg_iov->iov_base, msgv->msg_iov->iov_len, 0 )
+           == -1 ? -1 : 1;
+#elif defined (HAVE_SENDMMSG)
+    struct mmsghdr mmsgv[msgc];
+
+    for( unsigned i = 0; i < msgc; i++ )
+    {
+        mmsgv[i].msg_hdr = msgv[i];
+        mmsgv[i].msg_len = 0;
+    }
+    return sendmmsg( fd, mmsgv, msgc, 0 );
+#else
+    (void) msgc;
+    return sendmsg( fd, msgv, 0 ) == -1 ? -1 : 1;
+#endif
+}
+
+/** Sends packets to a sink, returns false if the sink is broken */
+static bool rtp_send( int fd, struct msghdr *msgv, unsigned msgc )
 {
 #ifdef _WIN32
 # define ENOBUFS      WSAENOBUFS
 # define EAGAIN       WSAEWOULDBLOCK
 # define EWOULDBLOCK  WSAEWOULDBLOCK
 #endif
+    for( unsigned i = 0; i < msgc; )
+    {
+        int val = rtp_sendmsgs( fd, msgv + i, msgc - i );
+        if( val > 0 )
+        {
+            i += val;
+            continue;
+        }
+
+        if( net_errno != EAGAIN && net_errno != EWOULDBLOCK
+         && net_errno != ENOBUFS && net_errno != ENOMEM )
+        {
+            int type;
+            getsockopt( fd, SOL_SOCKET, SO_TYPE,
+                        &type, &(socklen_t){ sizeof(type) });
+            if( type != SOCK_DGRAM )
+                return false; /* Broken connection */
+            /* ICMP soft error: ignore and retry */
+            rtp_sendmsgs( fd, msgv + i, 1 );
+        }
+        i++; /* the packet is lost */
+    }
+    return true;
+}
+
+/**
+ * Sends the packets at their date. The packets that are due at once are
+ * sent together: a single system call per sink handles all of them, and
+ * their payload, split across blocks by the packetizers, is not gathered.
+ */
+static void* ThreadSend( void *data )
+{
     sout_stream_id_t *id = data;
     unsigned i_caching = id->i_caching;
 
     for (;;)
     {
+        block_t *outv[RTP_BATCH];
+        unsigned outc = 0;
+
         block_t *out = block_FifoGet( id->p_fifo );
         block_cleanup_push (out);
-
-#ifdef HAVE_SRTP
-        if( id->srtp )
-        {   /* FIXME: this is awfully inefficient */
-            size_t len = out->i_buffer;
-            out = block_Realloc( out, 0, len + 10 );
-            out->i_buffer = len;
-
-            int canc = vlc_savecancel ();
-            int val = srtp_send( id->srtp, out->p_buffer, &len, len + 10 );
-            vlc_restorecancel (canc);
-            if( val )
-            {
-                errno = val;
-                msg_Dbg( id->p_stream, "SRTP sending error: %m" );
-                block_Release( out );
-                out = NULL;
-            }
-            else
-                out->i_buffer = len;
-        }
+        out = rtp_prepare( id, rtp_packet_Unwrap( out ) );
         if (out)
             mwait (out->i_dts + i_caching);
         vlc_cleanup_pop ();
         if (out == NULL)
             continue;
-#else
-        mwait (out->i_dts + i_caching);
-        vlc_cleanup_pop ();
-#endif
 
-        ssize_t len = out->i_buffer;
         int canc = vlc_savecancel ();
 
+        outv[outc++] = out;
+        while( outc < RTP_BATCH && block_FifoCount( id->p_fifo ) > 0
+            && block_FifoShow( id->p_fifo )->i_dts + i_caching <= mdate() )
+        {
+            out = rtp_prepare( id, rtp_packet_Unwrap(
+                                       block_FifoGet( id->p_fifo ) ) );
+            if( out != NULL )
+                outv[outc++] = out;
+        }
+
+        /* One message per packet, one buffer per block */
+        unsigned iovc = 0;
+        for( unsigned i = 0; i < outc; i++ )
+            for( block_t *b = outv[i]; b != NULL; b = b->p_next )
+                iovc++;
+
+        struct iovec iov[iovc];
+        struct msghdr msgv[outc];
+
+        iovc = 0;
+        for( unsigned i = 0; i < outc; i++ )
+        {
+            memset( &msgv[i], 0, sizeof (msgv[i]) );
+            msgv[i].msg_iov = iov + iovc;
+            for( block_t *b = outv[i]; b != NULL; b = b->p_next )
+            {
+                iov[iovc].iov_base = b->p_buffer;
+                iov[iovc].iov_len = b->i_buffer;
+                iovc++;
+            }
+            msgv[i].msg_iovlen = iov + iovc - msgv[i].msg_iov;
+        }
+
         vlc_mutex_lock( &id->lock_sink );
         unsigned deadc = 0; /* How many dead sockets? */
         int deadv[id->sinkc]; /* Dead sockets list */
@@ -1451,26 +1587,17 @@ static void* ThreadSend( void *data )
 #ifdef HAVE_SRTP
             if( !id->srtp ) /* FIXME: SRTCP support */
 #endif
-                SendRTCP( id->sinkv[i].rtcp, out );
+                for( unsigned j = 0; j < outc; j++ )
+                    SendRTCP( id->sinkv[i].rtcp, outv[j] );
 
-            if( send( id->sinkv[i].rtp_fd, out->p_buffer, len, 0 ) == -1
-             && net_errno != EAGAIN && net_errno != EWOULDBLOCK
-             && net_errno != ENOBUFS && net_errno != ENOMEM )
-            {
-                int type;
-                getsockopt( id->sinkv[i].rtp_fd, SOL_SOCKET, SO_TYPE,
-                            &type, &(socklen_t){ sizeof(type) });
-                if( type == SOCK_DGRAM )
-                    /* ICMP soft error: ignore and retry */
-                    send( id->sinkv[i].rtp_fd, out->p_buffer, len, 0 );
-                else
-                    /* Broken connection */
-                    deadv[deadc++] = id->sinkv[i].rtp_fd;
-            }
+            if( !rtp_send( id->sinkv[i].rtp_fd, msgv, outc ) )
+                deadv[deadc++] = id->sinkv[i].rtp_fd;
         }
-        id->i_seq_sent_next = ntohs(((uint16_t *) out->p_buffer)[1]) + 1;
+        id->i_seq_sent_next = ntohs(((uint16_t *) outv[outc - 1]->p_buffer)[1]) + 1;
         vlc_mutex_unlock( &id->lock_sink );
-        block_Release( out );
+
+        for( unsigned i = 0; i < outc; i++ )
+            block_ChainRelease( outv[i] );
 
         for( unsigned i = 0; i < deadc; i++ )
         {
@@ -1657,9 +1784,56 @@ void rtp_packetize_common( sout_stream_id_t *id, block_t *out,
 
 void rtp_packetize_send( sout_stream_id_t *id, block_t *out )
 {
+    if( out->p_next != NULL )
+    {
+        rtp_packet_t *pkt = malloc( sizeof (*pkt) );
+        if( unlikely(pkt == NULL) )
+        {
+            block_ChainRelease( out );
+            return;
+        }
+
+        /* The wrapper exposes the RTP header and the dates of the packet */
+        block_Init( &pkt->self, out->p_buffer, out->i_buffer );
+        block_CopyProperties( &pkt->self, out );
+        pkt->self.pf_release = rtp_packet_Release;
+        pkt->chain = out;
+        out = &pkt->self;
+    }
     block_FifoPut( id->p_fifo, out );
 }
 
+/**
+ * Allocates an RTP packet with room for i_header bytes of headers (RTP
+ * header included), followed by i_data bytes of payload from p_data, inside
+ * the buffer of the input block. The payload is not copied: it is
+ * referenced by a second block, chained to the headers.
+ * @return the headers block, or NULL on error
+ */
+block_t *rtp_packetize_new( block_t *in, size_t i_header,
+                            const uint8_t *p_data, size_t i_data )
+{
+    assert( p_data >= in->p_buffer
+         && p_data + i_data <= in->p_buffer + in->i_buffer );
+
+    block_t *out = block_Alloc( i_header );
+    block_t *payload = block_Clone( in );
+    if( unlikely(out == NULL || payload == NULL) )
+    {
+        if( out != NULL )
+            block_Release( out );
+        if( payload != NULL )
+            block_Release( payload );
+        return NULL;
+    }
+
+    payload->p_buffer = (uint8_t *)p_data;
+    payload->i_buffer = i_data;
+    payload->i_flags = 0;
+    out->p_next = payload;
+    return out;
+}
+
 /**
  * @return configured max RTP payload size (including payload type-specific
  * headers, excluding RTP and transport headers)
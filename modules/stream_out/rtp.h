@@ -57,6 +57,8 @@ int64_t rtp_get_ts( const sout_stream_t *p_stream, const sout_stream_id_t *id,
 void rtp_packetize_common (sout_stream_id_t *id, block_t *out,
                            int b_marker, int64_t i_pts);
 void rtp_packetize_send (sout_stream_id_t *id, block_t *out);
+block_t *rtp_packetize_new (block_t *in, size_t i_header,
+                            const uint8_t *p_data, size_t i_data);
 size_t rtp_mtu (const sout_stream_id_t *id);
 
 int rtp_packetize_xiph_config( sout_stream_id_t *id, const char *fmtp,
@@ -523,7 +523,7 @@ int rtp_get_fmt( vlc_object_t *obj, es_format_t *p_fmt, const char *mux,
 
 
 static int
-rtp_packetize_h264_nal( sout_stream_id_t *id,
+rtp_packetize_h264_nal( sout_stream_id_t *id, block_t *in,
                         const uint8_t *p_data, int i_data, int64_t i_pts,
                         int64_t i_dts, bool b_last, int64_t i_length );
 
@@ -672,7 +672,9 @@ static int rtp_packetize_mpa( sout_stream_id_t *id, block_t *in )
     for( i = 0; i < i_count; i++ )
     {
         int           i_payload = __MIN( i_max, i_data );
-        block_t *out = block_Alloc( 16 + i_payload );
+        block_t *out = rtp_packetize_new( in, 16, p_data, i_payload );
+        if( out == NULL )
+            return VLC_ENOMEM;
 
         /* rtp common header */
         rtp_packetize_common( id, out, (i == i_count - 1)?1:0, in->i_pts );
@@ -680,9 +682,8 @@ static int rtp_packetize_mpa( sout_stream_id_t *id, block_t *in )
         SetWBE( out->p_buffer + 12, 0 );
         /* fragment offset in the current frame */
         SetWBE( out->p_buffer + 14, i * i_max );
-        memcpy( &out->p_buffer[16], p_data, i_payload );
 
-        out->i_buffer   = 16 + i_payload;
+        out->i_buffer   = 16;
         out->i_dts    = in->i_dts + i * in->i_length / i_count;
         out->i_length = in->i_length / i_count;
 
@@ -764,7 +765,9 @@ static int rtp_packetize_mpv( sout_stream_id_t *id, block_t *in )
     for( i = 0; i < i_count; i++ )
     {
         int           i_payload = __MIN( i_max, i_data );
-        block_t *out = block_Alloc( 16 + i_payload );
+        block_t *out = rtp_packetize_new( in, 16, p_data, i_payload );
+        if( out == NULL )
+            return VLC_ENOMEM;
         /* MBZ:5 T:1 TR:10 AN:1 N:1 S:1 B:1 E:1 P:3 FBV:1 BFC:3 FFV:1 FFC:3 */
         uint32_t      h = ( i_temporal_ref << 16 )|
                           ( b_sequence_start << 13 )|
@@ -779,9 +782,7 @@ static int rtp_packetize_mpv( sout_stream_id_t *id, block_t *in )
 
         SetDWBE( out->p_buffer + 12, h );
 
-        memcpy( &out->p_buffer[16], p_data, i_payload );
-
-        out->i_buffer   = 16 + i_payload;
+        out->i_buffer   = 16;
         out->i_dts    = in->i_dts + i * in->i_length / i_count;
         out->i_length = in->i_length / i_count;
 
@@ -806,7 +807,9 @@ static int rtp_packetize_ac3( sout_stream_id_t *id, block_t *in )
     for( i = 0; i < i_count; i++ )
     {
         int           i_payload = __MIN( i_max, i_data );
-        block_t *out = block_Alloc( 14 + i_payload );
+        block_t *out = rtp_packetize_new( in, 14, p_data, i_payload );
+        if( out == NULL )
+            return VLC_ENOMEM;
 
         /* rtp common header */
         rtp_packetize_common( id, out, (i == i_count - 1)?1:0, in->i_pts );
@@ -814,10 +817,8 @@ static int rtp_packetize_ac3( sout_stream_id_t *id, block_t *in )
         out->p_buffer[12] = 1;
         /* unit header */
         out->p_buffer[13] = 0x00;
-        /* data */
-        memcpy( &out->p_buffer[14], p_data, i_payload );
 
-        out->i_buffer   = 14 + i_payload;
+        out->i_buffer   = 14;
         out->i_dts    = in->i_dts + i * in->i_length / i_count;
         out->i_length = in->i_length / i_count;
 
@@ -842,14 +843,14 @@ static int rtp_packetize_split( sout_stream_id_t *id, block_t *in )
     for( i = 0; i < i_count; i++ )
     {
         int           i_payload = __MIN( i_max, i_data );
-        block_t *out = block_Alloc( 12 + i_payload );
+        block_t *out = rtp_packetize_new( in, 12, p_data, i_payload );
+        if( out == NULL )
+            return VLC_ENOMEM;
 
         /* rtp common header */
         rtp_packetize_common( id, out, (i == i_count - 1),
                       (in->i_pts > VLC_TS_INVALID ? in->i_pts : in->i_dts) );
-        memcpy( &out->p_buffer[12], p_data, i_payload );
 
-        out->i_buffer   = 12 + i_payload;
         out->i_dts    = in->i_dts + i * in->i_length / i_count;
         out->i_length = in->i_length / i_count;
 
@@ -960,7 +961,9 @@ static int rtp_packetize_mp4a( sout_stream_id_t *id, block_t *in )
     for( i = 0; i < i_count; i++ )
     {
         int           i_payload = __MIN( i_max, i_data );
-        block_t *out = block_Alloc( 16 + i_payload );
+        block_t *out = rtp_packetize_new( in, 16, p_data, i_payload );
+        if( out == NULL )
+            return VLC_ENOMEM;
 
         /* rtp common header */
         rtp_packetize_common( id, out, ((i == i_count - 1)?1:0),
@@ -972,9 +975,7 @@ static int rtp_packetize_mp4a( sout_stream_id_t *id, block_t *in )
         /* for each AU length 13 bits + idx 3bits, */
         SetWBE( out->p_buffer + 14, (in->i_buffer << 3) | 0 );
 
-        memcpy( &out->p_buffer[16], p_data, i_payload );
-
-        out->i_buffer   = 16 + i_payload;
+        out->i_buffer   = 16;
         out->i_dts    = in->i_dts + i * in->i_length / i_count;
         out->i_length = in->i_length / i_count;
 
@@ -1020,7 +1021,10 @@ static int rtp_packetize_h263( sout_stream_id_t *id, block_t *in )
     for( i = 0; i < i_count; i++ )
     {
         int      i_payload = __MIN( i_max, i_data );
-        block_t *out = block_Alloc( RTP_H263_PAYLOAD_START + i_payload );
+        block_t *out = rtp_packetize_new( in, RTP_H263_PAYLOAD_START,
+                                          p_data, i_payload );
+        if( out == NULL )
+            return VLC_ENOMEM;
         b_p_bit = (i == 0) ? 1 : 0;
         h = ( b_p_bit << 10 )|
             ( b_v_bit << 9  )|
@@ -1034,9 +1038,8 @@ static int rtp_packetize_h263( sout_stream_id_t *id, block_t *in )
 
         /* h263 header */
         SetWBE( out->p_buffer + 12, h );
-        memcpy( &out->p_buffer[RTP_H263_PAYLOAD_START], p_data, i_payload );
 
-        out->i_buffer = RTP_H263_PAYLOAD_START + i_payload;
+        out->i_buffer = RTP_H263_PAYLOAD_START;
         out->i_dts    = in->i_dts + i * in->i_length / i_count;
         out->i_length = in->i_length / i_count;
 
@@ -1051,7 +1054,7 @@ static int rtp_packetize_h263( sout_stream_id_t *id, block_t *in )
 
 /* rfc3984 */
 static int
-rtp_packetize_h264_nal( sout_stream_id_t *id,
+rtp_packetize_h264_nal( sout_stream_id_t *id, block_t *in,
                         const uint8_t *p_data, int i_data, int64_t i_pts,
                         int64_t i_dts, bool b_last, int64_t i_length )
 {
@@ -1073,15 +1076,14 @@ rtp_packetize_h264_nal( sout_stream_id_t *id,
     if( i_data <= i_max )
     {
         /* Single NAL unit packet */
-        block_t *out = block_Alloc( 12 + i_data );
+        block_t *out = rtp_packetize_new( in, 12, p_data, i_data );
+        if( out == NULL )
+            return VLC_ENOMEM;
         out->i_dts    = i_dts;
         out->i_length = i_length;
 
         /* */
         rtp_packetize_common( id, out, b_last, i_pts );
-        out->i_buffer = 12 + i_data;
-
-        memcpy( &out->p_buffer[12], p_data, i_data );
 
         rtp_packetize_send( id, out );
     }
@@ -1097,20 +1099,21 @@ rtp_packetize_h264_nal( sout_stream_id_t *id,
         for( i = 0; i < i_count; i++ )
         {
             const int i_payload = __MIN( i_data, i_max-2 );
-            block_t *out = block_Alloc( 12 + 2 + i_payload );
+            block_t *out = rtp_packetize_new( in, 14, p_data, i_payload );
+            if( out == NULL )
+                return VLC_ENOMEM;
             out->i_dts    = i_dts + i * i_length / i_count;
             out->i_length = i_length / i_count;
 
             /* */
             rtp_packetize_common( id, out, (b_last && i_payload == i_data),
                                     i_pts );
-            out->i_buffer = 14 + i_payload;
+            out->i_buffer = 14;
 
             /* FU indicator */
             out->p_buffer[12] = 0x00 | (i_nal_hdr & 0x60) | 28;
             /* FU header */
             out->p_buffer[13] = ( i == 0 ? 0x80 : 0x00 ) | ( (i == i_count-1) ? 0x40 : 0x00 )  | i_nal_type;
-            memcpy( &out->p_buffer[14], p_data, i_payload );
 
             rtp_packetize_send( id, out );
 
@@ -1151,7 +1154,7 @@ static int rtp_packetize_h264( sout_stream_id_t *id, block_t *in )
             }
         }
         /* TODO add STAP-A to remove a lot of overhead with small slice/sei/... */
-        rtp_packetize_h264_nal( id, p_buffer, i_size,
+        rtp_packetize_h264_nal( id, in, p_buffer, i_size,
                 (in->i_pts > VLC_TS_INVALID ? in->i_pts : in->i_dts), in->i_dts,
                 (i_size >= i_buffer), in->i_length * i_size / in->i_buffer );
 
@@ -72,6 +72,16 @@ static block_t *audio_new_buffer( decoder_t *p_dec, int i_samples )
     return p_block;
 }
 
+static void DecodeStage( void *, void * );
+static void FilterStage( void *, void * );
+static void EncodeStage( void *, void * );
+static void PoolTask( void *, void * );
+
+static void ReleaseBlock( void *p_block )
+{
+    block_Release( p_block );
+}
+
 int transcode_audio_new( sout_stream_t *p_stream,
                                 sout_stream_id_t *id )
 {
@@ -170,11 +180,47 @@ int transcode_audio_new( sout_stream_t *p_stream,
         return VLC_EGENERIC;
     }
 
+    if( p_sys->p_audio_pool != NULL )
+    {
+        if( transcode_pipeline_pool( p_stream, id, p_sys->p_audio_pool,
+                                     PoolTask, ReleaseBlock ) )
+        {
+            aout_FiltersDelete( (vlc_object_t *)NULL, id->p_af_chain );
+            id->p_af_chain = NULL;
+            module_unneed( id->p_encoder, id->p_encoder->p_module );
+            id->p_encoder->p_module = NULL;
+            module_unneed( id->p_decoder, id->p_decoder->p_module );
+            id->p_decoder->p_module = NULL;
+            return VLC_EGENERIC;
+        }
+    }
+    else if( p_sys->i_threads >= 1 )
+    {
+        static const transcode_stage_run_t pf_run[STAGE_COUNT] =
+            { DecodeStage, FilterStage, EncodeStage };
+        static const transcode_stage_release_t pf_release[STAGE_COUNT] =
+            { ReleaseBlock, ReleaseBlock, ReleaseBlock };
+
+        if( transcode_pipeline_start( p_stream, id, pf_run, pf_release ) )
+        {
+            aout_FiltersDelete( (vlc_object_t *)NULL, id->p_af_chain );
+            id->p_af_chain = NULL;
+            module_unneed( id->p_encoder, id->p_encoder->p_module );
+            id->p_encoder->p_module = NULL;
+            module_unneed( id->p_decoder, id->p_decoder->p_module );
+            id->p_decoder->p_module = NULL;
+            return VLC_EGENERIC;
+        }
+    }
+
     return VLC_SUCCESS;
 }
 
 void transcode_audio_close( sout_stream_id_t *id )
 {
+    /* Stop the threads first, they use everything below */
+    transcode_pipeline_stop( id );
+
     /* Close decoder */
     if( id->p_decoder->p_module )
         module_unneed( id->p_decoder, id->p_decoder->p_module );
@@ -194,16 +240,121 @@ void transcode_audio_close( sout_stream_id_t *id )
         aout_FiltersDelete( (vlc_object_t *)NULL, id->p_af_chain );
 }
 
+/* Keeps in sync with the master clock and runs the audio filters */
+static block_t *transcode_audio_filter( sout_stream_t *p_stream,
+                                        sout_stream_id_t *id,
+                                        block_t *p_audio_buf )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    if( p_sys->b_master_sync )
+    {
+        mtime_t i_pts = date_Get( &id->interpolated_pts ) + 1;
+        mtime_t i_drift = p_audio_buf->i_pts - i_pts;
+        if (i_drift > MASTER_SYNC_MAX_DRIFT || i_drift < -MASTER_SYNC_MAX_DRIFT)
+        {
+            msg_Dbg( p_stream,
+                "drift is too high (%"PRId64"), resetting master sync",
+                i_drift );
+            date_Set( &id->interpolated_pts, p_audio_buf->i_pts );
+            i_pts = p_audio_buf->i_pts + 1;
+        }
+        /* Several audio streams may run at once on the pool: only the
+         * first one is the master clock */
+        if( id->b_drift_source )
+            atomic_store( &p_sys->i_master_drift,
+                          p_audio_buf->i_pts - i_pts );
+        date_Increment( &id->interpolated_pts, p_audio_buf->i_nb_samples );
+        p_audio_buf->i_pts = i_pts;
+    }
+
+    p_audio_buf->i_dts = p_audio_buf->i_pts;
+
+    /* Run filter chain */
+    p_audio_buf = aout_FiltersPlay( id->p_af_chain, p_audio_buf,
+                                    INPUT_RATE_DEFAULT );
+    if( !p_audio_buf )
+        abort();
+
+    p_audio_buf->i_dts = p_audio_buf->i_pts;
+    return p_audio_buf;
+}
+
+/* Decodes, filters and encodes one input block */
+static block_t *transcode_audio_run( sout_stream_t *p_stream,
+                                     sout_stream_id_t *id, block_t *in )
+{
+    block_t *p_out = NULL, *p_audio_buf;
+
+    while( (p_audio_buf = id->p_decoder->pf_decode_audio( id->p_decoder,
+                                                          &in )) )
+    {
+        p_audio_buf = transcode_audio_filter( p_stream, id, p_audio_buf );
+
+        block_ChainAppend( &p_out,
+            id->p_encoder->pf_encode_audio( id->p_encoder, p_audio_buf ) );
+        block_Release( p_audio_buf );
+    }
+    return p_out;
+}
+
+/*****************************************************************************
+ * Pipeline stages (threads > 0)
+ *****************************************************************************/
+static void DecodeStage( void *data, void *item )
+{
+    sout_stream_id_t *id = data;
+    block_t *p_block = item, *p_audio_buf;
+
+    while( (p_audio_buf = id->p_decoder->pf_decode_audio( id->p_decoder,
+                                                          &p_block )) )
+        transcode_stage_push( &id->stages[STAGE_FILTER], p_audio_buf );
+}
+
+static void FilterStage( void *data, void *item )
+{
+    sout_stream_id_t *id = data;
+
+    transcode_stage_push( &id->stages[STAGE_ENCODE],
+                          transcode_audio_filter( id->p_stream, id, item ) );
+}
+
+static void EncodeStage( void *data, void *item )
+{
+    sout_stream_id_t *id = data;
+    block_t *p_audio_buf = item;
+
+    transcode_pipeline_output( id,
+        id->p_encoder->pf_encode_audio( id->p_encoder, p_audio_buf ) );
+    block_Release( p_audio_buf );
+}
+
+/*****************************************************************************
+ * Worker pool task (audio-threads > 0)
+ *****************************************************************************/
+static void PoolTask( void *data, void *item )
+{
+    sout_stream_id_t *id = data;
+
+    transcode_pipeline_output( id,
+                               transcode_audio_run( id->p_stream, id, item ) );
+}
+
 int transcode_audio_process( sout_stream_t *p_stream,
                                     sout_stream_id_t *id,
                                     block_t *in, block_t **out )
 {
-    sout_stream_sys_t *p_sys = p_stream->p_sys;
-    block_t *p_block, *p_audio_buf;
     *out = NULL;
 
     if( unlikely( in == NULL ) )
     {
+        /* Once the threads are idle, the encoder can be flushed from here */
+        if( id->b_pipeline )
+        {
+            transcode_pipeline_drain( id );
+            *out = transcode_pipeline_collect( id );
+        }
+
         block_t *p_block;
         do {
            p_block = id->p_encoder->pf_encode_audio(id->p_encoder, NULL );
@@ -212,42 +363,18 @@ int transcode_audio_process( sout_stream_t *p_stream,
         return VLC_SUCCESS;
     }
 
-    while( (p_audio_buf = id->p_decoder->pf_decode_audio( id->p_decoder,
-                                                          &in )) )
+    if( id->b_pipeline )
     {
-        if( p_sys->b_master_sync )
-        {
-            mtime_t i_pts = date_Get( &id->interpolated_pts ) + 1;
-            mtime_t i_drift = p_audio_buf->i_pts - i_pts;
-            if (i_drift > MASTER_SYNC_MAX_DRIFT || i_drift < -MASTER_SYNC_MAX_DRIFT)
-            {
-                msg_Dbg( p_stream,
-                    "drift is too high (%"PRId64"), resetting master sync",
-                    i_drift );
-                date_Set( &id->interpolated_pts, p_audio_buf->i_pts );
-                i_pts = p_audio_buf->i_pts + 1;
-            }
-            p_sys->i_master_drift = p_audio_buf->i_pts - i_pts;
-            date_Increment( &id->interpolated_pts, p_audio_buf->i_nb_samples );
-            p_audio_buf->i_pts = i_pts;
-        }
-
-        p_audio_buf->i_dts = p_audio_buf->i_pts;
-
-        /* Run filter chain */
-        p_audio_buf = aout_FiltersPlay( id->p_af_chain, p_audio_buf,
-                                        INPUT_RATE_DEFAULT );
-        if( !p_audio_buf )
-            abort();
-
-        p_audio_buf->i_dts = p_audio_buf->i_pts;
-
-        p_block = id->p_encoder->pf_encode_audio( id->p_encoder, p_audio_buf );
-
-        block_ChainAppend( out, p_block );
-        block_Release( p_audio_buf );
+        /* This waits if the workers are too far behind */
+        if( id->b_pooled )
+            transcode_task_push( &id->task, in );
+        else
+            transcode_stage_push( &id->stages[STAGE_DECODE], in );
+        *out = transcode_pipeline_collect( id );
+        return VLC_SUCCESS;
     }
 
+    *out = transcode_audio_run( p_stream, id, in );
     return VLC_SUCCESS;
 }
 
@@ -295,7 +422,7 @@ bool transcode_audio_add( sout_stream_t *p_stream, es_format_t *p_fmt,
     }
 
     /* Open output stream */
-    id->id = sout_StreamIdAdd( p_stream->p_next, &id->p_encoder->fmt_out );
+    id->id = transcode_output_add( p_stream, &id->p_encoder->fmt_out );
     id->b_transcode = true;
 
     if( !id->id )
@@ -305,6 +432,11 @@ bool transcode_audio_add( sout_stream_t *p_stream, es_format_t *p_fmt,
     }
 
     date_Init( &id->interpolated_pts, p_fmt->audio.i_rate, 1 );
+    if( p_sys->p_drift_source == NULL )
+    {
+        p_sys->p_drift_source = id;
+        id->b_drift_source = true;
+    }
 
     return true;
 }
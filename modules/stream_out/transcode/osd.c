@@ -69,7 +69,7 @@ int transcode_osd_new( sout_stream_t *p_stream, sout_stream_id_t *id )
         }
 
         /* open output stream */
-        id->id = sout_StreamIdAdd( p_stream->p_next, &id->p_encoder->fmt_out );
+        id->id = transcode_output_add( p_stream, &id->p_encoder->fmt_out );
         id->b_transcode = true;
 
         if( !id->id ) goto error;
@@ -78,7 +78,7 @@ int transcode_osd_new( sout_stream_t *p_stream, sout_stream_id_t *id )
     {
         msg_Dbg( p_stream, "not transcoding a stream (fcc=`%4.4s')",
                  (char*)&id->p_decoder->fmt_out.i_codec );
-        id->id = sout_StreamIdAdd( p_stream->p_next, &id->p_decoder->fmt_out );
+        id->id = transcode_output_add( p_stream, &id->p_decoder->fmt_out );
         id->b_transcode = false;
 
         if( !id->id ) goto error;
@@ -135,10 +135,12 @@ int transcode_osd_process( sout_stream_t *p_stream, sout_stream_id_t *id,
     {
         block_t *p_block = NULL;
 
-        if( p_sys->b_master_sync && p_sys->i_master_drift )
+        mtime_t i_master_drift = p_sys->b_master_sync ?
+                                 atomic_load( &p_sys->i_master_drift ) : 0;
+        if( i_master_drift )
         {
-            p_subpic->i_start -= p_sys->i_master_drift;
-            if( p_subpic->i_stop ) p_subpic->i_stop -= p_sys->i_master_drift;
+            p_subpic->i_start -= i_master_drift;
+            if( p_subpic->i_stop ) p_subpic->i_stop -= i_master_drift;
         }
 
         p_block = id->p_encoder->pf_encode_sub( id->p_encoder, p_subpic );
@@ -0,0 +1,643 @@
+/*****************************************************************************
+ * pipeline.c: transcoding stream output module (threaded stages)
+ *****************************************************************************
+ * Copyright (C) 2026 VLC authors and VideoLAN
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************/
+
+#include "transcode.h"
+
+#include <assert.h>
+
+/* Interval between two statistics dumps */
+#define STATS_INTERVAL (10 * CLOCK_FREQ)
+
+static void PrintStats( transcode_stage_t *p_stage )
+{
+    uint64_t i_count = __MAX( p_stage->i_processed, 1 );
+
+    msg_Dbg( p_stage->p_obj, "%s stage: %"PRIu64" items, depth %u/%u "
+             "(peak %u), queued %"PRId64" us, processed %"PRId64" us, "
+             "producer stalled %"PRId64" ms",
+             p_stage->psz_name, p_stage->i_processed, p_stage->i_count,
+             p_stage->i_max, p_stage->i_peak,
+             p_stage->i_queue_time / (mtime_t)i_count,
+             p_stage->i_run_time / (mtime_t)i_count,
+             p_stage->i_stall_time / 1000 );
+}
+
+static void *StageThread( void *data )
+{
+    transcode_stage_t *p_stage = data;
+    mtime_t i_next_stats = mdate() + STATS_INTERVAL;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_stage->lock );
+    for( ;; )
+    {
+        while( !p_stage->b_abort && p_stage->i_count == 0 )
+            vlc_cond_wait( &p_stage->wait, &p_stage->lock );
+        if( p_stage->b_abort )
+            break;
+
+        void *p_item = p_stage->pp_items[p_stage->i_first];
+        mtime_t i_start = mdate();
+
+        p_stage->i_queue_time += i_start - p_stage->pi_dates[p_stage->i_first];
+        p_stage->i_first = (p_stage->i_first + 1) % p_stage->i_max;
+        p_stage->i_count--;
+        p_stage->b_busy = true;
+        vlc_cond_broadcast( &p_stage->space );
+        vlc_mutex_unlock( &p_stage->lock );
+
+        p_stage->pf_run( p_stage->p_data, p_item );
+
+        mtime_t i_now = mdate();
+        vlc_mutex_lock( &p_stage->lock );
+        p_stage->b_busy = false;
+        p_stage->i_processed++;
+        p_stage->i_run_time += i_now - i_start;
+        if( i_now >= i_next_stats )
+        {
+            PrintStats( p_stage );
+            i_next_stats = i_now + STATS_INTERVAL;
+        }
+        vlc_cond_broadcast( &p_stage->space );
+    }
+    vlc_mutex_unlock( &p_stage->lock );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+/**
+ * Starts a stage thread calling pf_run for each queued item, in order.
+ * At most i_max items may wait in the queue; pf_release destroys the ones
+ * still queued when the stage is stopped.
+ */
+int transcode_stage_start( transcode_stage_t *p_stage, vlc_object_t *p_obj,
+                           const char *psz_name, unsigned i_max,
+                           int i_priority,
+                           void (*pf_run)( void *, void * ),
+                           void (*pf_release)( void * ), void *p_data )
+{
+    assert( i_max > 0 );
+
+    p_stage->pp_items = malloc( i_max * sizeof(*p_stage->pp_items) );
+    p_stage->pi_dates = malloc( i_max * sizeof(*p_stage->pi_dates) );
+    if( !p_stage->pp_items || !p_stage->pi_dates )
+    {
+        free( p_stage->pp_items );
+        free( p_stage->pi_dates );
+        return VLC_ENOMEM;
+    }
+
+    p_stage->p_obj = p_obj;
+    p_stage->psz_name = psz_name;
+    p_stage->pf_run = pf_run;
+    p_stage->pf_release = pf_release;
+    p_stage->p_data = p_data;
+    p_stage->i_max = i_max;
+    p_stage->i_first = 0;
+    p_stage->i_count = 0;
+    p_stage->b_busy = false;
+    p_stage->b_abort = false;
+    p_stage->i_processed = 0;
+    p_stage->i_peak = 0;
+    p_stage->i_queue_time = 0;
+    p_stage->i_run_time = 0;
+    p_stage->i_stall_time = 0;
+
+    vlc_mutex_init( &p_stage->lock );
+    vlc_cond_init( &p_stage->wait );
+    vlc_cond_init( &p_stage->space );
+
+    if( vlc_clone( &p_stage->thread, StageThread, p_stage, i_priority ) )
+    {
+        msg_Err( p_obj, "cannot spawn %s thread", psz_name );
+        vlc_cond_destroy( &p_stage->space );
+        vlc_cond_destroy( &p_stage->wait );
+        vlc_mutex_destroy( &p_stage->lock );
+        free( p_stage->pp_items );
+        free( p_stage->pi_dates );
+        return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+/**
+ * Stops the stage thread and releases the items it did not process.
+ * The item being processed, if any, is completed first.
+ */
+void transcode_stage_stop( transcode_stage_t *p_stage )
+{
+    vlc_mutex_lock( &p_stage->lock );
+    p_stage->b_abort = true;
+    vlc_cond_signal( &p_stage->wait );
+    vlc_cond_broadcast( &p_stage->space );
+    vlc_mutex_unlock( &p_stage->lock );
+
+    vlc_join( p_stage->thread, NULL );
+
+    PrintStats( p_stage );
+
+    for( ; p_stage->i_count > 0; p_stage->i_count-- )
+    {
+        p_stage->pf_release( p_stage->pp_items[p_stage->i_first] );
+        p_stage->i_first = (p_stage->i_first + 1) % p_stage->i_max;
+    }
+
+    vlc_cond_destroy( &p_stage->space );
+    vlc_cond_destroy( &p_stage->wait );
+    vlc_mutex_destroy( &p_stage->lock );
+    free( p_stage->pp_items );
+    free( p_stage->pi_dates );
+}
+
+/**
+ * Queues an item. When the queue is full, this waits for the stage to
+ * catch up, so that a slow stage throttles the stages feeding it.
+ */
+void transcode_stage_push( transcode_stage_t *p_stage, void *p_item )
+{
+    vlc_mutex_lock( &p_stage->lock );
+    if( p_stage->i_count >= p_stage->i_max )
+    {
+        mtime_t i_start = mdate();
+        while( !p_stage->b_abort && p_stage->i_count >= p_stage->i_max )
+            vlc_cond_wait( &p_stage->space, &p_stage->lock );
+        p_stage->i_stall_time += mdate() - i_start;
+    }
+
+    if( p_stage->b_abort )
+    {
+        vlc_mutex_unlock( &p_stage->lock );
+        p_stage->pf_release( p_item );
+        return;
+    }
+
+    unsigned i_last = (p_stage->i_first + p_stage->i_count) % p_stage->i_max;
+    p_stage->pp_items[i_last] = p_item;
+    p_stage->pi_dates[i_last] = mdate();
+    p_stage->i_count++;
+    if( p_stage->i_count > p_stage->i_peak )
+        p_stage->i_peak = p_stage->i_count;
+    vlc_cond_signal( &p_stage->wait );
+    vlc_mutex_unlock( &p_stage->lock );
+}
+
+/**
+ * Waits until every queued item has been processed.
+ */
+void transcode_stage_drain( transcode_stage_t *p_stage )
+{
+    vlc_mutex_lock( &p_stage->lock );
+    while( !p_stage->b_abort && (p_stage->i_count > 0 || p_stage->b_busy) )
+        vlc_cond_wait( &p_stage->space, &p_stage->lock );
+    vlc_mutex_unlock( &p_stage->lock );
+}
+
+/*****************************************************************************
+ * Worker pool
+ *****************************************************************************/
+/* Maximum number of items of a task run in a row */
+#define POOL_BATCH 8
+
+struct transcode_pool_t
+{
+    vlc_object_t     *p_obj;
+    vlc_mutex_t      lock;
+    vlc_cond_t       wait;  /**< a task was scheduled, or abort */
+    vlc_cond_t       done;  /**< an item was taken or processed */
+    transcode_task_t *p_first;
+    transcode_task_t **pp_last;
+    bool             b_abort;
+    unsigned         i_threads;
+    vlc_thread_t     threads[];
+};
+
+static void PrintTaskStats( transcode_pool_t *p_pool, transcode_task_t *p_task )
+{
+    uint64_t i_count = __MAX( p_task->i_processed, 1 );
+
+    msg_Dbg( p_pool->p_obj, "%s task: %"PRIu64" items in %"PRIu64" batches, "
+             "depth %u/%u (peak %u), queued %"PRId64" us (max %"PRId64" us), "
+             "processed %"PRId64" us, producer stalled %"PRId64" ms",
+             p_task->psz_name, p_task->i_processed, p_task->i_batches,
+             p_task->i_count, p_task->i_max, p_task->i_peak,
+             p_task->i_queue_time / (mtime_t)i_count, p_task->i_queue_max,
+             p_task->i_run_time / (mtime_t)i_count,
+             p_task->i_stall_time / 1000 );
+}
+
+static void PoolSchedule( transcode_pool_t *p_pool, transcode_task_t *p_task )
+{
+    p_task->p_next = NULL;
+    *p_pool->pp_last = p_task;
+    p_pool->pp_last = &p_task->p_next;
+}
+
+static void *PoolThread( void *data )
+{
+    transcode_pool_t *p_pool = data;
+    void *pp_batch[POOL_BATCH];
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_pool->lock );
+    for( ;; )
+    {
+        while( !p_pool->b_abort && p_pool->p_first == NULL )
+            vlc_cond_wait( &p_pool->wait, &p_pool->lock );
+        if( p_pool->b_abort )
+            break;
+
+        transcode_task_t *p_task = p_pool->p_first;
+        p_pool->p_first = p_task->p_next;
+        if( p_pool->p_first == NULL )
+            p_pool->pp_last = &p_pool->p_first;
+
+        /* Take a batch of items, so that the worker stays on the same
+         * decoder and encoder for a while */
+        unsigned i_batch = __MIN( p_task->i_count, POOL_BATCH );
+        mtime_t i_start = mdate();
+
+        for( unsigned i = 0; i < i_batch; i++ )
+        {
+            mtime_t i_queued = i_start - p_task->pi_dates[p_task->i_first];
+
+            p_task->i_queue_time += i_queued;
+            if( i_queued > p_task->i_queue_max )
+                p_task->i_queue_max = i_queued;
+            pp_batch[i] = p_task->pp_items[p_task->i_first];
+            p_task->i_first = (p_task->i_first + 1) % p_task->i_max;
+        }
+        p_task->i_count -= i_batch;
+        p_task->b_running = true;
+        vlc_cond_broadcast( &p_pool->done );
+        vlc_mutex_unlock( &p_pool->lock );
+
+        for( unsigned i = 0; i < i_batch; i++ )
+            p_task->pf_run( p_task->p_data, pp_batch[i] );
+
+        mtime_t i_now = mdate();
+        vlc_mutex_lock( &p_pool->lock );
+        p_task->b_running = false;
+        p_task->i_processed += i_batch;
+        p_task->i_batches++;
+        p_task->i_run_time += i_now - i_start;
+        if( i_now >= p_task->i_next_stats )
+        {
+            PrintTaskStats( p_pool, p_task );
+            p_task->i_next_stats = i_now + STATS_INTERVAL;
+        }
+
+        /* Back to the end of the run queue, for fairness */
+        if( p_task->i_count > 0 )
+            PoolSchedule( p_pool, p_task );
+        else
+            p_task->b_scheduled = false;
+        vlc_cond_broadcast( &p_pool->done );
+    }
+    vlc_mutex_unlock( &p_pool->lock );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+/**
+ * Creates a pool of i_threads workers. The tasks must all be stopped
+ * before the pool is deleted.
+ */
+transcode_pool_t *transcode_pool_new( vlc_object_t *p_obj, unsigned i_threads,
+                                      int i_priority )
+{
+    transcode_pool_t *p_pool = malloc( sizeof( *p_pool ) +
+                                       i_threads * sizeof( vlc_thread_t ) );
+    if( unlikely( p_pool == NULL ) )
+        return NULL;
+
+    p_pool->p_obj = p_obj;
+    p_pool->p_first = NULL;
+    p_pool->pp_last = &p_pool->p_first;
+    p_pool->b_abort = false;
+    p_pool->i_threads = 0;
+    vlc_mutex_init( &p_pool->lock );
+    vlc_cond_init( &p_pool->wait );
+    vlc_cond_init( &p_pool->done );
+
+    for( unsigned i = 0; i < i_threads; i++ )
+    {
+        if( vlc_clone( &p_pool->threads[i], PoolThread, p_pool, i_priority ) )
+            break;
+        p_pool->i_threads++;
+    }
+
+    if( p_pool->i_threads == 0 )
+    {
+        msg_Err( p_obj, "cannot spawn worker threads" );
+        transcode_pool_delete( p_pool );
+        return NULL;
+    }
+    msg_Dbg( p_obj, "%u worker threads", p_pool->i_threads );
+    return p_pool;
+}
+
+void transcode_pool_delete( transcode_pool_t *p_pool )
+{
+    vlc_mutex_lock( &p_pool->lock );
+    assert( p_pool->p_first == NULL );
+    p_pool->b_abort = true;
+    vlc_cond_broadcast( &p_pool->wait );
+    vlc_mutex_unlock( &p_pool->lock );
+
+    for( unsigned i = 0; i < p_pool->i_threads; i++ )
+        vlc_join( p_pool->threads[i], NULL );
+
+    vlc_cond_destroy( &p_pool->done );
+    vlc_cond_destroy( &p_pool->wait );
+    vlc_mutex_destroy( &p_pool->lock );
+    free( p_pool );
+}
+
+/**
+ * Starts a task calling pf_run for each queued item, in order, from the
+ * workers of the pool. At most i_max items may wait in the queue.
+ */
+int transcode_task_start( transcode_task_t *p_task, transcode_pool_t *p_pool,
+                          const char *psz_name, unsigned i_max,
+                          void (*pf_run)( void *, void * ),
+                          void (*pf_release)( void * ), void *p_data )
+{
+    assert( i_max > 0 );
+
+    p_task->pp_items = malloc( i_max * sizeof(*p_task->pp_items) );
+    p_task->pi_dates = malloc( i_max * sizeof(*p_task->pi_dates) );
+    if( !p_task->pp_items || !p_task->pi_dates )
+    {
+        free( p_task->pp_items );
+        free( p_task->pi_dates );
+        return VLC_ENOMEM;
+    }
+
+    p_task->p_pool = p_pool;
+    p_task->psz_name = psz_name;
+    p_task->p_next = NULL;
+    p_task->pf_run = pf_run;
+    p_task->pf_release = pf_release;
+    p_task->p_data = p_data;
+    p_task->i_max = i_max;
+    p_task->i_first = 0;
+    p_task->i_count = 0;
+    p_task->b_scheduled = false;
+    p_task->b_running = false;
+    p_task->i_processed = 0;
+    p_task->i_batches = 0;
+    p_task->i_peak = 0;
+    p_task->i_queue_time = 0;
+    p_task->i_queue_max = 0;
+    p_task->i_run_time = 0;
+    p_task->i_stall_time = 0;
+    p_task->i_next_stats = mdate() + STATS_INTERVAL;
+    return VLC_SUCCESS;
+}
+
+/**
+ * Stops a task and releases the items it did not process.
+ * The batch being processed, if any, is completed first.
+ */
+void transcode_task_stop( transcode_task_t *p_task )
+{
+    transcode_pool_t *p_pool = p_task->p_pool;
+
+    vlc_mutex_lock( &p_pool->lock );
+    while( p_task->b_running )
+        vlc_cond_wait( &p_pool->done, &p_pool->lock );
+
+    if( p_task->b_scheduled )
+    {
+        transcode_task_t **pp = &p_pool->p_first;
+
+        while( *pp != p_task )
+            pp = &(*pp)->p_next;
+        *pp = p_task->p_next;
+        if( p_pool->pp_last == &p_task->p_next )
+            p_pool->pp_last = pp;
+        p_task->b_scheduled = false;
+    }
+
+    PrintTaskStats( p_pool, p_task );
+    vlc_mutex_unlock( &p_pool->lock );
+
+    for( ; p_task->i_count > 0; p_task->i_count-- )
+    {
+        p_task->pf_release( p_task->pp_items[p_task->i_first] );
+        p_task->i_first = (p_task->i_first + 1) % p_task->i_max;
+    }
+    free( p_task->pp_items );
+    free( p_task->pi_dates );
+}
+
+/**
+ * Queues an item. When the queue is full, this waits for the workers to
+ * catch up.
+ */
+void transcode_task_push( transcode_task_t *p_task, void *p_item )
+{
+    transcode_pool_t *p_pool = p_task->p_pool;
+
+    vlc_mutex_lock( &p_pool->lock );
+    if( p_task->i_count >= p_task->i_max )
+    {
+        mtime_t i_start = mdate();
+        while( p_task->i_count >= p_task->i_max )
+            vlc_cond_wait( &p_pool->done, &p_pool->lock );
+        p_task->i_stall_time += mdate() - i_start;
+    }
+
+    unsigned i_last = (p_task->i_first + p_task->i_count) % p_task->i_max;
+    p_task->pp_items[i_last] = p_item;
+    p_task->pi_dates[i_last] = mdate();
+    p_task->i_count++;
+    if( p_task->i_count > p_task->i_peak )
+        p_task->i_peak = p_task->i_count;
+
+    if( !p_task->b_scheduled )
+    {
+        p_task->b_scheduled = true;
+        PoolSchedule( p_pool, p_task );
+        vlc_cond_signal( &p_pool->wait );
+    }
+    vlc_mutex_unlock( &p_pool->lock );
+}
+
+/**
+ * Waits until every queued item has been processed.
+ */
+void transcode_task_drain( transcode_task_t *p_task )
+{
+    transcode_pool_t *p_pool = p_task->p_pool;
+
+    vlc_mutex_lock( &p_pool->lock );
+    while( p_task->i_count > 0 || p_task->b_running )
+        vlc_cond_wait( &p_pool->done, &p_pool->lock );
+    vlc_mutex_unlock( &p_pool->lock );
+}
+
+/*****************************************************************************
+ * Elementary stream pipeline
+ *****************************************************************************/
+/**
+ * Starts the decoder, filter and encoder stages of an elementary stream.
+ * Each stage gets its own queue of sout-transcode-queue-depth items. A stage
+ * without a run callback is left out.
+ */
+int transcode_pipeline_start( sout_stream_t *p_stream, sout_stream_id_t *id,
+                              const transcode_stage_run_t pf_run[STAGE_COUNT],
+                              const transcode_stage_release_t pf_release[STAGE_COUNT] )
+{
+    static const char *const ppsz_video[STAGE_COUNT] =
+        { "video decoder", "video filter", "video encoder" };
+    static const char *const ppsz_audio[STAGE_COUNT] =
+        { "audio decoder", "audio filter", "audio encoder" };
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    bool b_video = id->p_decoder->fmt_in.i_cat == VIDEO_ES;
+    const char *const *ppsz_names = b_video ? ppsz_video : ppsz_audio;
+    int i_priority = p_sys->b_high_priority ? VLC_THREAD_PRIORITY_OUTPUT :
+                     b_video ? VLC_THREAD_PRIORITY_VIDEO :
+                               VLC_THREAD_PRIORITY_AUDIO;
+
+    id->p_stream = p_stream;
+    id->p_buffers = NULL;
+    id->b_encoder_ready = false;
+    id->b_error = false;
+    vlc_mutex_init( &id->lock_out );
+
+    for( int i = 0; i < STAGE_COUNT; i++ )
+    {
+        id->stages[i].pf_run = pf_run[i];
+        if( pf_run[i] == NULL )
+            continue;
+        if( transcode_stage_start( &id->stages[i], VLC_OBJECT(p_stream),
+                                   ppsz_names[i], p_sys->i_queue_depth,
+                                   i_priority, pf_run[i], pf_release[i],
+                                   id ) )
+        {
+            while( i-- > 0 )
+                if( id->stages[i].pf_run )
+                    transcode_stage_stop( &id->stages[i] );
+            vlc_mutex_destroy( &id->lock_out );
+            return VLC_EGENERIC;
+        }
+    }
+
+    id->b_pipeline = true;
+    return VLC_SUCCESS;
+}
+
+/**
+ * Runs a whole elementary stream as a task of a worker pool: pf_run gets
+ * the input blocks, and hands the encoded ones to
+ * transcode_pipeline_output().
+ */
+int transcode_pipeline_pool( sout_stream_t *p_stream, sout_stream_id_t *id,
+                             transcode_pool_t *p_pool,
+                             transcode_stage_run_t pf_run,
+                             transcode_stage_release_t pf_release )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    bool b_video = id->p_decoder->fmt_in.i_cat == VIDEO_ES;
+
+    id->p_stream = p_stream;
+    id->p_buffers = NULL;
+    id->b_encoder_ready = false;
+    id->b_error = false;
+
+    if( transcode_task_start( &id->task, p_pool,
+                              b_video ? "video" : "audio",
+                              p_sys->i_queue_depth, pf_run, pf_release, id ) )
+        return VLC_ENOMEM;
+
+    vlc_mutex_init( &id->lock_out );
+    id->b_pooled = true;
+    id->b_pipeline = true;
+    return VLC_SUCCESS;
+}
+
+/**
+ * Stops the stages, upstream first so that the item being processed by a
+ * stage can still be handed to the next one.
+ */
+void transcode_pipeline_stop( sout_stream_id_t *id )
+{
+    if( !id->b_pipeline )
+        return;
+
+    if( id->b_pooled )
+        transcode_task_stop( &id->task );
+    else
+        for( int i = 0; i < STAGE_COUNT; i++ )
+            if( id->stages[i].pf_run )
+                transcode_stage_stop( &id->stages[i] );
+
+    block_ChainRelease( id->p_buffers );
+    id->p_buffers = NULL;
+    vlc_mutex_destroy( &id->lock_out );
+    id->b_pipeline = false;
+    id->b_pooled = false;
+}
+
+/**
+ * Waits until every queued item went through all the stages.
+ */
+void transcode_pipeline_drain( sout_stream_id_t *id )
+{
+    if( id->b_pooled )
+    {
+        transcode_task_drain( &id->task );
+        return;
+    }
+
+    for( int i = 0; i < STAGE_COUNT; i++ )
+        if( id->stages[i].pf_run )
+            transcode_stage_drain( &id->stages[i] );
+}
+
+/**
+ * Hands encoded blocks over to the next Send() call.
+ */
+void transcode_pipeline_output( sout_stream_id_t *id, block_t *p_block )
+{
+    if( p_block == NULL )
+        return;
+
+    vlc_mutex_lock( &id->lock_out );
+    block_ChainAppend( &id->p_buffers, p_block );
+    vlc_mutex_unlock( &id->lock_out );
+}
+
+block_t *transcode_pipeline_collect( sout_stream_id_t *id )
+{
+    vlc_mutex_lock( &id->lock_out );
+    block_t *p_block = id->p_buffers;
+    id->p_buffers = NULL;
+    vlc_mutex_unlock( &id->lock_out );
+    return p_block;
+}
@@ -131,10 +131,12 @@ int transcode_spu_process( sout_stream_t *p_stream,
     if( !p_subpic )
         return VLC_EGENERIC;
 
-    if( p_sys->b_master_sync && p_sys->i_master_drift )
+    mtime_t i_master_drift = p_sys->b_master_sync ?
+                             atomic_load( &p_sys->i_master_drift ) : 0;
+    if( i_master_drift )
     {
-        p_subpic->i_start -= p_sys->i_master_drift;
-        if( p_subpic->i_stop ) p_subpic->i_stop -= p_sys->i_master_drift;
+        p_subpic->i_start -= i_master_drift;
+        if( p_subpic->i_stop ) p_subpic->i_stop -= i_master_drift;
     }
 
     if( p_sys->b_soverlay )
@@ -179,7 +181,7 @@ bool transcode_spu_add( sout_stream_t *p_stream, es_format_t *p_fmt,
         }
 
         /* open output stream */
-        id->id = sout_StreamIdAdd( p_stream->p_next, &id->p_encoder->fmt_out );
+        id->id = transcode_output_add( p_stream, &id->p_encoder->fmt_out );
         id->b_transcode = true;
 
         if( !id->id )
@@ -125,11 +125,34 @@
 
 #define THREADS_TEXT N_("Number of threads")
 #define THREADS_LONGTEXT N_( \
-    "Number of threads used for the transcoding." )
+    "Number of threads used for the transcoding. If not zero, decoding, " \
+    "filtering and encoding of each stream run in separate threads." )
+#define ATHREADS_TEXT N_("Audio worker threads")
+#define ATHREADS_LONGTEXT N_( \
+    "If not zero, all the audio streams are transcoded by a shared pool of " \
+    "this many threads, instead of separate threads for each stream. " \
+    "This suits many streams encoded with the same parameters." )
 #define HP_TEXT N_("High priority")
 #define HP_LONGTEXT N_( \
-    "Runs the optional encoder thread at the OUTPUT priority instead of " \
-    "VIDEO." )
+    "Runs the optional transcoding threads at the OUTPUT priority instead " \
+    "of VIDEO or AUDIO." )
+#define QUEUE_TEXT N_("Queue depth")
+#define QUEUE_LONGTEXT N_( \
+    "Maximum number of blocks or pictures waiting for each transcoding " \
+    "thread. A full queue stalls the previous thread." )
+
+#define RENDITION_TEXT N_("Rendition")
+#define RENDITION_LONGTEXT N_( \
+    "Adds a video rendition as width x height : bitrate in kb/s, for " \
+    "instance 1280x720:3000. The video is then decoded and filtered once, " \
+    "and scaled and encoded for each rendition. This option can be " \
+    "repeated. Use a fixed GOP in the encoder options to get aligned " \
+    "keyframes." )
+#define DST_TEXT N_("Rendition destination")
+#define DST_LONGTEXT N_( \
+    "Stream chain of the preceding rendition. The other streams are sent " \
+    "to every rendition destination. Without it, the rendition goes to the " \
+    "next stream." )
 
 #define ASYNC_TEXT N_("Synchronise on audio track")
 #define ASYNC_LONGTEXT N_( \
@@ -185,6 +208,9 @@ vlc_module_begin ()
                  MAXWIDTH_LONGTEXT, true )
     add_integer( SOUT_CFG_PREFIX "maxheight", 0, MAXHEIGHT_TEXT,
                  MAXHEIGHT_LONGTEXT, true )
+    add_string( SOUT_CFG_PREFIX "rendition", NULL, RENDITION_TEXT,
+                RENDITION_LONGTEXT, true )
+    add_string( SOUT_CFG_PREFIX "dst", NULL, DST_TEXT, DST_LONGTEXT, true )
     add_module_list( SOUT_CFG_PREFIX "vfilter", "video filter2",
                      NULL, VFILTER_TEXT, VFILTER_LONGTEXT, false )
 
@@ -223,8 +249,12 @@ vlc_module_begin ()
     set_section( N_("Miscellaneous"), NULL )
     add_integer( SOUT_CFG_PREFIX "threads", 0, THREADS_TEXT,
                  THREADS_LONGTEXT, true )
+    add_integer_with_range( SOUT_CFG_PREFIX "audio-threads", 0, 0, 64,
+                            ATHREADS_TEXT, ATHREADS_LONGTEXT, true )
     add_bool( SOUT_CFG_PREFIX "high-priority", false, HP_TEXT, HP_LONGTEXT,
               true )
+    add_integer_with_range( SOUT_CFG_PREFIX "queue-depth", 4, 1, 100,
+                            QUEUE_TEXT, QUEUE_LONGTEXT, true )
 
 vlc_module_end ()
 
@@ -234,7 +264,7 @@ static const char *const ppsz_sout_options[] = {
     "deinterlace-module", "threads", "hurry-up", "aenc", "acodec", "ab", "alang",
     "afilter", "samplerate", "channels", "senc", "scodec", "soverlay",
     "sfilter", "osd", "audio-sync", "high-priority", "maxwidth", "maxheight",
-    NULL
+    "queue-depth", "audio-threads", "rendition", "dst", NULL
 };
 
 /*****************************************************************************
@@ -244,6 +274,173 @@ static sout_stream_id_t *Add ( sout_stream_t *, es_format_t * );
 static int               Del ( sout_stream_t *, sout_stream_id_t * );
 static int               Send( sout_stream_t *, sout_stream_id_t *, block_t* );
 
+/*****************************************************************************
+ * Ladder: the rendition and dst options can be repeated, so they are read
+ * from the configuration chain directly.
+ *****************************************************************************/
+static int LadderOpen( sout_stream_t *p_stream, sout_stream_sys_t *p_sys )
+{
+    transcode_ladder_t *p_rung = NULL;
+    int i_next = -1;
+
+    for( config_chain_t *p_cfg = p_stream->p_cfg; p_cfg != NULL;
+         p_cfg = p_cfg->p_next )
+    {
+        if( !strcmp( p_cfg->psz_name, "rendition" ) )
+        {
+            transcode_ladder_t rung = { 0, 0, 0, -1 };
+
+            if( p_cfg->psz_value == NULL ||
+                sscanf( p_cfg->psz_value, "%ux%u:%d", &rung.i_width,
+                        &rung.i_height, &rung.i_bitrate ) < 2 )
+            {
+                msg_Err( p_stream, " * ignore invalid rendition `%s'",
+                         p_cfg->psz_value ? p_cfg->psz_value : "" );
+                p_rung = NULL;
+                continue;
+            }
+            if( rung.i_bitrate < 16000 ) rung.i_bitrate *= 1000;
+
+            transcode_ladder_t *p_ladder =
+                realloc( p_sys->p_ladder,
+                         (p_sys->i_ladder + 1) * sizeof(*p_ladder) );
+            if( unlikely( p_ladder == NULL ) )
+                return VLC_ENOMEM;
+            p_sys->p_ladder = p_ladder;
+            p_rung = &p_ladder[p_sys->i_ladder++];
+            *p_rung = rung;
+            msg_Dbg( p_stream, " * adding rendition %ux%u %dkb/s",
+                     rung.i_width, rung.i_height, rung.i_bitrate / 1000 );
+        }
+        else if( !strcmp( p_cfg->psz_name, "dst" ) )
+        {
+            sout_stream_t *p_first, *p_last;
+
+            if( p_rung == NULL || p_rung->i_output >= 0 )
+            {
+                msg_Err( p_stream, " * ignore destination `%s' without "
+                         "rendition", p_cfg->psz_value ? p_cfg->psz_value : "" );
+                continue;
+            }
+
+            p_first = sout_StreamChainNew( p_stream->p_sout, p_cfg->psz_value,
+                                           p_stream->p_next, &p_last );
+            if( p_first == NULL )
+            {
+                msg_Err( p_stream, "cannot create chain `%s'",
+                         p_cfg->psz_value );
+                return VLC_EGENERIC;
+            }
+            int i_count = p_sys->i_outputs;
+            TAB_APPEND( i_count, p_sys->pp_outputs_last, p_last );
+            TAB_APPEND( p_sys->i_outputs, p_sys->pp_outputs, p_first );
+            p_rung->i_output = p_sys->i_outputs - 1;
+        }
+    }
+
+    /* The renditions without a destination share the next stream */
+    for( int i = 0; i < p_sys->i_ladder; i++ )
+    {
+        if( p_sys->p_ladder[i].i_output >= 0 )
+            continue;
+        if( !p_stream->p_next )
+            return VLC_EGENERIC;
+        if( i_next < 0 )
+        {
+            int i_count = p_sys->i_outputs;
+            TAB_APPEND( i_count, p_sys->pp_outputs_last, NULL );
+            TAB_APPEND( p_sys->i_outputs, p_sys->pp_outputs, p_stream->p_next );
+            i_next = p_sys->i_outputs - 1;
+        }
+        p_sys->p_ladder[i].i_output = i_next;
+    }
+    return VLC_SUCCESS;
+}
+
+static void LadderClose( sout_stream_sys_t *p_sys )
+{
+    for( int i = 0; i < p_sys->i_outputs; i++ )
+        if( p_sys->pp_outputs_last[i] != NULL )
+            sout_StreamChainDelete( p_sys->pp_outputs[i],
+                                    p_sys->pp_outputs_last[i] );
+    free( p_sys->pp_outputs );
+    free( p_sys->pp_outputs_last );
+    free( p_sys->p_ladder );
+}
+
+/*****************************************************************************
+ * Output: with a ladder, the streams other than the transcoded video are
+ * sent to every output and the id is an array of ids, one per output.
+ *****************************************************************************/
+void *transcode_output_add( sout_stream_t *p_stream, es_format_t *p_fmt )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    if( p_sys->i_outputs == 0 )
+        return sout_StreamIdAdd( p_stream->p_next, p_fmt );
+
+    void **pp_ids = malloc( p_sys->i_outputs * sizeof(*pp_ids) );
+    if( unlikely( pp_ids == NULL ) )
+        return NULL;
+
+    for( int i = 0; i < p_sys->i_outputs; i++ )
+    {
+        pp_ids[i] = sout_StreamIdAdd( p_sys->pp_outputs[i], p_fmt );
+        if( pp_ids[i] == NULL )
+        {
+            while( i-- > 0 )
+                sout_StreamIdDel( p_sys->pp_outputs[i], pp_ids[i] );
+            free( pp_ids );
+            return NULL;
+        }
+    }
+    return pp_ids;
+}
+
+void transcode_output_del( sout_stream_t *p_stream, void *id )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    if( p_sys->i_outputs == 0 )
+    {
+        sout_StreamIdDel( p_stream->p_next, id );
+        return;
+    }
+
+    void **pp_ids = id;
+    for( int i = 0; i < p_sys->i_outputs; i++ )
+        sout_StreamIdDel( p_sys->pp_outputs[i], pp_ids[i] );
+    free( pp_ids );
+}
+
+int transcode_output_send( sout_stream_t *p_stream, void *id,
+                           block_t *p_buffer )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    if( p_sys->i_outputs == 0 )
+        return sout_StreamIdSend( p_stream->p_next, id, p_buffer );
+
+    void **pp_ids = id;
+    while( p_buffer )
+    {
+        block_t *p_next = p_buffer->p_next;
+        int i;
+
+        p_buffer->p_next = NULL;
+        for( i = 0; i < p_sys->i_outputs - 1; i++ )
+        {
+            block_t *p_dup = block_Clone( p_buffer );
+            if( p_dup )
+                sout_StreamIdSend( p_sys->pp_outputs[i], pp_ids[i], p_dup );
+        }
+        sout_StreamIdSend( p_sys->pp_outputs[i], pp_ids[i], p_buffer );
+
+        p_buffer = p_next;
+    }
+    return VLC_SUCCESS;
+}
+
 /*****************************************************************************
  * Open:
  *****************************************************************************/
@@ -253,17 +450,23 @@ static int Open( vlc_object_t *p_this )
     sout_stream_sys_t *p_sys;
     char              *psz_string;
 
-    if( !p_stream->p_next )
-    {
-        msg_Err( p_stream, "cannot create chain" );
-        return VLC_EGENERIC;
-    }
     p_sys = calloc( 1, sizeof( *p_sys ) );
-    p_sys->i_master_drift = 0;
+    if( !p_sys )
+        return VLC_ENOMEM;
+    atomic_init( &p_sys->i_master_drift, 0 );
 
     config_ChainParse( p_stream, SOUT_CFG_PREFIX, ppsz_sout_options,
                    p_stream->p_cfg );
 
+    if( LadderOpen( p_stream, p_sys ) != VLC_SUCCESS ||
+        (p_sys->i_outputs == 0 && !p_stream->p_next) )
+    {
+        msg_Err( p_stream, "cannot create chain" );
+        LadderClose( p_sys );
+        free( p_sys );
+        return VLC_EGENERIC;
+    }
+
     /* Audio transcoding parameters */
     psz_string = var_GetString( p_stream, SOUT_CFG_PREFIX "aenc" );
     p_sys->psz_aenc = NULL;
@@ -382,6 +585,18 @@ static int Open( vlc_object_t *p_this )
 
     p_sys->i_threads = var_GetInteger( p_stream, SOUT_CFG_PREFIX "threads" );
     p_sys->b_high_priority = var_GetBool( p_stream, SOUT_CFG_PREFIX "high-priority" );
+    p_sys->i_queue_depth = __MAX( 1, var_GetInteger( p_stream, SOUT_CFG_PREFIX "queue-depth" ) );
+
+    int i_audio_threads = var_GetInteger( p_stream, SOUT_CFG_PREFIX "audio-threads" );
+    if( i_audio_threads > 0 )
+    {
+        p_sys->p_audio_pool = transcode_pool_new( VLC_OBJECT(p_stream),
+                                  i_audio_threads, p_sys->b_high_priority ?
+                                  VLC_THREAD_PRIORITY_OUTPUT :
+                                  VLC_THREAD_PRIORITY_AUDIO );
+        if( p_sys->p_audio_pool == NULL )
+            msg_Warn( p_stream, "audio worker pool disabled" );
+    }
 
     if( p_sys->i_vcodec )
     {
@@ -389,6 +604,8 @@ static int Open( vlc_object_t *p_this )
                  (char *)&p_sys->i_vcodec, p_sys->i_width, p_sys->i_height,
                  p_sys->f_scale, p_sys->i_vbitrate / 1000 );
     }
+    if( p_sys->i_ladder > 0 && !p_sys->i_vcodec && !p_sys->psz_venc )
+        msg_Warn( p_stream, "renditions ignored, video is not transcoded" );
 
     /* Subpictures transcoding parameters */
     p_sys->p_spu = NULL;
@@ -505,6 +722,11 @@ static void Close( vlc_object_t * p_this )
     config_ChainDestroy( p_sys->p_osd_cfg );
     free( p_sys->psz_osdenc );
 
+    LadderClose( p_sys );
+
+    if( p_sys->p_audio_pool != NULL )
+        transcode_pool_delete( p_sys->p_audio_pool );
+
     free( p_sys );
 }
 
@@ -560,7 +782,7 @@ static sout_stream_id_t *Add( sout_stream_t *p_stream, es_format_t *p_fmt )
     {
         msg_Dbg( p_stream, "not transcoding a stream (fcc=`%4.4s')",
                  (char*)&p_fmt->i_codec );
-        id->id = sout_StreamIdAdd( p_stream->p_next, p_fmt );
+        id->id = transcode_output_add( p_stream, p_fmt );
         id->b_transcode = false;
 
         success = id->id;
@@ -603,6 +825,8 @@ static int Del( sout_stream_t *p_stream, sout_stream_id_t *id )
         case AUDIO_ES:
             Send( p_stream, id, NULL );
             transcode_audio_close( id );
+            if( p_sys->p_drift_source == id )
+                p_sys->p_drift_source = NULL;
             break;
         case VIDEO_ES:
             Send( p_stream, id, NULL );
@@ -617,7 +841,7 @@ static int Del( sout_stream_t *p_stream, sout_stream_id_t *id )
         }
     }
 
-    if( id->id ) sout_StreamIdDel( p_stream->p_next, id->id );
+    if( id->id ) transcode_output_del( p_stream, id->id );
 
     if( id->p_decoder )
     {
@@ -645,12 +869,17 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_t *id,
     if( !id->b_transcode )
     {
         if( id->id )
-            return sout_StreamIdSend( p_stream->p_next, id->id, p_buffer );
+            return transcode_output_send( p_stream, id->id, p_buffer );
 
         block_Release( p_buffer );
         return VLC_EGENERIC;
     }
 
+    /* Decoders may modify their input in place */
+    p_buffer = block_Unshare( p_buffer );
+    if( unlikely(p_buffer == NULL) )
+        return VLC_ENOMEM;
+
     switch( id->p_decoder->fmt_in.i_cat )
     {
     case AUDIO_ES:
@@ -689,6 +918,6 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_t *id,
     }
 
     if( p_out )
-        return sout_StreamIdSend( p_stream->p_next, id->id, p_out );
+        return transcode_output_send( p_stream, id->id, p_out );
     return VLC_SUCCESS;
 }
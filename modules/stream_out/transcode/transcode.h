@@ -8,21 +8,121 @@
 #include <vlc_filter.h>
 #include <vlc_es.h>
 #include <vlc_codec.h>
-
-#include <vlc_picture_fifo.h>
+#include <vlc_atomic.h>
 
 #define MASTER_SYNC_MAX_DRIFT 100000
 
-struct sout_stream_sys_t
+/* Pipeline stage: a thread consuming a bounded queue */
+typedef struct
 {
-    sout_stream_id_t *id_video;
-    block_t         *p_buffers;
-    vlc_mutex_t     lock_out;
-    vlc_cond_t      cond;
-    bool            b_abort;
-    picture_fifo_t *pp_pics;
+    vlc_object_t    *p_obj;
+    const char      *psz_name;
     vlc_thread_t    thread;
+    vlc_mutex_t     lock;
+    vlc_cond_t      wait;   /**< an item was queued, or abort */
+    vlc_cond_t      space;  /**< an item was taken or processed */
+
+    void            **pp_items;
+    mtime_t         *pi_dates; /**< when each item was queued */
+    unsigned        i_max;
+    unsigned        i_first;
+    unsigned        i_count;
+    bool            b_busy;
+    bool            b_abort;
+
+    void            (*pf_run)( void *, void * );
+    void            (*pf_release)( void * );
+    void            *p_data;
+
+    /* Statistics */
+    uint64_t        i_processed;
+    unsigned        i_peak;
+    mtime_t         i_queue_time;
+    mtime_t         i_run_time;
+    mtime_t         i_stall_time;
+} transcode_stage_t;
+
+int  transcode_stage_start( transcode_stage_t *, vlc_object_t *, const char *,
+                            unsigned, int, void (*)( void *, void * ),
+                            void (*)( void * ), void * );
+void transcode_stage_stop ( transcode_stage_t * );
+void transcode_stage_push ( transcode_stage_t *, void * );
+void transcode_stage_drain( transcode_stage_t * );
 
+/* Worker pool shared by several streams. The work of each stream is queued
+ * in a task, whose items are run in order by one worker at a time */
+typedef struct transcode_pool_t transcode_pool_t;
+
+typedef struct transcode_task_t
+{
+    transcode_pool_t        *p_pool;
+    const char              *psz_name;
+    struct transcode_task_t *p_next;    /**< in the run queue */
+
+    void            **pp_items;
+    mtime_t         *pi_dates;  /**< when each item was queued */
+    unsigned        i_max;
+    unsigned        i_first;
+    unsigned        i_count;
+    bool            b_scheduled; /**< in the run queue, or running */
+    bool            b_running;
+
+    void            (*pf_run)( void *, void * );
+    void            (*pf_release)( void * );
+    void            *p_data;
+
+    /* Statistics */
+    uint64_t        i_processed;
+    uint64_t        i_batches;
+    unsigned        i_peak;
+    mtime_t         i_queue_time;
+    mtime_t         i_queue_max;
+    mtime_t         i_run_time;
+    mtime_t         i_stall_time;
+    mtime_t         i_next_stats;
+} transcode_task_t;
+
+transcode_pool_t *transcode_pool_new( vlc_object_t *, unsigned, int );
+void transcode_pool_delete( transcode_pool_t * );
+int  transcode_task_start( transcode_task_t *, transcode_pool_t *,
+                           const char *, unsigned,
+                           void (*)( void *, void * ), void (*)( void * ),
+                           void * );
+void transcode_task_stop ( transcode_task_t * );
+void transcode_task_push ( transcode_task_t *, void * );
+void transcode_task_drain( transcode_task_t * );
+
+enum
+{
+    STAGE_DECODE,
+    STAGE_FILTER,
+    STAGE_ENCODE,
+    STAGE_COUNT
+};
+
+/* Rendition of a ladder: the video is decoded and filtered once, then
+ * scaled and encoded for each rendition */
+typedef struct
+{
+    unsigned        i_width;
+    unsigned        i_height;
+    int             i_bitrate;
+    int             i_output;   /**< index in pp_outputs */
+} transcode_ladder_t;
+
+typedef struct
+{
+    encoder_t         *p_encoder;
+    filter_chain_t    *p_f_chain;   /**< scaling to the rendition size */
+    void              *id;          /**< video ES in the rendition output */
+    transcode_stage_t stage;
+    vlc_mutex_t       lock;
+    block_t           *p_buffers;
+    bool              b_ready;      /**< encoder opened */
+} transcode_rendition_t;
+
+struct sout_stream_sys_t
+{
     /* Audio */
     vlc_fourcc_t    i_acodec;   /* codec audio (0 if not transcode) */
     char            *psz_aenc;
@@ -36,7 +136,6 @@ struct sout_stream_sys_t
 
     /* Video */
     vlc_fourcc_t    i_vcodec;   /* codec video (0 if not transcode) */
-    video_format_t  fmt_input_video;
     char            *psz_venc;
     config_chain_t  *p_video_cfg;
     int             i_vbitrate;
@@ -49,7 +148,9 @@ struct sout_stream_sys_t
     config_chain_t  *p_deinterlace_cfg;
     int             i_threads;
     bool            b_high_priority;
+    unsigned        i_queue_depth;
     bool            b_hurry_up;
+    transcode_pool_t *p_audio_pool; /**< audio workers, or NULL */
 
     char            *psz_vf2;
 
@@ -69,7 +170,17 @@ struct sout_stream_sys_t
 
     /* Sync */
     bool            b_master_sync;
-    mtime_t         i_master_drift;
+    /* Written by the audio stage, read by the video and subpicture stages,
+     * which may run concurrently */
+    atomic_int_least64_t i_master_drift;
+    sout_stream_id_t *p_drift_source; /**< audio stream updating it */
+
+    /* Ladder */
+    int                 i_ladder;
+    transcode_ladder_t  *p_ladder;
+    int                 i_outputs;      /**< streams fed by the ladder */
+    sout_stream_t       **pp_outputs;
+    sout_stream_t       **pp_outputs_last; /**< NULL for the next stream */
 };
 
 struct aout_filters;
@@ -78,7 +189,7 @@ struct sout_stream_id_t
 {
     bool            b_transcode;
 
-    /* id of the out stream */
+    /* id of the out stream, see transcode_output_add() */
     void *id;
 
     /* Decoder */
@@ -90,6 +201,8 @@ struct sout_stream_id_t
          {
              filter_chain_t  *p_f_chain; /**< Video filters */
              filter_chain_t  *p_uf_chain; /**< User-specified video filters */
+             transcode_rendition_t *p_renditions; /**< Ladder encoders */
+             video_format_t  fmt_input; /**< Format the chains are set for */
          };
          struct aout_filters *p_af_chain; /**< Audio filters */
     };
@@ -99,8 +212,44 @@ struct sout_stream_id_t
 
     /* Sync */
     date_t          interpolated_pts;
+    bool            b_drift_source; /**< updates the master drift */
+
+    /* Pipeline (threads > 0): decoder, filters and encoder each run in
+     * their own thread, encoded blocks are picked up by Send().
+     * With a pool, the whole stream runs as a single task instead. */
+    bool              b_pipeline;
+    bool              b_pooled;
+    sout_stream_t     *p_stream;
+    transcode_stage_t stages[STAGE_COUNT];
+    transcode_task_t  task;
+    vlc_mutex_t       lock_out;
+    block_t           *p_buffers;
+    bool              b_encoder_ready; /**< video encoder opened */
+    bool              b_error;
 };
 
+/* Output */
+
+void *transcode_output_add ( sout_stream_t *, es_format_t * );
+void transcode_output_del  ( sout_stream_t *, void * );
+int  transcode_output_send ( sout_stream_t *, void *, block_t * );
+
+/* Pipeline */
+
+typedef void (*transcode_stage_run_t)( void *, void * );
+typedef void (*transcode_stage_release_t)( void * );
+
+int  transcode_pipeline_start( sout_stream_t *, sout_stream_id_t *,
+                               const transcode_stage_run_t[STAGE_COUNT],
+                               const transcode_stage_release_t[STAGE_COUNT] );
+int  transcode_pipeline_pool ( sout_stream_t *, sout_stream_id_t *,
+                               transcode_pool_t *, transcode_stage_run_t,
+                               transcode_stage_release_t );
+void transcode_pipeline_stop  ( sout_stream_id_t * );
+void transcode_pipeline_drain ( sout_stream_id_t * );
+void transcode_pipeline_output( sout_stream_id_t *, block_t * );
+block_t *transcode_pipeline_collect( sout_stream_id_t * );
+
 /* OSD */
 
 int transcode_osd_new( sout_stream_t *p_stream, sout_stream_id_t *id );
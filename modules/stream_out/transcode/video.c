@@ -97,42 +97,20 @@ static void transcode_video_filter_allocation_clear( filter_t *p_filter )
     VLC_UNUSED(p_filter);
 }
 
-static void* EncoderThread( void *obj )
-{
-    sout_stream_sys_t *p_sys = (sout_stream_sys_t*)obj;
-    sout_stream_id_t *id = p_sys->id_video;
-    picture_t *p_pic;
-    int canc = vlc_savecancel ();
-
-    for( ;; )
-    {
-        block_t *p_block;
-
-        vlc_mutex_lock( &p_sys->lock_out );
-        while( !p_sys->b_abort &&
-               (p_pic = picture_fifo_Pop( p_sys->pp_pics )) == NULL )
-            vlc_cond_wait( &p_sys->cond, &p_sys->lock_out );
-
-        if( p_sys->b_abort )
-        {
-            vlc_mutex_unlock( &p_sys->lock_out );
-            break;
-        }
-        vlc_mutex_unlock( &p_sys->lock_out );
+static void DecodeStage( void *, void * );
+static void FilterStage( void *, void * );
+static void EncodeStage( void *, void * );
+static int  transcode_ladder_new( sout_stream_t *, sout_stream_id_t * );
+static void transcode_ladder_close( sout_stream_t *, sout_stream_id_t * );
 
-        p_block = id->p_encoder->pf_encode_video( id->p_encoder, p_pic );
-
-        vlc_mutex_lock( &p_sys->lock_out );
-        block_ChainAppend( &p_sys->p_buffers, p_block );
-
-        vlc_mutex_unlock( &p_sys->lock_out );
-        picture_Release( p_pic );
-    }
-
-    block_ChainRelease( p_sys->p_buffers );
+static void ReleaseBlock( void *p_block )
+{
+    block_Release( p_block );
+}
 
-    vlc_restorecancel (canc);
-    return NULL;
+static void ReleasePicture( void *p_pic )
+{
+    picture_Release( p_pic );
 }
 
 int transcode_video_new( sout_stream_t *p_stream, sout_stream_id_t *id )
@@ -223,32 +201,30 @@ int transcode_video_new( sout_stream_t *p_stream, sout_stream_id_t *id )
     }
     id->p_encoder->p_module = NULL;
 
+    /* With a ladder, id->p_encoder is never opened: it only holds the format
+     * of the filtered pictures, that the renditions scale and encode. */
+    if( p_sys->i_ladder > 0 && transcode_ladder_new( p_stream, id ) )
+    {
+        module_unneed( id->p_decoder, id->p_decoder->p_module );
+        id->p_decoder->p_module = NULL;
+        free( id->p_decoder->p_owner );
+        return VLC_EGENERIC;
+    }
+
     if( p_sys->i_threads >= 1 )
     {
-        int i_priority = p_sys->b_high_priority ? VLC_THREAD_PRIORITY_OUTPUT :
-                           VLC_THREAD_PRIORITY_VIDEO;
-        p_sys->id_video = id;
-        vlc_mutex_init( &p_sys->lock_out );
-        vlc_cond_init( &p_sys->cond );
-        p_sys->pp_pics = picture_fifo_New();
-        if( p_sys->pp_pics == NULL )
-        {
-            msg_Err( p_stream, "cannot create picture fifo" );
-            vlc_mutex_destroy( &p_sys->lock_out );
-            vlc_cond_destroy( &p_sys->cond );
-            module_unneed( id->p_decoder, id->p_decoder->p_module );
-            id->p_decoder->p_module = NULL;
-            free( id->p_decoder->p_owner );
-            return VLC_ENOMEM;
-        }
-        p_sys->p_buffers = NULL;
-        p_sys->b_abort = false;
-        if( vlc_clone( &p_sys->thread, EncoderThread, p_sys, i_priority ) )
+        static const transcode_stage_run_t pf_run[STAGE_COUNT] =
+            { DecodeStage, FilterStage, EncodeStage };
+        static const transcode_stage_run_t pf_run_ladder[STAGE_COUNT] =
+            { DecodeStage, FilterStage, NULL };
+        static const transcode_stage_release_t pf_release[STAGE_COUNT] =
+            { ReleaseBlock, ReleasePicture, ReleasePicture };
+
+        if( transcode_pipeline_start( p_stream, id,
+                                      id->p_renditions ? pf_run_ladder : pf_run,
+                                      pf_release ) )
         {
-            msg_Err( p_stream, "cannot spawn encoder thread" );
-            vlc_mutex_destroy( &p_sys->lock_out );
-            vlc_cond_destroy( &p_sys->cond );
-            picture_fifo_Delete( p_sys->pp_pics );
+            transcode_ladder_close( p_stream, id );
             module_unneed( id->p_decoder, id->p_decoder->p_module );
             id->p_decoder->p_module = NULL;
             free( id->p_decoder->p_owner );
@@ -329,19 +305,13 @@ static void conversion_video_filter_append( sout_stream_id_t *id )
     }
 }
 
-static void transcode_video_encoder_init( sout_stream_t *p_stream,
-                                          sout_stream_id_t *id )
+/* Computes the encoder formats from the format of the filtered pictures */
+static void transcode_video_encoder_format( sout_stream_t *p_stream,
+                                            const es_format_t *p_fmt_out,
+                                            encoder_t *p_enc )
 {
     sout_stream_sys_t *p_sys = p_stream->p_sys;
 
-    const es_format_t *p_fmt_out = &id->p_decoder->fmt_out;
-    if( id->p_f_chain ) {
-        p_fmt_out = filter_chain_GetFmtOut( id->p_f_chain );
-    }
-    if( id->p_uf_chain ) {
-        p_fmt_out = filter_chain_GetFmtOut( id->p_uf_chain );
-    }
-
     /* Calculate scaling
      * width/height of source */
     int i_src_width = p_fmt_out->video.i_width;
@@ -368,8 +338,8 @@ static void transcode_video_encoder_init( sout_stream_t *p_stream,
     msg_Dbg( p_stream, "source pixel aspect is %f:1", f_aspect );
 
     /* Calculate scaling factor for specified parameters */
-    if( id->p_encoder->fmt_out.video.i_width <= 0 &&
-        id->p_encoder->fmt_out.video.i_height <= 0 && p_sys->f_scale )
+    if( p_enc->fmt_out.video.i_width <= 0 &&
+        p_enc->fmt_out.video.i_height <= 0 && p_sys->f_scale )
     {
         /* Global scaling. Make sure width will remain a factor of 16 */
         float f_real_scale;
@@ -388,26 +358,26 @@ static void transcode_video_encoder_init( sout_stream_t *p_stream,
         f_scale_width = f_real_scale;
         f_scale_height = (float) i_new_height / (float) i_src_height;
     }
-    else if( id->p_encoder->fmt_out.video.i_width > 0 &&
-             id->p_encoder->fmt_out.video.i_height <= 0 )
+    else if( p_enc->fmt_out.video.i_width > 0 &&
+             p_enc->fmt_out.video.i_height <= 0 )
     {
         /* Only width specified */
-        f_scale_width = (float)id->p_encoder->fmt_out.video.i_width/i_src_width;
+        f_scale_width = (float)p_enc->fmt_out.video.i_width/i_src_width;
         f_scale_height = f_scale_width;
     }
-    else if( id->p_encoder->fmt_out.video.i_width <= 0 &&
-             id->p_encoder->fmt_out.video.i_height > 0 )
+    else if( p_enc->fmt_out.video.i_width <= 0 &&
+             p_enc->fmt_out.video.i_height > 0 )
     {
          /* Only height specified */
-         f_scale_height = (float)id->p_encoder->fmt_out.video.i_height/i_src_height;
+         f_scale_height = (float)p_enc->fmt_out.video.i_height/i_src_height;
          f_scale_width = f_scale_height;
      }
-     else if( id->p_encoder->fmt_out.video.i_width > 0 &&
-              id->p_encoder->fmt_out.video.i_height > 0 )
+     else if( p_enc->fmt_out.video.i_width > 0 &&
+              p_enc->fmt_out.video.i_height > 0 )
      {
          /* Width and height specified */
-         f_scale_width = (float)id->p_encoder->fmt_out.video.i_width/i_src_width;
-         f_scale_height = (float)id->p_encoder->fmt_out.video.i_height/i_src_height;
+         f_scale_width = (float)p_enc->fmt_out.video.i_width/i_src_width;
+         f_scale_height = (float)p_enc->fmt_out.video.i_height/i_src_height;
      }
 
      /* check maxwidth and maxheight */
@@ -439,15 +409,15 @@ static void transcode_video_encoder_init( sout_stream_t *p_stream,
      f_aspect = f_aspect * i_dst_width / i_dst_height;
 
      /* Store calculated values */
-     id->p_encoder->fmt_out.video.i_width =
-     id->p_encoder->fmt_out.video.i_visible_width = i_dst_width;
-     id->p_encoder->fmt_out.video.i_height =
-     id->p_encoder->fmt_out.video.i_visible_height = i_dst_height;
+     p_enc->fmt_out.video.i_width =
+     p_enc->fmt_out.video.i_visible_width = i_dst_width;
+     p_enc->fmt_out.video.i_height =
+     p_enc->fmt_out.video.i_visible_height = i_dst_height;
 
-     id->p_encoder->fmt_in.video.i_width =
-     id->p_encoder->fmt_in.video.i_visible_width = i_dst_width;
-     id->p_encoder->fmt_in.video.i_height =
-     id->p_encoder->fmt_in.video.i_visible_height = i_dst_height;
+     p_enc->fmt_in.video.i_width =
+     p_enc->fmt_in.video.i_visible_width = i_dst_width;
+     p_enc->fmt_in.video.i_height =
+     p_enc->fmt_in.video.i_visible_height = i_dst_height;
 
      msg_Dbg( p_stream, "source %ix%i, destination %ix%i",
          i_src_width, i_src_height,
@@ -455,63 +425,77 @@ static void transcode_video_encoder_init( sout_stream_t *p_stream,
      );
 
     /* Handle frame rate conversion */
-    if( !id->p_encoder->fmt_out.video.i_frame_rate ||
-        !id->p_encoder->fmt_out.video.i_frame_rate_base )
+    if( !p_enc->fmt_out.video.i_frame_rate ||
+        !p_enc->fmt_out.video.i_frame_rate_base )
     {
         if( p_fmt_out->video.i_frame_rate &&
             p_fmt_out->video.i_frame_rate_base )
         {
-            id->p_encoder->fmt_out.video.i_frame_rate =
+            p_enc->fmt_out.video.i_frame_rate =
                 p_fmt_out->video.i_frame_rate;
-            id->p_encoder->fmt_out.video.i_frame_rate_base =
+            p_enc->fmt_out.video.i_frame_rate_base =
                 p_fmt_out->video.i_frame_rate_base;
         }
         else
         {
             /* Pick a sensible default value */
-            id->p_encoder->fmt_out.video.i_frame_rate = ENC_FRAMERATE;
-            id->p_encoder->fmt_out.video.i_frame_rate_base = ENC_FRAMERATE_BASE;
+            p_enc->fmt_out.video.i_frame_rate = ENC_FRAMERATE;
+            p_enc->fmt_out.video.i_frame_rate_base = ENC_FRAMERATE_BASE;
         }
     }
 
-    id->p_encoder->fmt_in.video.i_frame_rate =
-        id->p_encoder->fmt_out.video.i_frame_rate;
-    id->p_encoder->fmt_in.video.i_frame_rate_base =
-        id->p_encoder->fmt_out.video.i_frame_rate_base;
-
-    date_Init( &id->interpolated_pts,
-               id->p_encoder->fmt_out.video.i_frame_rate,
-               id->p_encoder->fmt_out.video.i_frame_rate_base );
+    p_enc->fmt_in.video.i_frame_rate =
+        p_enc->fmt_out.video.i_frame_rate;
+    p_enc->fmt_in.video.i_frame_rate_base =
+        p_enc->fmt_out.video.i_frame_rate_base;
 
     /* Check whether a particular aspect ratio was requested */
-    if( id->p_encoder->fmt_out.video.i_sar_num <= 0 ||
-        id->p_encoder->fmt_out.video.i_sar_den <= 0 )
+    if( p_enc->fmt_out.video.i_sar_num <= 0 ||
+        p_enc->fmt_out.video.i_sar_den <= 0 )
     {
-        vlc_ureduce( &id->p_encoder->fmt_out.video.i_sar_num,
-                     &id->p_encoder->fmt_out.video.i_sar_den,
+        vlc_ureduce( &p_enc->fmt_out.video.i_sar_num,
+                     &p_enc->fmt_out.video.i_sar_den,
                      (uint64_t)p_fmt_out->video.i_sar_num * i_src_width  * i_dst_height,
                      (uint64_t)p_fmt_out->video.i_sar_den * i_src_height * i_dst_width,
                      0 );
     }
     else
     {
-        vlc_ureduce( &id->p_encoder->fmt_out.video.i_sar_num,
-                     &id->p_encoder->fmt_out.video.i_sar_den,
-                     id->p_encoder->fmt_out.video.i_sar_num,
-                     id->p_encoder->fmt_out.video.i_sar_den,
+        vlc_ureduce( &p_enc->fmt_out.video.i_sar_num,
+                     &p_enc->fmt_out.video.i_sar_den,
+                     p_enc->fmt_out.video.i_sar_num,
+                     p_enc->fmt_out.video.i_sar_den,
                      0 );
     }
 
-    id->p_encoder->fmt_in.video.i_sar_num =
-        id->p_encoder->fmt_out.video.i_sar_num;
-    id->p_encoder->fmt_in.video.i_sar_den =
-        id->p_encoder->fmt_out.video.i_sar_den;
+    p_enc->fmt_in.video.i_sar_num =
+        p_enc->fmt_out.video.i_sar_num;
+    p_enc->fmt_in.video.i_sar_den =
+        p_enc->fmt_out.video.i_sar_den;
 
     msg_Dbg( p_stream, "encoder aspect is %i:%i",
-             id->p_encoder->fmt_out.video.i_sar_num * id->p_encoder->fmt_out.video.i_width,
-             id->p_encoder->fmt_out.video.i_sar_den * id->p_encoder->fmt_out.video.i_height );
+             p_enc->fmt_out.video.i_sar_num * p_enc->fmt_out.video.i_width,
+             p_enc->fmt_out.video.i_sar_den * p_enc->fmt_out.video.i_height );
 
-    id->p_encoder->fmt_in.video.i_chroma = id->p_encoder->fmt_in.i_codec;
+    p_enc->fmt_in.video.i_chroma = p_enc->fmt_in.i_codec;
+}
+
+static void transcode_video_encoder_init( sout_stream_t *p_stream,
+                                          sout_stream_id_t *id )
+{
+    const es_format_t *p_fmt_out = &id->p_decoder->fmt_out;
+    if( id->p_f_chain ) {
+        p_fmt_out = filter_chain_GetFmtOut( id->p_f_chain );
+    }
+    if( id->p_uf_chain ) {
+        p_fmt_out = filter_chain_GetFmtOut( id->p_uf_chain );
+    }
+
+    transcode_video_encoder_format( p_stream, p_fmt_out, id->p_encoder );
+
+    date_Init( &id->interpolated_pts,
+               id->p_encoder->fmt_out.video.i_frame_rate,
+               id->p_encoder->fmt_out.video.i_frame_rate_base );
 }
 
 static int transcode_video_encoder_open( sout_stream_t *p_stream,
@@ -540,7 +524,15 @@ static int transcode_video_encoder_open( sout_stream_t *p_stream,
     id->p_encoder->fmt_out.i_codec =
         vlc_fourcc_GetCodec( VIDEO_ES, id->p_encoder->fmt_out.i_codec );
 
-    id->id = sout_StreamIdAdd( p_stream->p_next, &id->p_encoder->fmt_out );
+    return VLC_SUCCESS;
+}
+
+/* The next stream must only be called from Send(), this is done once the
+ * encoder is opened. */
+static int transcode_video_stream_add( sout_stream_t *p_stream,
+                                       sout_stream_id_t *id )
+{
+    id->id = transcode_output_add( p_stream, &id->p_encoder->fmt_out );
     if( !id->id )
     {
         msg_Err( p_stream, "cannot add this stream" );
@@ -553,20 +545,9 @@ static int transcode_video_encoder_open( sout_stream_t *p_stream,
 void transcode_video_close( sout_stream_t *p_stream,
                                    sout_stream_id_t *id )
 {
-    if( p_stream->p_sys->i_threads >= 1 )
-    {
-        vlc_mutex_lock( &p_stream->p_sys->lock_out );
-        p_stream->p_sys->b_abort = true;
-        vlc_cond_signal( &p_stream->p_sys->cond );
-        vlc_mutex_unlock( &p_stream->p_sys->lock_out );
-
-        vlc_join( p_stream->p_sys->thread, NULL );
-        vlc_mutex_destroy( &p_stream->p_sys->lock_out );
-        vlc_cond_destroy( &p_stream->p_sys->cond );
-
-        picture_fifo_Delete( p_stream->p_sys->pp_pics );
-        p_stream->p_sys->pp_pics = NULL;
-    }
+    /* Stop the threads first, they use everything below */
+    transcode_pipeline_stop( id );
+    transcode_ladder_close( p_stream, id );
 
     /* Close decoder */
     if( id->p_decoder->p_module )
@@ -587,6 +568,263 @@ void transcode_video_close( sout_stream_t *p_stream,
         filter_chain_Delete( id->p_uf_chain );
 }
 
+/*****************************************************************************
+ * Ladder: every rendition scales and encodes the filtered pictures in its
+ * own thread. The pictures are shared by reference.
+ *****************************************************************************/
+static void RenditionStage( void *data, void *item )
+{
+    transcode_rendition_t *p_rend = data;
+    picture_t *p_pic = item;
+
+    if( p_rend->p_f_chain )
+        p_pic = filter_chain_VideoFilter( p_rend->p_f_chain, p_pic );
+    if( !p_pic )
+        return;
+
+    block_t *p_block =
+        p_rend->p_encoder->pf_encode_video( p_rend->p_encoder, p_pic );
+    picture_Release( p_pic );
+
+    vlc_mutex_lock( &p_rend->lock );
+    block_ChainAppend( &p_rend->p_buffers, p_block );
+    vlc_mutex_unlock( &p_rend->lock );
+}
+
+static int transcode_ladder_new( sout_stream_t *p_stream,
+                                 sout_stream_id_t *id )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    int i_priority = p_sys->b_high_priority ? VLC_THREAD_PRIORITY_OUTPUT :
+                     VLC_THREAD_PRIORITY_VIDEO;
+
+    id->p_renditions = calloc( p_sys->i_ladder, sizeof(*id->p_renditions) );
+    if( !id->p_renditions )
+        return VLC_ENOMEM;
+
+    for( int i = 0; i < p_sys->i_ladder; i++ )
+    {
+        transcode_rendition_t *p_rend = &id->p_renditions[i];
+
+        p_rend->p_encoder = sout_EncoderCreate( p_stream );
+        if( !p_rend->p_encoder )
+            goto error;
+        p_rend->p_encoder->p_module = NULL;
+        es_format_Init( &p_rend->p_encoder->fmt_in, VIDEO_ES, 0 );
+        es_format_Init( &p_rend->p_encoder->fmt_out, VIDEO_ES, 0 );
+
+        vlc_mutex_init( &p_rend->lock );
+        if( transcode_stage_start( &p_rend->stage, VLC_OBJECT(p_stream),
+                                   "video rendition", p_sys->i_queue_depth,
+                                   i_priority, RenditionStage, ReleasePicture,
+                                   p_rend ) )
+        {
+            vlc_mutex_destroy( &p_rend->lock );
+            vlc_object_release( p_rend->p_encoder );
+            p_rend->p_encoder = NULL;
+            goto error;
+        }
+    }
+    return VLC_SUCCESS;
+
+error:
+    transcode_ladder_close( p_stream, id );
+    return VLC_EGENERIC;
+}
+
+static void transcode_ladder_close( sout_stream_t *p_stream,
+                                    sout_stream_id_t *id )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    if( !id->p_renditions )
+        return;
+
+    for( int i = 0; i < p_sys->i_ladder; i++ )
+    {
+        transcode_rendition_t *p_rend = &id->p_renditions[i];
+        int i_output = p_sys->p_ladder[i].i_output;
+
+        if( !p_rend->p_encoder )
+            continue;
+
+        transcode_stage_stop( &p_rend->stage );
+        vlc_mutex_destroy( &p_rend->lock );
+        block_ChainRelease( p_rend->p_buffers );
+
+        if( p_rend->id )
+            sout_StreamIdDel( p_sys->pp_outputs[i_output], p_rend->id );
+        if( p_rend->p_encoder->p_module )
+            module_unneed( p_rend->p_encoder, p_rend->p_encoder->p_module );
+        if( p_rend->p_f_chain )
+            filter_chain_Delete( p_rend->p_f_chain );
+        es_format_Clean( &p_rend->p_encoder->fmt_in );
+        es_format_Clean( &p_rend->p_encoder->fmt_out );
+        vlc_object_release( p_rend->p_encoder );
+    }
+    free( id->p_renditions );
+    id->p_renditions = NULL;
+}
+
+/* Opens the rendition encoders for the format of the filtered pictures, or
+ * only rebuilds the scaling when that format changes. */
+static int transcode_ladder_open( sout_stream_t *p_stream,
+                                  sout_stream_id_t *id )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    const es_format_t *p_fmt_src = &id->p_encoder->fmt_in;
+
+    for( int i = 0; i < p_sys->i_ladder; i++ )
+    {
+        const transcode_ladder_t *p_rung = &p_sys->p_ladder[i];
+        transcode_rendition_t *p_rend = &id->p_renditions[i];
+        encoder_t *p_enc = p_rend->p_encoder;
+
+        if( !p_enc->p_module )
+        {
+            es_format_Clean( &p_enc->fmt_in );
+            es_format_Copy( &p_enc->fmt_in, p_fmt_src );
+            es_format_Clean( &p_enc->fmt_out );
+            es_format_Init( &p_enc->fmt_out, VIDEO_ES, p_sys->i_vcodec );
+            p_enc->fmt_out.i_id = id->p_encoder->fmt_out.i_id;
+            p_enc->fmt_out.i_group = id->p_encoder->fmt_out.i_group;
+            p_enc->fmt_out.i_bitrate = p_rung->i_bitrate > 0 ?
+                                       p_rung->i_bitrate : p_sys->i_vbitrate;
+            p_enc->fmt_out.video.i_width = p_rung->i_width & ~1;
+            p_enc->fmt_out.video.i_height = p_rung->i_height & ~1;
+            if( !p_enc->fmt_out.video.i_width && !p_enc->fmt_out.video.i_height )
+                p_enc->fmt_out.video.i_width = p_fmt_src->video.i_width;
+            /* Same frame rate everywhere, so that keyframes can line up */
+            p_enc->fmt_out.video.i_frame_rate =
+                id->p_encoder->fmt_out.video.i_frame_rate;
+            p_enc->fmt_out.video.i_frame_rate_base =
+                id->p_encoder->fmt_out.video.i_frame_rate_base;
+
+            transcode_video_encoder_format( p_stream, p_fmt_src, p_enc );
+
+            p_enc->i_threads = p_sys->i_threads;
+            p_enc->p_cfg = p_sys->p_video_cfg;
+            p_enc->p_module =
+                module_need( p_enc, "encoder", p_sys->psz_venc, true );
+            if( !p_enc->p_module )
+            {
+                msg_Err( p_stream, "cannot find video encoder (module:%s "
+                         "fourcc:%4.4s) for the %ux%u rendition",
+                         p_sys->psz_venc ? p_sys->psz_venc : "any",
+                         (char *)&p_sys->i_vcodec,
+                         p_enc->fmt_out.video.i_width,
+                         p_enc->fmt_out.video.i_height );
+                return VLC_EGENERIC;
+            }
+            p_enc->fmt_in.video.i_chroma = p_enc->fmt_in.i_codec;
+            p_enc->fmt_out.i_codec =
+                vlc_fourcc_GetCodec( VIDEO_ES, p_enc->fmt_out.i_codec );
+
+            msg_Dbg( p_stream, "rendition %d: %ix%i %ikb/s", i,
+                     p_enc->fmt_out.video.i_width,
+                     p_enc->fmt_out.video.i_height,
+                     p_enc->fmt_out.i_bitrate / 1000 );
+
+            vlc_mutex_lock( &p_rend->lock );
+            p_rend->b_ready = true;
+            vlc_mutex_unlock( &p_rend->lock );
+        }
+
+        /* Scaling and chroma conversion of the shared pictures */
+        if( p_rend->p_f_chain )
+            filter_chain_Delete( p_rend->p_f_chain );
+        p_rend->p_f_chain = filter_chain_New( p_stream, "video filter2",
+                                              false,
+                                   transcode_video_filter_allocation_init,
+                                   transcode_video_filter_allocation_clear,
+                                   p_sys );
+        if( !p_rend->p_f_chain )
+            return VLC_ENOMEM;
+        filter_chain_Reset( p_rend->p_f_chain, p_fmt_src, &p_enc->fmt_in );
+
+        if( p_fmt_src->video.i_chroma != p_enc->fmt_in.video.i_chroma ||
+            p_fmt_src->video.i_width != p_enc->fmt_in.video.i_width ||
+            p_fmt_src->video.i_height != p_enc->fmt_in.video.i_height )
+        {
+            filter_chain_AppendFilter( p_rend->p_f_chain, NULL, NULL,
+                                       p_fmt_src, &p_enc->fmt_in );
+        }
+    }
+    return VLC_SUCCESS;
+}
+
+static void transcode_ladder_push( sout_stream_t *p_stream,
+                                   sout_stream_id_t *id, picture_t *p_pic )
+{
+    int i_last = p_stream->p_sys->i_ladder - 1;
+
+    for( int i = 0; i < i_last; i++ )
+        transcode_stage_push( &id->p_renditions[i].stage,
+                              picture_Hold( p_pic ) );
+    transcode_stage_push( &id->p_renditions[i_last].stage, p_pic );
+}
+
+/* Waits for the rendition threads and flushes their encoders */
+static void transcode_ladder_flush( sout_stream_t *p_stream,
+                                    sout_stream_id_t *id )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    for( int i = 0; i < p_sys->i_ladder; i++ )
+        transcode_stage_drain( &id->p_renditions[i].stage );
+
+    for( int i = 0; i < p_sys->i_ladder; i++ )
+    {
+        transcode_rendition_t *p_rend = &id->p_renditions[i];
+        block_t *p_block;
+
+        if( !p_rend->p_encoder->p_module )
+            continue;
+        do {
+            p_block = p_rend->p_encoder->pf_encode_video( p_rend->p_encoder,
+                                                          NULL );
+            vlc_mutex_lock( &p_rend->lock );
+            block_ChainAppend( &p_rend->p_buffers, p_block );
+            vlc_mutex_unlock( &p_rend->lock );
+        } while( p_block );
+    }
+}
+
+/* Sends the encoded blocks of every rendition. The next streams must only
+ * be called from Send(). */
+static int transcode_ladder_output( sout_stream_t *p_stream,
+                                    sout_stream_id_t *id )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    for( int i = 0; i < p_sys->i_ladder; i++ )
+    {
+        transcode_rendition_t *p_rend = &id->p_renditions[i];
+        sout_stream_t *p_output = p_sys->pp_outputs[p_sys->p_ladder[i].i_output];
+
+        vlc_mutex_lock( &p_rend->lock );
+        bool b_ready = p_rend->b_ready;
+        block_t *p_out = p_rend->p_buffers;
+        p_rend->p_buffers = NULL;
+        vlc_mutex_unlock( &p_rend->lock );
+
+        if( b_ready && !p_rend->id )
+        {
+            p_rend->id = sout_StreamIdAdd( p_output,
+                                           &p_rend->p_encoder->fmt_out );
+            if( !p_rend->id )
+            {
+                msg_Err( p_stream, "cannot add this stream" );
+                block_ChainRelease( p_out );
+                return VLC_EGENERIC;
+            }
+        }
+        if( p_out )
+            sout_StreamIdSend( p_output, p_rend->id, p_out );
+    }
+    return VLC_SUCCESS;
+}
+
 static void OutputFrame( sout_stream_sys_t *p_sys, picture_t *p_pic, bool b_need_duplicate, sout_stream_t *p_stream, sout_stream_id_t *id, block_t **out )
 {
     picture_t *p_pic2 = NULL;
@@ -633,7 +871,7 @@ static void OutputFrame( sout_stream_sys_t *p_sys, picture_t *p_pic, bool b_need
         }
     }
 
-    if( p_sys->i_threads == 0 )
+    if( !id->b_pipeline && !id->p_renditions )
     {
         block_t *p_block;
 
@@ -659,7 +897,7 @@ static void OutputFrame( sout_stream_sys_t *p_sys, picture_t *p_pic, bool b_need
         if( unlikely( b_need_duplicate ) )
         {
 
-           if( p_sys->i_threads >= 1 )
+           if( id->b_pipeline || id->p_renditions )
            {
                /* We can't modify the picture, we need to duplicate it */
                p_pic2 = video_new_buffer_encoder( id->p_encoder );
@@ -679,197 +917,332 @@ static void OutputFrame( sout_stream_sys_t *p_sys, picture_t *p_pic, bool b_need
        }
     }
 
-    if( p_sys->i_threads == 0 )
+    if( id->p_renditions )
+    {
+        transcode_ladder_push( p_stream, id, p_pic );
+        if( p_pic2 != NULL )
+            transcode_ladder_push( p_stream, id, p_pic2 );
+    }
+    else if( !id->b_pipeline )
     {
         picture_Release( p_pic );
     }
     else
     {
-        vlc_mutex_lock( &p_sys->lock_out );
-        picture_fifo_Push( p_sys->pp_pics, p_pic );
+        transcode_stage_push( &id->stages[STAGE_ENCODE], p_pic );
         if( p_pic2 != NULL )
-        {
-            picture_fifo_Push( p_sys->pp_pics, p_pic2 );
-        }
-        vlc_cond_signal( &p_sys->cond );
-        vlc_mutex_unlock( &p_sys->lock_out );
+            transcode_stage_push( &id->stages[STAGE_ENCODE], p_pic2 );
     }
 }
 
-int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_t *id,
-                                    block_t *in, block_t **out )
+/* Sets the filters and the encoder up for the format of the decoded
+ * pictures, when it is first known or when it changes. */
+static int transcode_video_prepare( sout_stream_t *p_stream,
+                                    sout_stream_id_t *id )
 {
     sout_stream_sys_t *p_sys = p_stream->p_sys;
-    bool b_need_duplicate = false;
-    picture_t *p_pic;
-    *out = NULL;
+    bool b_opened = id->p_renditions ?
+                    id->p_renditions[0].p_encoder->p_module != NULL :
+                    id->p_encoder->p_module != NULL;
 
-    if( unlikely( in == NULL ) )
-    {
-        if( p_sys->i_threads == 0 )
-        {
-            block_t *p_block;
-            do {
-                p_block = id->p_encoder->pf_encode_video(id->p_encoder, NULL );
-                block_ChainAppend( out, p_block );
-            } while( p_block );
-        }
-        else
-        {
-            /*
-             * FIXME: we need EncoderThread() to flush buffers and signal us
-             * when it's done so we can send the last frames to the chain
-             */
-        }
+    if( likely( b_opened &&
+                video_format_IsSimilar( &id->fmt_input,
+                                        &id->p_decoder->fmt_out.video ) ) )
         return VLC_SUCCESS;
+
+    /* Pictures of the previous format must go through the filters and the
+     * encoders before those are reconfigured */
+    if( id->b_pipeline )
+        transcode_stage_drain( &id->stages[STAGE_FILTER] );
+    if( id->p_renditions )
+    {
+        for( int i = 0; i < p_sys->i_ladder; i++ )
+            transcode_stage_drain( &id->p_renditions[i].stage );
     }
+    else if( id->b_pipeline )
+        transcode_stage_drain( &id->stages[STAGE_ENCODE] );
 
+    if( b_opened )
+    {
+        msg_Info( p_stream, "aspect-ratio changed, reiniting. %i -> %i : %i -> %i.",
+                    id->fmt_input.i_sar_num, id->p_decoder->fmt_out.video.i_sar_num,
+                    id->fmt_input.i_sar_den, id->p_decoder->fmt_out.video.i_sar_den
+                );
+
+        /* Reinitialize filters */
+        id->p_encoder->fmt_out.video.i_width  = p_sys->i_width & ~1;
+        id->p_encoder->fmt_out.video.i_height = p_sys->i_height & ~1;
+        id->p_encoder->fmt_out.video.i_sar_num = id->p_encoder->fmt_out.video.i_sar_den = 0;
+    }
 
-    while( (p_pic = id->p_decoder->pf_decode_video( id->p_decoder, &in )) )
+    /* Close filters */
+    if( id->p_f_chain )
+        filter_chain_Delete( id->p_f_chain );
+    if( id->p_uf_chain )
+        filter_chain_Delete( id->p_uf_chain );
+    id->p_f_chain = id->p_uf_chain = NULL;
+
+    transcode_video_filter_init( p_stream, id );
+    transcode_video_encoder_init( p_stream, id );
+    conversion_video_filter_append( id );
+    memcpy( &id->fmt_input, &id->p_decoder->fmt_out.video, sizeof(video_format_t));
+
+    if( id->p_renditions )
+        return transcode_ladder_open( p_stream, id );
+    if( id->p_encoder->p_module )
+        return VLC_SUCCESS;
+
+    if( transcode_video_encoder_open( p_stream, id ) != VLC_SUCCESS )
+        return VLC_EGENERIC;
+
+    if( id->b_pipeline )
     {
+        vlc_mutex_lock( &id->lock_out );
+        id->b_encoder_ready = true;
+        vlc_mutex_unlock( &id->lock_out );
+        return VLC_SUCCESS;
+    }
+    return transcode_video_stream_add( p_stream, id );
+}
+
+/* Drops or duplicates the picture to keep in sync, and runs it through the
+ * filters towards the encoder. */
+static void transcode_video_filter( sout_stream_t *p_stream,
+                                    sout_stream_id_t *id, picture_t *p_pic,
+                                    block_t **out )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    bool b_need_duplicate = false;
 
-        if( p_stream->p_sout->i_out_pace_nocontrol && p_sys->b_hurry_up )
+    if( p_stream->p_sout->i_out_pace_nocontrol && p_sys->b_hurry_up )
+    {
+        mtime_t current_date = mdate();
+        if( unlikely( current_date + 50000 > p_pic->date ) )
         {
-            mtime_t current_date = mdate();
-            if( unlikely( current_date + 50000 > p_pic->date ) )
-            {
-                msg_Dbg( p_stream, "late picture skipped (%"PRId64")",
-                         current_date + 50000 - p_pic->date );
-                picture_Release( p_pic );
-                continue;
-            }
+            msg_Dbg( p_stream, "late picture skipped (%"PRId64")",
+                     current_date + 50000 - p_pic->date );
+            picture_Release( p_pic );
+            return;
         }
+    }
 
-        if( p_sys->b_master_sync )
-        {
-            mtime_t i_master_drift = p_sys->i_master_drift;
-            mtime_t i_pts = date_Get( &id->interpolated_pts ) + 1;
-            mtime_t i_video_drift = p_pic->date - i_pts;
+    if( p_sys->b_master_sync )
+    {
+        mtime_t i_master_drift = atomic_load( &p_sys->i_master_drift );
+        mtime_t i_pts = date_Get( &id->interpolated_pts ) + 1;
+        mtime_t i_video_drift = p_pic->date - i_pts;
 
-            if ( unlikely( i_video_drift > MASTER_SYNC_MAX_DRIFT
-                  || i_video_drift < -MASTER_SYNC_MAX_DRIFT ) )
-            {
-                msg_Dbg( p_stream,
-                    "drift is too high (%"PRId64", resetting master sync",
-                    i_video_drift );
-                date_Set( &id->interpolated_pts, p_pic->date );
-                i_pts = p_pic->date + 1;
-            }
-            i_video_drift = p_pic->date - i_pts;
-            b_need_duplicate = false;
+        if ( unlikely( i_video_drift > MASTER_SYNC_MAX_DRIFT
+              || i_video_drift < -MASTER_SYNC_MAX_DRIFT ) )
+        {
+            msg_Dbg( p_stream,
+                "drift is too high (%"PRId64", resetting master sync",
+                i_video_drift );
+            date_Set( &id->interpolated_pts, p_pic->date );
+            i_pts = p_pic->date + 1;
+        }
+        i_video_drift = p_pic->date - i_pts;
 
-            /* Set the pts of the frame being encoded */
-            p_pic->date = i_pts;
+        /* Set the pts of the frame being encoded */
+        p_pic->date = i_pts;
 
-            if( unlikely( i_video_drift < (i_master_drift - 50000) ) )
-            {
-#if 0
-                msg_Dbg( p_stream, "dropping frame (%i)",
-                         (int)(i_video_drift - i_master_drift) );
-#endif
-                picture_Release( p_pic );
-                continue;
-            }
-            else if( unlikely( i_video_drift > (i_master_drift + 50000) ) )
-            {
+        if( unlikely( i_video_drift < (i_master_drift - 50000) ) )
+        {
 #if 0
-                msg_Dbg( p_stream, "adding frame (%i)",
-                         (int)(i_video_drift - i_master_drift) );
+            msg_Dbg( p_stream, "dropping frame (%i)",
+                     (int)(i_video_drift - i_master_drift) );
 #endif
-                b_need_duplicate = true;
-            }
+            picture_Release( p_pic );
+            return;
         }
-        if( unlikely (
-             id->p_encoder->p_module &&
-             !video_format_IsSimilar( &p_sys->fmt_input_video, &id->p_decoder->fmt_out.video )
-            )
-          )
+        else if( unlikely( i_video_drift > (i_master_drift + 50000) ) )
         {
-            msg_Info( p_stream, "aspect-ratio changed, reiniting. %i -> %i : %i -> %i.",
-                        p_sys->fmt_input_video.i_sar_num, id->p_decoder->fmt_out.video.i_sar_num,
-                        p_sys->fmt_input_video.i_sar_den, id->p_decoder->fmt_out.video.i_sar_den
-                    );
-            /* Close filters */
-            if( id->p_f_chain )
-                filter_chain_Delete( id->p_f_chain );
-            id->p_f_chain = NULL;
-            if( id->p_uf_chain )
-                filter_chain_Delete( id->p_uf_chain );
-            id->p_uf_chain = NULL;
-
-            /* Reinitialize filters */
-            id->p_encoder->fmt_out.video.i_width  = p_sys->i_width & ~1;
-            id->p_encoder->fmt_out.video.i_height = p_sys->i_height & ~1;
-            id->p_encoder->fmt_out.video.i_sar_num = id->p_encoder->fmt_out.video.i_sar_den = 0;
-
-            transcode_video_filter_init( p_stream, id );
-            transcode_video_encoder_init( p_stream, id );
-            conversion_video_filter_append( id );
-            memcpy( &p_sys->fmt_input_video, &id->p_decoder->fmt_out.video, sizeof(video_format_t));
+#if 0
+            msg_Dbg( p_stream, "adding frame (%i)",
+                     (int)(i_video_drift - i_master_drift) );
+#endif
+            b_need_duplicate = true;
         }
+    }
+
+    /* Run the filter and output chains; first with the picture,
+     * and then with NULL as many times as we need until they
+     * stop outputting frames.
+     */
+    for ( ;; ) {
+        picture_t *p_filtered_pic = p_pic;
 
+        /* Run filter chain */
+        if( id->p_f_chain )
+            p_filtered_pic = filter_chain_VideoFilter( id->p_f_chain, p_filtered_pic );
+        if( !p_filtered_pic )
+            break;
 
-        if( unlikely( !id->p_encoder->p_module ) )
-        {
-            if( id->p_f_chain )
-                filter_chain_Delete( id->p_f_chain );
+        for ( ;; ) {
+            picture_t *p_user_filtered_pic = p_filtered_pic;
+
+            /* Run user specified filter chain */
             if( id->p_uf_chain )
-                filter_chain_Delete( id->p_uf_chain );
-            id->p_f_chain = id->p_uf_chain = NULL;
+                p_user_filtered_pic = filter_chain_VideoFilter( id->p_uf_chain, p_user_filtered_pic );
+            if( !p_user_filtered_pic )
+                break;
 
-            transcode_video_filter_init( p_stream, id );
-            transcode_video_encoder_init( p_stream, id );
-            conversion_video_filter_append( id );
-            memcpy( &p_sys->fmt_input_video, &id->p_decoder->fmt_out.video, sizeof(video_format_t));
+            OutputFrame( p_sys, p_user_filtered_pic, b_need_duplicate, p_stream, id, out );
+            b_need_duplicate = false;
 
-            if( transcode_video_encoder_open( p_stream, id ) != VLC_SUCCESS )
+            p_filtered_pic = NULL;
+        }
+
+        p_pic = NULL;
+    }
+}
+
+/*****************************************************************************
+ * Pipeline stages (threads > 0)
+ *****************************************************************************/
+static void DecodeStage( void *data, void *item )
+{
+    sout_stream_id_t *id = data;
+    block_t *p_block = item;
+    picture_t *p_pic;
+
+    while( (p_pic = id->p_decoder->pf_decode_video( id->p_decoder, &p_block )) )
+    {
+        /* b_error is only written by this thread */
+        if( id->b_error ||
+            transcode_video_prepare( id->p_stream, id ) != VLC_SUCCESS )
+        {
+            picture_Release( p_pic );
+            if( !id->b_error )
             {
-                picture_Release( p_pic );
-                transcode_video_close( p_stream, id );
-                id->b_transcode = false;
-                return VLC_EGENERIC;
+                vlc_mutex_lock( &id->lock_out );
+                id->b_error = true;
+                vlc_mutex_unlock( &id->lock_out );
             }
+            continue;
         }
+        transcode_stage_push( &id->stages[STAGE_FILTER], p_pic );
+    }
+}
 
-        /* Run the filter and output chains; first with the picture,
-         * and then with NULL as many times as we need until they
-         * stop outputting frames.
-         */
-        for ( ;; ) {
-            picture_t *p_filtered_pic = p_pic;
+static void FilterStage( void *data, void *item )
+{
+    sout_stream_id_t *id = data;
 
-            /* Run filter chain */
-            if( id->p_f_chain )
-                p_filtered_pic = filter_chain_VideoFilter( id->p_f_chain, p_filtered_pic );
-            if( !p_filtered_pic )
-                break;
+    transcode_video_filter( id->p_stream, id, item, NULL );
+}
 
-            for ( ;; ) {
-                picture_t *p_user_filtered_pic = p_filtered_pic;
+static void EncodeStage( void *data, void *item )
+{
+    sout_stream_id_t *id = data;
+    picture_t *p_pic = item;
 
-                /* Run user specified filter chain */
-                if( id->p_uf_chain )
-                    p_user_filtered_pic = filter_chain_VideoFilter( id->p_uf_chain, p_user_filtered_pic );
-                if( !p_user_filtered_pic )
-                    break;
+    transcode_pipeline_output( id,
+        id->p_encoder->pf_encode_video( id->p_encoder, p_pic ) );
+    picture_Release( p_pic );
+}
 
-                OutputFrame( p_sys, p_user_filtered_pic, b_need_duplicate, p_stream, id, out );
-                b_need_duplicate = false;
+static int transcode_video_pipeline_process( sout_stream_t *p_stream,
+                                             sout_stream_id_t *id,
+                                             block_t *in, block_t **out )
+{
+    if( unlikely( in == NULL ) )
+    {
+        /* Once the threads are idle, the encoder can be flushed from here */
+        transcode_pipeline_drain( id );
+        if( id->b_error )
+            return VLC_EGENERIC;
+        if( id->p_renditions )
+        {
+            transcode_ladder_flush( p_stream, id );
+            return transcode_ladder_output( p_stream, id );
+        }
+        if( !id->b_encoder_ready )
+            return VLC_SUCCESS;
+        if( !id->id && transcode_video_stream_add( p_stream, id ) )
+            return VLC_EGENERIC;
 
-                p_filtered_pic = NULL;
-            }
+        block_t *p_block;
+        *out = transcode_pipeline_collect( id );
+        do {
+            p_block = id->p_encoder->pf_encode_video(id->p_encoder, NULL );
+            block_ChainAppend( out, p_block );
+        } while( p_block );
+        return VLC_SUCCESS;
+    }
+
+    /* This waits if the decoder thread is too far behind */
+    transcode_stage_push( &id->stages[STAGE_DECODE], in );
+
+    vlc_mutex_lock( &id->lock_out );
+    bool b_ready = id->b_encoder_ready;
+    bool b_error = id->b_error;
+    vlc_mutex_unlock( &id->lock_out );
 
-            p_pic = NULL;
+    if( id->p_renditions )
+    {
+        if( !b_error && transcode_ladder_output( p_stream, id ) )
+            b_error = true;
+    }
+    else if( b_ready && !id->id && transcode_video_stream_add( p_stream, id ) )
+        b_error = true;
+    if( unlikely( b_error ) )
+    {
+        transcode_video_close( p_stream, id );
+        id->b_transcode = false;
+        return VLC_EGENERIC;
+    }
+
+    /* Pick up any return data the encoder thread wants to output. */
+    *out = transcode_pipeline_collect( id );
+    return VLC_SUCCESS;
+}
+
+int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_t *id,
+                                    block_t *in, block_t **out )
+{
+    picture_t *p_pic;
+    *out = NULL;
+
+    if( id->b_pipeline )
+        return transcode_video_pipeline_process( p_stream, id, in, out );
+
+    if( unlikely( in == NULL ) )
+    {
+        if( id->p_renditions )
+        {
+            transcode_ladder_flush( p_stream, id );
+            return transcode_ladder_output( p_stream, id );
         }
+
+        block_t *p_block;
+        do {
+            p_block = id->p_encoder->pf_encode_video(id->p_encoder, NULL );
+            block_ChainAppend( out, p_block );
+        } while( p_block );
+        return VLC_SUCCESS;
     }
 
-    if( p_sys->i_threads >= 1 )
+    while( (p_pic = id->p_decoder->pf_decode_video( id->p_decoder, &in )) )
     {
-        /* Pick up any return data the encoder thread wants to output. */
-        vlc_mutex_lock( &p_sys->lock_out );
-        *out = p_sys->p_buffers;
-        p_sys->p_buffers = NULL;
-        vlc_mutex_unlock( &p_sys->lock_out );
+        if( transcode_video_prepare( p_stream, id ) != VLC_SUCCESS )
+        {
+            picture_Release( p_pic );
+            block_ChainRelease( *out );
+            *out = NULL;
+            transcode_video_close( p_stream, id );
+            id->b_transcode = false;
+            return VLC_EGENERIC;
+        }
+
+        transcode_video_filter( p_stream, id, p_pic, out );
+    }
+
+    if( id->p_renditions && transcode_ladder_output( p_stream, id ) )
+    {
+        transcode_video_close( p_stream, id );
+        id->b_transcode = false;
+        return VLC_EGENERIC;
     }
 
     return VLC_SUCCESS;
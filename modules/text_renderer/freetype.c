@@ -333,6 +333,73 @@ struct font_stack_t
     font_stack_t  *p_next;
 };
 
+/* Faces loaded for styled text, kept open across renderings */
+#define FACE_CACHE_SIZE 16
+
+typedef struct
+{
+    char    *psz_fontname;
+    int     i_style_flags;  /* STYLE_BOLD and STYLE_ITALIC only */
+    FT_Face p_face;         /* NULL when the default face must be used */
+} face_cache_entry_t;
+
+/* Rendered glyphs, least recently used ones are dropped first */
+#define GLYPH_CACHE_BUCKETS   256
+#define GLYPH_CACHE_MAX_BYTES (8 * 1024 * 1024)
+
+typedef struct glyph_cache_entry_t glyph_cache_entry_t;
+struct glyph_cache_entry_t
+{
+    /* Key */
+    FT_Face   p_face;
+    int       i_font_size;
+    int       i_style_flags;
+    int       i_outline_radius;
+    int       i_glyph_index;
+    FT_Vector pen;            /* sub-pixel part of the pen positions */
+    FT_Vector pen_shadow;
+
+    /* Glyphs rendered at the sub-pixel pen positions */
+    FT_Glyph  p_glyph;
+    FT_BBox   glyph_bbox;
+    FT_Glyph  p_outline;
+    FT_BBox   outline_bbox;
+    FT_Glyph  p_shadow;
+    FT_BBox   shadow_bbox;
+    FT_Vector advance;
+    size_t    i_bytes;
+
+    glyph_cache_entry_t *p_hash_next;
+    glyph_cache_entry_t *p_lru_prev;
+    glyph_cache_entry_t *p_lru_next;
+};
+
+typedef struct
+{
+    glyph_cache_entry_t *pp_buckets[GLYPH_CACHE_BUCKETS];
+    glyph_cache_entry_t *p_lru_first;   /* most recently used */
+    glyph_cache_entry_t *p_lru_last;
+    size_t              i_bytes;
+} glyph_cache_t;
+
+/* Laid out lines of the last rendered texts */
+#define LAYOUT_CACHE_SIZE 8
+
+typedef struct
+{
+    uni_char_t    *psz_text;
+    text_style_t  **pp_styles;
+    int           i_text_length;
+    unsigned      i_width;
+    unsigned      i_height;
+    int           i_outline_thickness;
+
+    line_desc_t   *p_lines;
+    FT_BBox       bbox;
+    int           i_max_face_height;
+    uint64_t      i_last_use;
+} layout_cache_entry_t;
+
 /*****************************************************************************
  * filter_sys_t: freetype local data
  *****************************************************************************
@@ -367,6 +434,12 @@ struct filter_sys_t
 
     input_attachment_t **pp_font_attachments;
     int                  i_font_attachments;
+
+    face_cache_entry_t   p_faces[FACE_CACHE_SIZE];
+    int                  i_faces;
+    glyph_cache_t        glyph_cache;
+    layout_cache_entry_t p_layouts[LAYOUT_CACHE_SIZE];
+    uint64_t             i_layout_clock;
 };
 
 /* */
@@ -2046,6 +2119,59 @@ static bool FaceStyleEquals( const text_style_t *p_style1,
            !strcmp( p_style1->psz_fontname, p_style2->psz_fontname );
 }
 
+static void GlyphCacheFlush( glyph_cache_t *p_cache );
+
+static void FaceCacheFlush( filter_t *p_filter )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    /* The glyph cache is keyed by faces */
+    GlyphCacheFlush( &p_sys->glyph_cache );
+
+    for( int i = 0; i < p_sys->i_faces; i++ )
+    {
+        face_cache_entry_t *p_entry = &p_sys->p_faces[i];
+        if( p_entry->p_face )
+            FT_Done_Face( p_entry->p_face );
+        free( p_entry->psz_fontname );
+    }
+    p_sys->i_faces = 0;
+}
+
+/* Returns the face matching a style, or NULL if the default face must be
+ * used. The face belongs to the cache. */
+static FT_Face GetFace( filter_t *p_filter, const text_style_t *p_style )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+    const int i_style_flags = p_style->i_style_flags & (STYLE_BOLD | STYLE_ITALIC);
+
+    for( int i = 0; i < p_sys->i_faces; i++ )
+    {
+        const face_cache_entry_t *p_entry = &p_sys->p_faces[i];
+        if( p_entry->i_style_flags == i_style_flags &&
+            !strcmp( p_entry->psz_fontname, p_style->psz_fontname ) )
+            return p_entry->p_face;
+    }
+
+    if( p_sys->i_faces >= FACE_CACHE_SIZE )
+        FaceCacheFlush( p_filter );
+
+    FT_Face p_face = LoadFace( p_filter, p_style );
+    char *psz_fontname = strdup( p_style->psz_fontname );
+    if( unlikely(!psz_fontname) )
+    {
+        if( p_face )
+            FT_Done_Face( p_face );
+        return NULL;
+    }
+
+    face_cache_entry_t *p_entry = &p_sys->p_faces[p_sys->i_faces++];
+    p_entry->psz_fontname  = psz_fontname;
+    p_entry->i_style_flags = i_style_flags;
+    p_entry->p_face        = p_face;
+    return p_face;
+}
+
 static int GetGlyph( filter_t *p_filter,
                      FT_Glyph *pp_glyph,   FT_BBox *p_glyph_bbox,
                      FT_Glyph *pp_outline, FT_BBox *p_outline_bbox,
@@ -2125,19 +2251,261 @@ static int GetGlyph( filter_t *p_filter,
     return VLC_SUCCESS;
 }
 
-static void FixGlyph( FT_Glyph glyph, FT_BBox *p_bbox, FT_Face face, const FT_Vector *p_pen )
+static size_t GlyphBytes( FT_Glyph glyph )
+{
+    if( !glyph )
+        return 0;
+    if( glyph->format != FT_GLYPH_FORMAT_BITMAP )
+        return sizeof(FT_OutlineGlyphRec);
+
+    const FT_Bitmap *p_bitmap = &((FT_BitmapGlyph)glyph)->bitmap;
+    return sizeof(FT_BitmapGlyphRec) + abs( p_bitmap->pitch ) * p_bitmap->rows;
+}
+
+static unsigned GlyphCacheHash( FT_Face p_face, int i_font_size,
+                                int i_style_flags, int i_outline_radius,
+                                int i_glyph_index, const FT_Vector *p_pen,
+                                const FT_Vector *p_pen_shadow )
+{
+    uint32_t i_hash = (uintptr_t)p_face >> 4;
+
+    i_hash = i_hash * 31 + i_font_size;
+    i_hash = i_hash * 31 + i_style_flags;
+    i_hash = i_hash * 31 + i_outline_radius;
+    i_hash = i_hash * 31 + i_glyph_index;
+    i_hash = i_hash * 31 + (p_pen->x | (p_pen->y << 6));
+    i_hash = i_hash * 31 + (p_pen_shadow->x | (p_pen_shadow->y << 6));
+    return i_hash % GLYPH_CACHE_BUCKETS;
+}
+
+static void GlyphCacheRemove( glyph_cache_t *p_cache,
+                              glyph_cache_entry_t *p_entry )
+{
+    const unsigned i_hash = GlyphCacheHash( p_entry->p_face,
+                                            p_entry->i_font_size,
+                                            p_entry->i_style_flags,
+                                            p_entry->i_outline_radius,
+                                            p_entry->i_glyph_index,
+                                            &p_entry->pen,
+                                            &p_entry->pen_shadow );
+    glyph_cache_entry_t **pp_entry = &p_cache->pp_buckets[i_hash];
+    while( *pp_entry != p_entry )
+        pp_entry = &(*pp_entry)->p_hash_next;
+    *pp_entry = p_entry->p_hash_next;
+
+    if( p_entry->p_lru_prev )
+        p_entry->p_lru_prev->p_lru_next = p_entry->p_lru_next;
+    else
+        p_cache->p_lru_first = p_entry->p_lru_next;
+    if( p_entry->p_lru_next )
+        p_entry->p_lru_next->p_lru_prev = p_entry->p_lru_prev;
+    else
+        p_cache->p_lru_last = p_entry->p_lru_prev;
+
+    p_cache->i_bytes -= p_entry->i_bytes;
+
+    FT_Done_Glyph( p_entry->p_glyph );
+    if( p_entry->p_outline )
+        FT_Done_Glyph( p_entry->p_outline );
+    if( p_entry->p_shadow )
+        FT_Done_Glyph( p_entry->p_shadow );
+    free( p_entry );
+}
+
+static void GlyphCacheInit( glyph_cache_t *p_cache )
+{
+    for( int i = 0; i < GLYPH_CACHE_BUCKETS; i++ )
+        p_cache->pp_buckets[i] = NULL;
+    p_cache->p_lru_first = NULL;
+    p_cache->p_lru_last  = NULL;
+    p_cache->i_bytes     = 0;
+}
+
+static void GlyphCacheFlush( glyph_cache_t *p_cache )
+{
+    while( p_cache->p_lru_last )
+        GlyphCacheRemove( p_cache, p_cache->p_lru_last );
+}
+
+static void ShiftGlyph( FT_Glyph glyph, FT_BBox *p_bbox, const FT_Vector *p_shift )
+{
+    if( glyph->format == FT_GLYPH_FORMAT_BITMAP )
+    {
+        FT_BitmapGlyph glyph_bmp = (FT_BitmapGlyph)glyph;
+        glyph_bmp->left += p_shift->x;
+        glyph_bmp->top  += p_shift->y;
+    }
+    else
+    {
+        FT_Vector delta = { .x = p_shift->x * 64, .y = p_shift->y * 64 };
+        FT_Glyph_Transform( glyph, NULL, &delta );
+    }
+    p_bbox->xMin += p_shift->x;
+    p_bbox->xMax += p_shift->x;
+    p_bbox->yMin += p_shift->y;
+    p_bbox->yMax += p_shift->y;
+}
+
+/* Same as GetGlyph() but going through the glyph cache. Only the sub-pixel
+ * part of the pen positions changes the bitmaps, so glyphs are cached for
+ * it and moved by the integer part when used. */
+static int GetCachedGlyph( filter_t *p_filter,
+                           FT_Glyph *pp_glyph,   FT_BBox *p_glyph_bbox,
+                           FT_Glyph *pp_outline, FT_BBox *p_outline_bbox,
+                           FT_Glyph *pp_shadow,  FT_BBox *p_shadow_bbox,
+                           FT_Vector *p_advance,
+
+                           FT_Face  p_face,
+                           int i_font_size,
+                           int i_outline_radius,
+                           int i_glyph_index,
+                           int i_style_flags,
+                           const FT_Vector *p_pen,
+                           const FT_Vector *p_pen_shadow )
+{
+    glyph_cache_t *p_cache = &p_filter->p_sys->glyph_cache;
+    FT_Vector pen = { .x = p_pen->x & 63, .y = p_pen->y & 63 };
+    FT_Vector pen_shadow = { .x = 0, .y = 0 };
+    if( p_filter->p_sys->i_shadow_opacity > 0 )
+    {
+        pen_shadow.x = p_pen_shadow->x & 63;
+        pen_shadow.y = p_pen_shadow->y & 63;
+    }
+    const FT_Vector shift = { .x = FT_FLOOR(p_pen->x), .y = FT_FLOOR(p_pen->y) };
+    const FT_Vector shift_shadow = { .x = FT_FLOOR(p_pen_shadow->x),
+                                     .y = FT_FLOOR(p_pen_shadow->y) };
+
+    i_style_flags &= STYLE_BOLD | STYLE_ITALIC;
+
+    const unsigned i_hash = GlyphCacheHash( p_face, i_font_size, i_style_flags,
+                                            i_outline_radius, i_glyph_index,
+                                            &pen, &pen_shadow );
+    glyph_cache_entry_t *p_entry;
+    for( p_entry = p_cache->pp_buckets[i_hash]; p_entry; p_entry = p_entry->p_hash_next )
+    {
+        if( p_entry->p_face == p_face &&
+            p_entry->i_font_size == i_font_size &&
+            p_entry->i_style_flags == i_style_flags &&
+            p_entry->i_outline_radius == i_outline_radius &&
+            p_entry->i_glyph_index == i_glyph_index &&
+            p_entry->pen.x == pen.x && p_entry->pen.y == pen.y &&
+            p_entry->pen_shadow.x == pen_shadow.x &&
+            p_entry->pen_shadow.y == pen_shadow.y )
+            break;
+    }
+
+    if( p_entry )
+    {
+        /* Move it in front of the LRU list */
+        if( p_entry->p_lru_prev )
+        {
+            p_entry->p_lru_prev->p_lru_next = p_entry->p_lru_next;
+            if( p_entry->p_lru_next )
+                p_entry->p_lru_next->p_lru_prev = p_entry->p_lru_prev;
+            else
+                p_cache->p_lru_last = p_entry->p_lru_prev;
+
+            p_entry->p_lru_prev = NULL;
+            p_entry->p_lru_next = p_cache->p_lru_first;
+            p_cache->p_lru_first->p_lru_prev = p_entry;
+            p_cache->p_lru_first = p_entry;
+        }
+    }
+    else
+    {
+        p_entry = malloc( sizeof(*p_entry) );
+        if( unlikely(!p_entry) )
+            return VLC_ENOMEM;
+
+        if( GetGlyph( p_filter,
+                      &p_entry->p_glyph, &p_entry->glyph_bbox,
+                      &p_entry->p_outline, &p_entry->outline_bbox,
+                      &p_entry->p_shadow, &p_entry->shadow_bbox,
+                      p_face, i_glyph_index, i_style_flags,
+                      &pen, &pen_shadow ) )
+        {
+            free( p_entry );
+            return VLC_EGENERIC;
+        }
+        p_entry->p_face           = p_face;
+        p_entry->i_font_size      = i_font_size;
+        p_entry->i_style_flags    = i_style_flags;
+        p_entry->i_outline_radius = i_outline_radius;
+        p_entry->i_glyph_index    = i_glyph_index;
+        p_entry->pen              = pen;
+        p_entry->pen_shadow       = pen_shadow;
+        p_entry->advance          = p_face->glyph->advance;
+        p_entry->i_bytes          = sizeof(*p_entry) +
+                                    GlyphBytes( p_entry->p_glyph ) +
+                                    GlyphBytes( p_entry->p_outline ) +
+                                    GlyphBytes( p_entry->p_shadow );
+
+        while( p_cache->p_lru_last &&
+               p_cache->i_bytes + p_entry->i_bytes > GLYPH_CACHE_MAX_BYTES )
+            GlyphCacheRemove( p_cache, p_cache->p_lru_last );
+
+        p_entry->p_hash_next = p_cache->pp_buckets[i_hash];
+        p_cache->pp_buckets[i_hash] = p_entry;
+
+        p_entry->p_lru_prev = NULL;
+        p_entry->p_lru_next = p_cache->p_lru_first;
+        if( p_cache->p_lru_first )
+            p_cache->p_lru_first->p_lru_prev = p_entry;
+        else
+            p_cache->p_lru_last = p_entry;
+        p_cache->p_lru_first = p_entry;
+        p_cache->i_bytes += p_entry->i_bytes;
+    }
+
+    /* The lines own their glyphs */
+    FT_Glyph glyph, outline = NULL, shadow = NULL;
+    if( FT_Glyph_Copy( p_entry->p_glyph, &glyph ) )
+        return VLC_ENOMEM;
+    if( ( p_entry->p_outline && FT_Glyph_Copy( p_entry->p_outline, &outline ) ) ||
+        ( p_entry->p_shadow && FT_Glyph_Copy( p_entry->p_shadow, &shadow ) ) )
+    {
+        FT_Done_Glyph( glyph );
+        if( outline )
+            FT_Done_Glyph( outline );
+        return VLC_ENOMEM;
+    }
+
+    *p_glyph_bbox = p_entry->glyph_bbox;
+    ShiftGlyph( glyph, p_glyph_bbox, &shift );
+    *pp_glyph = glyph;
+
+    if( outline )
+    {
+        *p_outline_bbox = p_entry->outline_bbox;
+        ShiftGlyph( outline, p_outline_bbox, &shift );
+    }
+    *pp_outline = outline;
+
+    if( shadow )
+    {
+        *p_shadow_bbox = p_entry->shadow_bbox;
+        ShiftGlyph( shadow, p_shadow_bbox, &shift_shadow );
+    }
+    *pp_shadow = shadow;
+
+    *p_advance = p_entry->advance;
+    return VLC_SUCCESS;
+}
+
+static void FixGlyph( FT_Glyph glyph, FT_BBox *p_bbox, const FT_Vector *p_advance,
+                      const FT_Vector *p_pen )
 {
     FT_BitmapGlyph glyph_bmp = (FT_BitmapGlyph)glyph;
     if( p_bbox->xMin >= p_bbox->xMax )
     {
         p_bbox->xMin = FT_CEIL(p_pen->x);
-        p_bbox->xMax = FT_CEIL(p_pen->x + face->glyph->advance.x);
+        p_bbox->xMax = FT_CEIL(p_pen->x + p_advance->x);
         glyph_bmp->left = p_bbox->xMin;
     }
     if( p_bbox->yMin >= p_bbox->yMax )
     {
         p_bbox->yMax = FT_CEIL(p_pen->y);
-        p_bbox->yMin = FT_CEIL(p_pen->y + face->glyph->advance.y);
+        p_bbox->yMin = FT_CEIL(p_pen->y + p_advance->y);
         glyph_bmp->top  = p_bbox->yMax;
     }
 }
@@ -2263,6 +2631,7 @@ static int ProcessLines( filter_t *p_filter,
     int i_base_line = 0;
     const text_style_t *p_previous_style = NULL;
     FT_Face p_face = NULL;
+    int i_outline_radius = 0;
     for( int i_start = 0; i_start < i_len; )
     {
         /* Compute the length of the current text line */
@@ -2326,11 +2695,9 @@ static int ProcessLines( filter_t *p_filter,
             /* (Re)load/reconfigure the face if needed */
             if( !FaceStyleEquals( p_current_style, p_previous_style ) )
             {
-                if( p_face )
-                    FT_Done_Face( p_face );
                 p_previous_style = NULL;
 
-                p_face = LoadFace( p_filter, p_current_style );
+                p_face = GetFace( p_filter, p_current_style );
             }
             FT_Face p_current_face = p_face ? p_face : p_sys->p_face;
             if( !p_previous_style || p_previous_style->i_font_size != p_current_style->i_font_size )
@@ -2341,9 +2708,9 @@ static int ProcessLines( filter_t *p_filter,
                 {
                     double f_outline_thickness = var_InheritInteger( p_filter, "freetype-outline-thickness" ) / 100.0;
                     f_outline_thickness = VLC_CLIP( f_outline_thickness, 0.0, 0.5 );
-                    int i_radius = (p_current_style->i_font_size << 6) * f_outline_thickness;
+                    i_outline_radius = (p_current_style->i_font_size << 6) * f_outline_thickness;
                     FT_Stroker_Set( p_sys->p_stroker,
-                                    i_radius,
+                                    i_outline_radius,
                                     FT_STROKER_LINECAP_ROUND,
                                     FT_STROKER_LINEJOIN_ROUND, 0 );
                 }
@@ -2382,20 +2749,24 @@ static int ProcessLines( filter_t *p_filter,
                 FT_BBox  outline_bbox;
                 FT_Glyph shadow;
                 FT_BBox  shadow_bbox;
-
-                if( GetGlyph( p_filter,
-                              &glyph, &glyph_bbox,
-                              &outline, &outline_bbox,
-                              &shadow, &shadow_bbox,
-                              p_current_face, i_glyph_index, p_glyph_style->i_style_flags,
-                              &pen_new, &pen_shadow_new ) )
+                FT_Vector advance;
+
+                if( GetCachedGlyph( p_filter,
+                                    &glyph, &glyph_bbox,
+                                    &outline, &outline_bbox,
+                                    &shadow, &shadow_bbox,
+                                    &advance,
+                                    p_current_face, p_current_style->i_font_size,
+                                    i_outline_radius,
+                                    i_glyph_index, p_glyph_style->i_style_flags,
+                                    &pen_new, &pen_shadow_new ) )
                     goto next;
 
-                FixGlyph( glyph, &glyph_bbox, p_current_face, &pen_new );
+                FixGlyph( glyph, &glyph_bbox, &advance, &pen_new );
                 if( outline )
-                    FixGlyph( outline, &outline_bbox, p_current_face, &pen_new );
+                    FixGlyph( outline, &outline_bbox, &advance, &pen_new );
                 if( shadow )
-                    FixGlyph( shadow, &shadow_bbox, p_current_face, &pen_shadow_new );
+                    FixGlyph( shadow, &shadow_bbox, &advance, &pen_shadow_new );
 
                 /* FIXME and what about outline */
 
@@ -2494,8 +2865,8 @@ static int ProcessLines( filter_t *p_filter,
                     .i_line_thickness = i_line_thickness,
                 };
 
-                pen.x = pen_new.x + p_current_face->glyph->advance.x;
-                pen.y = pen_new.y + p_current_face->glyph->advance.y;
+                pen.x = pen_new.x + advance.x;
+                pen.y = pen_new.y + advance.y;
                 line_bbox = line_bbox_new;
             next:
                 i_glyph_last = i_glyph_index;
@@ -2560,9 +2931,6 @@ static int ProcessLines( filter_t *p_filter,
             break;
         }
     }
-    if( p_face )
-        FT_Done_Face( p_face );
-
     free( pp_fribidi_styles );
     free( p_fribidi_string );
     free( pi_karaoke_bar );
@@ -2571,6 +2939,133 @@ static int ProcessLines( filter_t *p_filter,
     return VLC_SUCCESS;
 }
 
+static bool LayoutStyleEquals( const text_style_t *p_a, const text_style_t *p_b )
+{
+    if( p_a == p_b )
+        return true;
+    if( !p_a || !p_b )
+        return false;
+    return !strcmp( p_a->psz_fontname, p_b->psz_fontname ) &&
+           p_a->i_font_size == p_b->i_font_size &&
+           p_a->i_font_color == p_b->i_font_color &&
+           p_a->i_font_alpha == p_b->i_font_alpha &&
+           p_a->i_style_flags == p_b->i_style_flags &&
+           p_a->i_karaoke_background_color == p_b->i_karaoke_background_color &&
+           p_a->i_karaoke_background_alpha == p_b->i_karaoke_background_alpha;
+}
+
+static void LayoutCacheEntryClean( layout_cache_entry_t *p_entry )
+{
+    for( int i = 0; i < p_entry->i_text_length; i++ )
+    {
+        text_style_t *p_style = p_entry->pp_styles[i];
+        if( p_style && ( i + 1 == p_entry->i_text_length ||
+                         p_style != p_entry->pp_styles[i + 1] ) )
+            text_style_Delete( p_style );
+    }
+    free( p_entry->pp_styles );
+    free( p_entry->psz_text );
+    FreeLines( p_entry->p_lines );
+    memset( p_entry, 0, sizeof(*p_entry) );
+}
+
+static layout_cache_entry_t *LayoutCacheFind( filter_t *p_filter,
+                                              const uni_char_t *psz_text,
+                                              text_style_t * const *pp_styles,
+                                              int i_text_length,
+                                              int i_outline_thickness )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    for( int i = 0; i < LAYOUT_CACHE_SIZE; i++ )
+    {
+        layout_cache_entry_t *p_entry = &p_sys->p_layouts[i];
+
+        if( !p_entry->p_lines ||
+            p_entry->i_text_length != i_text_length ||
+            p_entry->i_width  != p_filter->fmt_out.video.i_visible_width ||
+            p_entry->i_height != p_filter->fmt_out.video.i_visible_height ||
+            p_entry->i_outline_thickness != i_outline_thickness ||
+            memcmp( p_entry->psz_text, psz_text,
+                    i_text_length * sizeof(*psz_text) ) )
+            continue;
+
+        int j;
+        for( j = 0; j < i_text_length; j++ )
+        {
+            if( !LayoutStyleEquals( p_entry->pp_styles[j], pp_styles[j] ) )
+                break;
+        }
+        if( j < i_text_length )
+            continue;
+
+        p_entry->i_last_use = ++p_sys->i_layout_clock;
+        return p_entry;
+    }
+    return NULL;
+}
+
+/* Stores the lines in the cache, which then owns them. Returns false if they
+ * could not be stored (and must be freed by the caller). */
+static bool LayoutCacheAdd( filter_t *p_filter,
+                            const uni_char_t *psz_text,
+                            text_style_t * const *pp_styles,
+                            int i_text_length,
+                            int i_outline_thickness,
+                            line_desc_t *p_lines, const FT_BBox *p_bbox,
+                            int i_max_face_height )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    layout_cache_entry_t *p_entry = &p_sys->p_layouts[0];
+    for( int i = 1; i < LAYOUT_CACHE_SIZE && p_entry->p_lines; i++ )
+    {
+        if( !p_sys->p_layouts[i].p_lines ||
+            p_sys->p_layouts[i].i_last_use < p_entry->i_last_use )
+            p_entry = &p_sys->p_layouts[i];
+    }
+    LayoutCacheEntryClean( p_entry );
+
+    uni_char_t *psz_copy = malloc( i_text_length * sizeof(*psz_copy) );
+    text_style_t **pp_copy = calloc( i_text_length, sizeof(*pp_copy) );
+    if( unlikely(!psz_copy || !pp_copy) )
+    {
+        free( psz_copy );
+        free( pp_copy );
+        return false;
+    }
+    memcpy( psz_copy, psz_text, i_text_length * sizeof(*psz_copy) );
+
+    /* Keep the styles shared the same way as in the input */
+    for( int i = 0; i < i_text_length; i++ )
+    {
+        if( !pp_styles[i] )
+            continue;
+        if( i > 0 && pp_styles[i] == pp_styles[i - 1] )
+            pp_copy[i] = pp_copy[i - 1];
+        else
+            pp_copy[i] = text_style_Duplicate( pp_styles[i] );
+    }
+
+    p_entry->psz_text            = psz_copy;
+    p_entry->pp_styles           = pp_copy;
+    p_entry->i_text_length       = i_text_length;
+    p_entry->i_width             = p_filter->fmt_out.video.i_visible_width;
+    p_entry->i_height            = p_filter->fmt_out.video.i_visible_height;
+    p_entry->i_outline_thickness = i_outline_thickness;
+    p_entry->p_lines             = p_lines;
+    p_entry->bbox                = *p_bbox;
+    p_entry->i_max_face_height   = i_max_face_height;
+    p_entry->i_last_use          = ++p_sys->i_layout_clock;
+    return true;
+}
+
+static void LayoutCacheClean( filter_t *p_filter )
+{
+    for( int i = 0; i < LAYOUT_CACHE_SIZE; i++ )
+        LayoutCacheEntryClean( &p_filter->p_sys->p_layouts[i] );
+}
+
 /**
  * This function renders a text subpicture region into another one.
  * It also calculates the size needed for this string, and renders the
@@ -2704,11 +3199,33 @@ static int RenderCommon( filter_t *p_filter, subpicture_region_t *p_region_out,
                                    p_region_in->psz_text, p_style, 0 );
     }
 
-    if( !rv && i_text_length > 0 )
+    /* Karaoke text is laid out again on each rendering */
+    const int i_outline_thickness = var_InheritInteger( p_filter, "freetype-outline-thickness" );
+    bool b_cached = false;
+    if( !rv && i_text_length > 0 && !pi_k_durations )
+    {
+        const layout_cache_entry_t *p_layout =
+            LayoutCacheFind( p_filter, psz_text, pp_styles, i_text_length,
+                             i_outline_thickness );
+        if( p_layout )
+        {
+            p_lines = p_layout->p_lines;
+            bbox = p_layout->bbox;
+            i_max_face_height = p_layout->i_max_face_height;
+            b_cached = true;
+        }
+    }
+
+    if( !rv && i_text_length > 0 && !b_cached )
     {
         rv = ProcessLines( p_filter,
                            &p_lines, &bbox, &i_max_face_height,
                            psz_text, pp_styles, pi_k_durations, i_text_length );
+
+        if( !rv && p_lines && !pi_k_durations )
+            b_cached = LayoutCacheAdd( p_filter, psz_text, pp_styles,
+                                       i_text_length, i_outline_thickness,
+                                       p_lines, &bbox, i_max_face_height );
     }
 
     p_region_out->i_x = p_region_in->i_x;
@@ -2757,7 +3274,8 @@ static int RenderCommon( filter_t *p_filter, subpicture_region_t *p_region_out,
             var_SetBool( p_filter, "text-rerender", true );
     }
 
-    FreeLines( p_lines );
+    if( !b_cached )
+        FreeLines( p_lines );
 
     free( psz_text );
     for( int i = 0; i < i_text_length; i++ )
@@ -2954,6 +3472,11 @@ static int Create( vlc_object_t *p_this )
     p_sys->pp_font_attachments = NULL;
     p_sys->i_font_attachments = 0;
 
+    p_sys->i_faces = 0;
+    GlyphCacheInit( &p_sys->glyph_cache );
+    memset( p_sys->p_layouts, 0, sizeof(p_sys->p_layouts) );
+    p_sys->i_layout_clock = 0;
+
     p_filter->pf_render_text = RenderText;
     p_filter->pf_render_html = RenderHtml;
 
@@ -3009,6 +3532,9 @@ static void Destroy( vlc_object_t *p_this )
      * even if no other library functions have been made since FcInit(),
      * so don't call it. */
 
+    LayoutCacheClean( p_filter );
+    FaceCacheFlush( p_filter );
+
     if( p_sys->p_stroker )
         FT_Stroker_Done( p_sys->p_stroker );
     FT_Done_Face( p_sys->p_face );
@@ -32,17 +32,34 @@
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_filter.h>
+#include <vlc_cpu.h>
 #include "filter_picture.h"
 
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+# include <emmintrin.h>
+#endif
+#if defined(HAVE_AVX2_INTRINSICS)
+# include <immintrin.h>
+#endif
+#if defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
 static int  Open (vlc_object_t *);
 static void Close(vlc_object_t *);
 
+#define THREADS_TEXT N_("Blending threads")
+#define THREADS_LONGTEXT N_(\
+    "Number of threads used to blend large regions (0 for automatic).")
+
 vlc_module_begin()
     set_description(N_("Video pictures blending"))
     set_capability("video blending", 100)
+    add_integer_with_range("blend-threads", 0, 0, 16,
+                           THREADS_TEXT, THREADS_LONGTEXT, true)
     set_callbacks(Open, Close)
 vlc_module_end()
 
@@ -79,6 +96,22 @@ public:
     {
         return fmt;
     }
+    unsigned getX() const
+    {
+        return x;
+    }
+    unsigned getY() const
+    {
+        return y;
+    }
+    /* Returns the address of the first pixel of line dy for a plane
+     * subsampled by (rx, ry) and made of samples of the given size */
+    uint8_t *getPixels(unsigned plane, unsigned rx, unsigned ry,
+                       unsigned bytes, unsigned dy) const
+    {
+        const plane_t *p = &picture->p[plane];
+        return &p->p_pixels[(y + dy) / ry * p->i_pitch + x / rx * bytes];
+    }
     bool isFull(unsigned) const
     {
         return true;
@@ -591,13 +624,468 @@ static const struct {
 #undef YUV
 };
 
+/*****************************************************************************
+ * Row kernels
+ *
+ * They merge count 8 bits samples of src into dst, using a as the per sample
+ * alpha and alpha as the global alpha. The results are identical to the
+ * generic code above.
+ *****************************************************************************/
+typedef void (*merge_row_function_t)(uint8_t *dst, const uint8_t *src,
+                                     const uint8_t *a, unsigned alpha,
+                                     unsigned count);
+
+static void MergeRowC(uint8_t *dst, const uint8_t *src, const uint8_t *a,
+                      unsigned alpha, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++) {
+        unsigned f = div255(alpha * a[i]);
+        if (f > 0)
+            merge(&dst[i], src[i], f);
+    }
+}
+
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+__attribute__((__target__("sse2")))
+static inline __m128i Div255SSE2(__m128i v)
+{
+    v = _mm_add_epi16(v, _mm_srli_epi16(v, 8));
+    v = _mm_add_epi16(v, _mm_set1_epi16(1));
+    return _mm_srli_epi16(v, 8);
+}
+
+__attribute__((__target__("sse2")))
+static inline __m128i MergeSSE2(__m128i d, __m128i s, __m128i a, __m128i alpha)
+{
+    const __m128i f = Div255SSE2(_mm_mullo_epi16(a, alpha));
+    const __m128i g = _mm_sub_epi16(_mm_set1_epi16(255), f);
+    return Div255SSE2(_mm_add_epi16(_mm_mullo_epi16(d, g),
+                                    _mm_mullo_epi16(s, f)));
+}
+
+__attribute__((__target__("sse2")))
+static void MergeRowSSE2(uint8_t *dst, const uint8_t *src, const uint8_t *a,
+                         unsigned alpha, unsigned count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha16 = _mm_set1_epi16(alpha);
+    unsigned i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        const __m128i d = _mm_loadu_si128((const __m128i *)&dst[i]);
+        const __m128i s = _mm_loadu_si128((const __m128i *)&src[i]);
+        const __m128i f = _mm_loadu_si128((const __m128i *)&a[i]);
+
+        const __m128i lo = MergeSSE2(_mm_unpacklo_epi8(d, zero),
+                                     _mm_unpacklo_epi8(s, zero),
+                                     _mm_unpacklo_epi8(f, zero), alpha16);
+        const __m128i hi = MergeSSE2(_mm_unpackhi_epi8(d, zero),
+                                     _mm_unpackhi_epi8(s, zero),
+                                     _mm_unpackhi_epi8(f, zero), alpha16);
+        _mm_storeu_si128((__m128i *)&dst[i], _mm_packus_epi16(lo, hi));
+    }
+    MergeRowC(&dst[i], &src[i], &a[i], alpha, count - i);
+}
+#endif
+
+#if defined(HAVE_AVX2_INTRINSICS)
+__attribute__((__target__("avx2")))
+static inline __m256i Div255AVX2(__m256i v)
+{
+    v = _mm256_add_epi16(v, _mm256_srli_epi16(v, 8));
+    v = _mm256_add_epi16(v, _mm256_set1_epi16(1));
+    return _mm256_srli_epi16(v, 8);
+}
+
+__attribute__((__target__("avx2")))
+static inline __m256i MergeAVX2(__m256i d, __m256i s, __m256i a, __m256i alpha)
+{
+    const __m256i f = Div255AVX2(_mm256_mullo_epi16(a, alpha));
+    const __m256i g = _mm256_sub_epi16(_mm256_set1_epi16(255), f);
+    return Div255AVX2(_mm256_add_epi16(_mm256_mullo_epi16(d, g),
+                                       _mm256_mullo_epi16(s, f)));
+}
+
+__attribute__((__target__("avx2")))
+static void MergeRowAVX2(uint8_t *dst, const uint8_t *src, const uint8_t *a,
+                         unsigned alpha, unsigned count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha16 = _mm256_set1_epi16(alpha);
+    unsigned i = 0;
+
+    /* Unpacking and packing both work within 128 bits lanes, so the samples
+     * come back in their original order */
+    for (; i + 32 <= count; i += 32) {
+        const __m256i d = _mm256_loadu_si256((const __m256i *)&dst[i]);
+        const __m256i s = _mm256_loadu_si256((const __m256i *)&src[i]);
+        const __m256i f = _mm256_loadu_si256((const __m256i *)&a[i]);
+
+        const __m256i lo = MergeAVX2(_mm256_unpacklo_epi8(d, zero),
+                                     _mm256_unpacklo_epi8(s, zero),
+                                     _mm256_unpacklo_epi8(f, zero), alpha16);
+        const __m256i hi = MergeAVX2(_mm256_unpackhi_epi8(d, zero),
+                                     _mm256_unpackhi_epi8(s, zero),
+                                     _mm256_unpackhi_epi8(f, zero), alpha16);
+        _mm256_storeu_si256((__m256i *)&dst[i], _mm256_packus_epi16(lo, hi));
+    }
+    MergeRowC(&dst[i], &src[i], &a[i], alpha, count - i);
+}
+#endif
+
+#if defined(__ARM_NEON__)
+static inline uint8x8_t Div255NEON(uint16x8_t v)
+{
+    v = vaddq_u16(v, vshrq_n_u16(v, 8));
+    v = vaddq_u16(v, vdupq_n_u16(1));
+    return vshrn_n_u16(v, 8);
+}
+
+static inline uint8x8_t MergeNEON(uint8x8_t d, uint8x8_t s, uint8x8_t a,
+                                  uint8x8_t alpha)
+{
+    const uint8x8_t f = Div255NEON(vmull_u8(a, alpha));
+    const uint8x8_t g = vsub_u8(vdup_n_u8(255), f);
+    return Div255NEON(vmlal_u8(vmull_u8(d, g), s, f));
+}
+
+static void MergeRowNEON(uint8_t *dst, const uint8_t *src, const uint8_t *a,
+                         unsigned alpha, unsigned count)
+{
+    const uint8x8_t alpha8 = vdup_n_u8(alpha);
+    unsigned i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t d = vld1q_u8(&dst[i]);
+        const uint8x16_t s = vld1q_u8(&src[i]);
+        const uint8x16_t f = vld1q_u8(&a[i]);
+
+        vst1q_u8(&dst[i],
+                 vcombine_u8(MergeNEON(vget_low_u8(d),  vget_low_u8(s),
+                                       vget_low_u8(f),  alpha8),
+                             MergeNEON(vget_high_u8(d), vget_high_u8(s),
+                                       vget_high_u8(f), alpha8)));
+    }
+    MergeRowC(&dst[i], &src[i], &a[i], alpha, count - i);
+}
+#endif
+
+static merge_row_function_t GetMergeRow(void)
+{
+#if defined(HAVE_AVX2_INTRINSICS)
+    if (vlc_CPU_AVX2())
+        return MergeRowAVX2;
+#endif
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+    if (vlc_CPU_SSE2())
+        return MergeRowSSE2;
+#endif
+#if defined(__ARM_NEON__)
+    if (vlc_CPU_ARM_NEON())
+        return MergeRowNEON;
+#endif
+    return MergeRowC;
+}
+
+/*****************************************************************************
+ * Fast paths
+ *
+ * The most common destinations are blended line by line with the row
+ * kernels. Subsampled or interleaved samples are first gathered into small
+ * contiguous buffers.
+ *****************************************************************************/
+#define CHUNK_SIZE 256
+
+typedef void (*fast_blend_function_t)(merge_row_function_t merge_row,
+                                      const CPicture &dst, const CPicture &src,
+                                      unsigned width, unsigned height,
+                                      int alpha);
+
+template <bool swap_uv>
+static void BlendYUVAToI420(merge_row_function_t merge_row,
+                            const CPicture &dst, const CPicture &src,
+                            unsigned width, unsigned height, int alpha)
+{
+    uint8_t su[CHUNK_SIZE], sv[CHUNK_SIZE], sa[CHUNK_SIZE];
+    /* First source column landing on a chroma sample */
+    const unsigned x0 = dst.getX() % 2;
+
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t *src_y = src.getPixels(0, 1, 1, 1, y);
+        const uint8_t *src_u = src.getPixels(1, 1, 1, 1, y);
+        const uint8_t *src_v = src.getPixels(2, 1, 1, 1, y);
+        const uint8_t *src_a = src.getPixels(3, 1, 1, 1, y);
+
+        merge_row(dst.getPixels(0, 1, 1, 1, y), src_y, src_a, alpha, width);
+        if ((dst.getY() + y) % 2)
+            continue;
+
+        uint8_t *dst_u = dst.getPixels(swap_uv ? 2 : 1, 2, 2, 1, y) + x0;
+        uint8_t *dst_v = dst.getPixels(swap_uv ? 1 : 2, 2, 2, 1, y) + x0;
+        for (unsigned x = x0; x < width; ) {
+            unsigned n;
+            for (n = 0; n < CHUNK_SIZE && x < width; n++, x += 2) {
+                su[n] = src_u[x];
+                sv[n] = src_v[x];
+                sa[n] = src_a[x];
+            }
+            merge_row(dst_u, su, sa, alpha, n);
+            merge_row(dst_v, sv, sa, alpha, n);
+            dst_u += n;
+            dst_v += n;
+        }
+    }
+}
+
+template <bool swap_uv>
+static void BlendYUVAToNV12(merge_row_function_t merge_row,
+                            const CPicture &dst, const CPicture &src,
+                            unsigned width, unsigned height, int alpha)
+{
+    uint8_t suv[2 * CHUNK_SIZE], sa[2 * CHUNK_SIZE];
+    const unsigned x0 = dst.getX() % 2;
+
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t *src_y = src.getPixels(0, 1, 1, 1, y);
+        const uint8_t *src_u = src.getPixels(1, 1, 1, 1, y);
+        const uint8_t *src_v = src.getPixels(2, 1, 1, 1, y);
+        const uint8_t *src_a = src.getPixels(3, 1, 1, 1, y);
+
+        merge_row(dst.getPixels(0, 1, 1, 1, y), src_y, src_a, alpha, width);
+        if ((dst.getY() + y) % 2)
+            continue;
+
+        uint8_t *dst_uv = dst.getPixels(1, 2, 2, 2, y) + 2 * x0;
+        for (unsigned x = x0; x < width; ) {
+            unsigned n;
+            for (n = 0; n < 2 * CHUNK_SIZE && x < width; n += 2, x += 2) {
+                suv[n +  swap_uv] = src_u[x];
+                suv[n + !swap_uv] = src_v[x];
+                sa[n] = sa[n + 1] = src_a[x];
+            }
+            merge_row(dst_uv, suv, sa, alpha, n);
+            dst_uv += n;
+        }
+    }
+}
+
+static void BlendRGBAToRGB32(merge_row_function_t merge_row,
+                             const CPicture &dst, const CPicture &src,
+                             unsigned width, unsigned height, int alpha)
+{
+    const video_format_t *fmt = dst.getFormat();
+#ifdef WORDS_BIGENDIAN
+    const unsigned offset_r = (32 - fmt->i_lrshift) / 8;
+    const unsigned offset_g = (32 - fmt->i_lgshift) / 8;
+    const unsigned offset_b = (32 - fmt->i_lbshift) / 8;
+#else
+    const unsigned offset_r = fmt->i_lrshift / 8;
+    const unsigned offset_g = fmt->i_lgshift / 8;
+    const unsigned offset_b = fmt->i_lbshift / 8;
+#endif
+    /* The padding byte is the remaining one. It is merged with its own value
+     * and a null alpha, so that the vector kernels never read uninitialized
+     * samples and leave it untouched, as the generic code does */
+    const unsigned offset_x = 6 - offset_r - offset_g - offset_b;
+    uint8_t s[4 * CHUNK_SIZE], sa[4 * CHUNK_SIZE];
+
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t *src_rgba = src.getPixels(0, 1, 1, 4, y);
+        uint8_t *dst_rgb = dst.getPixels(0, 1, 1, 4, y);
+
+        for (unsigned x = 0; x < width; ) {
+            const unsigned n = __MIN(width - x, CHUNK_SIZE);
+            for (unsigned i = 0; i < n; i++) {
+                const uint8_t *p = &src_rgba[4 * (x + i)];
+                s[4 * i + offset_r] = p[0];
+                s[4 * i + offset_g] = p[1];
+                s[4 * i + offset_b] = p[2];
+                s[4 * i + offset_x] = dst_rgb[4 * (x + i) + offset_x];
+                sa[4 * i + offset_r] =
+                sa[4 * i + offset_g] =
+                sa[4 * i + offset_b] = p[3];
+                sa[4 * i + offset_x] = 0;
+            }
+            merge_row(&dst_rgb[4 * x], s, sa, alpha, 4 * n);
+            x += n;
+        }
+    }
+}
+
+static const struct {
+    vlc_fourcc_t          dst;
+    vlc_fourcc_t          src;
+    fast_blend_function_t blend;
+} fast_blends[] = {
+    { VLC_CODEC_I420,  VLC_CODEC_YUVA, BlendYUVAToI420<false> },
+    { VLC_CODEC_J420,  VLC_CODEC_YUVA, BlendYUVAToI420<false> },
+    { VLC_CODEC_YV12,  VLC_CODEC_YUVA, BlendYUVAToI420<true> },
+    { VLC_CODEC_NV12,  VLC_CODEC_YUVA, BlendYUVAToNV12<false> },
+    { VLC_CODEC_NV21,  VLC_CODEC_YUVA, BlendYUVAToNV12<true> },
+    { VLC_CODEC_RGB32, VLC_CODEC_RGBA, BlendRGBAToRGB32 },
+};
+
+/*****************************************************************************
+ * Threading
+ *
+ * Large regions are cut into horizontal bands blended concurrently. The
+ * bands never share a destination line, so no locking is needed while
+ * blending.
+ *****************************************************************************/
+#define MIN_BAND_PIXELS (128 * 1024)
+#define MAX_THREADS 16
+
+struct blend_job_t {
+    const picture_t      *dst;
+    const video_format_t *dst_fmt;
+    unsigned             dst_x, dst_y;
+    const picture_t      *src;
+    const video_format_t *src_fmt;
+    unsigned             src_x, src_y;
+    unsigned             width, height;
+    unsigned             band_height;
+    int                  alpha;
+};
+
 struct filter_sys_t {
-    filter_sys_t() : blend(NULL)
+    filter_sys_t() : blend(NULL), fast_blend(NULL), merge_row(NULL),
+                     max_threads(0), thread_count(0), job(NULL),
+                     band_count(0), next_band(0), pending(0), exiting(false)
     {
+        vlc_mutex_init(&lock);
+        vlc_cond_init(&wait_work);
+        vlc_cond_init(&wait_done);
     }
-    blend_function_t blend;
+    ~filter_sys_t()
+    {
+        vlc_mutex_lock(&lock);
+        exiting = true;
+        vlc_cond_broadcast(&wait_work);
+        vlc_mutex_unlock(&lock);
+        for (unsigned i = 0; i < thread_count; i++)
+            vlc_join(threads[i], NULL);
+
+        vlc_cond_destroy(&wait_done);
+        vlc_cond_destroy(&wait_work);
+        vlc_mutex_destroy(&lock);
+    }
+    blend_function_t      blend;
+    fast_blend_function_t fast_blend;
+    merge_row_function_t  merge_row;
+
+    unsigned          max_threads;
+    unsigned          thread_count;
+    vlc_thread_t      threads[MAX_THREADS];
+    vlc_mutex_t       lock;
+    vlc_cond_t        wait_work;
+    vlc_cond_t        wait_done;
+    const blend_job_t *job;
+    unsigned          band_count;
+    unsigned          next_band;
+    unsigned          pending;
+    bool              exiting;
 };
 
+static void BlendBand(const filter_sys_t *sys, const blend_job_t *job,
+                      unsigned band)
+{
+    const unsigned y = band * job->band_height;
+    if (y >= job->height)
+        return;
+    const unsigned height = __MIN(job->band_height, job->height - y);
+
+    CPicture dst(job->dst, job->dst_fmt, job->dst_x, job->dst_y + y);
+    CPicture src(job->src, job->src_fmt, job->src_x, job->src_y + y);
+
+    if (sys->fast_blend)
+        sys->fast_blend(sys->merge_row, dst, src, job->width, height,
+                        job->alpha);
+    else
+        sys->blend(dst, src, job->width, height, job->alpha);
+}
+
+static void *WorkerThread(void *data)
+{
+    filter_sys_t *sys = (filter_sys_t *)data;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock(&sys->lock);
+    for (;;) {
+        while (!sys->exiting && sys->next_band >= sys->band_count)
+            vlc_cond_wait(&sys->wait_work, &sys->lock);
+        if (sys->exiting)
+            break;
+
+        const blend_job_t *job = sys->job;
+        const unsigned band = sys->next_band++;
+        vlc_mutex_unlock(&sys->lock);
+
+        BlendBand(sys, job, band);
+
+        vlc_mutex_lock(&sys->lock);
+        if (--sys->pending == 0)
+            vlc_cond_signal(&sys->wait_done);
+    }
+    vlc_mutex_unlock(&sys->lock);
+
+    vlc_restorecancel(canc);
+    return NULL;
+}
+
+/* Starts the workers the first time a large enough region is blended, so
+ * that small subtitles never pay for them */
+static unsigned GetBandCount(filter_sys_t *sys, unsigned width,
+                             unsigned height)
+{
+    unsigned count = __MIN(width * height / MIN_BAND_PIXELS,
+                           sys->max_threads);
+    if (count <= 1)
+        return 1;
+
+    while (sys->thread_count + 1 < count) {
+        if (vlc_clone(&sys->threads[sys->thread_count], WorkerThread, sys,
+                      VLC_THREAD_PRIORITY_OUTPUT)) {
+            sys->max_threads = sys->thread_count + 1;
+            break;
+        }
+        sys->thread_count++;
+    }
+    return __MIN(count, sys->thread_count + 1);
+}
+
+static void BlendJob(filter_sys_t *sys, blend_job_t *job)
+{
+    const unsigned count = GetBandCount(sys, job->width, job->height);
+
+    job->band_height = (job->height + count - 1) / count;
+    if (count <= 1) {
+        BlendBand(sys, job, 0);
+        return;
+    }
+
+    vlc_mutex_lock(&sys->lock);
+    sys->job        = job;
+    sys->band_count = count;
+    sys->next_band  = 0;
+    sys->pending    = count;
+    vlc_cond_broadcast(&sys->wait_work);
+
+    /* The calling thread takes its share of the bands */
+    while (sys->next_band < sys->band_count) {
+        const unsigned band = sys->next_band++;
+        vlc_mutex_unlock(&sys->lock);
+
+        BlendBand(sys, job, band);
+
+        vlc_mutex_lock(&sys->lock);
+        sys->pending--;
+    }
+    while (sys->pending > 0)
+        vlc_cond_wait(&sys->wait_done, &sys->lock);
+    sys->job = NULL;
+    vlc_mutex_unlock(&sys->lock);
+}
+
 /**
  * It blends 2 picture together.
  */
@@ -623,13 +1111,20 @@ static void Blend(filter_t *filter,
     video_format_FixRgb(&filter->fmt_out.video);
     video_format_FixRgb(&filter->fmt_in.video);
 
-    sys->blend(CPicture(dst, &filter->fmt_out.video,
-                        filter->fmt_out.video.i_x_offset + x_offset,
-                        filter->fmt_out.video.i_y_offset + y_offset),
-               CPicture(src, &filter->fmt_in.video,
-                        filter->fmt_in.video.i_x_offset,
-                        filter->fmt_in.video.i_y_offset),
-               width, height, alpha);
+    blend_job_t job;
+    job.dst     = dst;
+    job.dst_fmt = &filter->fmt_out.video;
+    job.dst_x   = filter->fmt_out.video.i_x_offset + x_offset;
+    job.dst_y   = filter->fmt_out.video.i_y_offset + y_offset;
+    job.src     = src;
+    job.src_fmt = &filter->fmt_in.video;
+    job.src_x   = filter->fmt_in.video.i_x_offset;
+    job.src_y   = filter->fmt_in.video.i_y_offset;
+    job.width   = width;
+    job.height  = height;
+    job.alpha   = alpha;
+
+    BlendJob(sys, &job);
 }
 
 static int Open(vlc_object_t *object)
@@ -651,6 +1146,17 @@ static int Open(vlc_object_t *object)
         return VLC_EGENERIC;
     }
 
+    for (size_t i = 0; i < sizeof(fast_blends) / sizeof(*fast_blends); i++) {
+        if (fast_blends[i].src == src && fast_blends[i].dst == dst)
+            sys->fast_blend = fast_blends[i].blend;
+    }
+    sys->merge_row = GetMergeRow();
+
+    int threads = var_InheritInteger(filter, "blend-threads");
+    if (threads <= 0)
+        threads = __MIN(vlc_GetCPUCount(), 4);
+    sys->max_threads = __MIN(threads, MAX_THREADS);
+
     filter->pf_video_blend = Blend;
     filter->p_sys          = sys;
     return VLC_SUCCESS;
@@ -661,4 +1167,3 @@ static void Close(vlc_object_t *object)
     filter_t *filter = (filter_t *)object;
     delete filter->p_sys;
 }
-
@@ -58,15 +58,17 @@ static picture_t *Filter( filter_t *, picture_t * );
 #define BASE_IMAGE_TEXT N_("Image to be blended onto")
 #define BASE_IMAGE_LONGTEXT N_("The image which will be used to blend onto")
 
-#define BASE_CHROMA_TEXT N_("Chroma for the base image")
-#define BASE_CHROMA_LONGTEXT N_("Chroma which the base image will be loaded in")
+#define BASE_CHROMA_TEXT N_("Chromas for the base image")
+#define BASE_CHROMA_LONGTEXT N_("Comma separated list of chromas in which " \
+                                "the base image will be loaded, or \"all\" " \
+                                "for every supported destination chroma")
 
 #define BLEND_IMAGE_TEXT N_("Image which will be blended")
 #define BLEND_IMAGE_LONGTEXT N_("The image blended onto the base image")
 
-#define BLEND_CHROMA_TEXT N_("Chroma for the blend image")
-#define BLEND_CHROMA_LONGTEXT N_("Chroma which the blend image will be loaded" \
-                                 " in")
+#define BLEND_CHROMA_TEXT N_("Chromas for the blend image")
+#define BLEND_CHROMA_LONGTEXT N_("Comma separated list of chromas in which " \
+                                 "the blend image will be loaded")
 
 #define CFG_PREFIX "blendbench-"
 
@@ -103,6 +105,32 @@ static const char *const ppsz_filter_options[] = {
     "blend-chroma", NULL
 };
 
+/* Destination chromas handled by the "video blending" module */
+static const char *const ppsz_all_base_chromas[] = {
+    "RV15", "RV16", "RV24", "RV32",
+    "YVU9", "I410", "I411",
+    "YV12", "NV12", "NV21", "J420", "I420",
+#ifdef WORDS_BIGENDIAN
+    "I09B", "I0AB",
+#else
+    "I09L", "I0AL",
+#endif
+    "J422", "I422",
+#ifdef WORDS_BIGENDIAN
+    "I29B", "I2AB",
+#else
+    "I29L", "I2AL",
+#endif
+    "J444", "I444",
+#ifdef WORDS_BIGENDIAN
+    "I49B", "I4AB",
+#else
+    "I49L", "I4AL",
+#endif
+    "YUY2", "UYVY", "YVYU", "VYUY",
+    NULL
+};
+
 /*****************************************************************************
  * filter_sys_t: filter method descriptor
  *****************************************************************************/
@@ -111,15 +139,16 @@ struct filter_sys_t
     bool b_done;
     int i_loops, i_alpha;
 
-    picture_t *p_base_image;
-    picture_t *p_blend_image;
+    char *psz_base_image;
+    char *psz_blend_image;
 
-    vlc_fourcc_t i_base_chroma;
-    vlc_fourcc_t i_blend_chroma;
+    char *psz_base_chromas;
+    char *psz_blend_chromas;
 };
 
 static int blendbench_LoadImage( vlc_object_t *p_this, picture_t **pp_pic,
-                                 vlc_fourcc_t i_chroma, char *psz_file, const char *psz_name )
+                                 vlc_fourcc_t i_chroma, const char *psz_file,
+                                 const char *psz_name )
 {
     image_handler_t *p_image;
     video_format_t fmt_in, fmt_out;
@@ -134,7 +163,8 @@ static int blendbench_LoadImage( vlc_object_t *p_this, picture_t **pp_pic,
 
     if( *pp_pic == NULL )
     {
-        msg_Err( p_this, "Unable to load %s image", psz_name );
+        msg_Err( p_this, "Unable to load %s image in %4.4s", psz_name,
+                 (const char *)&i_chroma );
         return VLC_EGENERIC;
     }
 
@@ -145,6 +175,18 @@ static int blendbench_LoadImage( vlc_object_t *p_this, picture_t **pp_pic,
     return VLC_SUCCESS;
 }
 
+static vlc_fourcc_t blendbench_ParseChroma( const char *psz_chroma )
+{
+    char psz_fourcc[4] = { ' ', ' ', ' ', ' ' };
+
+    while( *psz_chroma == ' ' )
+        psz_chroma++;
+    for( int i = 0; i < 4 && psz_chroma[i] && psz_chroma[i] != ' '; i++ )
+        psz_fourcc[i] = psz_chroma[i];
+    return VLC_FOURCC( psz_fourcc[0], psz_fourcc[1],
+                       psz_fourcc[2], psz_fourcc[3] );
+}
+
 /*****************************************************************************
  * Create: allocates video thread output method
  *****************************************************************************/
@@ -152,8 +194,6 @@ static int Create( vlc_object_t *p_this )
 {
     filter_t *p_filter = (filter_t *)p_this;
     filter_sys_t *p_sys;
-    char *psz_temp, *psz_cmd;
-    int i_ret;
 
     /* Allocate structure */
     p_filter->p_sys = malloc( sizeof( filter_sys_t ) );
@@ -175,29 +215,14 @@ static int Create( vlc_object_t *p_this )
     p_sys->i_alpha = var_CreateGetIntegerCommand( p_filter,
                                                   CFG_PREFIX "alpha" );
 
-    psz_temp = var_CreateGetStringCommand( p_filter, CFG_PREFIX "base-chroma" );
-    p_sys->i_base_chroma = VLC_FOURCC( psz_temp[0], psz_temp[1],
-                                       psz_temp[2], psz_temp[3] );
-    psz_cmd = var_CreateGetStringCommand( p_filter, CFG_PREFIX "base-image" );
-    i_ret = blendbench_LoadImage( p_this, &p_sys->p_base_image,
-                                  p_sys->i_base_chroma, psz_cmd, "Base" );
-    free( psz_temp );
-    free( psz_cmd );
-    if( i_ret != VLC_SUCCESS )
-    {
-        free( p_sys );
-        return i_ret;
-    }
-
-    psz_temp = var_CreateGetStringCommand( p_filter,
-                                           CFG_PREFIX "blend-chroma" );
-    p_sys->i_blend_chroma = VLC_FOURCC( psz_temp[0], psz_temp[1],
-                                        psz_temp[2], psz_temp[3] );
-    psz_cmd = var_CreateGetStringCommand( p_filter, CFG_PREFIX "blend-image" );
-    blendbench_LoadImage( p_this, &p_sys->p_blend_image, p_sys->i_blend_chroma,
-                          psz_cmd, "Blend" );
-    free( psz_temp );
-    free( psz_cmd );
+    p_sys->psz_base_chromas =
+        var_CreateGetStringCommand( p_filter, CFG_PREFIX "base-chroma" );
+    p_sys->psz_base_image =
+        var_CreateGetStringCommand( p_filter, CFG_PREFIX "base-image" );
+    p_sys->psz_blend_chromas =
+        var_CreateGetStringCommand( p_filter, CFG_PREFIX "blend-chroma" );
+    p_sys->psz_blend_image =
+        var_CreateGetStringCommand( p_filter, CFG_PREFIX "blend-image" );
 
     return VLC_SUCCESS;
 }
@@ -210,58 +235,118 @@ static void Destroy( vlc_object_t *p_this )
     filter_t *p_filter = (filter_t *)p_this;
     filter_sys_t *p_sys = p_filter->p_sys;
 
-    picture_Release( p_sys->p_base_image );
-    picture_Release( p_sys->p_blend_image );
+    free( p_sys->psz_base_chromas );
+    free( p_sys->psz_base_image );
+    free( p_sys->psz_blend_chromas );
+    free( p_sys->psz_blend_image );
+    free( p_sys );
 }
 
 /*****************************************************************************
- * Render: displays previously rendered output
+ * blendbench_Run: benchmarks one base/blend chroma pair
  *****************************************************************************/
-static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
+static void blendbench_Run( filter_t *p_filter, vlc_fourcc_t i_base_chroma,
+                            vlc_fourcc_t i_blend_chroma )
 {
     filter_sys_t *p_sys = p_filter->p_sys;
+    vlc_object_t *p_this = VLC_OBJECT(p_filter);
+    picture_t *p_base_image, *p_blend_image;
     filter_t *p_blend;
 
-    if( p_sys->b_done )
-        return p_pic;
+    if( blendbench_LoadImage( p_this, &p_base_image, i_base_chroma,
+                              p_sys->psz_base_image, "Base" ) )
+        return;
+    if( blendbench_LoadImage( p_this, &p_blend_image, i_blend_chroma,
+                              p_sys->psz_blend_image, "Blend" ) )
+    {
+        picture_Release( p_base_image );
+        return;
+    }
 
     p_blend = vlc_object_create( p_filter, sizeof(filter_t) );
     if( !p_blend )
-    {
-        picture_Release( p_pic );
-        return NULL;
-    }
-    p_blend->fmt_out.video = p_sys->p_base_image->format;
-    p_blend->fmt_in.video = p_sys->p_blend_image->format;
+        goto out;
+    p_blend->fmt_out.video = p_base_image->format;
+    p_blend->fmt_in.video = p_blend_image->format;
     p_blend->p_module = module_need( p_blend, "video blending", NULL, false );
     if( !p_blend->p_module )
     {
-        picture_Release( p_pic );
+        msg_Warn( p_filter, "No blending from %4.4s to %4.4s",
+                  (const char *)&i_blend_chroma,
+                  (const char *)&i_base_chroma );
         vlc_object_release( p_blend );
-        return NULL;
+        goto out;
     }
 
     mtime_t time = mdate();
     for( int i_iter = 0; i_iter < p_sys->i_loops; ++i_iter )
     {
-        p_blend->pf_video_blend( p_blend,
-                                 p_sys->p_base_image, p_sys->p_blend_image,
+        p_blend->pf_video_blend( p_blend, p_base_image, p_blend_image,
                                  0, 0, p_sys->i_alpha );
     }
     time = mdate() - time;
-
-    msg_Info( p_filter, "Blended %d images in %f sec", p_sys->i_loops,
-              time / 1000000.0f );
-    msg_Info( p_filter, "Speed is: %f images/second, %f pixels/second",
+    if( time <= 0 )
+        time = 1;
+
+    const float f_pixels = (float)p_sys->i_loops *
+        p_blend_image->p[Y_PLANE].i_visible_pitch /
+        p_blend_image->p[Y_PLANE].i_pixel_pitch *
+        p_blend_image->p[Y_PLANE].i_visible_lines;
+
+    msg_Info( p_filter, "%4.4s onto %4.4s: blended %d images in %f sec",
+              (const char *)&i_blend_chroma, (const char *)&i_base_chroma,
+              p_sys->i_loops, time / 1000000.0f );
+    msg_Info( p_filter, "%4.4s onto %4.4s: %f images/second, "
+              "%f pixels/second, %f ns/pixel",
+              (const char *)&i_blend_chroma, (const char *)&i_base_chroma,
               (float) p_sys->i_loops / time * 1000000,
-              (float) p_sys->i_loops / time * 1000000 *
-                  p_sys->p_blend_image->p[Y_PLANE].i_visible_pitch *
-                  p_sys->p_blend_image->p[Y_PLANE].i_visible_lines );
+              f_pixels / time * 1000000, time * 1000.0f / f_pixels );
 
     module_unneed( p_blend, p_blend->p_module );
-
     vlc_object_release( p_blend );
+out:
+    picture_Release( p_blend_image );
+    picture_Release( p_base_image );
+}
+
+/*****************************************************************************
+ * Render: displays previously rendered output
+ *****************************************************************************/
+static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
 
+    if( p_sys->b_done )
+        return p_pic;
     p_sys->b_done = true;
+
+    const char *const *ppsz_base = ppsz_all_base_chromas;
+    const char *psz_base_list[2] = { p_sys->psz_base_chromas, NULL };
+    if( strcmp( p_sys->psz_base_chromas, "all" ) )
+        ppsz_base = psz_base_list;
+
+    for( ; *ppsz_base != NULL; ppsz_base++ )
+    {
+        for( const char *psz_base = *ppsz_base; psz_base != NULL; )
+        {
+            const vlc_fourcc_t i_base = blendbench_ParseChroma( psz_base );
+
+            for( const char *psz_blend = p_sys->psz_blend_chromas;
+                 psz_blend != NULL; )
+            {
+                blendbench_Run( p_filter, i_base,
+                                blendbench_ParseChroma( psz_blend ) );
+
+                psz_blend = strchr( psz_blend, ',' );
+                if( psz_blend != NULL )
+                    psz_blend++;
+            }
+
+            psz_base = strchr( psz_base, ',' );
+            if( psz_base != NULL )
+                psz_base++;
+        }
+    }
+
     return p_pic;
 }
@@ -41,6 +41,8 @@
 #include "mosaic.h"
 
 #define BLANK_DELAY INT64_C(1000000)
+#define STATS_INTERVAL INT64_C(10000000)
+#define MAX_THREADS 16
 
 /*****************************************************************************
  * Local prototypes
@@ -52,6 +54,42 @@ static subpicture_t *Filter ( filter_t *, mtime_t );
 static int MosaicCallback   ( vlc_object_t *, char const *, vlc_value_t,
                               vlc_value_t, void * );
 
+/*****************************************************************************
+ * mosaic_tile_t : state of one bridged picture source
+ *****************************************************************************/
+typedef struct
+{
+    /* Last source picture put in the mosaic and its conversion. They are kept
+     * so that a tile whose source did not change is not converted again. */
+    picture_t      *p_source;
+    picture_t      *p_converted;
+    video_format_t fmt_out;
+
+    /* Current composition */
+    picture_t      *p_picture;
+    bool           b_convert;
+    int            i_real_index;
+    int            i_x, i_y;
+    int            i_alpha;
+
+    /* Statistics */
+    unsigned       i_shown;        /* new pictures put in the mosaic */
+    unsigned       i_dropped;      /* pictures never shown */
+    mtime_t        i_lag_total;    /* lateness of the shown pictures */
+    mtime_t        i_lag_max;
+    unsigned       i_converted;
+    unsigned       i_reused;       /* previous conversion shown again */
+    mtime_t        i_convert_total;
+    mtime_t        i_convert_max;
+} mosaic_tile_t;
+
+typedef struct
+{
+    filter_t        *p_filter;
+    vlc_thread_t    thread;
+    image_handler_t *p_image;
+} mosaic_worker_t;
+
 /*****************************************************************************
  * filter_sys_t : filter descriptor
  *****************************************************************************/
@@ -79,6 +117,22 @@ struct filter_sys_t
     int i_offsets_length;
 
     mtime_t i_delay;
+
+    mosaic_tile_t *p_tiles;   /* One per bridged ES */
+    int i_tiles;
+    mtime_t i_next_stats;
+
+    /* Tiles conversion worker pool */
+    mosaic_worker_t *p_workers;
+    int i_workers;
+    vlc_mutex_t job_lock;
+    vlc_cond_t job_wait;
+    vlc_cond_t job_done;
+    mosaic_tile_t **pp_jobs;
+    int i_jobs;
+    int i_next_job;
+    int i_jobs_pending;
+    bool b_quit;
 };
 
 /*****************************************************************************
@@ -157,6 +211,11 @@ struct filter_sys_t
         "according to this value (in milliseconds). For high " \
         "values you will need to raise caching at input.")
 
+#define THREADS_TEXT N_("Threads")
+#define THREADS_LONGTEXT N_( \
+        "Number of threads used to scale and convert the mosaic elements " \
+        "(0 = automatic).")
+
 enum
 {
     position_auto = 0, position_fixed = 1, position_offsets = 2
@@ -223,15 +282,234 @@ vlc_module_begin ()
 
     add_integer( CFG_PREFIX "delay", 0, DELAY_TEXT, DELAY_LONGTEXT,
                  false )
+
+    add_integer_with_range( CFG_PREFIX "threads", 0, 0, MAX_THREADS,
+                            THREADS_TEXT, THREADS_LONGTEXT, true )
 vlc_module_end ()
 
 static const char *const ppsz_filter_options[] = {
     "alpha", "height", "width", "align", "xoffset", "yoffset",
     "borderw", "borderh", "position", "rows", "cols",
     "keep-aspect-ratio", "keep-picture", "order", "offsets",
-    "delay", NULL
+    "delay", "threads", NULL
 };
 
+/*****************************************************************************
+ * Tiles conversion
+ *****************************************************************************/
+static void TileSetSource( mosaic_tile_t *p_tile, picture_t *p_source,
+                           picture_t *p_converted )
+{
+    if( p_tile->p_source )
+        picture_Release( p_tile->p_source );
+    if( p_tile->p_converted )
+        picture_Release( p_tile->p_converted );
+    p_tile->p_source = p_source;
+    p_tile->p_converted = p_converted;
+}
+
+static void ConvertTile( filter_t *p_filter, image_handler_t *p_image,
+                         mosaic_tile_t *p_tile )
+{
+    picture_t *p_picture = p_tile->p_picture;
+    video_format_t fmt_in;
+
+    memset( &fmt_in, 0, sizeof( video_format_t ) );
+    fmt_in.i_chroma = p_picture->format.i_chroma;
+    fmt_in.i_height = p_picture->format.i_height;
+    fmt_in.i_width = p_picture->format.i_width;
+
+    const mtime_t i_start = mdate();
+    picture_t *p_converted = image_Convert( p_image, p_picture,
+                                            &fmt_in, &p_tile->fmt_out );
+    const mtime_t i_duration = mdate() - i_start;
+
+    if( !p_converted )
+    {
+        msg_Warn( p_filter, "image resizing and chroma conversion failed" );
+        TileSetSource( p_tile, NULL, NULL );
+        return;
+    }
+    TileSetSource( p_tile, picture_Hold( p_picture ), p_converted );
+
+    p_tile->i_converted++;
+    p_tile->i_convert_total += i_duration;
+    p_tile->i_convert_max = __MAX( p_tile->i_convert_max, i_duration );
+}
+
+static void *Worker( void *p_data )
+{
+    mosaic_worker_t *p_worker = p_data;
+    filter_sys_t *p_sys = p_worker->p_filter->p_sys;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_sys->job_lock );
+    for( ;; )
+    {
+        while( !p_sys->b_quit && p_sys->i_next_job >= p_sys->i_jobs )
+            vlc_cond_wait( &p_sys->job_wait, &p_sys->job_lock );
+        if( p_sys->b_quit )
+            break;
+
+        mosaic_tile_t *p_tile = p_sys->pp_jobs[p_sys->i_next_job++];
+        vlc_mutex_unlock( &p_sys->job_lock );
+
+        ConvertTile( p_worker->p_filter, p_worker->p_image, p_tile );
+
+        vlc_mutex_lock( &p_sys->job_lock );
+        if( --p_sys->i_jobs_pending == 0 )
+            vlc_cond_signal( &p_sys->job_done );
+    }
+    vlc_mutex_unlock( &p_sys->job_lock );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+/* Converts the tiles in p_sys->pp_jobs, the calling thread takes part */
+static void ConvertTiles( filter_t *p_filter, int i_jobs )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    if( i_jobs <= 0 )
+        return;
+
+    vlc_mutex_lock( &p_sys->job_lock );
+    p_sys->i_jobs = i_jobs;
+    p_sys->i_next_job = 0;
+    p_sys->i_jobs_pending = i_jobs;
+    if( p_sys->i_workers > 0 && i_jobs > 1 )
+        vlc_cond_broadcast( &p_sys->job_wait );
+
+    while( p_sys->i_next_job < p_sys->i_jobs )
+    {
+        mosaic_tile_t *p_tile = p_sys->pp_jobs[p_sys->i_next_job++];
+        vlc_mutex_unlock( &p_sys->job_lock );
+
+        ConvertTile( p_filter, p_sys->p_image, p_tile );
+
+        vlc_mutex_lock( &p_sys->job_lock );
+        p_sys->i_jobs_pending--;
+    }
+    while( p_sys->i_jobs_pending > 0 )
+        vlc_cond_wait( &p_sys->job_done, &p_sys->job_lock );
+    p_sys->i_jobs = 0;
+    p_sys->i_next_job = 0;
+    vlc_mutex_unlock( &p_sys->job_lock );
+}
+
+static void StartWorkers( filter_t *p_filter )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+    int i_threads = var_InheritInteger( p_filter, CFG_PREFIX "threads" );
+
+    if( i_threads <= 0 )
+        i_threads = __MIN( vlc_GetCPUCount(), 4 );
+    i_threads = __MIN( i_threads, MAX_THREADS );
+
+    p_sys->p_workers = NULL;
+    p_sys->i_workers = 0;
+    if( p_sys->b_keep || i_threads <= 1 )
+        return;
+
+    p_sys->p_workers = calloc( i_threads - 1, sizeof( *p_sys->p_workers ) );
+    if( !p_sys->p_workers )
+        return;
+
+    for( int i = 0; i < i_threads - 1; i++ )
+    {
+        mosaic_worker_t *p_worker = &p_sys->p_workers[p_sys->i_workers];
+
+        p_worker->p_filter = p_filter;
+        p_worker->p_image = image_HandlerCreate( p_filter );
+        if( !p_worker->p_image )
+            break;
+        if( vlc_clone( &p_worker->thread, Worker, p_worker,
+                       VLC_THREAD_PRIORITY_VIDEO ) )
+        {
+            image_HandlerDelete( p_worker->p_image );
+            break;
+        }
+        p_sys->i_workers++;
+    }
+    msg_Dbg( p_filter, "converting pictures with %d threads",
+             p_sys->i_workers + 1 );
+}
+
+static void StopWorkers( filter_t *p_filter )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    vlc_mutex_lock( &p_sys->job_lock );
+    p_sys->b_quit = true;
+    vlc_cond_broadcast( &p_sys->job_wait );
+    vlc_mutex_unlock( &p_sys->job_lock );
+
+    for( int i = 0; i < p_sys->i_workers; i++ )
+    {
+        vlc_join( p_sys->p_workers[i].thread, NULL );
+        image_HandlerDelete( p_sys->p_workers[i].p_image );
+    }
+    free( p_sys->p_workers );
+}
+
+/*****************************************************************************
+ * Statistics
+ *****************************************************************************/
+/* Totals of all the tiles, exposed as variables of the filter */
+static const char *const ppsz_counters[] = {
+    CFG_PREFIX "pictures-shown", CFG_PREFIX "pictures-dropped",
+    CFG_PREFIX "tiles-converted", CFG_PREFIX "tiles-reused",
+};
+
+static void UpdateCounters( filter_t *p_filter )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+    int64_t pi_totals[ARRAY_SIZE(ppsz_counters)] = { 0 };
+
+    for( int i = 0; i < p_sys->i_tiles; i++ )
+    {
+        const mosaic_tile_t *p_tile = &p_sys->p_tiles[i];
+
+        pi_totals[0] += p_tile->i_shown;
+        pi_totals[1] += p_tile->i_dropped;
+        pi_totals[2] += p_tile->i_converted;
+        pi_totals[3] += p_tile->i_reused;
+    }
+    for( size_t i = 0; i < ARRAY_SIZE(ppsz_counters); i++ )
+        var_SetInteger( p_filter, ppsz_counters[i], pi_totals[i] );
+}
+
+static void PrintStats( filter_t *p_filter, bridge_t *p_bridge )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    for( int i = 0; i < p_bridge->i_es_num && i < p_sys->i_tiles; i++ )
+    {
+        const bridged_es_t *p_es = p_bridge->pp_es[i];
+        mosaic_tile_t *p_tile = &p_sys->p_tiles[i];
+
+        if( p_es->b_empty )
+            continue;
+
+        msg_Dbg( p_filter, "tile %s: %u pushed, %u shown, %u dropped, "
+                 "lateness avg %"PRId64" max %"PRId64" us, "
+                 "%u converted, %u reused, "
+                 "conversion avg %"PRId64" max %"PRId64" us",
+                 p_es->psz_id ? p_es->psz_id : "?", p_es->i_pushed,
+                 p_tile->i_shown, p_tile->i_dropped,
+                 p_tile->i_shown ? p_tile->i_lag_total / p_tile->i_shown : 0,
+                 p_tile->i_lag_max, p_tile->i_converted, p_tile->i_reused,
+                 p_tile->i_converted ?
+                     p_tile->i_convert_total / p_tile->i_converted : 0,
+                 p_tile->i_convert_max );
+
+        /* Maxima are given per interval */
+        p_tile->i_lag_max = 0;
+        p_tile->i_convert_max = 0;
+    }
+}
+
 /*****************************************************************************
  * mosaic_ParseSetOffsets:
  * parse the "--mosaic-offsets x1,y1,x2,y2,x3,y3" parameter
@@ -294,6 +572,20 @@ static int CreateFilter( vlc_object_t *p_this )
     vlc_mutex_init( &p_sys->lock );
     vlc_mutex_lock( &p_sys->lock );
 
+    p_sys->p_tiles = NULL;
+    p_sys->i_tiles = 0;
+    p_sys->pp_jobs = NULL;
+    p_sys->i_jobs = 0;
+    p_sys->i_next_job = 0;
+    p_sys->i_jobs_pending = 0;
+    p_sys->b_quit = false;
+    p_sys->i_next_stats = mdate() + STATS_INTERVAL;
+    vlc_mutex_init( &p_sys->job_lock );
+    vlc_cond_init( &p_sys->job_wait );
+    vlc_cond_init( &p_sys->job_done );
+    for( size_t i = 0; i < ARRAY_SIZE(ppsz_counters); i++ )
+        var_Create( p_filter, ppsz_counters[i], VLC_VAR_INTEGER );
+
     config_ChainParse( p_filter, CFG_PREFIX, ppsz_filter_options,
                        p_filter->p_cfg );
 
@@ -367,6 +659,8 @@ static int CreateFilter( vlc_object_t *p_this )
     free( psz_offsets );
     var_AddCallback( p_filter, CFG_PREFIX "offsets", MosaicCallback, p_sys );
 
+    StartWorkers( p_filter );
+
     vlc_mutex_unlock( &p_sys->lock );
 
     return VLC_SUCCESS;
@@ -401,6 +695,17 @@ static void DestroyFilter( vlc_object_t *p_this )
     DEL_CB( order );
 #undef DEL_CB
 
+    StopWorkers( p_filter );
+    for( size_t i = 0; i < ARRAY_SIZE(ppsz_counters); i++ )
+        var_Destroy( p_filter, ppsz_counters[i] );
+    for( int i = 0; i < p_sys->i_tiles; i++ )
+        TileSetSource( &p_sys->p_tiles[i], NULL, NULL );
+    free( p_sys->p_tiles );
+    free( p_sys->pp_jobs );
+    vlc_cond_destroy( &p_sys->job_done );
+    vlc_cond_destroy( &p_sys->job_wait );
+    vlc_mutex_destroy( &p_sys->job_lock );
+
     if( !p_sys->b_keep )
     {
         image_HandlerDelete( p_sys->p_image );
@@ -519,19 +824,53 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
     row_inner_height = ( ( p_sys->i_height - ( p_sys->i_rows - 1 )
                        * p_sys->i_borderh ) / p_sys->i_rows );
 
+    if( p_sys->i_tiles < p_bridge->i_es_num )
+    {
+        mosaic_tile_t *p_tiles = realloc( p_sys->p_tiles,
+                                  p_bridge->i_es_num * sizeof( *p_tiles ) );
+        mosaic_tile_t **pp_jobs = p_tiles ? realloc( p_sys->pp_jobs,
+                                  p_bridge->i_es_num * sizeof( *pp_jobs ) )
+                                          : NULL;
+        if( p_tiles )
+            p_sys->p_tiles = p_tiles;
+        if( !pp_jobs )
+        {
+            vlc_global_unlock( VLC_MOSAIC_MUTEX );
+            vlc_mutex_unlock( &p_sys->lock );
+            return p_spu;
+        }
+        memset( &p_tiles[p_sys->i_tiles], 0,
+                (p_bridge->i_es_num - p_sys->i_tiles) * sizeof( *p_tiles ) );
+        p_sys->pp_jobs = pp_jobs;
+        p_sys->i_tiles = p_bridge->i_es_num;
+    }
+
+    if( mdate() >= p_sys->i_next_stats )
+    {
+        PrintStats( p_filter, p_bridge );
+        p_sys->i_next_stats = mdate() + STATS_INTERVAL;
+    }
+
+    /* Pick the pictures to show while holding the bridge, and only convert
+     * them once it is released so that the bridges are not blocked */
+    const int i_tiles = p_bridge->i_es_num;
+    int i_jobs = 0;
+
     i_real_index = 0;
 
-    for ( i_index = 0; i_index < p_bridge->i_es_num; i_index++ )
+    for ( i_index = 0; i_index < i_tiles; i_index++ )
     {
         bridged_es_t *p_es = p_bridge->pp_es[i_index];
-        video_format_t fmt_in, fmt_out;
-        picture_t *p_converted;
+        mosaic_tile_t *p_tile = &p_sys->p_tiles[i_index];
+        video_format_t fmt_out;
 
-        memset( &fmt_in, 0, sizeof( video_format_t ) );
-        memset( &fmt_out, 0, sizeof( video_format_t ) );
+        p_tile->p_picture = NULL;
 
         if ( p_es->b_empty )
+        {
+            TileSetSource( p_tile, NULL, NULL );
             continue;
+        }
 
         while ( p_es->p_picture != NULL
                  && p_es->p_picture->date + p_sys->i_delay < date )
@@ -539,6 +878,8 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
             if ( p_es->p_picture->p_next != NULL )
             {
                 picture_t *p_next = p_es->p_picture->p_next;
+                if( p_es->p_picture != p_tile->p_source )
+                    p_tile->i_dropped++;
                 picture_Release( p_es->p_picture );
                 p_es->p_picture = p_next;
             }
@@ -561,7 +902,10 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
         }
 
         if ( p_es->p_picture == NULL )
+        {
+            TileSetSource( p_tile, NULL, NULL );
             continue;
+        }
 
         if ( p_sys->i_order_length == 0 )
         {
@@ -582,81 +926,136 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
             if ( i == p_sys->i_order_length )
                 i_real_index = ++i_greatest_real_index_used;
         }
-        i_row = ( i_real_index / p_sys->i_cols ) % p_sys->i_rows;
-        i_col = i_real_index % p_sys->i_cols ;
-
-        if ( !p_sys->b_keep )
+        p_tile->i_real_index = i_real_index;
+        p_tile->i_x = p_es->i_x;
+        p_tile->i_y = p_es->i_y;
+        p_tile->i_alpha = p_es->i_alpha;
+        p_tile->p_picture = picture_Hold( p_es->p_picture );
+        p_tile->b_convert = false;
+
+        if( p_tile->p_picture != p_tile->p_source )
         {
-            /* Convert the images */
-            fmt_in.i_chroma = p_es->p_picture->format.i_chroma;
-            fmt_in.i_height = p_es->p_picture->format.i_height;
-            fmt_in.i_width = p_es->p_picture->format.i_width;
+            const mtime_t i_lag = date - p_tile->p_picture->date - p_sys->i_delay;
 
-            if( fmt_in.i_chroma == VLC_CODEC_YUVA ||
-                fmt_in.i_chroma == VLC_CODEC_RGBA )
-                fmt_out.i_chroma = VLC_CODEC_YUVA;
-            else
-                fmt_out.i_chroma = VLC_CODEC_I420;
-            fmt_out.i_width = col_inner_width;
-            fmt_out.i_height = row_inner_height;
+            p_tile->i_shown++;
+            p_tile->i_lag_total += i_lag;
+            p_tile->i_lag_max = __MAX( p_tile->i_lag_max, i_lag );
+        }
 
-            if( p_sys->b_ar ) /* keep aspect ratio */
-            {
-                if( (float)fmt_out.i_width / (float)fmt_out.i_height
-                      > (float)fmt_in.i_width / (float)fmt_in.i_height )
-                {
-                    fmt_out.i_width = ( fmt_out.i_height * fmt_in.i_width )
-                                         / fmt_in.i_height;
-                }
-                else
-                {
-                    fmt_out.i_height = ( fmt_out.i_width * fmt_in.i_height )
-                                        / fmt_in.i_width;
-                }
-             }
+        if ( p_sys->b_keep )
+        {
+            TileSetSource( p_tile, picture_Hold( p_tile->p_picture ), NULL );
+            continue;
+        }
 
-            fmt_out.i_visible_width = fmt_out.i_width;
-            fmt_out.i_visible_height = fmt_out.i_height;
+        /* Compute the converted format */
+        const video_format_t *p_fmt_in = &p_tile->p_picture->format;
+
+        memset( &fmt_out, 0, sizeof( video_format_t ) );
+        if( p_fmt_in->i_chroma == VLC_CODEC_YUVA ||
+            p_fmt_in->i_chroma == VLC_CODEC_RGBA )
+            fmt_out.i_chroma = VLC_CODEC_YUVA;
+        else
+            fmt_out.i_chroma = VLC_CODEC_I420;
+        fmt_out.i_width = col_inner_width;
+        fmt_out.i_height = row_inner_height;
 
-            p_converted = image_Convert( p_sys->p_image, p_es->p_picture,
-                                         &fmt_in, &fmt_out );
-            if( !p_converted )
+        if( p_sys->b_ar ) /* keep aspect ratio */
+        {
+            if( (float)fmt_out.i_width / (float)fmt_out.i_height
+                  > (float)p_fmt_in->i_width / (float)p_fmt_in->i_height )
             {
-                msg_Warn( p_filter,
-                           "image resizing and chroma conversion failed" );
-                continue;
+                fmt_out.i_width = ( fmt_out.i_height * p_fmt_in->i_width )
+                                     / p_fmt_in->i_height;
             }
+            else
+            {
+                fmt_out.i_height = ( fmt_out.i_width * p_fmt_in->i_height )
+                                    / p_fmt_in->i_width;
+            }
+         }
+
+        fmt_out.i_visible_width = fmt_out.i_width;
+        fmt_out.i_visible_height = fmt_out.i_height;
+
+        /* Unchanged tiles are not converted again */
+        if( p_tile->p_picture == p_tile->p_source && p_tile->p_converted &&
+            fmt_out.i_chroma == p_tile->fmt_out.i_chroma &&
+            fmt_out.i_width == p_tile->fmt_out.i_width &&
+            fmt_out.i_height == p_tile->fmt_out.i_height )
+        {
+            p_tile->i_reused++;
+            continue;
         }
-        else
+
+        p_tile->fmt_out = fmt_out;
+        p_tile->b_convert = true;
+        p_sys->pp_jobs[i_jobs++] = p_tile;
+    }
+
+    vlc_global_unlock( VLC_MOSAIC_MUTEX );
+
+    ConvertTiles( p_filter, i_jobs );
+    UpdateCounters( p_filter );
+
+    for ( i_index = 0; i_index < i_tiles; i_index++ )
+    {
+        mosaic_tile_t *p_tile = &p_sys->p_tiles[i_index];
+        picture_t *p_converted;
+        video_format_t fmt_out;
+
+        if( p_tile->p_picture == NULL )
+            continue;
+
+        if ( p_sys->b_keep )
         {
-            p_converted = p_es->p_picture;
-            fmt_in.i_width = fmt_out.i_width = p_converted->format.i_width;
-            fmt_in.i_height = fmt_out.i_height = p_converted->format.i_height;
-            fmt_in.i_chroma = fmt_out.i_chroma = p_converted->format.i_chroma;
+            p_converted = p_tile->p_picture;
+            memset( &fmt_out, 0, sizeof( video_format_t ) );
+            fmt_out.i_width = p_converted->format.i_width;
+            fmt_out.i_height = p_converted->format.i_height;
+            fmt_out.i_chroma = p_converted->format.i_chroma;
             fmt_out.i_visible_width = fmt_out.i_width;
             fmt_out.i_visible_height = fmt_out.i_height;
         }
+        else
+        {
+            p_converted = p_tile->p_converted;
+            fmt_out = p_tile->fmt_out;
+        }
+
+        picture_Release( p_tile->p_picture );
+        p_tile->p_picture = NULL;
+
+        if( !p_converted )
+            continue;
 
         p_region = subpicture_region_New( &fmt_out );
         /* FIXME the copy is probably not needed anymore */
         if( p_region )
             picture_Copy( p_region->p_picture, p_converted );
-        if( !p_sys->b_keep )
-            picture_Release( p_converted );
 
         if( !p_region )
         {
             msg_Err( p_filter, "cannot allocate SPU region" );
+            for( i_index++; i_index < i_tiles; i_index++ )
+            {
+                if( p_sys->p_tiles[i_index].p_picture )
+                    picture_Release( p_sys->p_tiles[i_index].p_picture );
+                p_sys->p_tiles[i_index].p_picture = NULL;
+            }
             p_filter->pf_sub_buffer_del( p_filter, p_spu );
-            vlc_global_unlock( VLC_MOSAIC_MUTEX );
             vlc_mutex_unlock( &p_sys->lock );
-            return p_spu;
+            return NULL;
         }
 
-        if( p_es->i_x >= 0 && p_es->i_y >= 0 )
+        i_real_index = p_tile->i_real_index;
+        i_row = ( i_real_index / p_sys->i_cols ) % p_sys->i_rows;
+        i_col = i_real_index % p_sys->i_cols ;
+
+        if( p_tile->i_x >= 0 && p_tile->i_y >= 0 )
         {
-            p_region->i_x = p_es->i_x;
-            p_region->i_y = p_es->i_y;
+            p_region->i_x = p_tile->i_x;
+            p_region->i_y = p_tile->i_y;
         }
         else if( p_sys->i_position == position_offsets )
         {
@@ -702,7 +1101,7 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
             }
         }
         p_region->i_align = p_sys->i_align;
-        p_region->i_alpha = p_es->i_alpha;
+        p_region->i_alpha = p_tile->i_alpha;
 
         if( p_region_prev == NULL )
         {
@@ -716,7 +1115,6 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
         p_region_prev = p_region;
     }
 
-    vlc_global_unlock( VLC_MOSAIC_MUTEX );
     vlc_mutex_unlock( &p_sys->lock );
 
     return p_spu;
@@ -33,6 +33,8 @@ typedef struct bridged_es_t
     int i_alpha;
     int i_x;
     int i_y;
+
+    unsigned i_pushed; /* pictures queued by the bridge */
 } bridged_es_t;
 
 typedef struct bridge_t
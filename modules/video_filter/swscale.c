@@ -56,6 +56,12 @@ static void CloseScaler( vlc_object_t * );
 #define SCALEMODE_TEXT N_("Scaling mode")
 #define SCALEMODE_LONGTEXT N_("Scaling mode to use.")
 
+#define THREADS_TEXT N_("Threads")
+#define THREADS_LONGTEXT N_( \
+    "Number of threads used to convert pictures (0 = automatic).")
+
+#define MAX_THREADS 16
+
 static const int pi_mode_values[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
 const char *const ppsz_mode_descriptions[] =
 { N_("Fast bilinear"), N_("Bilinear"), N_("Bicubic (good quality)"),
@@ -72,6 +78,8 @@ vlc_module_begin ()
     set_callbacks( OpenScaler, CloseScaler )
     add_integer( "swscale-mode", 2, SCALEMODE_TEXT, SCALEMODE_LONGTEXT, true )
         change_integer_list( pi_mode_values, ppsz_mode_descriptions )
+    add_integer_with_range( "swscale-threads", 0, 0, MAX_THREADS,
+                            THREADS_TEXT, THREADS_LONGTEXT, true )
 vlc_module_end ()
 
 /* Version checking */
@@ -81,14 +89,25 @@ vlc_module_end ()
  ****************************************************************************/
 
 /**
- * Internal swscale filter structure.
+ * Horizontal band of the output picture, converted with its own context.
  */
-struct filter_sys_t
+typedef struct
 {
-    SwsFilter *p_src_filter;
-    SwsFilter *p_dst_filter;
-    int i_cpu_mask, i_sws_flags;
+    struct SwsContext *ctx;
+    int i_src_y;        /* first source line */
+    int i_src_height;
+    int i_dst_y;        /* first output line */
+    int i_dst_height;
+    /* The band and its margins, when the picture is scaled vertically */
+    picture_t *p_pic;
+    int i_margin;       /* lines of p_pic above the band */
+} band_t;
 
+/**
+ * Scaler for one input/output geometry.
+ */
+typedef struct
+{
     video_format_t fmt_in;
     video_format_t fmt_out;
 
@@ -103,11 +122,58 @@ struct filter_sys_t
     bool b_copy;
     bool b_swap_uvi;
     bool b_swap_uvo;
+
+    /* Bands of the picture converted in parallel */
+    band_t p_bands[MAX_THREADS];
+    int i_bands;
+
+    uint64_t i_last_use;
+} scaler_t;
+
+/* Number of geometries kept around */
+#define SCALER_CACHE_SIZE 4
+
+typedef struct
+{
+    filter_t *p_filter;
+    const band_t *p_band;
+    picture_t *p_dst;
+    picture_t *p_src;
+    bool b_swap_uvi;
+    bool b_swap_uvo;
+} band_job_t;
+
+/**
+ * Internal swscale filter structure.
+ */
+struct filter_sys_t
+{
+    SwsFilter *p_src_filter;
+    SwsFilter *p_dst_filter;
+    int i_cpu_mask, i_sws_flags;
+
+    scaler_t p_scalers[SCALER_CACHE_SIZE];
+    scaler_t *p_scaler; /* in use */
+    uint64_t i_use_clock;
+
+    /* Bands worker pool, started on first use */
+    int i_threads;
+    vlc_thread_t p_threads[MAX_THREADS - 1];
+    int i_threads_started;
+    vlc_mutex_t job_lock;
+    vlc_cond_t job_wait;
+    vlc_cond_t job_done;
+    band_job_t p_jobs[MAX_THREADS];
+    int i_jobs;
+    int i_next_job;
+    int i_jobs_pending;
+    bool b_quit;
 };
 
 static picture_t *Filter( filter_t *, picture_t * );
 static int  Init( filter_t * );
-static void Clean( filter_t * );
+static void Clean( scaler_t * );
+static void StopThreads( filter_t * );
 
 typedef struct
 {
@@ -133,6 +199,13 @@ static int GetSwsCpuMask(void);
 #define ALLOW_YUVP (false)
 /* SwScaler does not like too small picture */
 #define MINIMUM_WIDTH (32)
+/* Bands are not worth it below that height, and start on multiples of 16
+ * lines so that subsampled planes and dithering patterns stay aligned */
+#define MINIMUM_BAND_HEIGHT (64)
+#define BAND_ALIGN (16)
+/* Lines converted around a vertically scaled band, in both pictures, so that
+ * the band lines do not depend on the picture edges */
+#define BAND_MARGIN (16)
 
 /* XXX is it always 3 even for BIG_ENDIAN (blend.c seems to think so) ? */
 #define OFFSET_A (3)
@@ -150,7 +223,7 @@ static int OpenScaler( vlc_object_t *p_this )
     if( GetParameters( NULL,
                        &p_filter->fmt_in.video,
                        &p_filter->fmt_out.video, 0 ) )
-        return VLC_EGENERIC;
+        return VLC_ENOTSUP;
 
     /* */
     p_filter->pf_video_filter = Filter;
@@ -183,17 +256,28 @@ static int OpenScaler( vlc_object_t *p_this )
     p_sys->p_dst_filter = NULL;
 
     /* Misc init */
-    p_sys->ctx = NULL;
-    p_sys->ctxA = NULL;
-    p_sys->p_src_a = NULL;
-    p_sys->p_dst_a = NULL;
-    p_sys->p_src_e = NULL;
-    p_sys->p_dst_e = NULL;
-    memset( &p_sys->fmt_in,  0, sizeof(p_sys->fmt_in) );
-    memset( &p_sys->fmt_out, 0, sizeof(p_sys->fmt_out) );
+    memset( p_sys->p_scalers, 0, sizeof(p_sys->p_scalers) );
+    p_sys->p_scaler = NULL;
+    p_sys->i_use_clock = 0;
+
+    p_sys->i_threads = var_InheritInteger( p_filter, "swscale-threads" );
+    if( p_sys->i_threads <= 0 )
+        p_sys->i_threads = __MIN( vlc_GetCPUCount(), 4 );
+    p_sys->i_threads = __MIN( p_sys->i_threads, MAX_THREADS );
+    p_sys->i_threads_started = 0;
+    vlc_mutex_init( &p_sys->job_lock );
+    vlc_cond_init( &p_sys->job_wait );
+    vlc_cond_init( &p_sys->job_done );
+    p_sys->i_jobs = 0;
+    p_sys->i_next_job = 0;
+    p_sys->i_jobs_pending = 0;
+    p_sys->b_quit = false;
 
     if( Init( p_filter ) )
     {
+        vlc_cond_destroy( &p_sys->job_done );
+        vlc_cond_destroy( &p_sys->job_wait );
+        vlc_mutex_destroy( &p_sys->job_lock );
         if( p_sys->p_src_filter )
             sws_freeFilter( p_sys->p_src_filter );
         free( p_sys );
@@ -218,7 +302,12 @@ static void CloseScaler( vlc_object_t *p_this )
     filter_t *p_filter = (filter_t*)p_this;
     filter_sys_t *p_sys = p_filter->p_sys;
 
-    Clean( p_filter );
+    StopThreads( p_filter );
+    for( int i = 0; i < SCALER_CACHE_SIZE; i++ )
+        Clean( &p_sys->p_scalers[i] );
+    vlc_cond_destroy( &p_sys->job_done );
+    vlc_cond_destroy( &p_sys->job_wait );
+    vlc_mutex_destroy( &p_sys->job_lock );
     if( p_sys->p_src_filter )
         sws_freeFilter( p_sys->p_src_filter );
     free( p_sys );
@@ -341,19 +430,181 @@ static int GetParameters( ScalerConfiguration *p_cfg,
     return VLC_SUCCESS;
 }
 
+/* Returns the number of output lines band boundaries must be a multiple of
+ * for the bands to be converted exactly as the whole picture, or 0 if the
+ * picture cannot be converted in bands.
+ * A band resized vertically is converted with margins, so that its lines get
+ * the filter taps of the whole picture. Their phase is the same only if the
+ * 16.16 fixed point step of swscale is exact for every plane, and if the
+ * boundaries fall on whole lines of both pictures. */
+static int GetBandStep( const video_format_t *p_fmti,
+                        const video_format_t *p_fmto, int i_sws_flags,
+                        bool *pb_scaled )
+{
+    const vlc_chroma_description_t *p_dsci =
+        vlc_fourcc_GetChromaDescription( p_fmti->i_chroma );
+    const vlc_chroma_description_t *p_dsco =
+        vlc_fourcc_GetChromaDescription( p_fmto->i_chroma );
+    if( !p_dsci || !p_dsco )
+        return 0;
+
+    const unsigned i_hi_num = p_dsci->plane_count > 1 ? p_dsci->p[1].h.num : 1;
+    const unsigned i_hi_den = p_dsci->plane_count > 1 ? p_dsci->p[1].h.den : 1;
+    const unsigned i_ho_num = p_dsco->plane_count > 1 ? p_dsco->p[1].h.num : 1;
+    const unsigned i_ho_den = p_dsco->plane_count > 1 ? p_dsco->p[1].h.den : 1;
+
+    *pb_scaled = p_fmti->i_height != p_fmto->i_height ||
+                 i_hi_num * i_ho_den != i_ho_num * i_hi_den;
+    if( !*pb_scaled )
+        return BAND_ALIGN;
+
+    /* The sinc filter reaches further than the margins */
+    if( i_sws_flags & SWS_SINC )
+        return 0;
+
+    const int64_t i_src = p_fmti->i_height;
+    const int64_t i_dst = p_fmto->i_height;
+    if( i_src % i_hi_den || i_dst % i_ho_den )
+        return 0;
+    const int64_t i_src_c = i_src * i_hi_num / i_hi_den;
+    const int64_t i_dst_c = i_dst * i_ho_num / i_ho_den;
+    if( ( i_src << 16 ) % i_dst || ( i_src_c << 16 ) % i_dst_c )
+        return 0;
+
+    /* Output lines i_dst_period start on the source line i_src_period */
+    const int64_t i_gcd = GCD( i_src, i_dst );
+    const int i_src_period = i_src / i_gcd;
+    const int i_dst_period = i_dst / i_gcd;
+    int i_step = i_dst_period;
+    while( i_step % BAND_ALIGN ||
+           i_step / i_dst_period * i_src_period % i_hi_den )
+        i_step += i_dst_period;
+    return i_step;
+}
+
+static int StartThreads( filter_t * );
+
+static void CleanBands( band_t *p_bands, int i_bands )
+{
+    for( int i = 0; i < i_bands; i++ )
+    {
+        if( p_bands[i].ctx )
+            sws_freeContext( p_bands[i].ctx );
+        if( p_bands[i].p_pic )
+            picture_Release( p_bands[i].p_pic );
+        p_bands[i].ctx = NULL;
+        p_bands[i].p_pic = NULL;
+    }
+}
+
+static void InitBands( filter_t *p_filter, scaler_t *p_scaler,
+                       const ScalerConfiguration *p_cfg,
+                       unsigned i_fmti_width, unsigned i_fmto_width )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+    const video_format_t *p_fmti = &p_filter->fmt_in.video;
+    const video_format_t *p_fmto = &p_filter->fmt_out.video;
+    const int i_src_height = p_fmti->i_height;
+    const int i_dst_height = p_fmto->i_height;
+
+    p_scaler->i_bands = 0;
+    if( p_sys->i_threads <= 1 || p_scaler->b_copy ||
+        p_scaler->i_extend_factor != 1 ||
+        i_dst_height < 2 * MINIMUM_BAND_HEIGHT )
+        return;
+
+    bool b_scaled;
+    const int i_step = GetBandStep( p_fmti, p_fmto, p_cfg->i_sws_flags,
+                                    &b_scaled );
+    if( i_step <= 0 )
+        return;
+
+    /* At least BAND_MARGIN lines of each picture */
+    int i_margin = 0;
+    if( b_scaled )
+    {
+        i_margin = __MAX( BAND_MARGIN, ( BAND_MARGIN * i_dst_height +
+                                         i_src_height - 1 ) / i_src_height );
+        i_margin = ( i_margin + i_step - 1 ) / i_step * i_step;
+    }
+
+    int i_bands = __MIN( p_sys->i_threads, i_dst_height / MINIMUM_BAND_HEIGHT );
+    const int i_band_height = ( ( i_dst_height + i_bands - 1 ) / i_bands +
+                                i_step - 1 ) / i_step * i_step;
+    i_bands = ( i_dst_height + i_band_height - 1 ) / i_band_height;
+    if( i_bands <= 1 || StartThreads( p_filter ) )
+        return;
+
+    for( int i = 0; i < i_bands; i++ )
+    {
+        band_t *p_band = &p_scaler->p_bands[i];
+        const int i_y = i * i_band_height;
+        const int i_top = __MAX( i_y - i_margin, 0 );
+        const int i_bottom = __MIN( i_y + i_band_height + i_margin,
+                                    i_dst_height );
+
+        p_band->i_dst_y = i_y;
+        p_band->i_dst_height = __MIN( i_band_height, i_dst_height - i_y );
+        p_band->i_margin = i_y - i_top;
+        p_band->i_src_y = (int64_t)i_top * i_src_height / i_dst_height;
+        p_band->i_src_height = (int64_t)i_bottom * i_src_height / i_dst_height -
+                               p_band->i_src_y;
+        p_band->ctx = sws_getContext( i_fmti_width, p_band->i_src_height,
+                                      p_cfg->i_fmti,
+                                      i_fmto_width, i_bottom - i_top,
+                                      p_cfg->i_fmto,
+                                      p_cfg->i_sws_flags | p_sys->i_cpu_mask,
+                                      p_sys->p_src_filter, p_sys->p_dst_filter,
+                                      0 );
+        p_band->p_pic = NULL;
+        if( b_scaled )
+            p_band->p_pic = picture_New( p_fmto->i_chroma, i_fmto_width,
+                                         i_bottom - i_top, 0, 1 );
+        if( !p_band->ctx || ( b_scaled && !p_band->p_pic ) )
+        {
+            CleanBands( p_scaler->p_bands, i + 1 );
+            return;
+        }
+    }
+    p_scaler->i_bands = i_bands;
+}
+
 static int Init( filter_t *p_filter )
 {
     filter_sys_t *p_sys = p_filter->p_sys;
     const video_format_t *p_fmti = &p_filter->fmt_in.video;
     video_format_t       *p_fmto = &p_filter->fmt_out.video;
+    scaler_t *p_scaler = p_sys->p_scaler;
 
-    if( IsFmtSimilar( p_fmti, &p_sys->fmt_in ) &&
-        IsFmtSimilar( p_fmto, &p_sys->fmt_out ) &&
-        p_sys->ctx )
+    if( p_scaler &&
+        IsFmtSimilar( p_fmti, &p_scaler->fmt_in ) &&
+        IsFmtSimilar( p_fmto, &p_scaler->fmt_out ) )
     {
         return VLC_SUCCESS;
     }
-    Clean( p_filter );
+
+    /* Reuse the scaler of a previously used geometry if possible, otherwise
+     * replace the least recently used one */
+    p_scaler = NULL;
+    for( int i = 0; i < SCALER_CACHE_SIZE; i++ )
+    {
+        scaler_t *p_entry = &p_sys->p_scalers[i];
+
+        if( p_entry->ctx &&
+            IsFmtSimilar( p_fmti, &p_entry->fmt_in ) &&
+            IsFmtSimilar( p_fmto, &p_entry->fmt_out ) )
+        {
+            p_entry->i_last_use = ++p_sys->i_use_clock;
+            p_sys->p_scaler = p_entry;
+            video_format_ScaleCropAr( p_fmto, p_fmti );
+            return VLC_SUCCESS;
+        }
+        if( !p_scaler || !p_entry->ctx ||
+            ( p_scaler->ctx && p_entry->i_last_use < p_scaler->i_last_use ) )
+            p_scaler = p_entry;
+    }
+    p_sys->p_scaler = NULL;
+    Clean( p_scaler );
 
     /* Init with new parameters */
     ScalerConfiguration cfg;
@@ -369,12 +620,12 @@ static int Init( filter_t *p_filter )
     }
 
     /* swscale does not like too small width */
-    p_sys->i_extend_factor = 1;
-    while( __MIN( p_fmti->i_width, p_fmto->i_width ) * p_sys->i_extend_factor < MINIMUM_WIDTH)
-        p_sys->i_extend_factor++;
+    p_scaler->i_extend_factor = 1;
+    while( __MIN( p_fmti->i_width, p_fmto->i_width ) * p_scaler->i_extend_factor < MINIMUM_WIDTH)
+        p_scaler->i_extend_factor++;
 
-    const unsigned i_fmti_width = p_fmti->i_width * p_sys->i_extend_factor;
-    const unsigned i_fmto_width = p_fmto->i_width * p_sys->i_extend_factor;
+    const unsigned i_fmti_width = p_fmti->i_width * p_scaler->i_extend_factor;
+    const unsigned i_fmto_width = p_fmto->i_width * p_scaler->i_extend_factor;
     for( int n = 0; n < (cfg.b_has_a ? 2 : 1); n++ )
     {
         const int i_fmti = n == 0 ? cfg.i_fmti : PIX_FMT_GRAY8;
@@ -386,92 +637,101 @@ static int Init( filter_t *p_filter )
                               cfg.i_sws_flags | p_sys->i_cpu_mask,
                               p_sys->p_src_filter, p_sys->p_dst_filter, 0 );
         if( n == 0 )
-            p_sys->ctx = ctx;
+            p_scaler->ctx = ctx;
         else
-            p_sys->ctxA = ctx;
+            p_scaler->ctxA = ctx;
     }
-    if( p_sys->ctxA )
+    if( p_scaler->ctxA )
     {
-        p_sys->p_src_a = picture_New( VLC_CODEC_GREY, i_fmti_width, p_fmti->i_height, 0, 1 );
-        p_sys->p_dst_a = picture_New( VLC_CODEC_GREY, i_fmto_width, p_fmto->i_height, 0, 1 );
+        p_scaler->p_src_a = picture_New( VLC_CODEC_GREY, i_fmti_width, p_fmti->i_height, 0, 1 );
+        p_scaler->p_dst_a = picture_New( VLC_CODEC_GREY, i_fmto_width, p_fmto->i_height, 0, 1 );
     }
-    if( p_sys->i_extend_factor != 1 )
+    if( p_scaler->i_extend_factor != 1 )
     {
-        p_sys->p_src_e = picture_New( p_fmti->i_chroma, i_fmti_width, p_fmti->i_height, 0, 1 );
-        p_sys->p_dst_e = picture_New( p_fmto->i_chroma, i_fmto_width, p_fmto->i_height, 0, 1 );
+        p_scaler->p_src_e = picture_New( p_fmti->i_chroma, i_fmti_width, p_fmti->i_height, 0, 1 );
+        p_scaler->p_dst_e = picture_New( p_fmto->i_chroma, i_fmto_width, p_fmto->i_height, 0, 1 );
 
-        if( p_sys->p_src_e )
-            memset( p_sys->p_src_e->p[0].p_pixels, 0, p_sys->p_src_e->p[0].i_pitch * p_sys->p_src_e->p[0].i_lines );
-        if( p_sys->p_dst_e )
-            memset( p_sys->p_dst_e->p[0].p_pixels, 0, p_sys->p_dst_e->p[0].i_pitch * p_sys->p_dst_e->p[0].i_lines );
+        if( p_scaler->p_src_e )
+            memset( p_scaler->p_src_e->p[0].p_pixels, 0, p_scaler->p_src_e->p[0].i_pitch * p_scaler->p_src_e->p[0].i_lines );
+        if( p_scaler->p_dst_e )
+            memset( p_scaler->p_dst_e->p[0].p_pixels, 0, p_scaler->p_dst_e->p[0].i_pitch * p_scaler->p_dst_e->p[0].i_lines );
     }
 
-    if( !p_sys->ctx ||
-        ( cfg.b_has_a && ( !p_sys->ctxA || !p_sys->p_src_a || !p_sys->p_dst_a ) ) ||
-        ( p_sys->i_extend_factor != 1 && ( !p_sys->p_src_e || !p_sys->p_dst_e ) ) )
+    if( !p_scaler->ctx ||
+        ( cfg.b_has_a && ( !p_scaler->ctxA || !p_scaler->p_src_a || !p_scaler->p_dst_a ) ) ||
+        ( p_scaler->i_extend_factor != 1 && ( !p_scaler->p_src_e || !p_scaler->p_dst_e ) ) )
     {
         msg_Err( p_filter, "could not init SwScaler and/or allocate memory" );
-        Clean( p_filter );
+        Clean( p_scaler );
         return VLC_EGENERIC;
     }
 
-    p_sys->b_add_a = cfg.b_add_a;
-    p_sys->b_copy = cfg.b_copy;
-    p_sys->fmt_in  = *p_fmti;
-    p_sys->fmt_out = *p_fmto;
-    p_sys->b_swap_uvi = cfg.b_swap_uvi;
-    p_sys->b_swap_uvo = cfg.b_swap_uvo;
+    p_scaler->b_add_a = cfg.b_add_a;
+    p_scaler->b_copy = cfg.b_copy;
+    p_scaler->fmt_in  = *p_fmti;
+    p_scaler->fmt_out = *p_fmto;
+    p_scaler->b_swap_uvi = cfg.b_swap_uvi;
+    p_scaler->b_swap_uvo = cfg.b_swap_uvo;
+    p_scaler->i_last_use = ++p_sys->i_use_clock;
+
+    InitBands( p_filter, p_scaler, &cfg, i_fmti_width, i_fmto_width );
+
+    p_sys->p_scaler = p_scaler;
 
     video_format_ScaleCropAr( p_fmto, p_fmti );
 #if 0
     msg_Dbg( p_filter, "%ix%i chroma: %4.4s -> %ix%i chroma: %4.4s extend by %d",
              p_fmti->i_width, p_fmti->i_height, (char *)&p_fmti->i_chroma,
              p_fmto->i_width, p_fmto->i_height, (char *)&p_fmto->i_chroma,
-             p_sys->i_extend_factor );
+             p_scaler->i_extend_factor );
 #endif
     return VLC_SUCCESS;
 }
-static void Clean( filter_t *p_filter )
+static void Clean( scaler_t *p_scaler )
 {
-    filter_sys_t *p_sys = p_filter->p_sys;
+    if( p_scaler->p_src_e )
+        picture_Release( p_scaler->p_src_e );
+    if( p_scaler->p_dst_e )
+        picture_Release( p_scaler->p_dst_e );
 
-    if( p_sys->p_src_e )
-        picture_Release( p_sys->p_src_e );
-    if( p_sys->p_dst_e )
-        picture_Release( p_sys->p_dst_e );
+    if( p_scaler->p_src_a )
+        picture_Release( p_scaler->p_src_a );
+    if( p_scaler->p_dst_a )
+        picture_Release( p_scaler->p_dst_a );
 
-    if( p_sys->p_src_a )
-        picture_Release( p_sys->p_src_a );
-    if( p_sys->p_dst_a )
-        picture_Release( p_sys->p_dst_a );
+    if( p_scaler->ctxA )
+        sws_freeContext( p_scaler->ctxA );
 
-    if( p_sys->ctxA )
-        sws_freeContext( p_sys->ctxA );
+    if( p_scaler->ctx )
+        sws_freeContext( p_scaler->ctx );
 
-    if( p_sys->ctx )
-        sws_freeContext( p_sys->ctx );
+    CleanBands( p_scaler->p_bands, p_scaler->i_bands );
 
     /* We have to set it to null has we call be called again :( */
-    p_sys->ctx = NULL;
-    p_sys->ctxA = NULL;
-    p_sys->p_src_a = NULL;
-    p_sys->p_dst_a = NULL;
-    p_sys->p_src_e = NULL;
-    p_sys->p_dst_e = NULL;
+    p_scaler->ctx = NULL;
+    p_scaler->ctxA = NULL;
+    p_scaler->p_src_a = NULL;
+    p_scaler->p_dst_a = NULL;
+    p_scaler->p_src_e = NULL;
+    p_scaler->p_dst_e = NULL;
+    p_scaler->i_bands = 0;
 }
 
 static void GetPixels( uint8_t *pp_pixel[4], int pi_pitch[4],
                        const picture_t *p_picture,
                        int i_plane_start, int i_plane_count,
-                       bool b_swap_uv )
+                       int i_y, bool b_swap_uv )
 {
     assert( !b_swap_uv || i_plane_count >= 3 );
     int n;
     for( n = 0; n < __MIN(i_plane_count, p_picture->i_planes-i_plane_start ); n++ )
     {
         const int nd = ( b_swap_uv && n >= 1 && n <= 2 ) ? (3 - n) : n;
-        pp_pixel[nd] = p_picture->p[i_plane_start+n].p_pixels;
-        pi_pitch[nd] = p_picture->p[i_plane_start+n].i_pitch;
+        const plane_t *p_plane = &p_picture->p[i_plane_start+n];
+        const int i_plane_y = i_y * p_plane->i_lines / p_picture->p[0].i_lines;
+
+        pp_pixel[nd] = &p_plane->p_pixels[i_plane_y * p_plane->i_pitch];
+        pi_pitch[nd] = p_plane->i_pitch;
     }
     for( ; n < 4; n++ )
     {
@@ -530,7 +790,9 @@ static void SwapUV( picture_t *p_dst, const picture_t *p_src )
     picture_CopyPixels( p_dst, &tmp );
 }
 static void Convert( filter_t *p_filter, struct SwsContext *ctx,
-                     picture_t *p_dst, picture_t *p_src, int i_height, int i_plane_start, int i_plane_count,
+                     picture_t *p_dst, int i_dst_y,
+                     picture_t *p_src, int i_src_y, int i_height,
+                     int i_plane_start, int i_plane_count,
                      bool b_swap_uvi, bool b_swap_uvo )
 {
     uint8_t palette[AVPALETTE_SIZE];
@@ -538,7 +800,7 @@ static void Convert( filter_t *p_filter, struct SwsContext *ctx,
     uint8_t *src[4]; int src_stride[4];
     uint8_t *dst[4]; int dst_stride[4];
 
-    GetPixels( src, src_stride, p_src, i_plane_start, i_plane_count, b_swap_uvi );
+    GetPixels( src, src_stride, p_src, i_plane_start, i_plane_count, i_src_y, b_swap_uvi );
     if( p_filter->fmt_in.video.i_chroma == VLC_CODEC_RGBP )
     {
         memset( palette, 0, sizeof(palette) );
@@ -549,7 +811,7 @@ static void Convert( filter_t *p_filter, struct SwsContext *ctx,
         src_stride[1] = 4;
     }
 
-    GetPixels( dst, dst_stride, p_dst, i_plane_start, i_plane_count, b_swap_uvo );
+    GetPixels( dst, dst_stride, p_dst, i_plane_start, i_plane_count, i_dst_y, b_swap_uvo );
 
 #if LIBSWSCALE_VERSION_INT  >= ((0<<16)+(5<<8)+0)
     sws_scale( ctx, src, src_stride, 0, i_height,
@@ -560,6 +822,139 @@ static void Convert( filter_t *p_filter, struct SwsContext *ctx,
 #endif
 }
 
+/****************************************************************************
+ * Bands conversion
+ ****************************************************************************/
+static void ConvertBand( const band_job_t *p_job )
+{
+    const band_t *p_band = p_job->p_band;
+
+    if( !p_band->p_pic )
+    {
+        Convert( p_job->p_filter, p_band->ctx, p_job->p_dst, p_band->i_dst_y,
+                 p_job->p_src, p_band->i_src_y, p_band->i_src_height, 0, 3,
+                 p_job->b_swap_uvi, p_job->b_swap_uvo );
+        return;
+    }
+
+    /* The band is converted with its margins, and only its lines are kept */
+    picture_t *p_pic = p_band->p_pic;
+    Convert( p_job->p_filter, p_band->ctx, p_pic, 0,
+             p_job->p_src, p_band->i_src_y, p_band->i_src_height, 0, 3,
+             p_job->b_swap_uvi, p_job->b_swap_uvo );
+
+    for( int n = 0; n < __MIN( p_job->p_dst->i_planes, 3 ); n++ )
+    {
+        const plane_t *s = &p_pic->p[n];
+        plane_t *d = &p_job->p_dst->p[n];
+        const int i_sy = p_band->i_margin * s->i_lines / p_pic->p[0].i_lines;
+        const int i_dy = p_band->i_dst_y * d->i_lines / p_job->p_dst->p[0].i_lines;
+        const int i_lines = p_band->i_dst_height * d->i_lines /
+                            p_job->p_dst->p[0].i_lines;
+
+        for( int y = 0; y < i_lines; y++ )
+            memcpy( &d->p_pixels[(i_dy + y) * d->i_pitch],
+                    &s->p_pixels[(i_sy + y) * s->i_pitch],
+                    __MIN( d->i_visible_pitch, s->i_pitch ) );
+    }
+}
+
+static void *BandThread( void *p_data )
+{
+    filter_sys_t *p_sys = ((filter_t *)p_data)->p_sys;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_sys->job_lock );
+    for( ;; )
+    {
+        while( !p_sys->b_quit && p_sys->i_next_job >= p_sys->i_jobs )
+            vlc_cond_wait( &p_sys->job_wait, &p_sys->job_lock );
+        if( p_sys->b_quit )
+            break;
+
+        const band_job_t *p_job = &p_sys->p_jobs[p_sys->i_next_job++];
+        vlc_mutex_unlock( &p_sys->job_lock );
+
+        ConvertBand( p_job );
+
+        vlc_mutex_lock( &p_sys->job_lock );
+        if( --p_sys->i_jobs_pending == 0 )
+            vlc_cond_signal( &p_sys->job_done );
+    }
+    vlc_mutex_unlock( &p_sys->job_lock );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+static int StartThreads( filter_t *p_filter )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    while( p_sys->i_threads_started < p_sys->i_threads - 1 )
+    {
+        if( vlc_clone( &p_sys->p_threads[p_sys->i_threads_started],
+                       BandThread, p_filter, VLC_THREAD_PRIORITY_VIDEO ) )
+            break;
+        p_sys->i_threads_started++;
+    }
+    return p_sys->i_threads_started > 0 ? VLC_SUCCESS : VLC_EGENERIC;
+}
+
+static void StopThreads( filter_t *p_filter )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    vlc_mutex_lock( &p_sys->job_lock );
+    p_sys->b_quit = true;
+    vlc_cond_broadcast( &p_sys->job_wait );
+    vlc_mutex_unlock( &p_sys->job_lock );
+
+    for( int i = 0; i < p_sys->i_threads_started; i++ )
+        vlc_join( p_sys->p_threads[i], NULL );
+    p_sys->i_threads_started = 0;
+}
+
+/* Converts the main planes band by band, the calling thread takes part */
+static void ConvertBands( filter_t *p_filter, picture_t *p_dst, picture_t *p_src )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+    const scaler_t *p_scaler = p_sys->p_scaler;
+
+    vlc_mutex_lock( &p_sys->job_lock );
+    for( int i = 0; i < p_scaler->i_bands; i++ )
+    {
+        band_job_t *p_job = &p_sys->p_jobs[i];
+
+        p_job->p_filter = p_filter;
+        p_job->p_band = &p_scaler->p_bands[i];
+        p_job->p_dst = p_dst;
+        p_job->p_src = p_src;
+        p_job->b_swap_uvi = p_scaler->b_swap_uvi;
+        p_job->b_swap_uvo = p_scaler->b_swap_uvo;
+    }
+    p_sys->i_jobs = p_scaler->i_bands;
+    p_sys->i_next_job = 0;
+    p_sys->i_jobs_pending = p_scaler->i_bands;
+    vlc_cond_broadcast( &p_sys->job_wait );
+
+    while( p_sys->i_next_job < p_sys->i_jobs )
+    {
+        const band_job_t *p_job = &p_sys->p_jobs[p_sys->i_next_job++];
+        vlc_mutex_unlock( &p_sys->job_lock );
+
+        ConvertBand( p_job );
+
+        vlc_mutex_lock( &p_sys->job_lock );
+        p_sys->i_jobs_pending--;
+    }
+    while( p_sys->i_jobs_pending > 0 )
+        vlc_cond_wait( &p_sys->job_done, &p_sys->job_lock );
+    p_sys->i_jobs = 0;
+    p_sys->i_next_job = 0;
+    vlc_mutex_unlock( &p_sys->job_lock );
+}
+
 /****************************************************************************
  * Filter: the whole thing
  ****************************************************************************
@@ -588,38 +983,41 @@ static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
     }
 
     /* */
+    const scaler_t *p_scaler = p_sys->p_scaler;
     picture_t *p_src = p_pic;
     picture_t *p_dst = p_pic_dst;
-    if( p_sys->i_extend_factor != 1 )
+    if( p_scaler->i_extend_factor != 1 )
     {
-        p_src = p_sys->p_src_e;
-        p_dst = p_sys->p_dst_e;
+        p_src = p_scaler->p_src_e;
+        p_dst = p_scaler->p_dst_e;
 
         CopyPad( p_src, p_pic );
     }
 
-    if( p_sys->b_copy && p_sys->b_swap_uvi == p_sys->b_swap_uvo )
+    if( p_scaler->b_copy && p_scaler->b_swap_uvi == p_scaler->b_swap_uvo )
         picture_CopyPixels( p_dst, p_src );
-    else if( p_sys->b_copy )
+    else if( p_scaler->b_copy )
         SwapUV( p_dst, p_src );
+    else if( p_scaler->i_bands > 1 )
+        ConvertBands( p_filter, p_dst, p_src );
     else
-        Convert( p_filter, p_sys->ctx, p_dst, p_src, p_fmti->i_height, 0, 3,
-                 p_sys->b_swap_uvi, p_sys->b_swap_uvo );
-    if( p_sys->ctxA )
+        Convert( p_filter, p_scaler->ctx, p_dst, 0, p_src, 0, p_fmti->i_height, 0, 3,
+                 p_scaler->b_swap_uvi, p_scaler->b_swap_uvo );
+    if( p_scaler->ctxA )
     {
         /* We extract the A plane to rescale it, and then we reinject it. */
         if( p_fmti->i_chroma == VLC_CODEC_RGBA )
-            ExtractA( p_sys->p_src_a, p_src, p_fmti->i_width * p_sys->i_extend_factor, p_fmti->i_height );
+            ExtractA( p_scaler->p_src_a, p_src, p_fmti->i_width * p_scaler->i_extend_factor, p_fmti->i_height );
         else
-            plane_CopyPixels( p_sys->p_src_a->p, p_src->p+A_PLANE );
+            plane_CopyPixels( p_scaler->p_src_a->p, p_src->p+A_PLANE );
 
-        Convert( p_filter, p_sys->ctxA, p_sys->p_dst_a, p_sys->p_src_a, p_fmti->i_height, 0, 1, false, false );
+        Convert( p_filter, p_scaler->ctxA, p_scaler->p_dst_a, 0, p_scaler->p_src_a, 0, p_fmti->i_height, 0, 1, false, false );
         if( p_fmto->i_chroma == VLC_CODEC_RGBA )
-            InjectA( p_dst, p_sys->p_dst_a, p_fmto->i_width * p_sys->i_extend_factor, p_fmto->i_height );
+            InjectA( p_dst, p_scaler->p_dst_a, p_fmto->i_width * p_scaler->i_extend_factor, p_fmto->i_height );
         else
-            plane_CopyPixels( p_dst->p+A_PLANE, p_sys->p_dst_a->p );
+            plane_CopyPixels( p_dst->p+A_PLANE, p_scaler->p_dst_a->p );
     }
-    else if( p_sys->b_add_a )
+    else if( p_scaler->b_add_a )
     {
         /* We inject a complete opaque alpha plane */
         if( p_fmto->i_chroma == VLC_CODEC_RGBA )
@@ -628,7 +1026,7 @@ static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
             FillA( &p_dst->p[A_PLANE], 0 );
     }
 
-    if( p_sys->i_extend_factor != 1 )
+    if( p_scaler->i_extend_factor != 1 )
     {
         picture_CopyPixels( p_pic_dst, p_dst );
     }
@@ -162,39 +162,53 @@ static int aout_FiltersPipelineCreate(vlc_object_t *obj, filter_t **filters,
     /* Remix channels */
     if (infmt->i_physical_channels != outfmt->i_physical_channels
      || infmt->i_original_channels != outfmt->i_original_channels)
-    {   /* Remixing currently requires FL32... TODO: S16N */
-        if (input.i_format != VLC_CODEC_FL32)
-        {
-            if (n == max)
-                goto overflow;
-
-            filter_t *f = TryFormat (obj, VLC_CODEC_FL32, &input);
-            if (f == NULL)
-            {
-                msg_Err (obj, "cannot find %s for conversion pipeline",
-                         "pre-mix converter");
-                goto error;
-            }
-
-            filters[n++] = f;
-        }
-
+    {
         if (n == max)
             goto overflow;
 
+        /* Try to convert the samples while remixing, in a single pass:
+         * straight to the output format if there is nothing else to do, or
+         * to FL32 for the resampler. */
         audio_sample_format_t output;
-        output.i_format = input.i_format;
+        output.i_format = (input.i_rate == outfmt->i_rate
+                        && AOUT_FMT_LINEAR(outfmt)) ? outfmt->i_format
+                                                    : VLC_CODEC_FL32;
         output.i_rate = input.i_rate;
         output.i_physical_channels = outfmt->i_physical_channels;
         output.i_original_channels = outfmt->i_original_channels;
         aout_FormatPrepare (&output);
 
-        filter_t *f = FindConverter (obj, &input, &output);
+        filter_t *f = NULL;
+        if (input.i_format != VLC_CODEC_FL32
+         || output.i_format != VLC_CODEC_FL32)
+            f = FindConverter (obj, &input, &output);
         if (f == NULL)
-        {
-            msg_Err (obj, "cannot find %s for conversion pipeline",
-                     "remixer");
-            goto error;
+        {   /* Otherwise, remixing requires FL32 */
+            if (input.i_format != VLC_CODEC_FL32)
+            {
+                f = TryFormat (obj, VLC_CODEC_FL32, &input);
+                if (f == NULL)
+                {
+                    msg_Err (obj, "cannot find %s for conversion pipeline",
+                             "pre-mix converter");
+                    goto error;
+                }
+
+                filters[n++] = f;
+                if (n == max)
+                    goto overflow;
+            }
+
+            output.i_format = input.i_format;
+            aout_FormatPrepare (&output);
+
+            f = FindConverter (obj, &input, &output);
+            if (f == NULL)
+            {
+                msg_Err (obj, "cannot find %s for conversion pipeline",
+                         "remixer");
+                goto error;
+            }
         }
 
         input = output;
@@ -34,6 +34,7 @@
 #include <vlc_input.h>
 #include "clock.h"
 #include <assert.h>
+#include <math.h>
 
 /* TODO:
  * - clean up locking once clock code is stable
@@ -74,6 +75,24 @@
  * new_average = (old_average * c_average + new_sample_value) / (c_average +1)
  */
 
+/*
+ * DISCUSSION : CLOCK RECOVERY BY LINEAR REGRESSION
+ *
+ * The average above converges slowly and keeps a part of the jitter, so
+ * the presentation dates wander and the audio output has to resample to
+ * follow them. When the recovery is enabled, the offsets between the
+ * system and the stream clocks are instead gathered in bins of
+ * CR_RECOVERY_BIN (system time):
+ *  - the network can only delay the clock references, so the lowest
+ *    offset of a bin is its best observation of the transmission delay,
+ *  - the spread of the offsets inside a bin measures the jitter.
+ * A least squares line is fitted on the lowest offsets of the last
+ * CR_RECOVERY_WINDOW bins: its slope is the drift between the clocks.
+ * The bins too far from the line (by the median absolute deviation of the
+ * residuals) are rejected before fitting again, so a congestion or a late
+ * burst does not bend the line.
+ */
+
 
 /*****************************************************************************
  * Constants
@@ -99,6 +118,21 @@
 /* Due to some problems in es_out, we cannot use a large value yet */
 #define CR_BUFFERING_TARGET (100000)
 
+/* Duration (in system time) of a clock recovery bin */
+#define CR_RECOVERY_BIN (CLOCK_FREQ)
+
+/* Number of bins used by the clock recovery regression (about a minute) */
+#define CR_RECOVERY_WINDOW (64)
+
+/* Number of bins needed before estimating the drift slope */
+#define CR_RECOVERY_SLOPE_MIN (8)
+
+/* Lowest deviation (in CLOCK_FREQ) that can be rejected as an outlier */
+#define CR_RECOVERY_TOLERANCE (CLOCK_FREQ/1000)
+
+/* Highest drift accepted between the clocks (1000 ppm) */
+#define CR_RECOVERY_DRIFT_MAX (1e-3)
+
 /*****************************************************************************
  * Structures
  *****************************************************************************/
@@ -122,6 +156,43 @@ static void    AvgUpdate( average_t *, mtime_t i_value );
 static mtime_t AvgGet( average_t * );
 static void    AvgRescale( average_t *, int i_divider );
 
+/**
+ * This structure holds the clock recovery regression
+ */
+typedef struct
+{
+    mtime_t i_stream; /* Stream date of the lowest offset */
+    mtime_t i_offset; /* Lowest offset of the bin */
+    mtime_t i_spread; /* Highest minus lowest offset of the bin */
+} recovery_bin_t;
+
+typedef struct
+{
+    /* Bin being filled */
+    recovery_bin_t current;
+    mtime_t        i_current_max;
+    mtime_t        i_current_end;
+
+    /* Last completed bins */
+    recovery_bin_t bin[CR_RECOVERY_WINDOW];
+    unsigned       i_first;
+    unsigned       i_count;
+
+    /* Fitted line: offset = f_offset + f_slope * (stream - i_origin) */
+    bool    b_valid;
+    mtime_t i_origin;
+    double  f_offset;
+    double  f_slope;
+
+    /* Estimations */
+    mtime_t i_jitter;
+    float   f_confidence;
+} recovery_t;
+static void    RecoveryReset( recovery_t * );
+static void    RecoveryUpdate( recovery_t *, mtime_t i_system,
+                               mtime_t i_stream, mtime_t i_offset );
+static mtime_t RecoveryGet( const recovery_t *, mtime_t i_stream );
+
 /* */
 typedef struct
 {
@@ -158,6 +229,10 @@ struct input_clock_t
     mtime_t i_next_drift_update;
     average_t drift;
 
+    /* Clock recovery */
+    bool       b_recovery;
+    recovery_t recovery;
+
     /* Late statistics */
     struct
     {
@@ -184,11 +259,12 @@ static mtime_t ClockStreamToSystem( input_clock_t *, mtime_t i_stream );
 static mtime_t ClockSystemToStream( input_clock_t *, mtime_t i_system );
 
 static mtime_t ClockGetTsOffset( input_clock_t * );
+static mtime_t ClockGetDrift( input_clock_t *, mtime_t i_stream );
 
 /*****************************************************************************
  * input_clock_New: create a new clock
  *****************************************************************************/
-input_clock_t *input_clock_New( int i_rate )
+input_clock_t *input_clock_New( int i_rate, bool b_recovery )
 {
     input_clock_t *cl = malloc( sizeof(*cl) );
     if( !cl )
@@ -208,6 +284,9 @@ input_clock_t *input_clock_New( int i_rate )
     cl->i_next_drift_update = VLC_TS_INVALID;
     AvgInit( &cl->drift, 10 );
 
+    cl->b_recovery = b_recovery;
+    RecoveryReset( &cl->recovery );
+
     cl->late.i_index = 0;
     for( int i = 0; i < INPUT_CLOCK_LATE_COUNT; i++ )
         cl->late.pi_value[i] = 0;
@@ -272,6 +351,7 @@ void input_clock_Update( input_clock_t *cl, vlc_object_t *p_log,
     {
         cl->i_next_drift_update = VLC_TS_INVALID;
         AvgReset( &cl->drift );
+        RecoveryReset( &cl->recovery );
 
         /* Feed synchro with a new reference point. */
         cl->b_has_reference = true;
@@ -291,6 +371,16 @@ void input_clock_Update( input_clock_t *cl, vlc_object_t *p_log,
         cl->i_next_drift_update = i_ck_system + CLOCK_FREQ/5; /* FIXME why that */
     }
 
+    /* The recovery uses every clock reference, and keeps estimating the
+     * jitter even when it does not drive the drift */
+    if( !b_can_pace_control )
+    {
+        const mtime_t i_converted = ClockSystemToStream( cl, i_ck_system );
+
+        RecoveryUpdate( &cl->recovery, i_ck_system, i_ck_stream,
+                        i_converted - i_ck_stream );
+    }
+
     /* Update the extra buffering value */
     if( !b_can_pace_control || b_reset_reference )
     {
@@ -314,7 +404,7 @@ void input_clock_Update( input_clock_t *cl, vlc_object_t *p_log,
 
     /* It does not take the decoder latency into account but it is not really
      * the goal of the clock here */
-    const mtime_t i_system_expected = ClockStreamToSystem( cl, i_ck_stream + AvgGet( &cl->drift ) );
+    const mtime_t i_system_expected = ClockStreamToSystem( cl, i_ck_stream + ClockGetDrift( cl, i_ck_stream ) );
     const mtime_t i_late = ( i_ck_system - cl->i_pts_delay ) - i_system_expected;
     *pb_late = i_late > 0;
     if( i_late > 0 )
@@ -394,7 +484,7 @@ mtime_t input_clock_GetWakeup( input_clock_t *cl )
 
     /* Synchronized, we can wait */
     if( cl->b_has_reference )
-        i_wakeup = ClockStreamToSystem( cl, cl->last.i_stream + AvgGet( &cl->drift ) - cl->i_buffering_duration );
+        i_wakeup = ClockStreamToSystem( cl, cl->last.i_stream + ClockGetDrift( cl, cl->last.i_stream ) - cl->i_buffering_duration );
 
     vlc_mutex_unlock( &cl->lock );
 
@@ -430,7 +520,7 @@ int input_clock_ConvertTS( input_clock_t *cl,
     /* */
     if( *pi_ts0 > VLC_TS_INVALID )
     {
-        *pi_ts0 = ClockStreamToSystem( cl, *pi_ts0 + AvgGet( &cl->drift ) );
+        *pi_ts0 = ClockStreamToSystem( cl, *pi_ts0 + ClockGetDrift( cl, *pi_ts0 ) );
         if( *pi_ts0 > cl->i_ts_max )
             cl->i_ts_max = *pi_ts0;
         *pi_ts0 += i_ts_delay;
@@ -439,7 +529,7 @@ int input_clock_ConvertTS( input_clock_t *cl,
     /* XXX we do not ipdate i_ts_max on purpose */
     if( pi_ts1 && *pi_ts1 > VLC_TS_INVALID )
     {
-        *pi_ts1 = ClockStreamToSystem( cl, *pi_ts1 + AvgGet( &cl->drift ) ) +
+        *pi_ts1 = ClockStreamToSystem( cl, *pi_ts1 + ClockGetDrift( cl, *pi_ts1 ) ) +
                   i_ts_delay;
     }
 
@@ -468,7 +558,8 @@ int input_clock_GetRate( input_clock_t *cl )
 
 int input_clock_GetState( input_clock_t *cl,
                           mtime_t *pi_stream_start, mtime_t *pi_system_start,
-                          mtime_t *pi_stream_duration, mtime_t *pi_system_duration )
+                          mtime_t *pi_stream_duration, mtime_t *pi_system_duration,
+                          input_clock_recovery_t *p_recovery )
 {
     vlc_mutex_lock( &cl->lock );
 
@@ -484,6 +575,16 @@ int input_clock_GetState( input_clock_t *cl,
     *pi_stream_duration = cl->last.i_stream - cl->ref.i_stream;
     *pi_system_duration = cl->last.i_system - cl->ref.i_system;
 
+    if( p_recovery )
+    {
+        const recovery_t *r = &cl->recovery;
+
+        p_recovery->i_jitter = r->i_jitter;
+        /* The offset decreases when the stream clock is faster */
+        p_recovery->f_drift = r->b_valid ? -r->f_slope * 1e6 : 0.;
+        p_recovery->f_confidence = r->f_confidence;
+    }
+
     vlc_mutex_unlock( &cl->lock );
 
     return VLC_SUCCESS;
@@ -623,6 +724,16 @@ static mtime_t ClockGetTsOffset( input_clock_t *cl )
     return cl->i_pts_delay * ( cl->i_rate - INPUT_RATE_DEFAULT ) / INPUT_RATE_DEFAULT;
 }
 
+/**
+ * It returns the drift (in stream clock) to apply to the stream date i_stream
+ */
+static mtime_t ClockGetDrift( input_clock_t *cl, mtime_t i_stream )
+{
+    if( cl->b_recovery && cl->recovery.b_valid )
+        return RecoveryGet( &cl->recovery, i_stream );
+    return AvgGet( &cl->drift );
+}
+
 /*****************************************************************************
  * Long term average helpers
  *****************************************************************************/
@@ -665,3 +776,162 @@ static void AvgRescale( average_t *p_avg, int i_divider )
     p_avg->i_value   = i_tmp / p_avg->i_divider;
     p_avg->i_residue = i_tmp % p_avg->i_divider;
 }
+
+/*****************************************************************************
+ * Clock recovery helpers
+ *****************************************************************************/
+static int RecoveryCompare( const void *a, const void *b )
+{
+    const mtime_t i_a = *(const mtime_t *)a, i_b = *(const mtime_t *)b;
+
+    return (i_a > i_b) - (i_a < i_b);
+}
+static mtime_t RecoveryMedian( mtime_t *p_value, unsigned i_count )
+{
+    qsort( p_value, i_count, sizeof(*p_value), RecoveryCompare );
+    return p_value[i_count / 2];
+}
+static void RecoveryReset( recovery_t *r )
+{
+    r->i_current_end = VLC_TS_INVALID;
+    r->i_first = 0;
+    r->i_count = 0;
+    r->b_valid = false;
+    r->i_jitter = 0;
+    r->f_confidence = 0.f;
+}
+/* Least squares fit of the bins selected by pb_inlier (all if NULL) */
+static void RecoveryRegress( recovery_t *r, const bool *pb_inlier )
+{
+    double f_x = 0., f_y = 0., f_xx = 0., f_xy = 0.;
+    unsigned n = 0;
+
+    for( unsigned i = 0; i < r->i_count; i++ )
+    {
+        const recovery_bin_t *p_bin = &r->bin[(r->i_first + i) % CR_RECOVERY_WINDOW];
+        if( pb_inlier && !pb_inlier[i] )
+            continue;
+
+        const double x = p_bin->i_stream - r->i_origin;
+        const double y = p_bin->i_offset;
+        f_x += x; f_y += y;
+        f_xx += x * x; f_xy += x * y;
+        n++;
+    }
+    assert( n > 0 );
+
+    const double f_det = n * f_xx - f_x * f_x;
+    r->f_slope = 0.;
+    if( n >= CR_RECOVERY_SLOPE_MIN && f_det > 0. )
+    {
+        r->f_slope = ( n * f_xy - f_x * f_y ) / f_det;
+        if( r->f_slope > CR_RECOVERY_DRIFT_MAX )
+            r->f_slope = CR_RECOVERY_DRIFT_MAX;
+        else if( r->f_slope < -CR_RECOVERY_DRIFT_MAX )
+            r->f_slope = -CR_RECOVERY_DRIFT_MAX;
+    }
+    r->f_offset = ( f_y - r->f_slope * f_x ) / n;
+}
+static void RecoveryFit( recovery_t *r )
+{
+    mtime_t pi_residual[CR_RECOVERY_WINDOW];
+    mtime_t pi_deviation[CR_RECOVERY_WINDOW];
+    bool pb_inlier[CR_RECOVERY_WINDOW];
+    const unsigned n = r->i_count;
+
+    /* Fit all the bins first, relatively to the last one to keep the
+     * values small */
+    r->i_origin = r->bin[(r->i_first + n - 1) % CR_RECOVERY_WINDOW].i_stream;
+    RecoveryRegress( r, NULL );
+
+    /* Reject the bins too far from the line */
+    for( unsigned i = 0; i < n; i++ )
+    {
+        const recovery_bin_t *p_bin = &r->bin[(r->i_first + i) % CR_RECOVERY_WINDOW];
+        pi_residual[i] = p_bin->i_offset - RecoveryGet( r, p_bin->i_stream );
+    }
+    memcpy( pi_deviation, pi_residual, n * sizeof(*pi_deviation) );
+    const mtime_t i_median = RecoveryMedian( pi_deviation, n );
+    for( unsigned i = 0; i < n; i++ )
+        pi_deviation[i] = llabs( pi_residual[i] - i_median );
+    const mtime_t i_mad = RecoveryMedian( pi_deviation, n );
+    /* 1.4826 * MAD estimates the standard deviation, keep 3 of them */
+    const mtime_t i_tolerance = __MAX( 4448 * i_mad / 1000,
+                                       CR_RECOVERY_TOLERANCE );
+
+    unsigned i_inlier = 0;
+    for( unsigned i = 0; i < n; i++ )
+    {
+        pb_inlier[i] = llabs( pi_residual[i] - i_median ) <= i_tolerance;
+        if( pb_inlier[i] )
+            i_inlier++;
+    }
+    if( i_inlier > 0 && i_inlier < n )
+        RecoveryRegress( r, pb_inlier );
+    r->b_valid = true;
+
+    /* Typical reception jitter: median spread of the accepted bins */
+    unsigned i_spread = 0;
+    for( unsigned i = 0; i < n; i++ )
+        if( pb_inlier[i] )
+            pi_deviation[i_spread++] = r->bin[(r->i_first + i) % CR_RECOVERY_WINDOW].i_spread;
+    if( i_spread > 0 )
+        r->i_jitter = RecoveryMedian( pi_deviation, i_spread );
+
+    /* The confidence grows with the window and drops with the outliers */
+    r->f_confidence = (float)i_inlier / CR_RECOVERY_WINDOW;
+}
+static void RecoveryUpdate( recovery_t *r, mtime_t i_system,
+                            mtime_t i_stream, mtime_t i_offset )
+{
+    recovery_bin_t *p_cur = &r->current;
+
+    if( r->i_current_end > VLC_TS_INVALID && i_system < r->i_current_end )
+    {
+        if( i_offset < p_cur->i_offset )
+        {
+            p_cur->i_stream = i_stream;
+            p_cur->i_offset = i_offset;
+        }
+        r->i_current_max = __MAX( r->i_current_max, i_offset );
+        p_cur->i_spread = r->i_current_max - p_cur->i_offset;
+
+        /* Until a bin is completed, follow the lowest offset */
+        if( r->i_count == 0 )
+        {
+            r->i_origin = p_cur->i_stream;
+            r->f_offset = p_cur->i_offset;
+        }
+        return;
+    }
+
+    /* Complete the current bin */
+    if( r->i_current_end > VLC_TS_INVALID )
+    {
+        if( r->i_count < CR_RECOVERY_WINDOW )
+            r->i_count++;
+        else
+            r->i_first = ( r->i_first + 1 ) % CR_RECOVERY_WINDOW;
+        r->bin[(r->i_first + r->i_count - 1) % CR_RECOVERY_WINDOW] = *p_cur;
+
+        RecoveryFit( r );
+    }
+    else
+    {
+        r->i_origin = i_stream;
+        r->f_offset = i_offset;
+        r->f_slope = 0.;
+        r->b_valid = true;
+    }
+
+    /* Start a new bin */
+    p_cur->i_stream = i_stream;
+    p_cur->i_offset = i_offset;
+    p_cur->i_spread = 0;
+    r->i_current_max = i_offset;
+    r->i_current_end = i_system + CR_RECOVERY_BIN;
+}
+static mtime_t RecoveryGet( const recovery_t *r, mtime_t i_stream )
+{
+    return llround( r->f_offset + r->f_slope * ( i_stream - r->i_origin ) );
+}
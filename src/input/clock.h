@@ -36,11 +36,24 @@
  */
 typedef struct input_clock_t input_clock_t;
 
+/**
+ * This structure holds the estimations of the clock recovery.
+ */
+typedef struct
+{
+    mtime_t i_jitter;     /**< Typical reception jitter (peak to peak) */
+    double  f_drift;      /**< Drift of the stream clock against the system clock (ppm) */
+    float   f_confidence; /**< Confidence in the estimations (0 to 1) */
+} input_clock_recovery_t;
+
 /**
  * This function creates a new input_clock_t.
  * You must use input_clock_Delete to delete it once unused.
+ *
+ * If b_recovery is true, the drift is recovered by a linear regression over
+ * the clock references instead of a long term average.
  */
-input_clock_t *input_clock_New( int i_rate );
+input_clock_t *input_clock_New( int i_rate, bool b_recovery );
 
 /**
  * This function destroys a input_clock_t created by input_clock_New.
@@ -118,10 +131,14 @@ int input_clock_GetRate( input_clock_t * );
 /**
  * This function returns current clock state or VLC_EGENERIC if there is not a
  * reference point.
+ *
+ * If p_recovery is not NULL, it will be filled with the current estimations
+ * of the clock recovery (they are estimated whatever the recovery mode).
  */
 int input_clock_GetState( input_clock_t *,
                           mtime_t *pi_stream_start, mtime_t *pi_system_start,
-                          mtime_t *pi_stream_duration, mtime_t *pi_system_duration );
+                          mtime_t *pi_stream_duration, mtime_t *pi_system_duration,
+                          input_clock_recovery_t *p_recovery );
 
 /**
  * This function allows the set the minimal configuration for the jitter estimation algo.
@@ -34,6 +34,7 @@
 #include <vlc_common.h>
 
 #include <vlc_block.h>
+#include <vlc_atomic.h>
 #include <vlc_vout.h>
 #include <vlc_aout.h>
 #include <vlc_sout.h>
@@ -52,6 +53,7 @@
 #include "resource.h"
 
 #include "../video_output/vout_control.h"
+#include "../modules/modules.h"
 
 static decoder_t *CreateDecoder( vlc_object_t *, input_thread_t *,
                                  es_format_t *, bool, input_resource_t *,
@@ -59,11 +61,14 @@ static decoder_t *CreateDecoder( vlc_object_t *, input_thread_t *,
 static void       DeleteDecoder( decoder_t * );
 
 static void      *DecoderThread( void * );
+static void       DecoderProcessBatch( decoder_t *, block_t *, mtime_t );
 static void       DecoderProcess( decoder_t *, block_t * );
+static void       DecoderPlayBatch( decoder_t * );
 static void       DecoderError( decoder_t *p_dec, block_t *p_block );
 static void       DecoderOutputChangePause( decoder_t *, bool b_paused, mtime_t i_date );
 static void       DecoderFlush( decoder_t * );
 static void       DecoderSignalBuffering( decoder_t *, bool );
+static bool       DecoderIsFlushing( decoder_t * );
 static void       DecoderFlushBuffering( decoder_t * );
 
 static void       DecoderUnsupportedCodec( decoder_t *, vlc_fourcc_t );
@@ -114,6 +119,31 @@ struct decoder_owner_sys_t
     /* fifo */
     block_fifo_t *p_fifo;
 
+    /* Batch decoding (only used by the decoder thread, but the counters) */
+    struct
+    {
+        bool b_enabled;
+
+        /* Blocks dequeued from the fifo but not processed yet */
+        atomic_size_t i_count;
+        atomic_size_t i_size;
+
+        /* Decoded audio not yet sent to the output */
+        block_t *p_audio;
+        block_t **pp_audio_next;
+        int     i_decoded;
+    } batch;
+
+    /* Decoding loop statistics (only used by the decoder thread) */
+    struct
+    {
+        unsigned i_wakeups;
+        unsigned i_blocks;
+        unsigned i_max;
+        mtime_t  i_process;  /* Time spent processing the blocks */
+        mtime_t  i_overhead; /* Time spent around them, but the waits */
+    } stats;
+
     /* Lock for communication with decoder thread */
     vlc_mutex_t lock;
     vlc_cond_t  wait_request;
@@ -172,6 +202,7 @@ struct decoder_owner_sys_t
 };
 
 #define DECODER_MAX_BUFFERING_COUNT (4)
+#define DECODER_MAX_BATCH_COUNT (64)
 #define DECODER_MAX_BUFFERING_AUDIO_DURATION (AOUT_MAX_PREPARE_TIME)
 #define DECODER_MAX_BUFFERING_VIDEO_DURATION (1*CLOCK_FREQ)
 
@@ -384,6 +415,11 @@ void input_DecoderDecode( decoder_t *p_dec, block_t *p_block, bool b_do_pace )
 {
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
 
+    /* Packetizers and decoders may modify their input in place */
+    p_block = block_Unshare( p_block );
+    if( unlikely(p_block == NULL) )
+        return;
+
     if( b_do_pace )
     {
         /* The fifo is not consummed when buffering and so will
@@ -414,7 +450,8 @@ bool input_DecoderIsEmpty( decoder_t * p_dec )
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
     assert( !p_owner->b_buffering );
 
-    bool b_empty = block_FifoCount( p_dec->p_owner->p_fifo ) <= 0;
+    bool b_empty = block_FifoCount( p_dec->p_owner->p_fifo ) <= 0 &&
+                   atomic_load( &p_owner->batch.i_count ) == 0;
     if( b_empty )
     {
         vlc_mutex_lock( &p_owner->lock );
@@ -658,7 +695,8 @@ size_t input_DecoderGetFifoSize( decoder_t *p_dec )
 {
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
 
-    return block_FifoSize( p_owner->p_fifo );
+    return block_FifoSize( p_owner->p_fifo ) +
+           atomic_load( &p_owner->batch.i_size );
 }
 
 void input_DecoderGetObjects( decoder_t *p_dec,
@@ -726,6 +764,56 @@ static void DecoderUnsupportedCodec( decoder_t *p_dec, vlc_fourcc_t codec )
                   (char*)&codec );
 }
 
+/**
+ * Loads a decoder or packetizer module.
+ *
+ * The modules which recently rejected the same elementary stream format are
+ * not probed again (see module_need_memo()).
+ */
+static module_t *DecoderNeed( decoder_t *p_dec, const char *psz_capability,
+                              const char *psz_name )
+{
+    const es_format_t *p_fmt = &p_dec->fmt_in;
+    struct
+    {
+        int i_cat;
+        vlc_fourcc_t i_codec;
+        vlc_fourcc_t i_original_fourcc;
+        int i_profile;
+        int i_level;
+        bool b_packetized;
+        union
+        {
+            video_format_t video;
+            audio_format_t audio;
+        } fmt;
+        int i_extra;
+        uint8_t extra[64];
+    } key;
+
+    if( ( p_fmt->i_cat != VIDEO_ES && p_fmt->i_cat != AUDIO_ES )
+     || p_fmt->i_extra < 0 || (size_t)p_fmt->i_extra > sizeof(key.extra)
+     || ( p_fmt->i_cat == VIDEO_ES && p_fmt->video.p_palette != NULL ) )
+        return module_need( p_dec, psz_capability, psz_name, false );
+
+    memset( &key, 0, sizeof(key) );
+    key.i_cat = p_fmt->i_cat;
+    key.i_codec = p_fmt->i_codec;
+    key.i_original_fourcc = p_fmt->i_original_fourcc;
+    key.i_profile = p_fmt->i_profile;
+    key.i_level = p_fmt->i_level;
+    key.b_packetized = p_fmt->b_packetized;
+    if( p_fmt->i_cat == VIDEO_ES )
+        key.fmt.video = p_fmt->video;
+    else
+        key.fmt.audio = p_fmt->audio;
+    key.i_extra = p_fmt->i_extra;
+    if( p_fmt->i_extra > 0 )
+        memcpy( key.extra, p_fmt->p_extra, p_fmt->i_extra );
+
+    return module_need_memo( p_dec, psz_capability, psz_name,
+                             &key, sizeof(key) );
+}
 
 /**
  * Create a decoder object
@@ -809,9 +897,9 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
 
     /* Find a suitable decoder/packetizer module */
     if( !b_packetizer )
-        p_dec->p_module = module_need( p_dec, "decoder", "$codec", false );
+        p_dec->p_module = DecoderNeed( p_dec, "decoder", "$codec" );
     else
-        p_dec->p_module = module_need( p_dec, "packetizer", "$packetizer", false );
+        p_dec->p_module = DecoderNeed( p_dec, "packetizer", "$packetizer" );
 
     /* Check if decoder requires already packetized data */
     if( !b_packetizer &&
@@ -828,8 +916,8 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
                             &null_es_format );
 
             p_owner->p_packetizer->p_module =
-                module_need( p_owner->p_packetizer,
-                             "packetizer", "$packetizer", false );
+                DecoderNeed( p_owner->p_packetizer,
+                             "packetizer", "$packetizer" );
 
             if( !p_owner->p_packetizer->p_module )
             {
@@ -883,6 +971,23 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
 
     p_owner->b_flushing = false;
 
+    /* Audio and subtitles decode quickly, and the data still to packetize
+     * comes in small blocks: the wake up of the thread is worth sharing */
+    p_owner->batch.b_enabled = b_packetizer || p_owner->p_packetizer ||
+                               p_dec->fmt_out.i_cat == AUDIO_ES ||
+                               p_dec->fmt_out.i_cat == SPU_ES;
+    atomic_init( &p_owner->batch.i_count, 0 );
+    atomic_init( &p_owner->batch.i_size, 0 );
+    p_owner->batch.p_audio = NULL;
+    p_owner->batch.pp_audio_next = &p_owner->batch.p_audio;
+    p_owner->batch.i_decoded = 0;
+
+    p_owner->stats.i_wakeups = 0;
+    p_owner->stats.i_blocks = 0;
+    p_owner->stats.i_max = 0;
+    p_owner->stats.i_process = 0;
+    p_owner->stats.i_overhead = 0;
+
     /* */
     p_owner->cc.b_supported = false;
     if( !b_packetizer )
@@ -911,20 +1016,86 @@ static void *DecoderThread( void *p_data )
 {
     decoder_t *p_dec = (decoder_t *)p_data;
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
+    const size_t i_max = p_owner->batch.b_enabled ? DECODER_MAX_BATCH_COUNT : 1;
 
     /* The decoder's main loop */
     for( ;; )
     {
-        block_t *p_block = block_FifoGet( p_owner->p_fifo );
+        /* The wait for data is not accounted as overhead */
+        const bool b_queued = block_FifoCount( p_owner->p_fifo ) > 0;
+        mtime_t i_start = mdate();
+
+        block_t *p_block = block_FifoGetBatch( p_owner->p_fifo, i_max );
+        if( !b_queued )
+            i_start = mdate();
 
         /* Make sure there is no cancellation point other than this one^^.
          * If you need one, be sure to push cleanup of p_block. */
+        if( p_block )
+        {
+            size_t i_count = 0, i_size = 0;
+            for( block_t *p = p_block; p != NULL; p = p->p_next )
+            {
+                i_count++;
+                i_size += p->i_buffer;
+            }
+            atomic_fetch_add( &p_owner->batch.i_count, i_count );
+            atomic_fetch_add( &p_owner->batch.i_size, i_size );
+        }
         DecoderSignalBuffering( p_dec, p_block == NULL );
 
         if( p_block )
         {
             int canc = vlc_savecancel();
 
+            DecoderProcessBatch( p_dec, p_block, i_start );
+
+            vlc_restorecancel( canc );
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Decodes a chain of blocks dequeued at once
+ *
+ * \param p_dec the decoder
+ * \param p_chain the blocks
+ * \param i_start the date of the wake up, for the statistics
+ */
+static void DecoderProcessBatch( decoder_t *p_dec, block_t *p_chain,
+                                 mtime_t i_start )
+{
+    decoder_owner_sys_t *p_owner = p_dec->p_owner;
+    mtime_t i_process = 0;
+    unsigned i_count = 0;
+    size_t i_size = 0;
+    /* Whether a flush started before the batch was processed. The
+     * output of a flush starting later is rejected, as for single blocks. */
+    bool b_flushing = p_owner->batch.b_enabled && DecoderIsFlushing( p_dec );
+
+    while( p_chain )
+    {
+        block_t *p_block = p_chain;
+
+        p_chain = p_block->p_next;
+        p_block->p_next = NULL;
+        i_count++;
+        i_size += p_block->i_buffer;
+
+        /* The flush emptied the fifo after the batch was dequeued: drop
+         * what it would have dropped, up to the flush request itself */
+        if( p_block->i_flags & BLOCK_FLAG_CORE_FLUSH )
+            b_flushing = false;
+
+        if( b_flushing )
+        {
+            block_Release( p_block );
+        }
+        else
+        {
+            const mtime_t i_date = mdate();
+
             if( p_block->i_flags & BLOCK_FLAG_CORE_EOS )
             {
                 /* calling DecoderProcess() with NULL block will make
@@ -938,10 +1109,25 @@ static void *DecoderThread( void *p_data )
             else
                 DecoderProcess( p_dec, p_block );
 
-            vlc_restorecancel( canc );
+            i_process += mdate() - i_date;
         }
     }
-    return NULL;
+
+    /* Send the decoded audio to the output at once */
+    const mtime_t i_date = mdate();
+    DecoderPlayBatch( p_dec );
+    const mtime_t i_end = mdate();
+    i_process += i_end - i_date;
+
+    /* The batch is only done once its audio is played */
+    atomic_fetch_sub( &p_owner->batch.i_count, i_count );
+    atomic_fetch_sub( &p_owner->batch.i_size, i_size );
+
+    p_owner->stats.i_wakeups++;
+    p_owner->stats.i_blocks += i_count;
+    p_owner->stats.i_max = __MAX( p_owner->stats.i_max, i_count );
+    p_owner->stats.i_process += i_process;
+    p_owner->stats.i_overhead += i_end - i_start - i_process;
 }
 
 static block_t *DecoderBlockFlushNew()
@@ -1153,12 +1339,14 @@ static void DecoderWaitDate( decoder_t *p_dec,
                                i_deadline ) == 0 );
 }
 
-static void DecoderPlayAudio( decoder_t *p_dec, block_t *p_audio,
-                              int *pi_played_sum, int *pi_lost_sum )
+static void DecoderOutputAudio( decoder_t *p_dec, block_t *p_audio,
+                                int *pi_played_sum, int *pi_lost_sum )
 {
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
     audio_output_t *p_aout = p_owner->p_aout;
 
+    vlc_assert_locked( &p_owner->lock );
+
     /* */
     if( p_audio->i_pts <= VLC_TS_INVALID ) // FIXME --VLC_TS_INVALID verify audio_output/*
     {
@@ -1168,9 +1356,6 @@ static void DecoderPlayAudio( decoder_t *p_dec, block_t *p_audio,
         return;
     }
 
-    /* */
-    vlc_mutex_lock( &p_owner->lock );
-
     if( p_owner->b_buffering || p_owner->buffer.p_audio )
     {
         p_audio->p_next = NULL;
@@ -1248,9 +1433,61 @@ static void DecoderPlayAudio( decoder_t *p_dec, block_t *p_audio,
         if( !p_owner->buffer.p_audio )
             break;
     }
+}
+
+/* It plays a chain of audio buffers under a single lock */
+static void DecoderPlayAudio( decoder_t *p_dec, block_t *p_audio,
+                              int *pi_played_sum, int *pi_lost_sum )
+{
+    decoder_owner_sys_t *p_owner = p_dec->p_owner;
+
+    vlc_mutex_lock( &p_owner->lock );
+    while( p_audio )
+    {
+        block_t *p_next = p_audio->p_next;
+
+        p_audio->p_next = NULL;
+        DecoderOutputAudio( p_dec, p_audio, pi_played_sum, pi_lost_sum );
+        p_audio = p_next;
+    }
     vlc_mutex_unlock( &p_owner->lock );
 }
 
+static void DecoderUpdateStatAudio( decoder_t *p_dec, int i_decoded,
+                                    int i_lost, int i_played )
+{
+    input_thread_t *p_input = p_dec->p_owner->p_input;
+
+    /* Update ugly stat */
+    if( p_input != NULL && (i_decoded > 0 || i_lost > 0 || i_played > 0) )
+    {
+        vlc_mutex_lock( &p_input->p->counters.counters_lock);
+        stats_Update( p_input->p->counters.p_lost_abuffers, i_lost, NULL );
+        stats_Update( p_input->p->counters.p_played_abuffers, i_played, NULL );
+        stats_Update( p_input->p->counters.p_decoded_audio, i_decoded, NULL );
+        vlc_mutex_unlock( &p_input->p->counters.counters_lock);
+    }
+}
+
+/* It sends the audio decoded by a batch to the output */
+static void DecoderPlayBatch( decoder_t *p_dec )
+{
+    decoder_owner_sys_t *p_owner = p_dec->p_owner;
+    block_t *p_audio = p_owner->batch.p_audio;
+    int i_lost = 0;
+    int i_played = 0;
+
+    if( p_audio )
+    {
+        p_owner->batch.p_audio = NULL;
+        p_owner->batch.pp_audio_next = &p_owner->batch.p_audio;
+        DecoderPlayAudio( p_dec, p_audio, &i_played, &i_lost );
+    }
+
+    DecoderUpdateStatAudio( p_dec, p_owner->batch.i_decoded, i_lost, i_played );
+    p_owner->batch.i_decoded = 0;
+}
+
 static void DecoderDecodeAudio( decoder_t *p_dec, block_t *p_block )
 {
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
@@ -1283,26 +1520,27 @@ static void DecoderDecodeAudio( decoder_t *p_dec, block_t *p_block )
         if( p_owner->i_preroll_end > VLC_TS_INVALID )
         {
             msg_Dbg( p_dec, "End of audio preroll" );
+            DecoderPlayBatch( p_dec );
             if( p_owner->p_aout )
                 aout_DecFlush( p_owner->p_aout );
             /* */
             p_owner->i_preroll_end = VLC_TS_INVALID;
         }
 
+        if( p_owner->batch.b_enabled )
+        {
+            /* Played at the end of the batch */
+            *p_owner->batch.pp_audio_next = p_aout_buf;
+            p_owner->batch.pp_audio_next = &p_aout_buf->p_next;
+            continue;
+        }
         DecoderPlayAudio( p_dec, p_aout_buf, &i_played, &i_lost );
     }
 
-    /* Update ugly stat */
-    input_thread_t  *p_input = p_owner->p_input;
-
-    if( p_input != NULL && (i_decoded > 0 || i_lost > 0 || i_played > 0) )
-    {
-        vlc_mutex_lock( &p_input->p->counters.counters_lock);
-        stats_Update( p_input->p->counters.p_lost_abuffers, i_lost, NULL );
-        stats_Update( p_input->p->counters.p_played_abuffers, i_played, NULL );
-        stats_Update( p_input->p->counters.p_decoded_audio, i_decoded, NULL );
-        vlc_mutex_unlock( &p_input->p->counters.counters_lock);
-    }
+    if( p_owner->batch.b_enabled )
+        p_owner->batch.i_decoded += i_decoded;
+    else
+        DecoderUpdateStatAudio( p_dec, i_decoded, i_lost, i_played );
 }
 static void DecoderGetCc( decoder_t *p_dec, decoder_t *p_dec_cc )
 {
@@ -1893,6 +2131,8 @@ static void DecoderProcessAudio( decoder_t *p_dec, block_t *p_block, bool b_flus
         DecoderDecodeAudio( p_dec, p_block );
     }
 
+    if( b_flush )
+        DecoderPlayBatch( p_dec );
     if( b_flush && p_owner->p_aout )
         aout_DecFlush( p_owner->p_aout );
 }
@@ -2059,6 +2299,14 @@ static void DeleteDecoder( decoder_t * p_dec )
     msg_Dbg( p_dec, "killing decoder fourcc `%4.4s', %u PES in FIFO",
              (char*)&p_dec->fmt_in.i_codec,
              (unsigned)block_FifoCount( p_owner->p_fifo ) );
+    if( p_owner->stats.i_blocks > 0 )
+        msg_Dbg( p_dec, "%u blocks in %u wake ups (up to %u), per block: "
+                 "%"PRId64" us of processing, %"PRId64" ns of overhead",
+                 p_owner->stats.i_blocks, p_owner->stats.i_wakeups,
+                 p_owner->stats.i_max,
+                 p_owner->stats.i_process / p_owner->stats.i_blocks,
+                 p_owner->stats.i_overhead * 1000 / p_owner->stats.i_blocks );
+    assert( p_owner->batch.p_audio == NULL );
 
     /* Free all packets still in the decoder fifo. */
     block_FifoEmpty( p_owner->p_fifo );
@@ -2187,6 +2435,9 @@ static block_t *aout_new_buffer( decoder_t *p_dec, int i_samples )
     {
         audio_output_t *p_aout = p_owner->p_aout;
 
+        /* The batched buffers use the previous parameters */
+        DecoderPlayBatch( p_dec );
+
         /* Parameters changed, restart the aout */
         vlc_mutex_lock( &p_owner->lock );
 
@@ -56,6 +56,9 @@
 /*****************************************************************************
  * Local prototypes
  *****************************************************************************/
+/* Interval between two reports of the clock recovery of a program */
+#define CLOCK_REPORT_INTERVAL (10 * CLOCK_FREQ)
+
 typedef struct
 {
     /* Program ID */
@@ -69,6 +72,7 @@ typedef struct
 
     /* Clock for this program */
     input_clock_t *p_clock;
+    mtime_t i_next_clock_report;
 
     char    *psz_name;
     char    *psz_now_playing;
@@ -535,7 +539,7 @@ static void EsOutChangePause( es_out_t *out, bool b_paused, mtime_t i_date )
             int i_ret;
             i_ret = input_clock_GetState( p_sys->p_pgrm->p_clock,
                                           &i_stream_start, &i_system_start,
-                                          &i_stream_duration, &i_system_duration );
+                                          &i_stream_duration, &i_system_duration, NULL );
             if( !i_ret )
             {
                 /* FIXME pcr != exactly what wanted */
@@ -605,7 +609,7 @@ static void EsOutDecodersStopBuffering( es_out_t *out, bool b_forced )
     mtime_t i_system_duration;
     i_ret = input_clock_GetState( p_sys->p_pgrm->p_clock,
                                   &i_stream_start, &i_system_start,
-                                  &i_stream_duration, &i_system_duration );
+                                  &i_stream_duration, &i_system_duration, NULL );
     assert( !i_ret || b_forced );
     if( i_ret )
         return;
@@ -801,7 +805,7 @@ static void EsOutFrameNext( es_out_t *out )
 
         i_ret = input_clock_GetState( p_sys->p_pgrm->p_clock,
                                       &i_stream_start, &i_system_start,
-                                      &i_stream_duration, &i_system_duration );
+                                      &i_stream_duration, &i_system_duration, NULL );
         if( i_ret )
             return;
 
@@ -834,7 +838,7 @@ static mtime_t EsOutGetBuffering( es_out_t *out )
     mtime_t i_system_duration;
     i_ret = input_clock_GetState( p_sys->p_pgrm->p_clock,
                                   &i_stream_start, &i_system_start,
-                                  &i_stream_duration, &i_system_duration );
+                                  &i_stream_duration, &i_system_duration, NULL );
 
     if( i_ret )
         return 0;
@@ -1038,7 +1042,9 @@ static es_out_pgrm_t *EsOutProgramAdd( es_out_t *out, int i_group )
     p_pgrm->psz_name = NULL;
     p_pgrm->psz_now_playing = NULL;
     p_pgrm->psz_publisher = NULL;
-    p_pgrm->p_clock = input_clock_New( p_sys->i_rate );
+    p_pgrm->p_clock = input_clock_New( p_sys->i_rate,
+                        var_InheritBool( p_sys->p_input, "clock-recovery" ) );
+    p_pgrm->i_next_clock_report = mdate() + CLOCK_REPORT_INTERVAL;
     if( !p_pgrm->p_clock )
     {
         free( p_pgrm );
@@ -1123,6 +1129,25 @@ static es_out_pgrm_t *EsOutProgramFind( es_out_t *p_out, int i_group )
     return EsOutProgramAdd( p_out, i_group );
 }
 
+/* EsOutProgramReportClock:
+ *  Logs the estimations of the clock recovery of a program
+ */
+static void EsOutProgramReportClock( es_out_t *p_out, es_out_pgrm_t *p_pgrm )
+{
+    es_out_sys_t *p_sys = p_out->p_sys;
+    mtime_t i_stream_start, i_system_start, i_stream_duration, i_system_duration;
+    input_clock_recovery_t recovery;
+
+    if( input_clock_GetState( p_pgrm->p_clock, &i_stream_start, &i_system_start,
+                              &i_stream_duration, &i_system_duration,
+                              &recovery ) )
+        return;
+
+    msg_Dbg( p_sys->p_input, "program %d clock: jitter %"PRId64" us, "
+             "drift %+.1f ppm (confidence %.2f)", p_pgrm->i_id,
+             recovery.i_jitter, recovery.f_drift, recovery.f_confidence );
+}
+
 /* EsOutProgramMeta:
  */
 static char *EsOutProgramGetMetaName( es_out_pgrm_t *p_pgrm )
@@ -2286,12 +2311,18 @@ static int EsOutControlLocked( es_out_t *out, int i_query, va_list args )
         }
 
         /* TODO do not use mdate() but proper stream acquisition date */
+        const mtime_t i_now = mdate();
         bool b_late;
         input_clock_Update( p_pgrm->p_clock, VLC_OBJECT(p_sys->p_input),
                             &b_late,
                             p_sys->p_input->p->b_can_pace_control || p_sys->b_buffering,
                             EsOutIsExtraBufferingAllowed( out ),
-                            i_pcr, mdate() );
+                            i_pcr, i_now );
+        if( i_now >= p_pgrm->i_next_clock_report )
+        {
+            EsOutProgramReportClock( out, p_pgrm );
+            p_pgrm->i_next_clock_report = i_now + CLOCK_REPORT_INTERVAL;
+        }
 
         if( p_pgrm == p_sys->p_pgrm )
         {
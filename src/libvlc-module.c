@@ -525,6 +525,13 @@ static const char *const ppsz_pos_descriptions[] =
     "real-time sources. Use this if you experience jerky playback of " \
     "network streams.")
 
+#define CLOCK_RECOVERY_TEXT N_("Clock recovery by regression")
+#define CLOCK_RECOVERY_LONGTEXT N_( \
+    "Recover the clock of real-time sources with a linear regression " \
+    "over the clock references, rejecting the network jitter, instead of " \
+    "a long term average. It converges faster and keeps steadier " \
+    "timestamps on jittery network streams.")
+
 #define CLOCK_JITTER_TEXT N_("Clock jitter")
 #define CLOCK_JITTER_LONGTEXT N_( \
     "This defines the maximum input delay jitter that the synchronization " \
@@ -1849,6 +1856,8 @@ vlc_module_begin ()
     add_integer( "clock-synchro", -1, CLOCK_SYNCHRO_TEXT,
                  CLOCK_SYNCHRO_LONGTEXT, true )
         change_integer_list( pi_clock_values, ppsz_clock_descriptions )
+    add_bool( "clock-recovery", false, CLOCK_RECOVERY_TEXT,
+              CLOCK_RECOVERY_LONGTEXT, true )
     add_integer( "clock-jitter", 5 * CLOCK_FREQ/1000, CLOCK_JITTER_TEXT,
               CLOCK_JITTER_LONGTEXT, true )
         change_safe()
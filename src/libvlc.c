@@ -110,6 +110,7 @@ libvlc_int_t * libvlc_InternalCreate( void )
     priv->p_playlist = NULL;
     priv->p_dialog_provider = NULL;
     priv->p_vlm = NULL;
+    priv->probe_memo = module_MemoCreate();
 
     vlc_ExitInit( &priv->exit );
 
@@ -596,6 +597,8 @@ void libvlc_InternalDestroy( libvlc_int_t *p_libvlc )
     libvlc_priv_t *priv = libvlc_priv( p_libvlc );
 
     vlc_ExitDestroy( &priv->exit );
+    if( priv->probe_memo != NULL )
+        module_MemoDestroy( priv->probe_memo );
 
     assert( atomic_load(&(vlc_internals(p_libvlc)->refs)) == 1 );
     vlc_object_release( p_libvlc );
@@ -25,6 +25,8 @@
 #ifndef LIBVLC_LIBVLC_H
 # define LIBVLC_LIBVLC_H 1
 
+# include <vlc_atomic.h>
+
 extern const char psz_vlc_changeset[];
 
 typedef struct variable_t variable_t;
@@ -152,7 +154,9 @@ typedef struct libvlc_priv_t
         void (*cb) (void *, int, const vlc_log_t *, const char *, va_list);
         void *opaque;
         signed char verbose;
+        atomic_int max_type; ///< Most verbose message type not filtered out
         vlc_rwlock_t lock;
+        struct vlc_logger *logger; ///< Asynchronous output thread, or NULL
     } log;
     bool               b_stats;     ///< Whether to collect stats
 
@@ -164,6 +168,7 @@ typedef struct libvlc_priv_t
     sap_handler_t     *p_sap; ///< SAP SDP advertiser
 #endif
     struct vlc_actions *actions; ///< Hotkeys handler
+    struct module_memo *probe_memo; ///< Module probe results (or NULL)
 
     /* Interfaces */
     struct intf_thread_t *p_intf; ///< Interfaces linked-list
@@ -39,6 +39,7 @@
 #include <vlc_common.h>
 #include <vlc_block.h>
 #include <vlc_fs.h>
+#include <vlc_atomic.h>
 
 /**
  * @section Block handling functions.
@@ -94,6 +95,7 @@ void block_Init( block_t *restrict b, void *buf, size_t size )
     b->i_pts =
     b->i_dts = VLC_TS_INVALID;
     b->i_length = 0;
+    b->p_shared = NULL;
 #ifndef NDEBUG
     b->pf_release = BlockNoRelease;
 #endif
@@ -150,6 +152,108 @@ block_t *block_Alloc (size_t size)
     return b;
 }
 
+/**
+ * @section Shared payloads
+ */
+struct block_shared_t
+{
+    atomic_uintptr_t refs; /**< Number of blocks using the payload */
+    block_t *owner; /**< Block the payload was allocated with */
+    block_free_t pf_release; /**< Original release callback of the owner */
+};
+
+static void block_shared_Release (block_t *block)
+{
+    struct block_shared_t *shared = block->p_shared;
+    block_t *owner = shared->owner;
+
+    if (block != owner)
+    {
+        block_Invalidate (block);
+        free (block);
+    }
+    else
+        /* The owner header stays alive as long as the payload. */
+        owner->p_next = NULL;
+
+    if (atomic_fetch_sub (&shared->refs, 1) != 1)
+        return;
+
+    owner->p_shared = NULL;
+    owner->pf_release = shared->pf_release;
+    free (shared);
+    block_Release (owner);
+}
+
+/** Whether other blocks may still read the payload */
+static bool block_IsShared (const block_t *block)
+{
+    return block->p_shared != NULL && atomic_load (&block->p_shared->refs) > 1;
+}
+
+/**
+ * Creates a block sharing the payload of another block, without copying it.
+ * The payload is freed when both blocks and all their clones are released.
+ *
+ * The payload must not be modified in place as long as it is shared,
+ * block_Unshare() returns a block which can be modified.
+ *
+ * @return the new block, or NULL on memory error (the original block is left
+ * untouched)
+ */
+block_t *block_Clone (block_t *block)
+{
+    struct block_shared_t *shared = block->p_shared;
+
+    block_Check (block);
+
+    if (shared == NULL)
+    {
+        shared = malloc (sizeof (*shared));
+        if (unlikely(shared == NULL))
+            return NULL;
+
+        atomic_init (&shared->refs, 1);
+        shared->owner = block;
+        shared->pf_release = block->pf_release;
+        block->p_shared = shared;
+        block->pf_release = block_shared_Release;
+    }
+
+    block_t *clone = malloc (sizeof (*clone));
+    if (unlikely(clone == NULL))
+        return NULL;
+
+    block_Init (clone, block->p_start, block->i_size);
+    clone->p_buffer = block->p_buffer;
+    clone->i_buffer = block->i_buffer;
+    block_CopyProperties (clone, block);
+    clone->p_shared = shared;
+    clone->pf_release = block_shared_Release;
+    atomic_fetch_add (&shared->refs, 1);
+    return clone;
+}
+
+/**
+ * Returns a block whose payload can be modified in place: the block itself
+ * if its payload is not shared (anymore), otherwise a private copy of it, in
+ * which case the block is released.
+ */
+block_t *block_Unshare (block_t *block)
+{
+    if (!block_IsShared (block))
+        return block;
+
+    block_t *copy = block_Alloc (block->i_buffer);
+    if (likely(copy != NULL))
+    {
+        BlockMetaCopy (copy, block);
+        memcpy (copy->p_buffer, block->p_buffer, block->i_buffer);
+    }
+    block_Release (block);
+    return copy;
+}
+
 block_t *block_Realloc( block_t *p_block, ssize_t i_prebody, size_t i_body )
 {
     size_t requested = i_prebody + i_body;
@@ -172,7 +276,7 @@ block_t *block_Realloc( block_t *p_block, ssize_t i_prebody, size_t i_body )
          p_block->i_buffer = 0; /* discard current payload */
     if( p_block->i_buffer == 0 )
     {
-        if( requested <= p_block->i_size )
+        if( requested <= p_block->i_size && !block_IsShared( p_block ) )
         {   /* Enough room: recycle buffer */
             size_t extra = p_block->i_size - requested;
 
@@ -211,7 +315,10 @@ block_t *block_Realloc( block_t *p_block, ssize_t i_prebody, size_t i_body )
      * minimize the payload size for memory copy. */
     assert( i_prebody >= 0 );
     if( (size_t)(p_block->p_buffer - p_start) < (size_t)i_prebody
-     || (size_t)(p_end - p_block->p_buffer) < i_body )
+     || (size_t)(p_end - p_block->p_buffer) < i_body
+     /* The space around a shared payload belongs to all its users */
+     || ( ( i_prebody > 0 || i_body > p_block->i_buffer )
+       && block_IsShared( p_block ) ) )
     {
         block_t *p_rea = block_Alloc( requested );
         if( p_rea )
@@ -696,6 +803,64 @@ block_t *block_FifoGet( block_fifo_t *p_fifo )
     return b;
 }
 
+/**
+ * Dequeues up to i_max blocks from the FIFO at once. If necessary, wait until
+ * there is one block in the queue. This function is (always) cancellation
+ * point.
+ *
+ * It takes the FIFO lock only once, which amortizes the wake up of a reader
+ * thread over all the blocks queued meanwhile.
+ *
+ * @return a chain of blocks (linked by p_next), or NULL if block_FifoWake()
+ * was called.
+ */
+block_t *block_FifoGetBatch( block_fifo_t *p_fifo, size_t i_max )
+{
+    block_t *b;
+
+    assert( i_max > 0 );
+    vlc_testcancel( );
+
+    vlc_mutex_lock( &p_fifo->lock );
+    mutex_cleanup_push( &p_fifo->lock );
+
+    while( ( p_fifo->p_first == NULL ) && !p_fifo->b_force_wake )
+        vlc_cond_wait( &p_fifo->wait, &p_fifo->lock );
+
+    vlc_cleanup_pop();
+    b = p_fifo->p_first;
+
+    p_fifo->b_force_wake = false;
+    if( b == NULL )
+    {
+        /* Forced wakeup */
+        vlc_mutex_unlock( &p_fifo->lock );
+        return NULL;
+    }
+
+    block_t **pp_last = &p_fifo->p_first;
+    size_t i_size = 0;
+
+    for( size_t i = 0; i < i_max && *pp_last != NULL; i++ )
+    {
+        i_size += (*pp_last)->i_buffer;
+        pp_last = &(*pp_last)->p_next;
+        p_fifo->i_depth--;
+    }
+    p_fifo->i_size -= i_size;
+
+    p_fifo->p_first = *pp_last;
+    *pp_last = NULL;
+    if( p_fifo->p_first == NULL )
+        p_fifo->pp_last = &p_fifo->p_first;
+
+    /* We don't know how many threads can queue new packets now. */
+    vlc_cond_broadcast( &p_fifo->wait_room );
+    vlc_mutex_unlock( &p_fifo->lock );
+
+    return b;
+}
+
 /**
  * Peeks the first block in the FIFO.
  * If necessary, wait until there is one block.
@@ -29,6 +29,7 @@
 #include <vlc_modules.h>
 #include <vlc_spu.h>
 #include <libvlc.h>
+#include "../modules/modules.h"
 #include <assert.h>
 
 typedef struct
@@ -366,6 +367,59 @@ int filter_chain_MouseEvent( filter_chain_t *p_chain,
 }
 
 /* Helpers */
+
+/**
+ * Loads the module of a chained filter.
+ *
+ * Unnamed filters are converters: they only depend on the formats, so the
+ * modules which recently rejected the same conversion are not probed again
+ * (see module_need_memo()).
+ */
+static module_t *FilterNeed( filter_chain_t *p_chain, filter_t *p_filter,
+                             const char *psz_name )
+{
+    const es_format_t *p_in = &p_filter->fmt_in, *p_out = &p_filter->fmt_out;
+    struct
+    {
+        int i_cat;
+        vlc_fourcc_t i_codec_in;
+        vlc_fourcc_t i_codec_out;
+        union
+        {
+            video_format_t video;
+            audio_format_t audio;
+        } in, out;
+        bool b_allow_fmt_out_change;
+    } key;
+
+    if( psz_name != NULL || p_filter->p_cfg != NULL
+     || p_in->i_cat != p_out->i_cat
+     || ( p_in->i_cat != VIDEO_ES && p_in->i_cat != AUDIO_ES )
+     || ( p_in->i_cat == VIDEO_ES
+       && ( p_in->video.p_palette != NULL || p_out->video.p_palette != NULL ) ) )
+        return module_need( p_filter, p_chain->psz_capability,
+                            psz_name, psz_name != NULL );
+
+    memset( &key, 0, sizeof(key) );
+    key.i_cat = p_in->i_cat;
+    key.i_codec_in = p_in->i_codec;
+    key.i_codec_out = p_out->i_codec;
+    if( p_in->i_cat == VIDEO_ES )
+    {
+        key.in.video = p_in->video;
+        key.out.video = p_out->video;
+    }
+    else
+    {
+        key.in.audio = p_in->audio;
+        key.out.audio = p_out->audio;
+    }
+    key.b_allow_fmt_out_change = p_filter->b_allow_fmt_out_change;
+
+    return module_need_memo( p_filter, p_chain->psz_capability, NULL,
+                             &key, sizeof(key) );
+}
+
 static filter_t *filter_chain_AppendFilterInternal( filter_chain_t *p_chain,
                                                     const char *psz_name,
                                                     config_chain_t *p_cfg,
@@ -396,8 +450,7 @@ static filter_t *filter_chain_AppendFilterInternal( filter_chain_t *p_chain,
     p_filter->p_cfg = p_cfg;
     p_filter->b_allow_fmt_out_change = p_chain->b_allow_fmt_out_change;
 
-    p_filter->p_module = module_need( p_filter, p_chain->psz_capability,
-                                      psz_name, psz_name != NULL );
+    p_filter->p_module = FilterNeed( p_chain, p_filter, psz_name );
 
     if( !p_filter->p_module )
         goto error;
@@ -40,6 +40,7 @@
 # include <locale.h>
 #endif
 #include <errno.h>                                                  /* errno */
+#include <limits.h>
 #include <assert.h>
 #include <unistd.h>
 
@@ -49,8 +50,903 @@
 #   include <vlc_network.h>          /* 'net_strerror' and 'WSAGetLastError' */
 #endif
 #include <vlc_charset.h>
+#include <vlc_atomic.h>
 #include "../libvlc.h"
 
+#ifdef _WIN32
+static void Win32DebugOutputMsg (void *, int , const vlc_log_t *,
+                                 const char *, va_list);
+#endif
+
+/*** Asynchronous logging ***/
+
+/* Messages are queued as binary records in a ring buffer per emitting
+ * thread: the format string and the arguments are copied, and the message
+ * is only formatted by the logger thread, which then calls the log callback.
+ * The emitting threads thus never format, nor wait for the output. The
+ * messages that cannot be deferred (too big, unsupported conversions, thread
+ * logging to several instances...) are still output synchronously. */
+
+#define LOG_RING_SIZE  32768 /* bytes per thread, must be a power of two */
+#define LOG_RECORD_MAX  4096 /* bytes per record */
+#define LOG_BURST         50 /* identical messages per second per thread */
+#define LOG_SPEC_MAX      32 /* bytes per conversion specification */
+
+typedef struct vlc_logger vlc_logger_t;
+typedef struct log_ring log_ring_t;
+
+struct vlc_logger
+{
+    libvlc_priv_t *priv;
+    vlc_thread_t thread;
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    log_ring_t *rings; /**< Rings of the emitting threads (lock) */
+    bool stop; /**< Whether to exit once the rings are empty (lock) */
+    atomic_bool idle; /**< Whether the logger thread waits for a signal */
+    atomic_uint seq; /**< Sequence number of the next record */
+    uint32_t next; /**< Sequence number of the next output (logger thread) */
+    char *text; /**< Formatting buffer (logger thread) */
+    size_t size; /**< Formatting buffer size (logger thread) */
+};
+
+struct log_ring
+{
+    log_ring_t *next; /**< Next ring of the logger (logger lock) */
+    vlc_logger_t *owner;
+    atomic_uint refs; /**< Emitting thread and logger references */
+    atomic_bool detached; /**< Whether the logger is gone */
+    atomic_size_t head; /**< Bytes ever written (emitting thread) */
+    atomic_size_t tail; /**< Bytes ever read (logger thread) */
+    atomic_uint dropped; /**< Records lost as the ring was full */
+    unsigned reported; /**< Lost records already reported (logger thread) */
+
+    /* Rate limiting (emitting thread) */
+    uint32_t last_hash; /**< Hash of the last packed record */
+    uintptr_t last_id;
+    int last_type;
+    unsigned repeats;
+    unsigned suppressed;
+    mtime_t window;
+
+    unsigned char data[LOG_RING_SIZE];
+};
+
+/**
+ * Log record header. It is followed by the object type, module, header (if
+ * any) and format strings, then by the values of the arguments.
+ */
+typedef struct
+{
+    uint32_t size; /**< Record size, including this header */
+    uint32_t seq;
+    uint32_t suppressed; /**< Identical messages suppressed before this one */
+    int type;
+    int errnum;
+    bool has_header;
+    uintptr_t id;
+} log_record_t;
+
+static vlc_mutex_t log_key_lock = VLC_STATIC_MUTEX;
+static vlc_threadvar_t log_key; /* ring of the calling thread */
+static unsigned log_key_refs = 0;
+static char log_self; /* marks the logger threads */
+
+static int LogKeyHold (void (*destructor) (void *))
+{
+    int ret = 0;
+
+    vlc_mutex_lock (&log_key_lock);
+    if (log_key_refs == 0)
+        ret = vlc_threadvar_create (&log_key, destructor);
+    if (ret == 0)
+        log_key_refs++;
+    vlc_mutex_unlock (&log_key_lock);
+    return ret;
+}
+
+static void LogKeyRelease (void)
+{
+    vlc_mutex_lock (&log_key_lock);
+    assert (log_key_refs > 0);
+    if (--log_key_refs == 0)
+        vlc_threadvar_delete (&log_key);
+    vlc_mutex_unlock (&log_key_lock);
+}
+
+static void RingRelease (void *data)
+{
+    log_ring_t *ring = data;
+
+    if (atomic_fetch_sub (&ring->refs, 1) == 1)
+        free (ring);
+}
+
+static log_ring_t *RingNew (vlc_logger_t *logger)
+{
+    log_ring_t *ring = malloc (sizeof (*ring));
+    if (unlikely(ring == NULL))
+        return NULL;
+
+    ring->owner = logger;
+    atomic_init (&ring->refs, 2);
+    atomic_init (&ring->detached, false);
+    atomic_init (&ring->head, 0);
+    atomic_init (&ring->tail, 0);
+    atomic_init (&ring->dropped, 0);
+    ring->reported = 0;
+    ring->last_hash = 0;
+    ring->last_id = 0;
+    ring->last_type = -1;
+    ring->repeats = 0;
+    ring->suppressed = 0;
+    ring->window = 0;
+
+    vlc_mutex_lock (&logger->lock);
+    ring->next = logger->rings;
+    logger->rings = ring;
+    vlc_mutex_unlock (&logger->lock);
+    return ring;
+}
+
+static void RingWrite (log_ring_t *ring, size_t pos, const void *buf,
+                       size_t len)
+{
+    size_t offset = pos & (LOG_RING_SIZE - 1);
+    size_t first = __MIN(len, LOG_RING_SIZE - offset);
+
+    memcpy (ring->data + offset, buf, first);
+    memcpy (ring->data, (const unsigned char *)buf + first, len - first);
+}
+
+static void RingRead (const log_ring_t *ring, size_t pos, void *buf,
+                      size_t len)
+{
+    size_t offset = pos & (LOG_RING_SIZE - 1);
+    size_t first = __MIN(len, LOG_RING_SIZE - offset);
+
+    memcpy (buf, ring->data + offset, first);
+    memcpy ((unsigned char *)buf + first, ring->data, len - first);
+}
+
+enum log_arg
+{
+    LOG_ARG_INVALID,
+    LOG_ARG_NONE,
+    LOG_ARG_ERRNO,
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_INTMAX,
+    LOG_ARG_SIZE,
+    LOG_ARG_PTRDIFF,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_LDOUBLE,
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER,
+};
+
+typedef struct
+{
+    enum log_arg type;
+    bool width; /**< Whether the width is an argument */
+    bool precision; /**< Whether the precision is an argument */
+    int limit; /**< Literal precision, or -1 if none */
+    size_t length; /**< Length of the specification, with the percent sign */
+} log_spec_t;
+
+/**
+ * Parses a printf() conversion specification. Positional arguments, %n and
+ * wide characters are not supported.
+ */
+static void ParseSpec (const char *str, log_spec_t *spec)
+{
+    const char *p = str + 1;
+    int len = 0;
+
+    spec->width = spec->precision = false;
+    spec->limit = -1;
+
+    p += strspn (p, "-+ #0'");
+    if (*p == '*')
+    {
+        spec->width = true;
+        p++;
+    }
+    else
+        p += strspn (p, "0123456789");
+    if (*p == '.')
+    {
+        if (*++p == '*')
+        {
+            spec->precision = true;
+            p++;
+        }
+        else
+        {
+            unsigned long limit = strtoul (p, NULL, 10);
+
+            spec->limit = (limit < INT_MAX) ? limit : INT_MAX;
+            p += strspn (p, "0123456789");
+        }
+    }
+
+    if (p[0] == 'h' && p[1] == 'h')
+    {
+        len = 'H';
+        p += 2;
+    }
+    else if (p[0] == 'l' && p[1] == 'l')
+    {
+        len = 'q';
+        p += 2;
+    }
+    else if (*p != '\0' && strchr ("hlqLjzt", *p) != NULL)
+        len = *(p++);
+
+    switch (*p)
+    {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            switch (len)
+            {
+                case 0: case 'H': case 'h':
+                    spec->type = LOG_ARG_INT;
+                    break;
+                case 'l':
+                    spec->type = LOG_ARG_LONG;
+                    break;
+                case 'q':
+                    spec->type = LOG_ARG_LLONG;
+                    break;
+                case 'j':
+                    spec->type = LOG_ARG_INTMAX;
+                    break;
+                case 'z':
+                    spec->type = LOG_ARG_SIZE;
+                    break;
+                case 't':
+                    spec->type = LOG_ARG_PTRDIFF;
+                    break;
+                default:
+                    spec->type = LOG_ARG_INVALID;
+            }
+            break;
+        case 'e': case 'E': case 'f': case 'F':
+        case 'g': case 'G': case 'a': case 'A':
+            if (len == 'L')
+                spec->type = LOG_ARG_LDOUBLE;
+            else if (len == 0 || len == 'l')
+                spec->type = LOG_ARG_DOUBLE;
+            else
+                spec->type = LOG_ARG_INVALID;
+            break;
+        case 'c':
+            spec->type = len ? LOG_ARG_INVALID : LOG_ARG_INT;
+            break;
+        case 's':
+            spec->type = len ? LOG_ARG_INVALID : LOG_ARG_STRING;
+            break;
+        case 'p':
+            spec->type = len ? LOG_ARG_INVALID : LOG_ARG_POINTER;
+            break;
+#ifndef _WIN32
+        case 'm':
+            spec->type = len ? LOG_ARG_INVALID : LOG_ARG_ERRNO;
+            break;
+#endif
+        case '%':
+            spec->type = (p == str + 1) ? LOG_ARG_NONE : LOG_ARG_INVALID;
+            break;
+        default:
+            spec->type = LOG_ARG_INVALID;
+    }
+    spec->length = p + 1 - str;
+    if (spec->length >= LOG_SPEC_MAX)
+        spec->type = LOG_ARG_INVALID;
+}
+
+/**
+ * Copies the strings and the arguments of a message after a record header.
+ * \return the record size, or 0 if the message cannot be deferred
+ */
+static size_t RecordPack (unsigned char *buf, const vlc_log_t *msg,
+                          const char *format, va_list ap)
+{
+    size_t len = sizeof (log_record_t);
+
+#define PUT(ptr, size) \
+    do { \
+        if (len + (size) > LOG_RECORD_MAX) \
+            return 0; \
+        memcpy (buf + len, ptr, size); \
+        len += (size); \
+    } while (0)
+#define PUT_STR(str) PUT(str, strlen (str) + 1)
+#define PUT_ARG(type) \
+    do { \
+        type val = va_arg (ap, type); \
+        PUT(&val, sizeof (val)); \
+    } while (0)
+#define GET_PUT_ARG(type, val) \
+    do { \
+        val = va_arg (ap, type); \
+        PUT(&(val), sizeof (val)); \
+    } while (0)
+
+    PUT_STR(msg->psz_object_type);
+    PUT_STR(msg->psz_module);
+    if (msg->psz_header != NULL)
+        PUT_STR(msg->psz_header);
+    PUT_STR(format);
+
+    for (const char *p = strchr (format, '%'); p != NULL; p = strchr (p, '%'))
+    {
+        log_spec_t spec;
+        int precision;
+
+        ParseSpec (p, &spec);
+        if (spec.width)
+            PUT_ARG(int);
+        if (spec.precision)
+            GET_PUT_ARG(int, precision);
+        else
+            precision = spec.limit;
+
+        switch (spec.type)
+        {
+            case LOG_ARG_INVALID:
+                return 0;
+            case LOG_ARG_NONE:
+            case LOG_ARG_ERRNO:
+                break;
+            case LOG_ARG_INT:
+                PUT_ARG(int);
+                break;
+            case LOG_ARG_LONG:
+                PUT_ARG(long);
+                break;
+            case LOG_ARG_LLONG:
+                PUT_ARG(long long);
+                break;
+            case LOG_ARG_INTMAX:
+                PUT_ARG(intmax_t);
+                break;
+            case LOG_ARG_SIZE:
+                PUT_ARG(size_t);
+                break;
+            case LOG_ARG_PTRDIFF:
+                PUT_ARG(ptrdiff_t);
+                break;
+            case LOG_ARG_DOUBLE:
+                PUT_ARG(double);
+                break;
+            case LOG_ARG_LDOUBLE:
+                PUT_ARG(long double);
+                break;
+            case LOG_ARG_STRING:
+            {
+                const char *str = va_arg (ap, const char *);
+                if (str == NULL)
+                    str = "(null)";
+
+                /* With a precision, the string needs not be terminated */
+                size_t slen = (precision >= 0) ? strnlen (str, precision)
+                                               : strlen (str);
+                if (len + slen + 1 > LOG_RECORD_MAX)
+                    return 0;
+                memcpy (buf + len, str, slen);
+                buf[len + slen] = '\0';
+                len += slen + 1;
+                break;
+            }
+            case LOG_ARG_POINTER:
+                PUT_ARG(void *);
+                break;
+        }
+        p += spec.length;
+    }
+#undef GET_PUT_ARG
+#undef PUT_ARG
+#undef PUT_STR
+#undef PUT
+    return len;
+}
+
+/**
+ * Queues a message in the ring of the calling thread.
+ * \return false if the message must be output synchronously
+ */
+static bool LogAsync (libvlc_priv_t *priv, int type, const vlc_log_t *msg,
+                      const char *format, va_list args)
+{
+    vlc_logger_t *logger = priv->log.logger;
+    int errnum = errno;
+
+    if (logger == NULL)
+        return false;
+
+    log_ring_t *ring = vlc_threadvar_get (log_key);
+    if (ring == (log_ring_t *)&log_self)
+        goto sync; /* logging from a log callback */
+    if (ring != NULL && atomic_load (&ring->detached))
+    {   /* the instance of the ring is gone */
+        vlc_threadvar_set (log_key, NULL);
+        RingRelease (ring);
+        ring = NULL;
+    }
+    if (ring == NULL)
+    {
+        ring = RingNew (logger);
+        if (unlikely(ring == NULL))
+            goto sync;
+        vlc_threadvar_set (log_key, ring);
+    }
+    else if (ring->owner != logger)
+        goto sync;
+
+    unsigned char buf[LOG_RECORD_MAX];
+    va_list ap;
+    size_t size;
+
+    va_copy (ap, args);
+    size = RecordPack (buf, msg, format, ap);
+    va_end (ap);
+    if (size == 0)
+        goto sync;
+
+    /* Let through LOG_BURST identical messages per second at most. The
+     * packed strings and argument values are compared, so that messages
+     * sharing a format string but not their arguments are all output. */
+    uint32_t hash = 2166136261u;
+    for (size_t i = sizeof (log_record_t); i < size; i++)
+        hash = (hash ^ buf[i]) * 16777619u;
+
+    mtime_t now = mdate ();
+    if (hash == ring->last_hash && msg->i_object_id == ring->last_id
+     && type == ring->last_type && now - ring->window < CLOCK_FREQ)
+    {
+        if (++ring->repeats > LOG_BURST)
+        {
+            ring->suppressed++;
+            goto out;
+        }
+    }
+    else
+    {
+        ring->last_hash = hash;
+        ring->last_id = msg->i_object_id;
+        ring->last_type = type;
+        ring->repeats = 1;
+        ring->window = now;
+    }
+
+    size_t head = atomic_load_explicit (&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit (&ring->tail, memory_order_acquire);
+    if (LOG_RING_SIZE - (head - tail) < size)
+    {   /* the logger thread is too late */
+        atomic_fetch_add (&ring->dropped, 1);
+        goto out;
+    }
+
+    log_record_t rec = {
+        .size = size,
+        .seq = atomic_fetch_add (&logger->seq, 1),
+        .suppressed = ring->suppressed,
+        .type = type,
+        .errnum = errnum,
+        .has_header = msg->psz_header != NULL,
+        .id = msg->i_object_id,
+    };
+    ring->suppressed = 0;
+    memcpy (buf, &rec, sizeof (rec));
+    RingWrite (ring, head, buf, size);
+    atomic_store (&ring->head, head + size);
+
+    if (atomic_load (&logger->idle))
+    {
+        vlc_mutex_lock (&logger->lock);
+        vlc_cond_signal (&logger->wait);
+        vlc_mutex_unlock (&logger->lock);
+    }
+out:
+    errno = errnum;
+    return true;
+sync:
+    errno = errnum;
+    return false;
+}
+
+static void LogOutput (libvlc_priv_t *priv, int type, const vlc_log_t *msg,
+                       const char *format, ...)
+{
+    va_list ap;
+
+    va_start (ap, format);
+#ifdef _WIN32
+    va_list dol;
+
+    va_copy (dol, ap);
+    Win32DebugOutputMsg (&priv->log.verbose, type, msg, format, dol);
+    va_end (dol);
+#endif
+    vlc_rwlock_rdlock (&priv->log.lock);
+    priv->log.cb (priv->log.opaque, type, msg, format, ap);
+    vlc_rwlock_unlock (&priv->log.lock);
+    va_end (ap);
+}
+
+/**
+ * Appends formatted text to the formatting buffer of the logger.
+ */
+static bool LogAppend (vlc_logger_t *logger, size_t *len,
+                       const char *format, ...)
+{
+    va_list ap;
+
+    for (;;)
+    {
+        va_start (ap, format);
+        int ret = vsnprintf (logger->text + *len, logger->size - *len,
+                             format, ap);
+        va_end (ap);
+        if (ret < 0)
+            return false;
+        if ((size_t)ret < logger->size - *len)
+        {
+            *len += ret;
+            return true;
+        }
+
+        size_t size = 2 * (*len + ret + 1);
+        char *text = realloc (logger->text, size);
+        if (unlikely(text == NULL))
+            return false;
+        logger->text = text;
+        logger->size = size;
+    }
+}
+
+/**
+ * Formats a record, as vsnprintf() would have formatted the message.
+ */
+static const char *RecordFormat (vlc_logger_t *logger,
+                                 const log_record_t *rec, const char *format,
+                                 const unsigned char *args)
+{
+    size_t len = 0;
+    const char *p;
+
+#define GET(val) \
+    do { \
+        memcpy (&(val), args, sizeof (val)); \
+        args += sizeof (val); \
+    } while (0)
+#define APPEND(...) \
+    (spec.width \
+     ? (spec.precision \
+        ? LogAppend (logger, &len, spec_str, width, precision, __VA_ARGS__) \
+        : LogAppend (logger, &len, spec_str, width, __VA_ARGS__)) \
+     : (spec.precision \
+        ? LogAppend (logger, &len, spec_str, precision, __VA_ARGS__) \
+        : LogAppend (logger, &len, spec_str, __VA_ARGS__)))
+#define APPEND_ARG(type) \
+    do { \
+        type val; \
+        GET(val); \
+        APPEND(val); \
+    } while (0)
+
+    logger->text[0] = '\0';
+    while ((p = strchr (format, '%')) != NULL)
+    {
+        log_spec_t spec;
+        char spec_str[LOG_SPEC_MAX];
+        int width = 0, precision = 0;
+
+        LogAppend (logger, &len, "%.*s", (int)(p - format), format);
+        ParseSpec (p, &spec);
+        format = p + spec.length;
+        assert (spec.type != LOG_ARG_INVALID);
+        memcpy (spec_str, p, spec.length);
+        spec_str[spec.length] = '\0';
+
+        if (spec.width)
+            GET(width);
+        if (spec.precision)
+            GET(precision);
+
+        switch (spec.type)
+        {
+            case LOG_ARG_INVALID: /* rejected by RecordPack() */
+            case LOG_ARG_NONE:
+                APPEND(0);
+                break;
+            case LOG_ARG_ERRNO:
+            {
+#ifdef __GLIBC__
+                errno = rec->errnum;
+                APPEND(0);
+#else
+                char errbuf[1001];
+
+                if (strerror_r (rec->errnum, errbuf, sizeof (errbuf)))
+                    snprintf (errbuf, sizeof (errbuf), "error %d",
+                              rec->errnum);
+                spec_str[spec.length - 1] = 's';
+                APPEND(errbuf);
+#endif
+                break;
+            }
+            case LOG_ARG_INT:
+                APPEND_ARG(int);
+                break;
+            case LOG_ARG_LONG:
+                APPEND_ARG(long);
+                break;
+            case LOG_ARG_LLONG:
+                APPEND_ARG(long long);
+                break;
+            case LOG_ARG_INTMAX:
+                APPEND_ARG(intmax_t);
+                break;
+            case LOG_ARG_SIZE:
+                APPEND_ARG(size_t);
+                break;
+            case LOG_ARG_PTRDIFF:
+                APPEND_ARG(ptrdiff_t);
+                break;
+            case LOG_ARG_DOUBLE:
+                APPEND_ARG(double);
+                break;
+            case LOG_ARG_LDOUBLE:
+                APPEND_ARG(long double);
+                break;
+            case LOG_ARG_STRING:
+            {
+                const char *str = (const char *)args;
+
+                args += strlen (str) + 1;
+                APPEND(str);
+                break;
+            }
+            case LOG_ARG_POINTER:
+                APPEND_ARG(void *);
+                break;
+        }
+    }
+    LogAppend (logger, &len, "%s", format);
+#undef APPEND_ARG
+#undef APPEND
+#undef GET
+    return logger->text;
+}
+
+/**
+ * Reports the lost records of a ring if any, or else outputs its oldest
+ * record.
+ */
+static void RecordOutput (vlc_logger_t *logger, log_ring_t *ring)
+{
+    libvlc_priv_t *priv = logger->priv;
+    unsigned dropped = atomic_load (&ring->dropped);
+
+    if (dropped != ring->reported)
+    {
+        const vlc_log_t msg = {
+            .i_object_id = 0,
+            .psz_object_type = "generic",
+            .psz_module = MODULE_STRING,
+            .psz_header = NULL,
+        };
+
+        LogOutput (priv, VLC_MSG_WARN, &msg,
+                   "%u log message(s) dropped: logging too fast",
+                   dropped - ring->reported);
+        ring->reported = dropped;
+        return;
+    }
+
+    size_t tail = atomic_load_explicit (&ring->tail, memory_order_relaxed);
+    if (atomic_load_explicit (&ring->head, memory_order_acquire) == tail)
+        return;
+
+    union
+    {
+        log_record_t rec;
+        unsigned char data[LOG_RECORD_MAX];
+    } buf;
+
+    RingRead (ring, tail, &buf.rec, sizeof (buf.rec));
+    RingRead (ring, tail + sizeof (buf.rec), buf.data + sizeof (buf.rec),
+              buf.rec.size - sizeof (buf.rec));
+    atomic_store_explicit (&ring->tail, tail + buf.rec.size,
+                           memory_order_release);
+    logger->next = buf.rec.seq + 1;
+
+    const char *str = (const char *)buf.data + sizeof (buf.rec);
+    vlc_log_t msg;
+
+    msg.i_object_id = buf.rec.id;
+    msg.psz_object_type = str;
+    str += strlen (str) + 1;
+    msg.psz_module = str;
+    str += strlen (str) + 1;
+    msg.psz_header = NULL;
+    if (buf.rec.has_header)
+    {
+        msg.psz_header = str;
+        str += strlen (str) + 1;
+    }
+
+    const char *format = str;
+    const unsigned char *args = (const unsigned char *)str + strlen (str) + 1;
+
+    if (buf.rec.suppressed > 0)
+        LogOutput (priv, buf.rec.type, &msg,
+                   "previous message repeated %"PRIu32" more times",
+                   buf.rec.suppressed);
+    LogOutput (priv, buf.rec.type, &msg, "%s",
+               RecordFormat (logger, &buf.rec, format, args));
+}
+
+/**
+ * Finds the ring with lost records to report, or else with the next record
+ * in sequence order. Also frees the rings of the exited threads once they
+ * are empty. Called with the logger lock held.
+ *
+ * A thread takes its sequence number before it publishes its record. If the
+ * oldest published record is not the next one, an earlier record is about to
+ * be published: its thread will signal the logger thread, as it waits.
+ */
+static log_ring_t *RingOldest (vlc_logger_t *logger)
+{
+    log_ring_t *oldest = NULL;
+    uint32_t oldest_seq = 0;
+
+    for (log_ring_t **pp = &logger->rings, *ring; (ring = *pp) != NULL;)
+    {
+        /* The thread reference must be checked before the head: the thread
+         * may still be writing a record otherwise. */
+        bool orphan = atomic_load (&ring->refs) == 1;
+        size_t tail = atomic_load_explicit (&ring->tail, memory_order_relaxed);
+
+        if (atomic_load (&ring->dropped) != ring->reported)
+            return ring;
+
+        if (atomic_load (&ring->head) == tail)
+        {
+            if (orphan)
+            {
+                *pp = ring->next;
+                free (ring);
+                continue;
+            }
+        }
+        else
+        {
+            log_record_t rec;
+
+            RingRead (ring, tail, &rec, sizeof (rec));
+            if (oldest == NULL || (int32_t)(rec.seq - oldest_seq) < 0)
+            {
+                oldest = ring;
+                oldest_seq = rec.seq;
+            }
+        }
+        pp = &ring->next;
+    }
+
+    if (oldest != NULL && oldest_seq != logger->next && !logger->stop)
+        return NULL;
+    return oldest;
+}
+
+static void *LoggerThread (void *data)
+{
+    vlc_logger_t *logger = data;
+
+    /* C locale to get error messages in English in the logs */
+    locale_t c = newlocale (LC_MESSAGES_MASK, "C", (locale_t)0);
+    locale_t locale = uselocale (c);
+
+    vlc_threadvar_set (log_key, &log_self);
+
+    vlc_mutex_lock (&logger->lock);
+    for (;;)
+    {
+        log_ring_t *ring = RingOldest (logger);
+
+        if (ring == NULL)
+        {
+            if (logger->stop)
+                break;
+
+            /* Check again after the emitting threads know they must signal */
+            atomic_store (&logger->idle, true);
+            ring = RingOldest (logger);
+            if (ring == NULL)
+                vlc_cond_wait (&logger->wait, &logger->lock);
+            atomic_store (&logger->idle, false);
+            if (ring == NULL)
+                continue;
+        }
+
+        vlc_mutex_unlock (&logger->lock);
+        RecordOutput (logger, ring);
+        vlc_mutex_lock (&logger->lock);
+    }
+    vlc_mutex_unlock (&logger->lock);
+
+    vlc_threadvar_set (log_key, NULL);
+    uselocale (locale);
+    freelocale (c);
+    return NULL;
+}
+
+static vlc_logger_t *LoggerCreate (libvlc_priv_t *priv)
+{
+    vlc_logger_t *logger = malloc (sizeof (*logger));
+    if (unlikely(logger == NULL))
+        return NULL;
+
+    logger->size = 1024;
+    logger->text = malloc (logger->size);
+    if (unlikely(logger->text == NULL))
+        goto error;
+    if (LogKeyHold (RingRelease))
+        goto error;
+
+    logger->priv = priv;
+    vlc_mutex_init (&logger->lock);
+    vlc_cond_init (&logger->wait);
+    logger->rings = NULL;
+    logger->stop = false;
+    atomic_init (&logger->idle, false);
+    atomic_init (&logger->seq, 0);
+    logger->next = 0;
+
+    if (vlc_clone (&logger->thread, LoggerThread, logger,
+                   VLC_THREAD_PRIORITY_LOW))
+    {
+        vlc_cond_destroy (&logger->wait);
+        vlc_mutex_destroy (&logger->lock);
+        LogKeyRelease ();
+        goto error;
+    }
+    return logger;
+
+error:
+    free (logger->text);
+    free (logger);
+    return NULL;
+}
+
+/**
+ * Outputs the pending messages, and stops the logger thread.
+ */
+static void LoggerDestroy (vlc_logger_t *logger)
+{
+    vlc_mutex_lock (&logger->lock);
+    logger->stop = true;
+    vlc_cond_signal (&logger->wait);
+    vlc_mutex_unlock (&logger->lock);
+    vlc_join (logger->thread, NULL);
+
+    /* The rings of the running threads are freed by the threads */
+    for (log_ring_t *ring = logger->rings, *next; ring != NULL; ring = next)
+    {
+        next = ring->next;
+        atomic_store (&ring->detached, true);
+        RingRelease (ring);
+    }
+
+    vlc_cond_destroy (&logger->wait);
+    vlc_mutex_destroy (&logger->lock);
+    LogKeyRelease ();
+    free (logger->text);
+    free (logger);
+}
+
 /**
  * Emit a log message.
  * \param obj VLC object emitting the message or NULL
@@ -69,21 +965,12 @@ void vlc_Log (vlc_object_t *obj, int type, const char *module,
     va_end (args);
 }
 
-#ifdef _WIN32
-static void Win32DebugOutputMsg (void *, int , const vlc_log_t *,
-                                 const char *, va_list);
-#endif
-
 /**
- * Emit a log message. This function is the variable argument list equivalent
- * to vlc_Log().
+ * Emit a log message synchronously, from the calling thread.
  */
-void vlc_vaLog (vlc_object_t *obj, int type, const char *module,
-                const char *format, va_list args)
+static void LogSync (libvlc_priv_t *priv, int type, const vlc_log_t *msg,
+                     const char *format, va_list args)
 {
-    if (obj != NULL && obj->i_flags & OBJECT_FLAGS_QUIET)
-        return;
-
     /* C locale to get error messages in English in the logs */
     locale_t c = newlocale (LC_MESSAGES_MASK, "C", (locale_t)0);
     locale_t locale = uselocale (c);
@@ -144,35 +1031,18 @@ void vlc_vaLog (vlc_object_t *obj, int type, const char *module,
     }
 #endif
 
-    /* Fill message information fields */
-    vlc_log_t msg;
-
-    msg.i_object_id = (uintptr_t)obj;
-    msg.psz_object_type = (obj != NULL) ? obj->psz_object_type : "generic";
-    msg.psz_module = module;
-    msg.psz_header = NULL;
-
-    for (vlc_object_t *o = obj; o != NULL; o = o->p_parent)
-        if (o->psz_header != NULL)
-        {
-            msg.psz_header = o->psz_header;
-            break;
-        }
-
     /* Pass message to the callback */
-    libvlc_priv_t *priv = obj ? libvlc_priv (obj->p_libvlc) : NULL;
-
 #ifdef _WIN32
     va_list ap;
 
     va_copy (ap, args);
-    Win32DebugOutputMsg (priv ? &priv->log.verbose : NULL, type, &msg, format, ap);
+    Win32DebugOutputMsg (priv ? &priv->log.verbose : NULL, type, msg, format, ap);
     va_end (ap);
 #endif
 
     if (priv) {
         vlc_rwlock_rdlock (&priv->log.lock);
-        priv->log.cb (priv->log.opaque, type, &msg, format, args);
+        priv->log.cb (priv->log.opaque, type, msg, format, args);
         vlc_rwlock_unlock (&priv->log.lock);
     }
 
@@ -180,6 +1050,43 @@ void vlc_vaLog (vlc_object_t *obj, int type, const char *module,
     freelocale (c);
 }
 
+/**
+ * Emit a log message. This function is the variable argument list equivalent
+ * to vlc_Log().
+ */
+void vlc_vaLog (vlc_object_t *obj, int type, const char *module,
+                const char *format, va_list args)
+{
+    if (obj != NULL && obj->i_flags & OBJECT_FLAGS_QUIET)
+        return;
+
+    libvlc_priv_t *priv = obj ? libvlc_priv (obj->p_libvlc) : NULL;
+
+    /* Filtered out messages cost nothing more */
+    if (priv != NULL
+     && type > atomic_load_explicit (&priv->log.max_type,
+                                     memory_order_relaxed))
+        return;
+
+    /* Fill message information fields */
+    vlc_log_t msg;
+
+    msg.i_object_id = (uintptr_t)obj;
+    msg.psz_object_type = (obj != NULL) ? obj->psz_object_type : "generic";
+    msg.psz_module = module;
+    msg.psz_header = NULL;
+
+    for (vlc_object_t *o = obj; o != NULL; o = o->p_parent)
+        if (o->psz_header != NULL)
+        {
+            msg.psz_header = o->psz_header;
+            break;
+        }
+
+    if (priv == NULL || !LogAsync (priv, type, &msg, format, args))
+        LogSync (priv, type, &msg, format, args);
+}
+
 static const char msg_type[4][9] = { "", " error", " warning", " debug" };
 #define COL(x,y)  "\033[" #x ";" #y "m"
 #define RED     COL(31,1)
@@ -290,6 +1197,7 @@ static void Win32DebugOutputMsg (void* d, int type, const vlc_log_t *p_item,
 void vlc_LogSet (libvlc_int_t *vlc, vlc_log_cb cb, void *opaque)
 {
     libvlc_priv_t *priv = libvlc_priv (vlc);
+    int max_type = VLC_MSG_DBG;
 
     if (cb == NULL)
     {
@@ -300,11 +1208,14 @@ void vlc_LogSet (libvlc_int_t *vlc, vlc_log_cb cb, void *opaque)
 #endif
             cb = PrintMsg;
         opaque = (void *)(intptr_t)priv->log.verbose;
+        /* Same filter as the default callbacks */
+        max_type = (priv->log.verbose < 0) ? -1 : priv->log.verbose + 1;
     }
 
     vlc_rwlock_wrlock (&priv->log.lock);
     priv->log.cb = cb;
     priv->log.opaque = opaque;
+    atomic_store (&priv->log.max_type, max_type);
     vlc_rwlock_unlock (&priv->log.lock);
 
     /* Announce who we are */
@@ -327,7 +1238,9 @@ void vlc_LogInit (libvlc_int_t *vlc)
     else
         priv->log.verbose = var_InheritInteger (vlc, "verbose");
 
+    atomic_init (&priv->log.max_type, VLC_MSG_DBG);
     vlc_rwlock_init (&priv->log.lock);
+    priv->log.logger = LoggerCreate (priv);
     vlc_LogSet (vlc, NULL, NULL);
 }
 
@@ -335,5 +1248,10 @@ void vlc_LogDeinit (libvlc_int_t *vlc)
 {
     libvlc_priv_t *priv = libvlc_priv (vlc);
 
+    if (priv->log.logger != NULL)
+    {
+        LoggerDestroy (priv->log.logger);
+        priv->log.logger = NULL;
+    }
     vlc_rwlock_destroy (&priv->log.lock);
 }
@@ -130,6 +130,10 @@ void *vlc_custom_create (vlc_object_t *parent, size_t length,
         return NULL;
     priv->psz_name = NULL;
     priv->var_root = NULL;
+    for (unsigned i = 0; i < VAR_HASH_SIZE; i++)
+        atomic_init (&priv->var_hash[i], 0);
+    atomic_init (&priv->var_readers, 0);
+    priv->var_retired = NULL;
     vlc_mutex_init (&priv->var_lock);
     vlc_cond_init (&priv->var_wait);
     priv->pipes[0] = priv->pipes[1] = -1;
@@ -145,14 +145,149 @@ static int varcmp( const void *a, const void *b )
     return strcmp( va->psz_name, vb->psz_name );
 }
 
+/**
+ * Hashes a variable name (32-bits FNV-1a).
+ */
+static uint32_t HashName( const char *psz_name )
+{
+    uint32_t i_hash = 2166136261u;
+
+    while( *psz_name )
+        i_hash = (i_hash ^ (unsigned char)*(psz_name++)) * 16777619u;
+    return i_hash;
+}
+
+/**
+ * Finds a variable in the hash index of an object.
+ *
+ * This does not need the variable lock, but the caller must then be counted
+ * in var_readers, so that the variables it walks through are not freed.
+ * The names are compared only when the hashes match, which almost always
+ * means a single strcmp() per lookup.
+ */
+static variable_t *LookupHash( vlc_object_internals_t *priv,
+                               const char *psz_name, uint32_t i_hash )
+{
+    uintptr_t p = atomic_load( &priv->var_hash[i_hash % VAR_HASH_SIZE] );
+
+    while( p != 0 )
+    {
+        variable_t *p_var = (variable_t *)p;
+
+        if( p_var->i_hash == i_hash
+         && (p_var->psz_name == psz_name
+          || !strcmp( p_var->psz_name, psz_name )) )
+            return p_var;
+        p = atomic_load( &p_var->next );
+    }
+    return NULL;
+}
+
 static variable_t *Lookup( vlc_object_t *obj, const char *psz_name )
 {
     vlc_object_internals_t *priv = vlc_internals( obj );
-    variable_t **pp_var;
 
     vlc_assert_locked( &priv->var_lock );
-    pp_var = tfind( &psz_name, &priv->var_root, varcmp );
-    return (pp_var != NULL) ? *pp_var : NULL;
+    return LookupHash( priv, psz_name, HashName( psz_name ) );
+}
+
+/**
+ * Adds a new variable to the hash index, with the variable lock held.
+ * From then on, the variable is visible to the lock-free readers.
+ */
+static void Publish( vlc_object_internals_t *priv, variable_t *p_var )
+{
+    atomic_uintptr_t *p_head = &priv->var_hash[p_var->i_hash % VAR_HASH_SIZE];
+
+    atomic_store( &p_var->next, atomic_load( p_head ) );
+    atomic_store( p_head, (uintptr_t)p_var );
+}
+
+/**
+ * Removes a variable from the hash index, with the variable lock held.
+ *
+ * The variable is retired rather than freed, as lock-free readers may still
+ * be looking at it: the retired variables are released together as soon as
+ * no readers are counted after the removal.
+ *
+ * \return the list of the variables that can be destroyed (or NULL)
+ */
+static variable_t *Unpublish( vlc_object_internals_t *priv,
+                              variable_t *p_var )
+{
+    atomic_uintptr_t *pp = &priv->var_hash[p_var->i_hash % VAR_HASH_SIZE];
+
+    while( atomic_load( pp ) != (uintptr_t)p_var )
+        pp = &((variable_t *)atomic_load( pp ))->next;
+    /* The removed variable keeps its link, for the readers still on it */
+    atomic_store( pp, atomic_load( &p_var->next ) );
+
+    p_var->p_retired = priv->var_retired;
+    priv->var_retired = p_var;
+
+    /* Readers counted from now on cannot reach any retired variable */
+    if( atomic_load( &priv->var_readers ) != 0 )
+        return NULL;
+
+    p_var = priv->var_retired;
+    priv->var_retired = NULL;
+    return p_var;
+}
+
+/**
+ * Starts a change of the value of a variable, with the variable lock held.
+ * The lock-free readers retry until WriteEnd().
+ */
+static void WriteBegin( variable_t *p_var )
+{
+    unsigned seq = atomic_load_explicit( &p_var->i_seq, memory_order_relaxed );
+
+    atomic_store_explicit( &p_var->i_seq, seq + 1, memory_order_relaxed );
+    atomic_thread_fence( memory_order_release );
+}
+
+static void WriteEnd( variable_t *p_var )
+{
+    unsigned seq = atomic_load_explicit( &p_var->i_seq, memory_order_relaxed );
+
+    atomic_store_explicit( &p_var->i_seq, seq + 1, memory_order_release );
+}
+
+static void SetValue( variable_t *p_var, vlc_value_t val )
+{
+    WriteBegin( p_var );
+    p_var->val = val;
+    WriteEnd( p_var );
+}
+
+/**
+ * Checks the current value again, after the limits or the choices changed.
+ */
+static void RecheckValue( variable_t *p_var )
+{
+    WriteBegin( p_var );
+    CheckValue( p_var, &p_var->val );
+    WriteEnd( p_var );
+}
+
+/**
+ * Reads the value of a variable without the variable lock (sequence lock).
+ * Only for values that need no duplication: a string could be freed while
+ * it is being copied.
+ */
+static void ReadValue( variable_t *p_var, vlc_value_t *p_val )
+{
+    unsigned seq;
+
+    do
+    {
+        seq = atomic_load_explicit( &p_var->i_seq, memory_order_acquire );
+        *p_val = p_var->val;
+        atomic_thread_fence( memory_order_acquire );
+    }
+    while( (seq & 1)
+        || seq != atomic_load_explicit( &p_var->i_seq,
+                                        memory_order_relaxed ) );
 }
 
 static void Destroy( variable_t *p_var )
@@ -193,6 +328,17 @@ static void Destroy( variable_t *p_var )
     free( p_var );
 }
 
+static void DestroyRetired( variable_t *p_var )
+{
+    while( p_var != NULL )
+    {
+        variable_t *p_next = p_var->p_retired;
+
+        Destroy( p_var );
+        p_var = p_next;
+    }
+}
+
 #undef var_Create
 /**
  * Initialize a vlc variable
@@ -216,6 +362,10 @@ int var_Create( vlc_object_t *p_this, const char *psz_name, int i_type )
 
     p_var->psz_name = strdup( psz_name );
     p_var->psz_text = NULL;
+    p_var->i_hash = HashName( psz_name );
+    atomic_init( &p_var->next, 0 );
+    atomic_init( &p_var->i_seq, 0 );
+    p_var->p_retired = NULL;
 
     p_var->i_type = i_type & ~VLC_VAR_DOINHERIT;
 
@@ -298,7 +448,10 @@ int var_Create( vlc_object_t *p_this, const char *psz_name, int i_type )
     if( unlikely(pp_var == NULL) )
         ret = VLC_ENOMEM;
     else if( (p_oldvar = *pp_var) == p_var ) /* Variable create */
+    {
+        Publish( p_priv, p_var );
         p_var = NULL; /* Variable created */
+    }
     else /* Variable already exists */
     {
         assert (((i_type ^ p_oldvar->i_type) & VLC_VAR_CLASS) == 0);
@@ -343,13 +496,15 @@ int var_Destroy( vlc_object_t *p_this, const char *psz_name )
     WaitUnused( p_this, p_var );
 
     if( --p_var->i_usage == 0 )
+    {
         tdelete( p_var, &p_priv->var_root, varcmp );
+        p_var = Unpublish( p_priv, p_var );
+    }
     else
         p_var = NULL;
     vlc_mutex_unlock( &p_priv->var_lock );
 
-    if( p_var != NULL )
-        Destroy( p_var );
+    DestroyRetired( p_var );
     return VLC_SUCCESS;
 }
 
@@ -362,8 +517,13 @@ void var_DestroyAll( vlc_object_t *obj )
 {
     vlc_object_internals_t *priv = vlc_internals( obj );
 
+    assert( atomic_load( &priv->var_readers ) == 0 );
     tdestroy( priv->var_root, CleanupVar );
     priv->var_root = NULL;
+    for( unsigned i = 0; i < VAR_HASH_SIZE; i++ )
+        atomic_store( &priv->var_hash[i], 0 );
+    DestroyRetired( priv->var_retired );
+    priv->var_retired = NULL;
 }
 
 #undef var_Change
@@ -407,7 +567,7 @@ int var_Change( vlc_object_t *p_this, const char *psz_name,
             p_var->i_type |= VLC_VAR_HASMIN;
             p_var->min = *p_val;
             p_var->ops->pf_dup( &p_var->min );
-            CheckValue( p_var, &p_var->val );
+            RecheckValue( p_var );
             break;
         case VLC_VAR_GETMIN:
             if( p_var->i_type & VLC_VAR_HASMIN )
@@ -423,7 +583,7 @@ int var_Change( vlc_object_t *p_this, const char *psz_name,
             p_var->i_type |= VLC_VAR_HASMAX;
             p_var->max = *p_val;
             p_var->ops->pf_dup( &p_var->max );
-            CheckValue( p_var, &p_var->val );
+            RecheckValue( p_var );
             break;
         case VLC_VAR_GETMAX:
             if( p_var->i_type & VLC_VAR_HASMAX )
@@ -439,7 +599,7 @@ int var_Change( vlc_object_t *p_this, const char *psz_name,
             p_var->i_type |= VLC_VAR_HASSTEP;
             p_var->step = *p_val;
             p_var->ops->pf_dup( &p_var->step );
-            CheckValue( p_var, &p_var->val );
+            RecheckValue( p_var );
             break;
         case VLC_VAR_GETSTEP:
             if( p_var->i_type & VLC_VAR_HASSTEP )
@@ -460,7 +620,7 @@ int var_Change( vlc_object_t *p_this, const char *psz_name,
                 ( p_val2 && p_val2->psz_string ) ?
                 strdup( p_val2->psz_string ) : NULL;
 
-            CheckValue( p_var, &p_var->val );
+            RecheckValue( p_var );
             break;
         }
         case VLC_VAR_DELCHOICE:
@@ -489,7 +649,7 @@ int var_Change( vlc_object_t *p_this, const char *psz_name,
             REMOVE_ELEM( p_var->choices_text.p_values,
                          p_var->choices_text.i_count, i );
 
-            CheckValue( p_var, &p_var->val );
+            RecheckValue( p_var );
             break;
         }
         case VLC_VAR_CHOICESCOUNT:
@@ -523,7 +683,7 @@ int var_Change( vlc_object_t *p_this, const char *psz_name,
                 break;
 
             p_var->i_default = i;
-            CheckValue( p_var, &p_var->val );
+            RecheckValue( p_var );
             break;
         }
         case VLC_VAR_SETVALUE:
@@ -535,7 +695,7 @@ int var_Change( vlc_object_t *p_this, const char *psz_name,
             /* Check boundaries and list */
             CheckValue( p_var, &newval );
             /* Set the variable */
-            p_var->val = newval;
+            SetValue( p_var, newval );
             /* Free data if needed */
             p_var->ops->pf_free( &oldval );
             break;
@@ -612,7 +772,7 @@ int var_GetAndSet( vlc_object_t *p_this, const char *psz_name, int i_action,
 {
     int i_ret;
     variable_t *p_var;
-    vlc_value_t oldval;
+    vlc_value_t oldval, newval;
 
     assert( p_this );
     assert( p_val );
@@ -633,26 +793,26 @@ int var_GetAndSet( vlc_object_t *p_this, const char *psz_name, int i_action,
     //p_var->ops->pf_dup( &val );
 
     /* Backup needed stuff */
-    oldval = p_var->val;
+    oldval = newval = p_var->val;
 
     /* depending of the action requiered */
     switch( i_action )
     {
     case VLC_VAR_BOOL_TOGGLE:
         assert( ( p_var->i_type & VLC_VAR_BOOL ) == VLC_VAR_BOOL );
-        p_var->val.b_bool = !p_var->val.b_bool;
+        newval.b_bool = !newval.b_bool;
         break;
     case VLC_VAR_INTEGER_ADD:
         assert( ( p_var->i_type & VLC_VAR_INTEGER ) == VLC_VAR_INTEGER );
-        p_var->val.i_int += p_val->i_int;
+        newval.i_int += p_val->i_int;
         break;
     case VLC_VAR_INTEGER_OR:
         assert( ( p_var->i_type & VLC_VAR_INTEGER ) == VLC_VAR_INTEGER );
-        p_var->val.i_int |= p_val->i_int;
+        newval.i_int |= p_val->i_int;
         break;
     case VLC_VAR_INTEGER_NAND:
         assert( ( p_var->i_type & VLC_VAR_INTEGER ) == VLC_VAR_INTEGER );
-        p_var->val.i_int &= ~p_val->i_int;
+        newval.i_int &= ~p_val->i_int;
         break;
     default:
         vlc_mutex_unlock( &p_priv->var_lock );
@@ -660,8 +820,9 @@ int var_GetAndSet( vlc_object_t *p_this, const char *psz_name, int i_action,
     }
 
     /*  Check boundaries */
-    CheckValue( p_var, &p_var->val );
-    *p_val = p_var->val;
+    CheckValue( p_var, &newval );
+    SetValue( p_var, newval );
+    *p_val = newval;
 
     /* Deal with callbacks.*/
     i_ret = TriggerCallback( p_this, p_var, psz_name, oldval );
@@ -736,7 +897,7 @@ int var_SetChecked( vlc_object_t *p_this, const char *psz_name,
     CheckValue( p_var, &val );
 
     /* Set the variable */
-    p_var->val = val;
+    SetValue( p_var, val );
 
     /* Deal with callbacks */
     i_ret = TriggerCallback( p_this, p_var, psz_name, oldval );
@@ -762,38 +923,57 @@ int var_Set( vlc_object_t *p_this, const char *psz_name, vlc_value_t val )
     return var_SetChecked( p_this, psz_name, 0, val );
 }
 
-#undef var_GetChecked
-int var_GetChecked( vlc_object_t *p_this, const char *psz_name,
-                    int expected_type, vlc_value_t *p_val )
+/**
+ * Gets the value of a variable from its hashed name.
+ *
+ * Neither the lookup nor the read of a value that needs no duplication take
+ * the variable lock, so that readers never wait for the writers. Strings
+ * are still copied with the lock held.
+ */
+static int GetChecked( vlc_object_t *p_this, const char *psz_name,
+                       uint32_t i_hash, int expected_type, vlc_value_t *p_val )
 {
-    assert( p_this );
-
     vlc_object_internals_t *p_priv = vlc_internals( p_this );
     variable_t *p_var;
     int err = VLC_SUCCESS;
 
-    vlc_mutex_lock( &p_priv->var_lock );
+    atomic_fetch_add( &p_priv->var_readers, 1 );
 
-    p_var = Lookup( p_this, psz_name );
+    p_var = LookupHash( p_priv, psz_name, i_hash );
     if( p_var != NULL )
     {
         assert( expected_type == 0 ||
                 (p_var->i_type & VLC_VAR_CLASS) == expected_type );
         assert ((p_var->i_type & VLC_VAR_CLASS) != VLC_VAR_VOID);
 
-        /* Really get the variable */
-        *p_val = p_var->val;
-
-        /* Duplicate value if needed */
-        p_var->ops->pf_dup( p_val );
+        if( p_var->ops->pf_dup != DupDummy )
+        {
+            /* Really get the variable, and duplicate it */
+            vlc_mutex_lock( &p_priv->var_lock );
+            *p_val = p_var->val;
+            p_var->ops->pf_dup( p_val );
+            vlc_mutex_unlock( &p_priv->var_lock );
+        }
+        else
+            ReadValue( p_var, p_val );
     }
     else
         err = VLC_ENOVAR;
 
-    vlc_mutex_unlock( &p_priv->var_lock );
+    atomic_fetch_sub( &p_priv->var_readers, 1 );
     return err;
 }
 
+#undef var_GetChecked
+int var_GetChecked( vlc_object_t *p_this, const char *psz_name,
+                    int expected_type, vlc_value_t *p_val )
+{
+    assert( p_this );
+
+    return GetChecked( p_this, psz_name, HashName( psz_name ), expected_type,
+                       p_val );
+}
+
 #undef var_Get
 /**
  * Get a variable's value
@@ -1208,10 +1388,12 @@ static void CheckValue ( variable_t *p_var, vlc_value_t *p_val )
 int var_Inherit( vlc_object_t *p_this, const char *psz_name, int i_type,
                  vlc_value_t *p_val )
 {
+    uint32_t i_hash = HashName( psz_name );
+
     i_type &= VLC_VAR_CLASS;
     for( vlc_object_t *obj = p_this; obj != NULL; obj = obj->p_parent )
     {
-        if( var_GetChecked( obj, psz_name, i_type, p_val ) == VLC_SUCCESS )
+        if( GetChecked( obj, psz_name, i_hash, i_type, p_val ) == VLC_SUCCESS )
             return VLC_SUCCESS;
     }
 
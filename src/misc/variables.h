@@ -30,12 +30,18 @@
  */
 typedef struct vlc_object_internals vlc_object_internals_t;
 
+/** Number of buckets of the per-object variable hash index */
+# define VAR_HASH_SIZE 32
+
 struct vlc_object_internals
 {
     char           *psz_name; /* given name */
 
     /* Object variables */
     void           *var_root;
+    atomic_uintptr_t var_hash[VAR_HASH_SIZE]; /* lock-free lookup index */
+    atomic_uint     var_readers; /* lock-free lookups in progress */
+    variable_t     *var_retired; /* unlinked variables not yet freed */
     vlc_mutex_t     var_lock;
     vlc_cond_t      var_wait;
 
@@ -103,6 +109,15 @@ struct variable_t
     int                i_entries;
     /** Array of registered callbacks */
     callback_entry_t * p_entries;
+
+    /** Hash of the name */
+    uint32_t     i_hash;
+    /** Next variable in the same hash bucket */
+    atomic_uintptr_t next;
+    /** Value sequence counter, odd while the value is being written */
+    atomic_uint  i_seq;
+    /** Next unlinked variable waiting for the lock-free readers to leave */
+    variable_t * p_retired;
 };
 
 extern void var_DestroyAll( vlc_object_t * );
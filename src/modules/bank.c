@@ -47,12 +47,22 @@
 #include "config/configuration.h"
 #include "modules/modules.h"
 
+/** Modules providing a capability, sorted by decreasing score */
+typedef struct
+{
+    const char *name;
+    module_t **modv;
+    size_t modc;
+} vlc_modcap_t;
+
 static struct
 {
     vlc_mutex_t lock;
     module_t *head;
     unsigned usage;
-} modules = { VLC_STATIC_MUTEX, NULL, 0 };
+    vlc_modcap_t *caps; /**< Capabilities index, sorted by name */
+    size_t caps_count;
+} modules = { VLC_STATIC_MUTEX, NULL, 0, NULL, 0 };
 
 /*****************************************************************************
  * Local prototypes
@@ -61,6 +71,8 @@ static struct
 static void AllocateAllPlugins (vlc_object_t *);
 #endif
 static module_t *module_InitStatic (vlc_plugin_cb);
+static void module_IndexCaps (void);
+static void module_UnindexCaps (void);
 
 static void module_StoreBank (module_t *module)
 {
@@ -113,6 +125,7 @@ void module_InitBank (void)
         if (likely(module != NULL))
             module_StoreBank (module);
         config_SortConfig ();
+        module_IndexCaps ();
     }
     modules.usage++;
 
@@ -145,6 +158,7 @@ void module_EndBank (bool b_plugins)
     if (--modules.usage == 0)
     {
         config_UnsortConfig ();
+        module_UnindexCaps ();
         head = modules.head;
         modules.head = NULL;
     }
@@ -187,6 +201,7 @@ size_t module_LoadPlugins (vlc_object_t *obj)
 #endif
         config_UnsortConfig ();
         config_SortConfig ();
+        module_IndexCaps ();
     }
     vlc_mutex_unlock (&modules.lock);
 
@@ -249,6 +264,109 @@ static int modulecmp (const void *a, const void *b)
     return (*mb)->i_score - (*ma)->i_score;
 }
 
+typedef struct
+{
+    module_t *module;
+    size_t rank; /**< Position in the bank */
+} vlc_modrank_t;
+
+static int modulecapcmp (const void *a, const void *b)
+{
+    const vlc_modrank_t *ma = a, *mb = b;
+    int ret = strcmp (module_get_capability (ma->module),
+                      module_get_capability (mb->module));
+    /* Keep the bank order within a capability, as qsort() is not stable */
+    if (ret == 0)
+        ret = (ma->rank > mb->rank) - (ma->rank < mb->rank);
+    return ret;
+}
+
+static int capcmp (const void *key, const void *elem)
+{
+    const vlc_modcap_t *cap = elem;
+    return strcmp (key, cap->name);
+}
+
+static void module_UnindexCaps (void)
+{
+    /*vlc_assert_locked (&modules.lock);*/
+    if (modules.caps_count > 0)
+        free (modules.caps[0].modv);
+    free (modules.caps);
+    modules.caps = NULL;
+    modules.caps_count = 0;
+}
+
+/**
+ * Builds the index of the modules by capability.
+ * This is done whenever modules are added to the bank, so that
+ * module_list_cap() does not walk and sort the whole bank on every call.
+ */
+static void module_IndexCaps (void)
+{
+    vlc_modrank_t *ranks = NULL;
+    size_t n;
+
+    /*vlc_assert_locked (&modules.lock);*/
+    module_UnindexCaps ();
+
+    module_t **tab = module_list_get (&n);
+    if (unlikely(tab == NULL) || n == 0)
+        goto out;
+
+    ranks = malloc (n * sizeof (*ranks));
+    if (unlikely(ranks == NULL))
+        goto out;
+    for (size_t i = 0; i < n; i++)
+    {
+        ranks[i].module = tab[i];
+        ranks[i].rank = i;
+    }
+    qsort (ranks, n, sizeof (*ranks), modulecapcmp);
+
+    /* All the modules of a capability are contiguous in tab[] */
+    size_t count = 1;
+    for (size_t i = 0; i < n; i++)
+    {
+        tab[i] = ranks[i].module;
+        if (i > 0 && strcmp (module_get_capability (tab[i - 1]),
+                             module_get_capability (tab[i])))
+            count++;
+    }
+
+    vlc_modcap_t *caps = malloc (count * sizeof (*caps));
+    if (unlikely(caps == NULL))
+        goto out;
+
+    vlc_modcap_t *cap = caps;
+    cap->name = module_get_capability (tab[0]);
+    cap->modv = tab;
+    cap->modc = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (strcmp (cap->name, module_get_capability (tab[i])))
+        {
+            cap++;
+            cap->name = module_get_capability (tab[i]);
+            cap->modv = tab + i;
+            cap->modc = 0;
+        }
+        cap->modc++;
+    }
+    assert (cap == caps + count - 1);
+
+    /* Same order as when sorting the bank walk (see module_list_cap()) */
+    for (size_t i = 0; i < count; i++)
+        qsort (caps[i].modv, caps[i].modc, sizeof (module_t *), modulecmp);
+
+    modules.caps = caps;
+    modules.caps_count = count;
+    tab = NULL; /* owned by the index */
+out:
+    free (ranks);
+    module_list_free (tab);
+}
+
 /**
  * Builds a sorted list of all VLC modules with a given capability.
  * The list is sorted from the highest module score to the lowest.
@@ -259,36 +377,24 @@ static int modulecmp (const void *a, const void *b)
  */
 ssize_t module_list_cap (module_t ***restrict list, const char *cap)
 {
-    /* TODO: This is quite inefficient. List should be sorted by capability. */
-    ssize_t n = 0;
+    const vlc_modcap_t *entry;
+    size_t n = 0;
 
     assert (list != NULL);
 
-    for (module_t *mod = modules.head; mod != NULL; mod = mod->next)
-    {
-         if (module_provides (mod, cap))
-             n++;
-         for (module_t *subm = mod->submodule; subm != NULL; subm = subm->next)
-             if (module_provides (subm, cap))
-                 n++;
-    }
+    /* The index is read-only once the bank is ready, like the bank itself */
+    entry = bsearch (cap, modules.caps, modules.caps_count,
+                     sizeof (*modules.caps), capcmp);
+    if (entry != NULL)
+        n = entry->modc;
 
     module_t **tab = malloc (sizeof (*tab) * n);
     *list = tab;
     if (unlikely(tab == NULL))
         return -1;
 
-    for (module_t *mod = modules.head; mod != NULL; mod = mod->next)
-    {
-         if (module_provides (mod, cap))
-             *(tab++)= mod;
-         for (module_t *subm = mod->submodule; subm != NULL; subm = subm->next)
-             if (module_provides (subm, cap))
-                 *(tab++) = subm;
-    }
-
-    assert (tab == *list + n);
-    qsort (*list, n, sizeof (*tab), modulecmp);
+    if (n > 0)
+        memcpy (tab, entry->modv, sizeof (*tab) * n);
     return n;
 }
 
@@ -359,8 +465,10 @@ typedef struct module_bank
     size_t         i_cache;
     module_cache_t *cache;
 
-    int            i_loaded_cache;
+    size_t         i_loaded_cache;
+    size_t         i_loaded_hint;
     module_cache_t *loaded_cache;
+    bool           b_cache_dirty; /* the cache must be saved */
 } module_bank_t;
 
 static void AllocatePluginDir (module_bank_t *, unsigned,
@@ -375,12 +483,13 @@ static void AllocatePluginPath (vlc_object_t *p_this, const char *path,
 {
     module_bank_t bank;
     module_cache_t *cache = NULL;
+    struct cache_file *file = NULL;
     size_t count = 0;
 
     switch( mode )
     {
         case CACHE_USE:
-            count = CacheLoad( p_this, path, &cache );
+            count = CacheLoad( p_this, path, &cache, &file );
             break;
         case CACHE_RESET:
             CacheDelete( p_this, path );
@@ -398,6 +507,8 @@ static void AllocatePluginPath (vlc_object_t *p_this, const char *path,
     bank.i_cache = 0;
     bank.loaded_cache = cache;
     bank.i_loaded_cache = count;
+    bank.i_loaded_hint = 0;
+    bank.b_cache_dirty = mode == CACHE_RESET;
 
     /* Don't go deeper than 5 subdirectories */
     AllocatePluginDir (&bank, 5, path, NULL);
@@ -409,10 +520,22 @@ static void AllocatePluginPath (vlc_object_t *p_this, const char *path,
             for( size_t i = 0; i < count; i++ )
             {
                 if (cache[i].p_module != NULL)
+                {
                    vlc_module_destroy (cache[i].p_module);
-                free (cache[i].path);
+                   bank.b_cache_dirty = true;
+                }
             }
             free( cache );
+            if (file != NULL)
+                CacheRelease (file);
+            /* Only rewrite the cache if it does not match the plug-ins */
+            if (!bank.b_cache_dirty)
+            {
+                for (size_t i = 0; i < bank.i_cache; i++)
+                    free (bank.cache[i].path);
+                free (bank.cache);
+                break;
+            }
         case CACHE_RESET:
             CacheSave (p_this, path, bank.cache, bank.i_cache);
         case CACHE_IGNORE:
@@ -514,7 +637,7 @@ static int AllocatePluginFile (module_bank_t *bank, const char *abspath,
     if (bank->mode == CACHE_USE)
     {
         module = CacheFind (bank->loaded_cache, bank->i_loaded_cache,
-                            relpath, st);
+                            &bank->i_loaded_hint, relpath, st);
         if (module != NULL)
         {
             module->psz_filename = strdup (abspath);
@@ -526,7 +649,10 @@ static int AllocatePluginFile (module_bank_t *bank, const char *abspath,
         }
     }
     if (module == NULL)
+    {
         module = module_InitDynamic (bank->obj, abspath, true);
+        bank->b_cache_dirty = true;
+    }
     if (module == NULL)
         return -1;
 
@@ -33,15 +33,20 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #ifdef HAVE_UNISTD_H
 #   include <unistd.h>
 #endif
+#ifdef HAVE_MMAP
+#   include <sys/mman.h>
+#endif
 #include <assert.h>
 
 #include <vlc_common.h>
 #include "libvlc.h"
 
 #include <vlc_plugin.h>
+#include <vlc_atomic.h>
 #include <errno.h>
 
 #include "config/configuration.h"
@@ -57,12 +62,18 @@
 #ifdef HAVE_DYNAMIC_PLUGINS
 /* Sub-version number
  * (only used to avoid breakage in dev version when cache structure changes) */
-#define CACHE_SUBVERSION_NUM 22
+#define CACHE_SUBVERSION_NUM 23
 
 /* Cache filename */
 #define CACHE_NAME "plugins.dat"
 /* Magic for the cache filename */
 #define CACHE_STRING "cache "PACKAGE_NAME" "PACKAGE_VERSION
+#ifdef DISTRO_VERSION
+/* Allow binary maintaner to pass a string to detect new binary version*/
+# define CACHE_MAGIC CACHE_STRING DISTRO_VERSION
+#else
+# define CACHE_MAGIC CACHE_STRING
+#endif
 
 
 void CacheDelete( vlc_object_t *obj, const char *dir )
@@ -78,144 +89,522 @@ void CacheDelete( vlc_object_t *obj, const char *dir )
     free( path );
 }
 
-#define LOAD_IMMEDIATE(a) \
-    if (fread (&(a), sizeof (char), sizeof (a), file) != sizeof (a)) \
-        goto error
-#define LOAD_FLAG(a) \
-    do { \
-        unsigned char b; \
-        LOAD_IMMEDIATE(b); \
-        if (b > 1) \
-            goto error; \
-        (a) = b; \
-    } while (0)
-
-static int CacheLoadString (char **p, FILE *file)
-{
-    char *psz = NULL;
-    uint16_t size;
-
-    LOAD_IMMEDIATE (size);
-    if (size > 16384)
+/*
+ * The cache file is a position-independent image which is used in place, be
+ * it mapped or read in memory with a single call: the records are arrays of
+ * fixed-size structures referring to each other by index, and the strings
+ * are offsets within a table of deduplicated nul-terminated strings.
+ * Offset zero of the table is an empty string standing for NULL.
+ */
+typedef struct
+{
+    uint32_t offset; /**< From the start of the file, aligned on 8 bytes */
+    uint32_t count; /**< Number of records (bytes for the string table) */
+} cache_section_t;
+
+typedef struct
+{
+    uint32_t subversion;
+    uint32_t byte_order;
+    uint32_t file_size;
+    uint32_t reserved;
+    cache_section_t plugins;
+    cache_section_t modules;
+    cache_section_t configs;
+    cache_section_t lists;
+    cache_section_t strings;
+} cache_header_t;
+
+typedef struct
+{
+    int64_t  mtime;
+    int64_t  size;
+    uint32_t path;
+    uint32_t domain;
+    uint32_t module; /**< First module record, the plugin itself */
+    uint32_t submodule_count; /**< Following module records */
+    uint32_t config; /**< First configuration record */
+    uint32_t config_count;
+    uint32_t config_items;
+    uint32_t bool_items;
+    uint8_t  unloadable;
+} cache_plugin_t;
+
+typedef struct
+{
+    uint32_t shortname;
+    uint32_t longname;
+    uint32_t help;
+    uint32_t capability;
+    int32_t  score;
+    uint32_t shortcuts; /**< First list word (string offsets) */
+    uint32_t shortcut_count;
+} cache_module_t;
+
+typedef union
+{
+    int64_t i;
+    float   f;
+} cache_value_t;
+
+typedef struct
+{
+    cache_value_t orig; /**< String offset for string items */
+    cache_value_t min;
+    cache_value_t max;
+    uint64_t list_cb; /**< Choices callback if no list (see CacheLoadConfig) */
+    uint32_t type_name;
+    uint32_t name;
+    uint32_t text;
+    uint32_t longtext;
+    uint32_t list; /**< First list word (values or string offsets) */
+    uint32_t list_text; /**< First list word (string offsets) */
+    uint16_t list_count;
+    uint8_t  type;
+    uint8_t  flags;
+    char     short_name;
+} cache_config_t;
+
+#define CACHE_BYTE_ORDER 0x01020304
+
+#define CACHE_CONFIG_ADVANCED   0x01
+#define CACHE_CONFIG_INTERNAL   0x02
+#define CACHE_CONFIG_UNSAVEABLE 0x04
+#define CACHE_CONFIG_SAFE       0x08
+#define CACHE_CONFIG_REMOVED    0x10
+
+#define CACHE_ALIGN(x) (((x) + 15) & ~(size_t)15)
+#define CACHE_SECTION_ALIGN(x) (((x) + 7) & ~(size_t)7)
+#define CACHE_HEADER_OFFSET CACHE_SECTION_ALIGN(sizeof (CACHE_MAGIC))
+
+/** Plugins cache file image, shared by the modules loaded from it */
+struct cache_file
+{
+    atomic_uint refs;
+    bool mapped;
+    size_t size;
+    const unsigned char *data;
+
+    const cache_plugin_t *plugins;
+    const cache_module_t *modules;
+    const cache_config_t *configs;
+    const uint32_t *lists;
+    const char *strings;
+    cache_header_t header;
+};
+
+/** Single allocation holding the descriptors of a cached plugin */
+typedef struct
+{
+    struct cache_file *file;
+    module_t modules[];
+} cache_block_t;
+
+void CacheRelease (struct cache_file *file)
+{
+    if (atomic_fetch_sub (&file->refs, 1) != 1)
+        return;
+
+#ifdef HAVE_MMAP
+    if (file->mapped)
+        munmap ((void *)file->data, file->size);
+    else
+#endif
+        free ((void *)file->data);
+    free (file);
+}
+
+static struct cache_file *CacheOpen (vlc_object_t *obj, const char *path)
+{
+    struct cache_file *file;
+    struct stat st;
+    void *data = NULL;
+
+    int fd = vlc_open (path, O_RDONLY);
+    if (fd == -1)
+    {
+        msg_Warn (obj, "cannot read %s (%m)", path);
+        return NULL;
+    }
+
+    if (fstat (fd, &st) || st.st_size < 0 || st.st_size > UINT32_MAX)
+        goto error;
+
+    file = malloc (sizeof (*file));
+    if (unlikely(file == NULL))
+        goto error;
+
+    atomic_init (&file->refs, 1);
+    file->size = st.st_size;
+    file->mapped = false;
+#ifdef HAVE_MMAP
+    if (file->size > 0)
     {
+        data = mmap (NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+            file->mapped = true;
+        else
+            data = NULL;
+    }
+#endif
+    if (data == NULL)
+    {   /* If mmap() is not implemented by the OS _or_ the filesystem... */
+        size_t done = 0;
+
+        data = malloc (file->size ? file->size : 1);
+        if (unlikely(data == NULL))
+        {
+            free (file);
+            goto error;
+        }
+
+        while (done < file->size)
+        {
+            ssize_t val = read (fd, (char *)data + done, file->size - done);
+            if (val <= 0)
+            {
+                if (val < 0 && errno == EINTR)
+                    continue;
+                free (data);
+                free (file);
+                goto error;
+            }
+            done += val;
+        }
+    }
+    close (fd);
+
+    file->data = data;
+    return file;
+
 error:
+    msg_Warn (obj, "cannot read %s (%m)", path);
+    close (fd);
+    return NULL;
+}
+
+static bool CacheCheckSection (const struct cache_file *file,
+                               const cache_section_t *section, size_t size)
+{
+    return (section->offset % 8) == 0
+        && section->offset <= file->size
+        && section->count <= (file->size - section->offset) / size;
+}
+
+/** Validates the header of the cache file and locates the sections. */
+static int CacheCheckFile (struct cache_file *file)
+{
+    const cache_header_t *header;
+
+    if (file->size < CACHE_HEADER_OFFSET + sizeof (*header)
+     || memcmp (file->data, CACHE_MAGIC, sizeof (CACHE_MAGIC)))
+        return -1;
+
+    header = (const cache_header_t *)(file->data + CACHE_HEADER_OFFSET);
+    if (header->subversion != CACHE_SUBVERSION_NUM
+     || header->byte_order != CACHE_BYTE_ORDER
+     || header->file_size != file->size)
+        return -1;
+
+    if (!CacheCheckSection (file, &header->plugins, sizeof (cache_plugin_t))
+     || !CacheCheckSection (file, &header->modules, sizeof (cache_module_t))
+     || !CacheCheckSection (file, &header->configs, sizeof (cache_config_t))
+     || !CacheCheckSection (file, &header->lists, sizeof (uint32_t))
+     || !CacheCheckSection (file, &header->strings, 1))
+        return -1;
+
+    /* Any string offset within the table is terminated */
+    file->strings = (const char *)(file->data + header->strings.offset);
+    if (header->strings.count == 0
+     || file->strings[0] != '\0'
+     || file->strings[header->strings.count - 1] != '\0')
         return -1;
+
+    file->plugins = (const void *)(file->data + header->plugins.offset);
+    file->modules = (const void *)(file->data + header->modules.offset);
+    file->configs = (const void *)(file->data + header->configs.offset);
+    file->lists = (const void *)(file->data + header->lists.offset);
+    file->header = *header;
+    return 0;
+}
+
+static bool CacheCheckString (const struct cache_file *file, uint32_t offset)
+{
+    return offset < file->header.strings.count;
+}
+
+static bool CacheCheckList (const struct cache_file *file,
+                            uint32_t first, uint32_t count)
+{
+    return first <= file->header.lists.count
+        && count <= file->header.lists.count - first;
+}
+
+/** Gets a string from the table, NULL if the offset is zero. */
+static char *CacheString (const struct cache_file *file, uint32_t offset)
+{
+    return offset ? (char *)file->strings + offset : NULL;
+}
+
+/** Gets a string from the table, empty if the offset is zero. */
+static char *CacheListString (const struct cache_file *file, uint32_t offset)
+{
+    return (char *)file->strings + offset;
+}
+
+/**
+ * Validates the records of a plugin, and counts the pointers needed by its
+ * shortcuts and choices lists.
+ */
+static int CacheCheckPlugin (const struct cache_file *file,
+                             const cache_plugin_t *plugin, size_t *pointers)
+{
+    const cache_header_t *header = &file->header;
+    size_t count = 0;
+
+    if (plugin->module >= header->modules.count
+     || plugin->submodule_count >= header->modules.count - plugin->module
+     || plugin->config > header->configs.count
+     || plugin->config_count > header->configs.count - plugin->config
+     || !CacheCheckString (file, plugin->path) || plugin->path == 0
+     || !CacheCheckString (file, plugin->domain)
+     || plugin->unloadable > 1)
+        return -1;
+
+    for (size_t i = 0; i <= plugin->submodule_count; i++)
+    {
+        const cache_module_t *m = file->modules + plugin->module + i;
+
+        if (!CacheCheckString (file, m->shortname)
+         || !CacheCheckString (file, m->longname)
+         || !CacheCheckString (file, m->help)
+         || !CacheCheckString (file, m->capability)
+         || m->shortcut_count > MODULE_SHORTCUT_MAX
+         || !CacheCheckList (file, m->shortcuts, m->shortcut_count))
+            return -1;
+        for (size_t j = 0; j < m->shortcut_count; j++)
+            if (!CacheCheckString (file, file->lists[m->shortcuts + j]))
+                return -1;
+        count += m->shortcut_count;
     }
 
-    if (size > 0)
+    for (size_t i = 0; i < plugin->config_count; i++)
     {
-        psz = malloc (size+1);
-        if (unlikely(psz == NULL))
-            goto error;
-        if (fread (psz, 1, size, file) != size)
+        const cache_config_t *c = file->configs + plugin->config + i;
+
+        if (!CacheCheckString (file, c->type_name)
+         || !CacheCheckString (file, c->name)
+         || !CacheCheckString (file, c->text)
+         || !CacheCheckString (file, c->longtext)
+         || !CacheCheckList (file, c->list, c->list_count)
+         || !CacheCheckList (file, c->list_text, c->list_count))
+            return -1;
+
+        if (IsConfigStringType (c->type))
         {
-            free (psz);
-            goto error;
+            if (c->orig.i < 0 || c->orig.i > UINT32_MAX
+             || !CacheCheckString (file, c->orig.i))
+                return -1;
+            for (size_t j = 0; j < c->list_count; j++)
+                if (!CacheCheckString (file, file->lists[c->list + j]))
+                    return -1;
+            count += c->list_count;
         }
-        psz[size] = '\0';
+        for (size_t j = 0; j < c->list_count; j++)
+            if (!CacheCheckString (file, file->lists[c->list_text + j]))
+                return -1;
+        count += c->list_count;
     }
-    *p = psz;
+
+    *pointers = count;
     return 0;
 }
 
-#define LOAD_STRING(a) \
-    if (CacheLoadString (&(a), file)) goto error
+static void CacheLoadModule (struct cache_file *file, module_t *module,
+                             const cache_module_t *m, char ***pointers)
+{
+    module->psz_shortname = CacheString (file, m->shortname);
+    module->psz_longname = CacheString (file, m->longname);
+    module->psz_help = CacheString (file, m->help);
+    module->psz_capability = CacheString (file, m->capability);
+    module->i_score = m->score;
+
+    module->i_shortcuts = m->shortcut_count;
+    module->pp_shortcuts = *pointers;
+    for (unsigned i = 0; i < m->shortcut_count; i++)
+        module->pp_shortcuts[i] =
+            CacheListString (file, file->lists[m->shortcuts + i]);
+    *pointers += m->shortcut_count;
+
+    module->b_loaded = false;
+    module->pf_activate = NULL;
+    module->pf_deactivate = NULL;
+    module->p_config = NULL;
+    module->confsize = 0;
+    module->i_config_items = 0;
+    module->i_bool_items = 0;
+    module->handle = NULL;
+    module->psz_filename = NULL;
+    module->domain = NULL;
+}
 
-static int CacheLoadConfig (module_config_t *cfg, FILE *file)
+static int CacheLoadConfig (struct cache_file *file, module_config_t *cfg,
+                            const cache_config_t *c, char ***pointers)
 {
-    LOAD_IMMEDIATE (cfg->i_type);
-    LOAD_IMMEDIATE (cfg->i_short);
-    LOAD_FLAG (cfg->b_advanced);
-    LOAD_FLAG (cfg->b_internal);
-    LOAD_FLAG (cfg->b_unsaveable);
-    LOAD_FLAG (cfg->b_safe);
-    LOAD_FLAG (cfg->b_removed);
-    LOAD_STRING (cfg->psz_type);
-    LOAD_STRING (cfg->psz_name);
-    LOAD_STRING (cfg->psz_text);
-    LOAD_STRING (cfg->psz_longtext);
-    LOAD_IMMEDIATE (cfg->list_count);
+    cfg->i_type = c->type;
+    cfg->i_short = c->short_name;
+    cfg->b_advanced = (c->flags & CACHE_CONFIG_ADVANCED) != 0;
+    cfg->b_internal = (c->flags & CACHE_CONFIG_INTERNAL) != 0;
+    cfg->b_unsaveable = (c->flags & CACHE_CONFIG_UNSAVEABLE) != 0;
+    cfg->b_safe = (c->flags & CACHE_CONFIG_SAFE) != 0;
+    cfg->b_removed = (c->flags & CACHE_CONFIG_REMOVED) != 0;
+    cfg->psz_type = CacheString (file, c->type_name);
+    cfg->psz_name = CacheString (file, c->name);
+    cfg->psz_text = CacheString (file, c->text);
+    cfg->psz_longtext = CacheString (file, c->longtext);
+    cfg->list_count = c->list_count;
 
     if (IsConfigStringType (cfg->i_type))
     {
-        LOAD_STRING (cfg->orig.psz);
+        /* The current value is owned, as it can be changed */
+        cfg->orig.psz = CacheString (file, c->orig.i);
         if (cfg->orig.psz != NULL)
+        {
             cfg->value.psz = strdup (cfg->orig.psz);
+            if (unlikely(cfg->value.psz == NULL))
+                return -1;
+        }
         else
             cfg->value.psz = NULL;
+        cfg->min.psz = cfg->max.psz = NULL;
 
         if (cfg->list_count)
-            cfg->list.psz = xmalloc (cfg->list_count * sizeof (char *));
-        else /* TODO: fix config_GetPszChoices() instead of this hack: */
-            LOAD_IMMEDIATE(cfg->list.psz_cb);
-        for (unsigned i = 0; i < cfg->list_count; i++)
         {
-            LOAD_STRING (cfg->list.psz[i]);
-            if (cfg->list.psz[i] == NULL /* NULL -> empty string */
-             && (cfg->list.psz[i] = calloc (1, 1)) == NULL)
-                goto error;
+            cfg->list.psz = *pointers;
+            for (unsigned i = 0; i < cfg->list_count; i++)
+                cfg->list.psz[i] =
+                    CacheListString (file, file->lists[c->list + i]);
+            *pointers += cfg->list_count;
         }
+        else /* TODO: fix config_GetPszChoices() instead of this hack: */
+            cfg->list.psz_cb = (vlc_string_list_cb)(uintptr_t)c->list_cb;
     }
     else
     {
-        LOAD_IMMEDIATE (cfg->orig);
-        LOAD_IMMEDIATE (cfg->min);
-        LOAD_IMMEDIATE (cfg->max);
+        if (IsConfigFloatType (cfg->i_type))
+        {
+            cfg->orig.f = c->orig.f;
+            cfg->min.f = c->min.f;
+            cfg->max.f = c->max.f;
+        }
+        else
+        {
+            cfg->orig.i = c->orig.i;
+            cfg->min.i = c->min.i;
+            cfg->max.i = c->max.i;
+        }
         cfg->value = cfg->orig;
 
-        if (cfg->list_count)
-            cfg->list.i = xmalloc (cfg->list_count * sizeof (int));
+        if (cfg->list_count) /* used in place */
+            cfg->list.i = (int *)(file->lists + c->list);
         else /* TODO: fix config_GetPszChoices() instead of this hack: */
-            LOAD_IMMEDIATE(cfg->list.i_cb);
-        for (unsigned i = 0; i < cfg->list_count; i++)
-             LOAD_IMMEDIATE (cfg->list.i[i]);
-    }
-    cfg->list_text = xmalloc (cfg->list_count * sizeof (char *));
-    for (unsigned i = 0; i < cfg->list_count; i++)
-    {
-        LOAD_STRING (cfg->list_text[i]);
-        if (cfg->list_text[i] == NULL /* NULL -> empty string */
-         && (cfg->list_text[i] = calloc (1, 1)) == NULL)
-            goto error;
+            cfg->list.i_cb = (vlc_integer_list_cb)(uintptr_t)c->list_cb;
     }
 
+    cfg->list_text = *pointers;
+    for (unsigned i = 0; i < cfg->list_count; i++)
+        cfg->list_text[i] =
+            CacheListString (file, file->lists[c->list_text + i]);
+    *pointers += cfg->list_count;
     return 0;
-error:
-    return -1; /* FIXME: leaks */
 }
 
-static int CacheLoadModuleConfig (module_t *module, FILE *file)
+/**
+ * Materializes the descriptors of a cached plugin.
+ *
+ * The plugin module, its submodules, the configuration items and the
+ * pointer arrays are allocated at once, and the strings point to the cache
+ * file image, which the plugin keeps a reference to.
+ */
+static module_t *CacheLoadPlugin (struct cache_file *file,
+                                  const cache_plugin_t *plugin)
 {
-    uint16_t lines;
+    size_t pointers;
 
-    /* Calculate the structure length */
-    LOAD_IMMEDIATE (module->i_config_items);
-    LOAD_IMMEDIATE (module->i_bool_items);
-    LOAD_IMMEDIATE (lines);
+    if (CacheCheckPlugin (file, plugin, &pointers))
+        return NULL;
 
-    /* Allocate memory */
-    if (lines)
+    const size_t modcount = 1 + plugin->submodule_count;
+    const size_t confoff = CACHE_ALIGN(sizeof (cache_block_t)
+                                      + modcount * sizeof (module_t));
+    const size_t ptroff = confoff
+                        + plugin->config_count * sizeof (module_config_t);
+    cache_block_t *block = malloc (ptroff + pointers * sizeof (char *));
+    if (unlikely(block == NULL))
+        return NULL;
+
+    char **ptr = (char **)((char *)block + ptroff);
+    module_t *module = block->modules;
+
+    block->file = file;
+    for (size_t i = 0; i < modcount; i++)
     {
-        module->p_config = malloc (lines * sizeof (module_config_t));
-        if (unlikely(module->p_config == NULL))
+        module_t *m = block->modules + i;
+
+        CacheLoadModule (file, m, file->modules + plugin->module + i, &ptr);
+        m->next = (i > 0 && i + 1 < modcount) ? m + 1 : NULL;
+        m->parent = (i > 0) ? module : NULL;
+        m->submodule = NULL;
+        m->submodule_count = 0;
+        m->b_unloadable = false;
+        m->cache = block;
+    }
+    if (plugin->submodule_count > 0)
+    {
+        module->submodule = module + 1;
+        module->submodule_count = plugin->submodule_count;
+    }
+    module->b_unloadable = plugin->unloadable;
+    module->domain = CacheString (file, plugin->domain);
+    module->i_config_items = plugin->config_items;
+    module->i_bool_items = plugin->bool_items;
+
+    /* Items are accounted as they come, for CacheDestroyModule() */
+    module->p_config = (module_config_t *)((char *)block + confoff);
+    for (size_t i = 0; i < plugin->config_count; i++)
+    {
+        if (CacheLoadConfig (file, module->p_config + i,
+                             file->configs + plugin->config + i, &ptr))
         {
-            module->confsize = 0;
-            return -1;
+            atomic_fetch_add (&file->refs, 1);
+            CacheDestroyModule (module);
+            return NULL;
         }
+        module->confsize++;
     }
-    else
-        module->p_config = NULL;
-    module->confsize = lines;
+    assert (ptr == (char **)((char *)block + ptroff) + pointers);
 
-    /* Do the duplication job */
-    for (size_t i = 0; i < lines; i++)
-        if (CacheLoadConfig (module->p_config + i, file))
-            return -1;
-    return 0;
-error:
-    return -1; /* FIXME: leaks */
+    if (module->domain != NULL)
+        vlc_bindtextdomain (module->domain);
+    atomic_fetch_add (&file->refs, 1);
+    return module;
 }
 
+/**
+ * Releases the descriptors of a plugin loaded from the cache.
+ */
+void CacheDestroyModule (module_t *module)
+{
+    cache_block_t *block = module->cache;
+
+    assert (module->parent == NULL);
+    for (size_t i = 0; i < module->confsize; i++)
+        if (IsConfigStringType (module->p_config[i].i_type))
+            free (module->p_config[i].value.psz);
+    free (module->psz_filename);
+    CacheRelease (block->file);
+    free (block);
+}
 
 /**
  * Loads a plugins cache file.
@@ -224,261 +613,362 @@ error:
  * will in turn be queried by AllocateAllPlugins() to see if it needs to
  * actually load the dynamically loadable module.
  * This allows us to only fully load plugins when they are actually used.
+ *
+ * The cache entries paths point to the cache file image, which the caller
+ * must release with CacheRelease() once it is done with the entries.
  */
-size_t CacheLoad( vlc_object_t *p_this, const char *dir, module_cache_t **r )
+size_t CacheLoad (vlc_object_t *p_this, const char *dir, module_cache_t **r,
+                  struct cache_file **filep)
 {
     char *psz_filename;
-    FILE *file;
-    int i_size, i_read;
-    char p_cachestring[sizeof(CACHE_STRING)];
-    size_t i_cache;
-    int32_t i_marker;
+    struct cache_file *file;
 
     assert( dir != NULL );
 
     *r = NULL;
+    *filep = NULL;
     if( asprintf( &psz_filename, "%s"DIR_SEP CACHE_NAME, dir ) == -1 )
         return 0;
 
     msg_Dbg( p_this, "loading plugins cache file %s", psz_filename );
 
-    file = vlc_fopen( psz_filename, "rb" );
-    if( !file )
-    {
-        msg_Warn( p_this, "cannot read %s (%m)",
-                  psz_filename );
-        free( psz_filename );
-        return 0;
-    }
+    file = CacheOpen( p_this, psz_filename );
     free( psz_filename );
-
-    /* Check the file is a plugins cache */
-    i_size = sizeof(CACHE_STRING) - 1;
-    i_read = fread( p_cachestring, 1, i_size, file );
-    if( i_read != i_size ||
-        memcmp( p_cachestring, CACHE_STRING, i_size ) )
-    {
-        msg_Warn( p_this, "This doesn't look like a valid plugins cache" );
-        fclose( file );
+    if( file == NULL )
         return 0;
-    }
 
-#ifdef DISTRO_VERSION
-    /* Check for distribution specific version */
-    char p_distrostring[sizeof( DISTRO_VERSION )];
-    i_size = sizeof( DISTRO_VERSION ) - 1;
-    i_read = fread( p_distrostring, 1, i_size, file );
-    if( i_read != i_size ||
-        memcmp( p_distrostring, DISTRO_VERSION, i_size ) )
+    if( CacheCheckFile( file ) )
     {
         msg_Warn( p_this, "This doesn't look like a valid plugins cache" );
-        fclose( file );
-        return 0;
-    }
-#endif
-
-    /* Check Sub-version number */
-    i_read = fread( &i_marker, 1, sizeof(i_marker), file );
-    if( i_read != sizeof(i_marker) || i_marker != CACHE_SUBVERSION_NUM )
-    {
-        msg_Warn( p_this, "This doesn't look like a valid plugins cache "
-                  "(corrupted header)" );
-        fclose( file );
-        return 0;
-    }
-
-    /* Check header marker */
-    i_read = fread( &i_marker, 1, sizeof(i_marker), file );
-    if( i_read != sizeof(i_marker) ||
-        i_marker != ftell( file ) - (int)sizeof(i_marker) )
-    {
-        msg_Warn( p_this, "This doesn't look like a valid plugins cache "
-                  "(corrupted header)" );
-        fclose( file );
-        return 0;
-    }
-
-    if (fread( &i_cache, 1, sizeof(i_cache), file ) != sizeof(i_cache) )
-    {
-        msg_Warn( p_this, "This doesn't look like a valid plugins cache "
-                  "(file too short)" );
-        fclose( file );
+        CacheRelease( file );
         return 0;
     }
 
+    const size_t count = file->header.plugins.count;
     module_cache_t *cache = NULL;
 
-    for (size_t count = 0; count < i_cache;)
+    if( count > 0 )
     {
-        module_t *module;
-        int i_submodules;
-
-        module = vlc_module_create (NULL);
-
-        /* Load additional infos */
-        LOAD_STRING(module->psz_shortname);
-        LOAD_STRING(module->psz_longname);
-        LOAD_STRING(module->psz_help);
-
-        LOAD_IMMEDIATE(module->i_shortcuts);
-        if (module->i_shortcuts > MODULE_SHORTCUT_MAX)
-            goto error;
-        else
+        cache = malloc( count * sizeof (*cache) );
+        if( unlikely(cache == NULL) )
         {
-            module->pp_shortcuts =
-                              xmalloc (sizeof (char **) * module->i_shortcuts);
-            for (unsigned j = 0; j < module->i_shortcuts; j++)
-                LOAD_STRING(module->pp_shortcuts[j]);
+            CacheRelease( file );
+            return 0;
         }
+    }
 
-        LOAD_STRING(module->psz_capability);
-        LOAD_IMMEDIATE(module->i_score);
-        LOAD_IMMEDIATE(module->b_unloadable);
-
-        /* Config stuff */
-        if (CacheLoadModuleConfig (module, file) != VLC_SUCCESS)
-            goto error;
-
-        LOAD_STRING(module->domain);
-        if (module->domain != NULL)
-            vlc_bindtextdomain (module->domain);
-
-        LOAD_IMMEDIATE( i_submodules );
+    for( size_t i = 0; i < count; i++ )
+    {
+        const cache_plugin_t *plugin = file->plugins + i;
+        module_t *module = CacheLoadPlugin( file, plugin );
 
-        while( i_submodules-- )
+        if( module == NULL )
         {
-            module_t *submodule = vlc_module_create (module);
-            free (submodule->pp_shortcuts);
-            LOAD_STRING(submodule->psz_shortname);
-            LOAD_STRING(submodule->psz_longname);
-
-            LOAD_IMMEDIATE(submodule->i_shortcuts);
-            if (submodule->i_shortcuts > MODULE_SHORTCUT_MAX)
-                goto error;
-            else
-            {
-                submodule->pp_shortcuts =
-                           xmalloc (sizeof (char **) * submodule->i_shortcuts);
-                for (unsigned j = 0; j < submodule->i_shortcuts; j++)
-                    LOAD_STRING(submodule->pp_shortcuts[j]);
-            }
-
-            LOAD_STRING(submodule->psz_capability);
-            LOAD_IMMEDIATE(submodule->i_score);
+            msg_Warn( p_this, "plugins cache not loaded (corrupted)" );
+            while( i > 0 )
+                vlc_module_destroy( cache[--i].p_module );
+            free( cache );
+            CacheRelease( file );
+            return 0;
         }
 
-        char *path;
-        struct stat st;
-
-        /* Load common info */
-        LOAD_STRING(path);
-        if (path == NULL)
-            goto error;
-        LOAD_IMMEDIATE(st.st_mtime);
-        LOAD_IMMEDIATE(st.st_size);
-
-        CacheAdd (&cache, &count, path, &st, module);
-        free (path);
-        /* TODO: deal with errors */
+        cache[i].path = CacheString( file, plugin->path );
+        cache[i].mtime = plugin->mtime;
+        cache[i].size = plugin->size;
+        cache[i].p_module = module;
     }
-    fclose( file );
 
     *r = cache;
-    return i_cache;
+    *filep = file;
+    return count;
+}
 
-error:
-    msg_Warn( p_this, "plugins cache not loaded (corrupted)" );
+/** Builder of the cache file image */
+typedef struct
+{
+    cache_plugin_t *plugins;
+    cache_module_t *modules;
+    cache_config_t *configs;
+    uint32_t *lists;
+    cache_header_t header;
+
+    char *strings;
+    size_t strings_size;
+    size_t strings_alloc;
+    uint32_t *hash; /**< Open-addressing table of the string offsets */
+    size_t hash_mask;
+} cache_writer_t;
+
+static uint32_t CacheHash (const char *str)
+{
+    uint32_t hash = 2166136261u;
 
-    /* TODO: cleanup */
-    fclose( file );
-    return 0;
+    while (*str)
+        hash = (hash ^ (unsigned char)*(str++)) * 16777619u;
+    return hash;
 }
 
-#define SAVE_IMMEDIATE( a ) \
-    if (fwrite (&(a), sizeof(a), 1, file) != 1) \
-        goto error
-#define SAVE_FLAG(a) \
-    do { \
-        char b = (a); \
-        SAVE_IMMEDIATE(b); \
-    } while (0)
-
-static int CacheSaveString (FILE *file, const char *str)
+/** Adds a string to the table, or finds an identical one. */
+static int CacheSaveString (cache_writer_t *w, const char *str,
+                            uint32_t *offset)
 {
-    uint16_t size = (str != NULL) ? strlen (str) : 0;
+    if (str == NULL)
+    {
+        *offset = 0;
+        return 0;
+    }
 
-    SAVE_IMMEDIATE (size);
-    if (size != 0 && fwrite (str, 1, size, file) != size)
+    size_t i = CacheHash (str) & w->hash_mask;
+    while (w->hash[i] != 0)
     {
-error:
+        if (!strcmp (w->strings + w->hash[i], str))
+        {
+            *offset = w->hash[i];
+            return 0;
+        }
+        i = (i + 1) & w->hash_mask;
+    }
+
+    size_t len = strlen (str) + 1;
+    if (len > UINT32_MAX - w->strings_size)
         return -1;
+    if (w->strings_size + len > w->strings_alloc)
+    {
+        size_t alloc = 2 * w->strings_alloc + len;
+        char *strings = realloc (w->strings, alloc);
+        if (unlikely(strings == NULL))
+            return -1;
+        w->strings = strings;
+        w->strings_alloc = alloc;
     }
+    memcpy (w->strings + w->strings_size, str, len);
+    *offset = w->hash[i] = w->strings_size;
+    w->strings_size += len;
     return 0;
 }
 
-#define SAVE_STRING( a ) \
-    if (CacheSaveString (file, (a))) \
+#define SAVE_STRING(a, b) \
+    if (CacheSaveString (w, (b), &(a))) \
         goto error
 
-static int CacheSaveConfig (FILE *file, const module_config_t *cfg)
-{
-    SAVE_IMMEDIATE (cfg->i_type);
-    SAVE_IMMEDIATE (cfg->i_short);
-    SAVE_FLAG (cfg->b_advanced);
-    SAVE_FLAG (cfg->b_internal);
-    SAVE_FLAG (cfg->b_unsaveable);
-    SAVE_FLAG (cfg->b_safe);
-    SAVE_FLAG (cfg->b_removed);
-    SAVE_STRING (cfg->psz_type);
-    SAVE_STRING (cfg->psz_name);
-    SAVE_STRING (cfg->psz_text);
-    SAVE_STRING (cfg->psz_longtext);
-    SAVE_IMMEDIATE (cfg->list_count);
+static int CacheSaveModule (cache_writer_t *w, const module_t *module)
+{
+    cache_module_t *m = w->modules + w->header.modules.count++;
+
+    SAVE_STRING (m->shortname, module->psz_shortname);
+    SAVE_STRING (m->longname, module->psz_longname);
+    SAVE_STRING (m->help, module->psz_help);
+    SAVE_STRING (m->capability, module->psz_capability);
+    m->score = module->i_score;
+    m->shortcuts = w->header.lists.count;
+    m->shortcut_count = module->i_shortcuts;
+    for (unsigned i = 0; i < module->i_shortcuts; i++)
+        SAVE_STRING (w->lists[w->header.lists.count++],
+                     module->pp_shortcuts[i]);
+    return 0;
+error:
+    return -1;
+}
+
+static int CacheSaveConfig (cache_writer_t *w, const module_config_t *cfg)
+{
+    cache_config_t *c = w->configs + w->header.configs.count++;
+
+    c->type = cfg->i_type;
+    c->short_name = cfg->i_short;
+    c->flags = (cfg->b_advanced ? CACHE_CONFIG_ADVANCED : 0)
+             | (cfg->b_internal ? CACHE_CONFIG_INTERNAL : 0)
+             | (cfg->b_unsaveable ? CACHE_CONFIG_UNSAVEABLE : 0)
+             | (cfg->b_safe ? CACHE_CONFIG_SAFE : 0)
+             | (cfg->b_removed ? CACHE_CONFIG_REMOVED : 0);
+    SAVE_STRING (c->type_name, cfg->psz_type);
+    SAVE_STRING (c->name, cfg->psz_name);
+    SAVE_STRING (c->text, cfg->psz_text);
+    SAVE_STRING (c->longtext, cfg->psz_longtext);
+    c->list_count = cfg->list_count;
+    c->list = w->header.lists.count;
 
     if (IsConfigStringType (cfg->i_type))
     {
-        SAVE_STRING (cfg->orig.psz);
-        if (cfg->list_count == 0)
-            SAVE_IMMEDIATE (cfg->list.psz_cb); /* XXX: see CacheLoadConfig() */
+        uint32_t orig;
+
+        SAVE_STRING (orig, cfg->orig.psz);
+        c->orig.i = orig;
+        if (cfg->list_count == 0) /* XXX: see CacheLoadConfig() */
+            c->list_cb = (uintptr_t)cfg->list.psz_cb;
         for (unsigned i = 0; i < cfg->list_count; i++)
-            SAVE_STRING (cfg->list.psz[i]);
+            SAVE_STRING (w->lists[w->header.lists.count++],
+                         cfg->list.psz[i]);
     }
     else
     {
-        SAVE_IMMEDIATE (cfg->orig);
-        SAVE_IMMEDIATE (cfg->min);
-        SAVE_IMMEDIATE (cfg->max);
-        if (cfg->list_count == 0)
-            SAVE_IMMEDIATE (cfg->list.i_cb); /* XXX: see CacheLoadConfig() */
+        if (IsConfigFloatType (cfg->i_type))
+        {
+            c->orig.f = cfg->orig.f;
+            c->min.f = cfg->min.f;
+            c->max.f = cfg->max.f;
+        }
+        else
+        {
+            c->orig.i = cfg->orig.i;
+            c->min.i = cfg->min.i;
+            c->max.i = cfg->max.i;
+        }
+        if (cfg->list_count == 0) /* XXX: see CacheLoadConfig() */
+            c->list_cb = (uintptr_t)cfg->list.i_cb;
         for (unsigned i = 0; i < cfg->list_count; i++)
-             SAVE_IMMEDIATE (cfg->list.i[i]);
+            w->lists[w->header.lists.count++] = cfg->list.i[i];
     }
-    for (unsigned i = 0; i < cfg->list_count; i++)
-        SAVE_STRING (cfg->list_text[i]);
 
+    c->list_text = w->header.lists.count;
+    for (unsigned i = 0; i < cfg->list_count; i++)
+        SAVE_STRING (w->lists[w->header.lists.count++], cfg->list_text[i]);
     return 0;
 error:
     return -1;
 }
 
-static int CacheSaveModuleConfig (FILE *file, const module_t *module)
+static int CacheSavePlugin (cache_writer_t *w, const module_cache_t *entry)
 {
-    uint16_t lines = module->confsize;
-
-    SAVE_IMMEDIATE (module->i_config_items);
-    SAVE_IMMEDIATE (module->i_bool_items);
-    SAVE_IMMEDIATE (lines);
-
-    for (size_t i = 0; i < lines; i++)
-        if (CacheSaveConfig (file, module->p_config + i))
-           goto error;
+    const module_t *module = entry->p_module;
+    cache_plugin_t *p = w->plugins + w->header.plugins.count++;
+
+    SAVE_STRING (p->path, entry->path);
+    SAVE_STRING (p->domain, module->domain);
+    p->mtime = entry->mtime;
+    p->size = entry->size;
+    p->unloadable = module->b_unloadable;
+
+    p->module = w->header.modules.count;
+    p->submodule_count = module->submodule_count;
+    if (CacheSaveModule (w, module))
+        goto error;
+    for (const module_t *m = module->submodule; m != NULL; m = m->next)
+        if (CacheSaveModule (w, m))
+            goto error;
 
+    p->config = w->header.configs.count;
+    p->config_count = module->confsize;
+    p->config_items = module->i_config_items;
+    p->bool_items = module->i_bool_items;
+    for (size_t i = 0; i < module->confsize; i++)
+        if (CacheSaveConfig (w, module->p_config + i))
+            goto error;
     return 0;
 error:
     return -1;
 }
 
-static int CacheSaveBank( FILE *file, const module_cache_t *, size_t );
+static int CacheWriteSection (FILE *file, const void *data, size_t size)
+{
+    static const char padding[8];
+
+    if (size > 0 && fwrite (data, size, 1, file) != 1)
+        return -1;
+    size = CACHE_SECTION_ALIGN(size) - size;
+    if (size > 0 && fwrite (padding, size, 1, file) != 1)
+        return -1;
+    return 0;
+}
+
+static int CacheSaveBank (FILE *file, const module_cache_t *cache,
+                          size_t i_cache)
+{
+    cache_writer_t w;
+    size_t modules = 0, configs = 0, lists = 0, strings = 2;
+    int ret = -1;
+
+    /* Count the records */
+    for (size_t i = 0; i < i_cache; i++)
+    {
+        const module_t *module = cache[i].p_module;
+
+        modules += 1 + module->submodule_count;
+        for (const module_t *m = module; m != NULL;
+             m = (m == module) ? module->submodule : m->next)
+        {
+            lists += m->i_shortcuts;
+            strings += 4 + m->i_shortcuts;
+        }
+        configs += module->confsize;
+        for (size_t j = 0; j < module->confsize; j++)
+        {
+            lists += 2 * module->p_config[j].list_count;
+            strings += 5 + 2 * module->p_config[j].list_count;
+        }
+    }
+
+    if (i_cache > UINT32_MAX || modules > UINT32_MAX || configs > UINT32_MAX
+     || lists > UINT32_MAX)
+        return -1;
+
+    memset (&w, 0, sizeof (w));
+    w.plugins = calloc (i_cache ? i_cache : 1, sizeof (*w.plugins));
+    w.modules = calloc (modules ? modules : 1, sizeof (*w.modules));
+    w.configs = calloc (configs ? configs : 1, sizeof (*w.configs));
+    w.lists = calloc (lists ? lists : 1, sizeof (*w.lists));
+    w.hash_mask = 1;
+    while (w.hash_mask < 2 * strings)
+        w.hash_mask <<= 1;
+    w.hash = calloc (w.hash_mask--, sizeof (*w.hash));
+    w.strings_alloc = 4096;
+    w.strings = malloc (w.strings_alloc);
+    if (unlikely(w.plugins == NULL || w.modules == NULL || w.configs == NULL
+              || w.lists == NULL || w.hash == NULL || w.strings == NULL))
+        goto out;
+    w.strings[0] = '\0'; /* NULL */
+    w.strings_size = 1;
+
+    for (size_t i = 0; i < i_cache; i++)
+        if (CacheSavePlugin (&w, cache + i))
+            goto out;
+    assert (w.header.modules.count == modules);
+    assert (w.header.configs.count == configs);
+    assert (w.header.lists.count == lists);
+
+    /* Lay out the sections */
+    cache_header_t *h = &w.header;
+    size_t offset = CACHE_HEADER_OFFSET + CACHE_SECTION_ALIGN(sizeof (*h));
+
+    h->subversion = CACHE_SUBVERSION_NUM;
+    h->byte_order = CACHE_BYTE_ORDER;
+    h->plugins.offset = offset;
+    offset += CACHE_SECTION_ALIGN(i_cache * sizeof (*w.plugins));
+    h->modules.offset = offset;
+    offset += CACHE_SECTION_ALIGN(modules * sizeof (*w.modules));
+    h->configs.offset = offset;
+    offset += CACHE_SECTION_ALIGN(configs * sizeof (*w.configs));
+    h->lists.offset = offset;
+    offset += CACHE_SECTION_ALIGN(lists * sizeof (*w.lists));
+    h->strings.offset = offset;
+    h->strings.count = w.strings_size;
+    offset += CACHE_SECTION_ALIGN(w.strings_size);
+    if (offset > UINT32_MAX)
+        goto out;
+    h->file_size = offset;
+
+    /* Contains version number */
+    if (CacheWriteSection (file, CACHE_MAGIC, sizeof (CACHE_MAGIC))
+     || CacheWriteSection (file, h, sizeof (*h))
+     || CacheWriteSection (file, w.plugins, i_cache * sizeof (*w.plugins))
+     || CacheWriteSection (file, w.modules, modules * sizeof (*w.modules))
+     || CacheWriteSection (file, w.configs, configs * sizeof (*w.configs))
+     || CacheWriteSection (file, w.lists, lists * sizeof (*w.lists))
+     || CacheWriteSection (file, w.strings, w.strings_size))
+        goto out;
+
+    if (fflush (file)) /* flush libc buffers */
+        goto out;
+    ret = 0; /* success! */
+out:
+    free (w.strings);
+    free (w.hash);
+    free (w.lists);
+    free (w.configs);
+    free (w.modules);
+    free (w.plugins);
+    return ret;
+}
 
 /**
  * Saves a module cache to disk, and release cache data from memory.
@@ -529,98 +1019,6 @@ out:
     free (entries);
 }
 
-static int CacheSaveSubmodule (FILE *, const module_t *);
-
-static int CacheSaveBank (FILE *file, const module_cache_t *cache,
-                          size_t i_cache)
-{
-    uint32_t i_file_size = 0;
-
-    /* Contains version number */
-    if (fputs (CACHE_STRING, file) == EOF)
-        goto error;
-#ifdef DISTRO_VERSION
-    /* Allow binary maintaner to pass a string to detect new binary version*/
-    if (fputs( DISTRO_VERSION, file ) == EOF)
-        goto error;
-#endif
-    /* Sub-version number (to avoid breakage in the dev version when cache
-     * structure changes) */
-    i_file_size = CACHE_SUBVERSION_NUM;
-    if (fwrite (&i_file_size, sizeof (i_file_size), 1, file) != 1 )
-        goto error;
-
-    /* Header marker */
-    i_file_size = ftell( file );
-    if (fwrite (&i_file_size, sizeof (i_file_size), 1, file) != 1)
-        goto error;
-
-    if (fwrite( &i_cache, sizeof (i_cache), 1, file) != 1)
-        goto error;
-
-    for (unsigned i = 0; i < i_cache; i++)
-    {
-        module_t *module = cache[i].p_module;
-        uint32_t i_submodule;
-
-        /* Save additional infos */
-        SAVE_STRING(module->psz_shortname);
-        SAVE_STRING(module->psz_longname);
-        SAVE_STRING(module->psz_help);
-        SAVE_IMMEDIATE(module->i_shortcuts);
-        for (unsigned j = 0; j < module->i_shortcuts; j++)
-            SAVE_STRING(module->pp_shortcuts[j]);
-
-        SAVE_STRING(module->psz_capability);
-        SAVE_IMMEDIATE(module->i_score);
-        SAVE_IMMEDIATE(module->b_unloadable);
-
-        /* Config stuff */
-        if (CacheSaveModuleConfig (file, module))
-            goto error;
-
-        SAVE_STRING(module->domain);
-
-        i_submodule = module->submodule_count;
-        SAVE_IMMEDIATE( i_submodule );
-        if (CacheSaveSubmodule (file, module->submodule))
-            goto error;
-
-        /* Save common info */
-        SAVE_STRING(cache[i].path);
-        SAVE_IMMEDIATE(cache[i].mtime);
-        SAVE_IMMEDIATE(cache[i].size);
-    }
-
-    if (fflush (file)) /* flush libc buffers */
-        goto error;
-    return 0; /* success! */
-
-error:
-    return -1;
-}
-
-static int CacheSaveSubmodule( FILE *file, const module_t *p_module )
-{
-    if( !p_module )
-        return 0;
-    if( CacheSaveSubmodule( file, p_module->next ) )
-        goto error;
-
-    SAVE_STRING( p_module->psz_shortname );
-    SAVE_STRING( p_module->psz_longname );
-    SAVE_IMMEDIATE( p_module->i_shortcuts );
-    for( unsigned j = 0; j < p_module->i_shortcuts; j++ )
-         SAVE_STRING( p_module->pp_shortcuts[j] );
-
-    SAVE_STRING( p_module->psz_capability );
-    SAVE_IMMEDIATE( p_module->i_score );
-    return 0;
-
-error:
-    return -1;
-}
-
 /*****************************************************************************
  * CacheMerge: Merge a cache module descriptor with a full module descriptor.
  *****************************************************************************/
@@ -651,23 +1049,29 @@ void CacheMerge( vlc_object_t *p_this, module_t *p_cache, module_t *p_module )
 
 /**
  * Looks up a plugin file in a table of cached plugins.
+ *
+ * The directories are normally browsed in the same order as when the cache
+ * was saved, so the search starts after the previous match (*hint).
  */
-module_t *CacheFind (module_cache_t *cache, size_t count,
+module_t *CacheFind (module_cache_t *cache, size_t count, size_t *hint,
                      const char *path, const struct stat *st)
 {
-    while (count > 0)
+    for (size_t n = 0, i = *hint; n < count; n++, i++)
     {
-        if (cache->path != NULL
-         && !strcmp (cache->path, path)
-         && cache->mtime == st->st_mtime
-         && cache->size == st->st_size)
+        if (i >= count)
+            i = 0;
+
+        module_cache_t *entry = cache + i;
+        if (entry->path != NULL
+         && !strcmp (entry->path, path)
+         && entry->mtime == st->st_mtime
+         && entry->size == st->st_size)
        {
-            module_t *module = cache->p_module;
-            cache->p_module = NULL;
+            module_t *module = entry->p_module;
+            entry->p_module = NULL;
+            *hint = i + 1;
             return module;
        }
-       cache++;
-       count--;
     }
 
     return NULL;
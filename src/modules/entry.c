@@ -80,6 +80,7 @@ module_t *vlc_module_create (module_t *parent)
     /*module->handle = garbage */
     module->psz_filename = NULL;
     module->domain = NULL;
+    module->cache = NULL;
     return module;
 }
 
@@ -91,6 +92,15 @@ void vlc_module_destroy (module_t *module)
 {
     assert (!module->b_loaded || !module->b_unloadable);
 
+#ifdef HAVE_DYNAMIC_PLUGINS
+    if (module->cache != NULL)
+    {   /* The plugin owns the descriptors of its submodules */
+        if (module->parent == NULL)
+            CacheDestroyModule (module);
+        return;
+    }
+#endif
+
     for (module_t *m = module->submodule, *next; m != NULL; m = next)
     {
         next = m->next;
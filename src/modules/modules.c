@@ -169,11 +169,140 @@ static bool module_match_name (const module_t *m, const char *name)
      return false;
 }
 
+/*
+ * Probe results memo
+ *
+ * Format negotiation probes the same candidates with the same formats over
+ * and over, and most of them reject the formats. The memo remembers, for a
+ * given tuple of formats (the key), which modules failed to open, so that
+ * further probes skip them for a while. Only the modules which returned
+ * VLC_ENOTSUP are remembered: VLC_EGENERIC may also come from options,
+ * missing resources or other transient errors. The accepted module is thus
+ * reached without running the Open() callbacks of the modules that rejected
+ * the formats, while the order of the candidates stays the same.
+ */
+#define MEMO_KEYS     32 /* must be a power of two */
+#define MEMO_KEY_MAX  256
+#define MEMO_MODULES  64
+#define MEMO_LIFETIME (CLOCK_FREQ * 10)
+
+typedef struct
+{
+    const void *data;
+    size_t length;
+    uint32_t hash;
+} module_memo_key_t;
+
+typedef struct
+{
+    uint32_t hash;
+    size_t length; /**< Key length, zero if the entry is unused */
+    mtime_t date; /**< Creation date */
+    unsigned count;
+    const module_t *rejected[MEMO_MODULES];
+    unsigned char key[MEMO_KEY_MAX];
+} module_memo_entry_t;
+
+struct module_memo
+{
+    vlc_mutex_t lock;
+    module_memo_entry_t entries[MEMO_KEYS];
+};
+
+struct module_memo *module_MemoCreate (void)
+{
+    struct module_memo *memo = malloc (sizeof (*memo));
+    if (unlikely(memo == NULL))
+        return NULL;
+
+    vlc_mutex_init (&memo->lock);
+    for (unsigned i = 0; i < MEMO_KEYS; i++)
+        memo->entries[i].length = 0;
+    return memo;
+}
+
+void module_MemoDestroy (struct module_memo *memo)
+{
+    vlc_mutex_destroy (&memo->lock);
+    free (memo);
+}
+
+static uint32_t module_MemoHash (const void *data, size_t length)
+{
+    const unsigned char *p = data;
+    uint32_t hash = 2166136261u;
+
+    while (length-- > 0)
+        hash = (hash ^ *(p++)) * 16777619u;
+    return hash;
+}
+
+/** Finds the live entry for a key, or NULL. */
+static module_memo_entry_t *module_MemoFind (struct module_memo *memo,
+                                             const module_memo_key_t *key,
+                                             mtime_t now)
+{
+    module_memo_entry_t *entry = &memo->entries[key->hash & (MEMO_KEYS - 1)];
+
+    vlc_assert_locked (&memo->lock);
+    if (entry->length != key->length || entry->hash != key->hash
+     || memcmp (entry->key, key->data, key->length))
+        return NULL;
+    if (now - entry->date > MEMO_LIFETIME)
+    {   /* Expired: the environment of the modules may have changed */
+        entry->length = 0;
+        return NULL;
+    }
+    return entry;
+}
+
+static bool module_MemoRejected (struct module_memo *memo,
+                                 const module_memo_key_t *key,
+                                 const module_t *m)
+{
+    bool rejected = false;
+
+    vlc_mutex_lock (&memo->lock);
+    module_memo_entry_t *entry = module_MemoFind (memo, key, mdate ());
+    if (entry != NULL)
+        for (unsigned i = 0; i < entry->count && !rejected; i++)
+            rejected = entry->rejected[i] == m;
+    vlc_mutex_unlock (&memo->lock);
+    return rejected;
+}
+
+static void module_MemoReject (struct module_memo *memo,
+                               const module_memo_key_t *key,
+                               const module_t *m)
+{
+    mtime_t now = mdate ();
+
+    vlc_mutex_lock (&memo->lock);
+    module_memo_entry_t *entry = module_MemoFind (memo, key, now);
+    if (entry == NULL)
+    {   /* Evict whatever other key used the slot */
+        entry = &memo->entries[key->hash & (MEMO_KEYS - 1)];
+        entry->hash = key->hash;
+        entry->length = key->length;
+        entry->date = now;
+        entry->count = 0;
+        memcpy (entry->key, key->data, key->length);
+    }
+    if (entry->count < MEMO_MODULES)
+        entry->rejected[entry->count++] = m;
+    vlc_mutex_unlock (&memo->lock);
+}
+
 static int module_load (vlc_object_t *obj, module_t *m,
+                        struct module_memo *memo,
+                        const module_memo_key_t *key,
                         vlc_activate_t init, va_list args)
 {
     int ret = VLC_SUCCESS;
 
+    if (memo != NULL && module_MemoRejected (memo, key, m))
+        return VLC_EGENERIC;
+
     if (module_Map (obj, m))
         return VLC_EGENERIC;
 
@@ -185,9 +314,17 @@ static int module_load (vlc_object_t *obj, module_t *m,
         ret = init (m->pf_activate, ap);
         va_end (ap);
     }
+
+    if (memo != NULL && ret == VLC_ENOTSUP)
+        module_MemoReject (memo, key, m);
     return ret;
 }
 
+static module_t *module_load_list (vlc_object_t *obj, const char *capability,
+                                   const char *name, bool strict,
+                                   const module_memo_key_t *key,
+                                   vlc_activate_t probe, va_list args);
+
 #undef vlc_module_load
 /**
  * Finds and instantiates the best module of a certain type.
@@ -213,6 +350,22 @@ module_t *vlc_module_load(vlc_object_t *obj, const char *capability,
                           const char *name, bool strict,
                           vlc_activate_t probe, ...)
 {
+    module_t *module;
+    va_list args;
+
+    va_start(args, probe);
+    module = module_load_list(obj, capability, name, strict, NULL, probe,
+                              args);
+    va_end(args);
+    return module;
+}
+
+static module_t *module_load_list (vlc_object_t *obj, const char *capability,
+                                   const char *name, bool strict,
+                                   const module_memo_key_t *key,
+                                   vlc_activate_t probe, va_list args)
+{
+    struct module_memo *memo = NULL;
     char *var = NULL;
 
     if (name == NULL || name[0] == '\0')
@@ -240,9 +393,11 @@ module_t *vlc_module_load(vlc_object_t *obj, const char *capability,
 
     module_t *module = NULL;
     const bool b_force_backup = obj->b_force; /* FIXME: remove this */
-    va_list args;
 
-    va_start(args, probe);
+    /* The memo only applies to probes which are not forced */
+    if (key != NULL && !strict)
+        memo = libvlc_priv(obj->p_libvlc)->probe_memo;
+
     while (*name)
     {
         char buf[32];
@@ -265,6 +420,9 @@ module_t *vlc_module_load(vlc_object_t *obj, const char *capability,
             goto done;
 
         obj->b_force = strict && strcasecmp ("any", shortcut);
+        /* Forced modules are always probed */
+        struct module_memo *shortcut_memo =
+            strcasecmp ("any", shortcut) ? NULL : memo;
         for (ssize_t i = 0; i < total; i++)
         {
             module_t *cand = mods[i];
@@ -274,7 +432,8 @@ module_t *vlc_module_load(vlc_object_t *obj, const char *capability,
                 continue;
             mods[i] = NULL; // only try each module once at most...
 
-            int ret = module_load (obj, cand, probe, args);
+            int ret = module_load (obj, cand, shortcut_memo, key, probe,
+                                   args);
             switch (ret)
             {
                 case VLC_SUCCESS:
@@ -296,7 +455,7 @@ module_t *vlc_module_load(vlc_object_t *obj, const char *capability,
             if (cand == NULL || module_get_score (cand) <= 0)
                 continue;
 
-            int ret = module_load (obj, cand, probe, args);
+            int ret = module_load (obj, cand, memo, key, probe, args);
             switch (ret)
             {
                 case VLC_SUCCESS:
@@ -308,7 +467,6 @@ module_t *vlc_module_load(vlc_object_t *obj, const char *capability,
         }
     }
 done:
-    va_end (args);
     obj->b_force = b_force_backup;
     module_list_free (mods);
     free (var);
@@ -366,6 +524,45 @@ module_t *module_need(vlc_object_t *obj, const char *cap, const char *name,
     return vlc_module_load(obj, cap, name, strict, generic_start, obj);
 }
 
+static module_t *module_load_memo(vlc_object_t *obj, const char *capability,
+                                  const char *name,
+                                  const module_memo_key_t *key,
+                                  vlc_activate_t probe, ...)
+{
+    module_t *module;
+    va_list args;
+
+    va_start(args, probe);
+    module = module_load_list(obj, capability, name, false, key, probe, args);
+    va_end(args);
+    return module;
+}
+
+#undef module_need_memo
+/**
+ * Finds and instantiates the best module of a certain type, like
+ * module_need() without strict name matching, but skipping the candidates
+ * which recently rejected the same formats. A module rejects the formats by
+ * returning VLC_ENOTSUP from its Open() callback. The modules named in
+ * \p name are always probed.
+ *
+ * \param key tuple of the formats which the modules depend on
+ * \param length size of the key in bytes
+ */
+module_t *module_need_memo(vlc_object_t *obj, const char *cap,
+                           const char *name, const void *key, size_t length)
+{
+    if (unlikely(length == 0 || length > MEMO_KEY_MAX))
+        return module_need(obj, cap, name, false);
+
+    module_memo_key_t memo_key = {
+        .data = key,
+        .length = length,
+        .hash = module_MemoHash(key, length),
+    };
+    return module_load_memo(obj, cap, name, &memo_key, generic_start, obj);
+}
+
 #undef module_unneed
 void module_unneed(vlc_object_t *obj, module_t *module)
 {
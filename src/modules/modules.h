@@ -98,6 +98,7 @@ struct module_t
     module_handle_t     handle;                             /* Unique handle */
     char *              psz_filename;                     /* Module filename */
     char *              domain;                            /* gettext domain */
+    void *              cache;      /* plugins cache allocation, or NULL */
 };
 
 module_t *vlc_plugin_describe (vlc_plugin_cb);
@@ -112,6 +113,14 @@ int module_Map (vlc_object_t *, module_t *);
 
 ssize_t module_list_cap (module_t ***, const char *);
 
+/* Probe results memo */
+struct module_memo;
+struct module_memo *module_MemoCreate (void);
+void module_MemoDestroy (struct module_memo *);
+module_t *module_need_memo (vlc_object_t *, const char *, const char *,
+                            const void *, size_t);
+#define module_need_memo(a,b,c,d,e) module_need_memo(VLC_OBJECT(a),b,c,d,e)
+
 int vlc_bindtextdomain (const char *);
 
 /* Low-level OS-dependent handler */
@@ -122,14 +131,19 @@ void module_Unload (module_handle_t);
 /* Plugins cache */
 void   CacheMerge (vlc_object_t *, module_t *, module_t *);
 void   CacheDelete(vlc_object_t *, const char *);
-size_t CacheLoad  (vlc_object_t *, const char *, module_cache_t **);
 
 struct stat;
+struct cache_file;
+
+size_t CacheLoad  (vlc_object_t *, const char *, module_cache_t **,
+                   struct cache_file **);
+void   CacheRelease (struct cache_file *);
+void   CacheDestroyModule (module_t *);
 
 int CacheAdd (module_cache_t **, size_t *,
               const char *, const struct stat *, module_t *);
 void CacheSave  (vlc_object_t *, const char *, module_cache_t *, size_t);
-module_t *CacheFind (module_cache_t *, size_t,
+module_t *CacheFind (module_cache_t *, size_t, size_t *,
                      const char *, const struct stat *);
 
 #endif /* !LIBVLC_MODULES_H */
@@ -61,11 +61,43 @@ typedef struct {
     spu_heap_entry_t entry[VOUT_MAX_SUBPICTURES];
 } spu_heap_t;
 
+/* Number of rendered text regions kept across subpicture updates */
+#define SPU_CACHE_SIZE 16
+
+/* A rendered (and possibly scaled) text region, keyed by what the text
+ * renderer and the scaler depend upon */
+typedef struct {
+    /* Key */
+    uint32_t       hash;
+    char           *text;
+    char           *html;
+    text_style_t   *style;
+    video_format_t fmt;
+    int            align;
+    bool           renderbg;
+    unsigned       text_width;
+    unsigned       text_height;
+    vlc_fourcc_t   chroma;
+
+    /* Value */
+    video_format_t rendered_fmt;
+    picture_t      *picture;
+    subpicture_region_private_t *scaled;
+
+    uint64_t       last_use;
+} spu_cache_entry_t;
+
+typedef struct {
+    spu_cache_entry_t entry[SPU_CACHE_SIZE];
+    uint64_t          clock;
+} spu_cache_t;
+
 struct spu_private_t {
     vlc_mutex_t  lock;            /* lock to protect all followings fields */
     vlc_object_t *input;
 
     spu_heap_t   heap;
+    spu_cache_t  cache;
 
     int channel;             /**< number of subpicture channels registered */
     filter_t *text;                              /**< text renderer module */
@@ -156,6 +188,197 @@ static void SpuHeapClean(spu_heap_t *heap)
     }
 }
 
+/*****************************************************************************
+ * Rendered text cache
+ *
+ * Subpicture updaters (text subtitles, OSD, marquees...) recreate their
+ * regions whenever they are revalidated, which would otherwise mean
+ * rendering and scaling identical text again.
+ *****************************************************************************/
+static uint32_t SpuCacheHashString(uint32_t hash, const char *str)
+{
+    /* FNV-1a */
+    if (str)
+        for (; *str; str++)
+            hash = (hash ^ (uint8_t)*str) * 16777619;
+    return hash;
+}
+
+static uint32_t SpuCacheHash(const subpicture_region_t *region)
+{
+    uint32_t hash = SpuCacheHashString(2166136261u, region->psz_text);
+    return SpuCacheHashString(hash, region->psz_html);
+}
+
+static bool SpuCacheStringEqual(const char *a, const char *b)
+{
+    if (!a || !b)
+        return a == b;
+    return !strcmp(a, b);
+}
+
+static bool SpuCacheStyleEqual(const text_style_t *a, const text_style_t *b)
+{
+    if (!a || !b)
+        return a == b;
+    return SpuCacheStringEqual(a->psz_fontname, b->psz_fontname) &&
+           a->i_font_size                == b->i_font_size &&
+           a->i_font_color               == b->i_font_color &&
+           a->i_font_alpha               == b->i_font_alpha &&
+           a->i_style_flags              == b->i_style_flags &&
+           a->i_outline_color            == b->i_outline_color &&
+           a->i_outline_alpha            == b->i_outline_alpha &&
+           a->i_shadow_color             == b->i_shadow_color &&
+           a->i_shadow_alpha             == b->i_shadow_alpha &&
+           a->i_background_color         == b->i_background_color &&
+           a->i_background_alpha         == b->i_background_alpha &&
+           a->i_karaoke_background_color == b->i_karaoke_background_color &&
+           a->i_karaoke_background_alpha == b->i_karaoke_background_alpha &&
+           a->i_outline_width            == b->i_outline_width &&
+           a->i_shadow_width             == b->i_shadow_width &&
+           a->i_spacing                  == b->i_spacing;
+}
+
+static void SpuCacheInit(spu_cache_t *cache)
+{
+    for (int i = 0; i < SPU_CACHE_SIZE; i++)
+        cache->entry[i].picture = NULL;
+    cache->clock = 0;
+}
+
+static void SpuCacheEntryClean(spu_cache_entry_t *entry)
+{
+    if (!entry->picture)
+        return;
+
+    free(entry->text);
+    free(entry->html);
+    if (entry->style)
+        text_style_Delete(entry->style);
+    video_format_Clean(&entry->rendered_fmt);
+    picture_Release(entry->picture);
+    if (entry->scaled)
+        subpicture_region_private_Delete(entry->scaled);
+    entry->picture = NULL;
+}
+
+static void SpuCacheClean(spu_cache_t *cache)
+{
+    for (int i = 0; i < SPU_CACHE_SIZE; i++)
+        SpuCacheEntryClean(&cache->entry[i]);
+}
+
+static spu_cache_entry_t *SpuCacheFind(spu_cache_t *cache,
+                                       const subpicture_region_t *region,
+                                       const filter_t *text,
+                                       vlc_fourcc_t chroma)
+{
+    const uint32_t hash = SpuCacheHash(region);
+
+    for (int i = 0; i < SPU_CACHE_SIZE; i++) {
+        spu_cache_entry_t *entry = &cache->entry[i];
+
+        if (!entry->picture || entry->hash != hash)
+            continue;
+        if (entry->chroma      != chroma ||
+            entry->text_width  != text->fmt_out.video.i_width ||
+            entry->text_height != text->fmt_out.video.i_height ||
+            entry->align       != region->i_align ||
+            entry->renderbg    != region->b_renderbg ||
+            !video_format_IsSimilar(&entry->fmt, &region->fmt))
+            continue;
+        if (!SpuCacheStringEqual(entry->text, region->psz_text) ||
+            !SpuCacheStringEqual(entry->html, region->psz_html) ||
+            !SpuCacheStyleEqual(entry->style, region->p_style))
+            continue;
+
+        entry->last_use = ++cache->clock;
+        return entry;
+    }
+    return NULL;
+}
+
+/* Stores a freshly rendered region; fmt is the text region format before
+ * rendering */
+static spu_cache_entry_t *SpuCacheAdd(spu_cache_t *cache,
+                                      const video_format_t *fmt,
+                                      const subpicture_region_t *region,
+                                      const filter_t *text,
+                                      vlc_fourcc_t chroma)
+{
+    spu_cache_entry_t *entry = &cache->entry[0];
+
+    for (int i = 1; i < SPU_CACHE_SIZE && entry->picture; i++) {
+        if (!cache->entry[i].picture ||
+            cache->entry[i].last_use < entry->last_use)
+            entry = &cache->entry[i];
+    }
+    SpuCacheEntryClean(entry);
+
+    entry->hash        = SpuCacheHash(region);
+    entry->text        = region->psz_text ? strdup(region->psz_text) : NULL;
+    entry->html        = region->psz_html ? strdup(region->psz_html) : NULL;
+    entry->style       = region->p_style ? text_style_Duplicate(region->p_style)
+                                         : NULL;
+    entry->fmt         = *fmt;
+    entry->fmt.p_palette = NULL;
+    entry->align       = region->i_align;
+    entry->renderbg    = region->b_renderbg;
+    entry->text_width  = text->fmt_out.video.i_width;
+    entry->text_height = text->fmt_out.video.i_height;
+    entry->chroma      = chroma;
+    entry->scaled      = NULL;
+    entry->last_use    = ++cache->clock;
+
+    if ((region->psz_text && !entry->text) ||
+        (region->psz_html && !entry->html) ||
+        (region->p_style && !entry->style) ||
+        video_format_Copy(&entry->rendered_fmt, &region->fmt)) {
+        free(entry->text);
+        free(entry->html);
+        if (entry->style)
+            text_style_Delete(entry->style);
+        return NULL;
+    }
+    entry->picture = picture_Hold(region->p_picture);
+    return entry;
+}
+
+/* Restores a cached rendering into a text region */
+static void SpuCacheRestore(const spu_cache_entry_t *entry,
+                            subpicture_region_t *region)
+{
+    video_format_t fmt;
+
+    if (video_format_Copy(&fmt, &entry->rendered_fmt))
+        return;
+    free(region->fmt.p_palette);
+    region->fmt = fmt;
+    if (region->p_picture)
+        picture_Release(region->p_picture);
+    region->p_picture = picture_Hold(entry->picture);
+
+    if (entry->scaled && !region->p_private) {
+        region->p_private = subpicture_region_private_New(&entry->scaled->fmt);
+        if (region->p_private)
+            region->p_private->p_picture = picture_Hold(entry->scaled->p_picture);
+    }
+}
+
+/* Keeps the last scaled version of a cached region */
+static void SpuCacheSetScaled(spu_cache_entry_t *entry,
+                              const subpicture_region_private_t *scaled)
+{
+    if (entry->scaled && entry->scaled->p_picture == scaled->p_picture)
+        return;
+
+    if (entry->scaled)
+        subpicture_region_private_Delete(entry->scaled);
+    entry->scaled = subpicture_region_private_New((video_format_t *)&scaled->fmt);
+    if (entry->scaled)
+        entry->scaled->p_picture = picture_Hold(scaled->p_picture);
+}
+
 struct filter_owner_sys_t {
     spu_t *spu;
     int   channel;
@@ -688,10 +911,24 @@ static void SpuRenderRegion(spu_t *spu,
     *dst_ptr  = NULL;
 
     /* Render text region */
+    spu_cache_entry_t *cache_entry = NULL;
     if (region->fmt.i_chroma == VLC_CODEC_TEXT) {
-        SpuRenderText(spu, &restore_text, region,
-                      chroma_list,
-                      render_date - subpic->i_start);
+        if (sys->text)
+            cache_entry = SpuCacheFind(&sys->cache, region, sys->text,
+                                       chroma_list[0]);
+        if (cache_entry) {
+            SpuCacheRestore(cache_entry, region);
+        } else {
+            SpuRenderText(spu, &restore_text, region,
+                          chroma_list,
+                          render_date - subpic->i_start);
+
+            /* Text which must be rendered again (karaoke) is not cached */
+            if (!restore_text && region->fmt.i_chroma != VLC_CODEC_TEXT &&
+                region->p_picture)
+                cache_entry = SpuCacheAdd(&sys->cache, &fmt_original, region,
+                                          sys->text, chroma_list[0]);
+        }
 
         /* Check if the rendering has failed ... */
         if (region->fmt.i_chroma == VLC_CODEC_TEXT)
@@ -877,6 +1114,9 @@ static void SpuRenderRegion(spu_t *spu,
         if (region->p_private) {
             region_fmt     = region->p_private->fmt;
             region_picture = region->p_private->p_picture;
+
+            if (cache_entry)
+                SpuCacheSetScaled(cache_entry, region->p_private);
         }
     }
 
@@ -1218,6 +1458,7 @@ spu_t *spu_Create(vlc_object_t *object)
     vlc_mutex_init(&sys->lock);
 
     SpuHeapInit(&sys->heap);
+    SpuCacheInit(&sys->cache);
 
     sys->text = NULL;
     sys->scale = NULL;
@@ -1287,6 +1528,7 @@ void spu_Destroy(spu_t *spu)
 
     /* Destroy all remaining subpictures */
     SpuHeapClean(&sys->heap);
+    SpuCacheClean(&sys->cache);
 
     vlc_mutex_destroy(&sys->lock);
 
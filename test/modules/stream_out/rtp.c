@@ -0,0 +1,141 @@
+/*****************************************************************************
+ * rtp.c: RTP stream output test
+ *****************************************************************************
+ * Copyright (C) 2026 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Streams a generated MPEG audio file with the RTP stream output, and
+ * decodes every datagram received on the loopback interface: each RTP
+ * packet must be sent as one datagram made of its headers and payload. */
+
+#include "../../libvlc/test.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define FRAMES     100
+#define FRAME_SIZE 417 /* MPEG-1 layer III, 128 kbit/s, 44.1 kHz */
+
+static char *write_sample (void)
+{
+    static const uint8_t hdr[4] = { 0xFF, 0xFB, 0x90, 0x00 };
+    uint8_t frame[FRAME_SIZE];
+    char path[] = "/tmp/vlc-test-rtp-XXXXXX";
+    int fd = mkstemp (path);
+    assert (fd != -1);
+
+    memset (frame, 0, sizeof (frame));
+    memcpy (frame, hdr, sizeof (hdr));
+    for (unsigned i = 0; i < FRAMES; i++)
+        assert (write (fd, frame, sizeof (frame)) == sizeof (frame));
+    close (fd);
+    return strdup (path);
+}
+
+static int open_receiver (unsigned *port)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof (addr);
+    int fd = socket (AF_INET, SOCK_DGRAM, 0);
+    assert (fd != -1);
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    /* RTP ports are even, RTCP uses the next one */
+    for (*port = 41234; *port < 41334; *port += 2)
+    {
+        addr.sin_port = htons (*port);
+        if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) == 0)
+            break;
+    }
+    assert (getsockname (fd, (struct sockaddr *)&addr, &addrlen) == 0);
+    assert (ntohs (addr.sin_port) == *port);
+
+    struct timeval tv = { .tv_sec = 2, .tv_usec = 0 };
+    setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+    return fd;
+}
+
+static void test_rtp_mpa (const char **argv, int argc)
+{
+    char *path = write_sample ();
+    unsigned port;
+    int fd = open_receiver (&port);
+    char sout[64];
+
+    log ("Testing RTP stream output to port %u\n", port);
+    snprintf (sout, sizeof (sout), ":sout=#rtp{dst=127.0.0.1,port=%u}", port);
+
+    libvlc_instance_t *vlc = libvlc_new (argc, argv);
+    assert (vlc != NULL);
+    libvlc_media_t *md = libvlc_media_new_path (vlc, path);
+    assert (md != NULL);
+    libvlc_media_add_option (md, sout);
+    libvlc_media_player_t *mp = libvlc_media_player_new_from_media (md);
+    assert (mp != NULL);
+    libvlc_media_release (md);
+    libvlc_media_player_play (mp);
+
+    uint8_t buf[2048];
+    unsigned packets = 0;
+    uint16_t seq = 0;
+    ssize_t len;
+
+    while ((len = recv (fd, buf, sizeof (buf), 0)) >= 0)
+    {
+        /* RTP header: version 2, MPEG audio payload type */
+        assert (len >= 12);
+        assert ((buf[0] >> 6) == 2);
+        assert ((buf[1] & 0x7F) == 14);
+        if (packets > 0)
+            assert ((uint16_t)((buf[2] << 8) | buf[3]) == (uint16_t)(seq + 1));
+        seq = (buf[2] << 8) | buf[3];
+
+        /* RFC2250 header and the payload in the same datagram */
+        assert (len > 16);
+        assert (buf[12] == 0 && buf[13] == 0);
+        if (buf[14] == 0 && buf[15] == 0)
+            assert (buf[16] == 0xFF && (buf[17] & 0xE0) == 0xE0);
+        packets++;
+
+        if (packets == FRAMES)
+            break;
+    }
+
+    log ("Received %u RTP packets\n", packets);
+    assert (packets >= FRAMES / 2);
+
+    libvlc_media_player_stop (mp);
+    libvlc_media_player_release (mp);
+    libvlc_release (vlc);
+    close (fd);
+    unlink (path);
+    free (path);
+}
+
+int main (void)
+{
+    test_init ();
+
+    test_rtp_mpa (test_defaults_args, test_defaults_nargs);
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*****************************************************************************
+ * bench.h: audio filter kernels benchmark helpers
+ *****************************************************************************
+ * Copyright (C) 2026 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* A benchmark defines kernels[], whose first entry is the C reference, and
+ * runs each supported kernel on the same signal for every layout. */
+
+#ifndef TEST_AUDIO_OUTPUT_BENCH_H
+#define TEST_AUDIO_OUTPUT_BENCH_H
+
+#include "../../libvlc/test.h"
+
+#include <math.h>
+
+#define BENCH_RATE  48000
+#define BENCH_TIME  10  /* seconds */
+
+static const unsigned bench_layouts[] = { 2, 6, 8 };
+
+/** Returns a pseudo-random sample in [-1, 1) */
+static inline float bench_Noise( uint32_t *p_seed )
+{
+    *p_seed = *p_seed * 1664525 + 1013904223;
+    return (int32_t)*p_seed / 2147483648.f;
+}
+
+/** Returns the speed relative to real time of i_frames processed in i_time */
+static inline double bench_Speed( unsigned i_frames, mtime_t i_time )
+{
+    return i_time > 0 ? (double)i_frames * CLOCK_FREQ / BENCH_RATE / i_time
+                      : INFINITY;
+}
+
+/** Returns the largest difference between two signals */
+static inline float bench_MaxDiff( const float *p_a, const float *p_b,
+                                   size_t i_count )
+{
+    float f_diff = 0.f;
+
+    for( size_t i = 0; i < i_count; i++ )
+        f_diff = __MAX( f_diff, fabsf( p_a[i] - p_b[i] ) );
+    return f_diff;
+}
+
+/** Checks whether the CPU runs a kernel, logging it if not */
+static inline bool bench_Supported( const char *psz_case,
+                                    const char *psz_name, unsigned i_cpu )
+{
+    if( (vlc_CPU() & i_cpu) == i_cpu )
+        return true;
+    log( "%s: %-4s not supported\n", psz_case, psz_name );
+    return false;
+}
+
+/** Logs the speed of a kernel, compared with the C reference if any */
+static inline void bench_Report( const char *psz_case, const char *psz_name,
+                                 double f_speed, double f_ref, float f_diff )
+{
+    if( f_ref <= 0. )
+    {
+        log( "%s: %-4s %8.1fx real time\n", psz_case, psz_name, f_speed );
+    }
+    else
+    {
+        log( "%s: %-4s %8.1fx real time (%.2fx C), max difference %g\n",
+             psz_case, psz_name, f_speed, f_speed / f_ref, f_diff );
+    }
+}
+
+#endif
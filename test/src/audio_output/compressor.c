@@ -0,0 +1,152 @@
+/*****************************************************************************
+ * compressor.c: compressor kernels accuracy and throughput benchmark
+ *****************************************************************************
+ * Copyright (C) 2026 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* The compressor is built into this program, so that its vector kernels can
+ * be compared with the C ones on the same signal, whatever the CPU. */
+
+#define __PLUGIN__
+#define MODULE_NAME compressor
+#define MODULE_STRING "compressor"
+#include "../../../modules/audio_filter/compressor.c"
+
+#include "bench.h"
+
+static const struct
+{
+    const char *psz_name;
+    peak_t pf_peak;
+    delay_t pf_delay;
+    unsigned i_cpu;
+} kernels[] = {
+    { "C", PeakC, DelayC, 0 },
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+    { "SSE2", PeakSSE2, DelaySSE2, VLC_CPU_SSE2 },
+#endif
+#if defined(__ARM_NEON__)
+    { "NEON", PeakNEON, DelayNEON, VLC_CPU_ARM_NEON },
+#endif
+};
+
+#define BENCH_DELAY 480 /* lookahead frames */
+
+/**
+ * Runs the kernels on the whole signal in place, by chunks as the filter.
+ * Returns the speed relative to real time.
+ */
+static double RunKernels( peak_t pf_peak, delay_t pf_delay, float *p_buf,
+                          float *p_lev, unsigned i_frames,
+                          unsigned i_channels )
+{
+    static float pf_delay_line[BENCH_DELAY * AOUT_CHAN_MAX];
+    float pf_gain[CHUNK_SIZE];
+    unsigned i_pos = 0;
+    mtime_t i_time;
+
+    memset( pf_delay_line, 0, sizeof(pf_delay_line) );
+    for( unsigned i = 0; i < CHUNK_SIZE; i++ )
+        pf_gain[i] = 1.f - i / (2.f * CHUNK_SIZE);
+
+    i_time = mdate();
+    for( unsigned i = 0; i < i_frames; )
+    {
+        unsigned i_chunk = __MIN( CHUNK_SIZE, i_frames - i );
+        i_chunk = __MIN( i_chunk, BENCH_DELAY - i_pos );
+
+        pf_peak( p_lev + i, p_buf, i_chunk, i_channels );
+        pf_delay( p_buf, &pf_delay_line[i_pos * i_channels], pf_gain,
+                  i_chunk, i_channels );
+
+        i_pos = ( i_pos + i_chunk ) % BENCH_DELAY;
+        p_buf += i_chunk * i_channels;
+        i += i_chunk;
+    }
+    i_time = mdate() - i_time;
+
+    return bench_Speed( i_frames, i_time );
+}
+
+static void bench_compressor( void )
+{
+    const unsigned i_frames = BENCH_TIME * BENCH_RATE;
+
+    for( size_t l = 0; l < ARRAY_SIZE(bench_layouts); l++ )
+    {
+        const unsigned i_channels = bench_layouts[l];
+        const size_t i_samples = (size_t)i_frames * i_channels;
+        float *p_src = malloc( i_samples * sizeof(float) );
+        float *p_ref = malloc( i_samples * sizeof(float) );
+        float *p_out = malloc( i_samples * sizeof(float) );
+        float *p_ref_lev = malloc( i_frames * sizeof(float) );
+        float *p_lev = malloc( i_frames * sizeof(float) );
+        uint32_t i_seed = 1;
+        char psz_case[32];
+        double f_ref = 0.;
+
+        assert( p_src != NULL && p_ref != NULL && p_out != NULL );
+        assert( p_ref_lev != NULL && p_lev != NULL );
+
+        for( size_t i = 0; i < i_samples; i++ )
+            p_src[i] = bench_Noise( &i_seed );
+        snprintf( psz_case, sizeof(psz_case), "%u channels", i_channels );
+
+        for( size_t k = 0; k < ARRAY_SIZE(kernels); k++ )
+        {
+            if( !bench_Supported( psz_case, kernels[k].psz_name,
+                                  kernels[k].i_cpu ) )
+                continue;
+
+            float *p_buf = k == 0 ? p_ref : p_out;
+            float *p_buf_lev = k == 0 ? p_ref_lev : p_lev;
+
+            memcpy( p_buf, p_src, i_samples * sizeof(float) );
+            double f_speed = RunKernels( kernels[k].pf_peak,
+                                         kernels[k].pf_delay, p_buf,
+                                         p_buf_lev, i_frames, i_channels );
+            float f_diff = 0.f;
+            if( k > 0 )
+                f_diff = __MAX( bench_MaxDiff( p_out, p_ref, i_samples ),
+                                bench_MaxDiff( p_lev, p_ref_lev, i_frames ) );
+
+            bench_Report( psz_case, kernels[k].psz_name, f_speed, f_ref,
+                          f_diff );
+            if( k == 0 )
+                f_ref = f_speed;
+            /* The C peak detection is branchless, hence slightly rounded */
+            assert( f_diff < 1e-6f );
+        }
+
+        free( p_lev );
+        free( p_ref_lev );
+        free( p_out );
+        free( p_ref );
+        free( p_src );
+    }
+}
+
+int main( void )
+{
+    test_init();
+    alarm( 60 );
+
+    log( "Benchmarking the compressor kernels\n" );
+    bench_compressor();
+
+    return 0;
+}
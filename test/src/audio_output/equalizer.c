@@ -0,0 +1,186 @@
+/*****************************************************************************
+ * equalizer.c: equalizer kernels accuracy and throughput benchmark
+ *****************************************************************************
+ * Copyright (C) 2026 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* The equalizer is built into this program, so that its vector kernels can
+ * be compared with the C one on the same signal, whatever the CPU. */
+
+#define __PLUGIN__
+#define MODULE_NAME equalizer
+#define MODULE_STRING "equalizer"
+#include "../../../modules/audio_filter/equalizer.c"
+
+#include "bench.h"
+
+typedef void (*eqz_kernel_t)( filter_sys_t *, float *, const float *,
+                              unsigned, unsigned );
+
+static const struct
+{
+    const char *psz_name;
+    eqz_kernel_t pf_filter;
+    unsigned i_cpu;
+} kernels[] = {
+    { "C", EqzFilterC, 0 },
+#if defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
+    { "SSE2", EqzFilterSSE2, VLC_CPU_SSE2 },
+#endif
+#if defined(__ARM_NEON__)
+    { "NEON", EqzFilterNEON, VLC_CPU_ARM_NEON },
+#endif
+};
+
+#define BENCH_BLOCK 1024 /* frames per block */
+
+typedef struct
+{
+    filter_sys_t sys;
+    float f_alpha[EQZ_BANDS_PAD];
+    float f_beta[EQZ_BANDS_PAD];
+    float f_gamma[EQZ_BANDS_PAD];
+    float f_amp[EQZ_BANDS_PAD];
+} bench_eqz_t;
+
+static void InitEqz( bench_eqz_t *p_eqz, bool b_2eqz )
+{
+    filter_sys_t *p_sys = &p_eqz->sys;
+    eqz_config_t cfg;
+    unsigned i_preset = 0;
+
+    memset( p_eqz, 0, sizeof(*p_eqz) );
+    EqzCoeffs( BENCH_RATE, 1.0f, true, &cfg );
+
+    for( unsigned i = 0; i < NB_PRESETS; i++ )
+        if( !strcmp( eqz_preset_10b[i].psz_name, "rock" ) )
+            i_preset = i;
+
+    p_sys->i_band = cfg.i_band;
+    p_sys->f_alpha = p_eqz->f_alpha;
+    p_sys->f_beta = p_eqz->f_beta;
+    p_sys->f_gamma = p_eqz->f_gamma;
+    p_sys->f_amp = p_eqz->f_amp;
+    for( int i = 0; i < cfg.i_band; i++ )
+    {
+        p_eqz->f_alpha[i] = cfg.band[i].f_alpha;
+        p_eqz->f_beta[i] = cfg.band[i].f_beta;
+        p_eqz->f_gamma[i] = cfg.band[i].f_gamma;
+        p_eqz->f_amp[i] = EqzConvertdB( eqz_preset_10b[i_preset].f_amp[i] );
+    }
+    p_sys->f_gamp = powf( 10.0f, eqz_preset_10b[i_preset].f_preamp / 20.0f );
+    p_sys->b_2eqz = b_2eqz;
+}
+
+/**
+ * Filters the whole signal in place by blocks.
+ * Returns the speed relative to real time.
+ */
+static double RunKernel( eqz_kernel_t pf_filter, bool b_2eqz, float *p_buf,
+                         unsigned i_frames, unsigned i_channels )
+{
+    bench_eqz_t eqz;
+    mtime_t i_time;
+
+    InitEqz( &eqz, b_2eqz );
+
+    i_time = mdate();
+    for( unsigned i = 0; i < i_frames; i += BENCH_BLOCK )
+    {
+        float *p_block = p_buf + i * i_channels;
+        pf_filter( &eqz.sys, p_block, p_block, BENCH_BLOCK, i_channels );
+    }
+    i_time = mdate() - i_time;
+
+    return bench_Speed( i_frames, i_time );
+}
+
+static void bench_equalizer( void )
+{
+    const unsigned i_frames = BENCH_TIME * BENCH_RATE / BENCH_BLOCK
+                            * BENCH_BLOCK;
+
+    for( size_t l = 0; l < ARRAY_SIZE(bench_layouts); l++ )
+    {
+        const unsigned i_channels = bench_layouts[l];
+        const size_t i_samples = (size_t)i_frames * i_channels;
+        float *p_src = malloc( i_samples * sizeof(float) );
+        float *p_ref = malloc( i_samples * sizeof(float) );
+        float *p_out = malloc( i_samples * sizeof(float) );
+        uint32_t i_seed = 1;
+
+        assert( p_src != NULL && p_ref != NULL && p_out != NULL );
+
+        /* Some noise over a sine, then silence for the denormals */
+        for( unsigned i = 0; i < i_frames; i++ )
+            for( unsigned c = 0; c < i_channels; c++ )
+            {
+                float f_noise = bench_Noise( &i_seed );
+                p_src[i * i_channels + c] = i < i_frames / 2
+                    ? .1f * f_noise + .4f * sinf( 2.f * M_PI * 440.f
+                                                  * (c + 1) * i / BENCH_RATE )
+                    : 0.f;
+            }
+
+        for( int i_pass = 1; i_pass <= 2; i_pass++ )
+        {
+            const bool b_2eqz = i_pass == 2;
+            char psz_case[32];
+            double f_ref = 0.;
+
+            snprintf( psz_case, sizeof(psz_case), "%u channels, %d pass",
+                      i_channels, i_pass );
+
+            for( size_t k = 0; k < ARRAY_SIZE(kernels); k++ )
+            {
+                if( !bench_Supported( psz_case, kernels[k].psz_name,
+                                      kernels[k].i_cpu ) )
+                    continue;
+
+                float *p_buf = k == 0 ? p_ref : p_out;
+
+                memcpy( p_buf, p_src, i_samples * sizeof(float) );
+                double f_speed = RunKernel( kernels[k].pf_filter, b_2eqz,
+                                            p_buf, i_frames, i_channels );
+                float f_diff = k == 0 ? 0.f
+                             : bench_MaxDiff( p_out, p_ref, i_samples );
+
+                bench_Report( psz_case, kernels[k].psz_name, f_speed, f_ref,
+                              f_diff );
+                if( k == 0 )
+                    f_ref = f_speed;
+                /* Only the rounding may differ */
+                assert( f_diff < 1e-4f );
+            }
+        }
+
+        free( p_out );
+        free( p_ref );
+        free( p_src );
+    }
+}
+
+int main( void )
+{
+    test_init();
+    alarm( 60 );
+
+    log( "Benchmarking the equalizer kernels\n" );
+    bench_equalizer();
+
+    return 0;
+}
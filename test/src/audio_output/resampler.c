@@ -0,0 +1,277 @@
+/*****************************************************************************
+ * resampler.c: audio resamplers quality test and throughput benchmark
+ *****************************************************************************
+ * Copyright (C) 2026 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Every available resampler converts sine waves: the output is compared
+ * with the ideal sine to measure the signal to noise ratio, and the time
+ * spent in the filter gives the speed relative to real time. The length of
+ * every output is checked, and the quality of the resamplers with a known
+ * minimum. */
+
+#define MODULE_STRING "resampler"
+
+#include <math.h>
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_aout.h>
+#include <vlc_filter.h>
+#include <vlc_modules.h>
+
+static const struct
+{
+    const char *psz_name;
+    double f_min_snr; /* dB at both frequencies, NAN if not checked */
+} resamplers[] = {
+    { "polyphase",             80. },
+    { "speex_resampler",       NAN },
+    { "samplerate",            NAN },
+    { "bandlimited_resampler", NAN },
+    { "ugly_resampler",        NAN },
+};
+
+static const struct
+{
+    unsigned i_in;
+    unsigned i_out;
+    unsigned i_channels;
+} cases[] = {
+    { 44100, 48000, 2 },
+    { 48000, 44100, 2 },
+    { 48000, 96000, 2 },
+    { 96000, 48000, 2 },
+    { 32000, 48000, 6 },
+    { 44100, 48000, 8 },
+};
+
+#define BENCH_BLOCK 1024 /* input frames per block */
+#define AMPLITUDE   .5
+
+typedef struct
+{
+    double f_snr;       /**< signal to noise ratio (dB) */
+    double f_amplitude; /**< amplitude of the fitted sine */
+    double f_frames;    /**< output frames expected from the input length */
+    size_t i_frames;    /**< output frames */
+    double f_speed;     /**< speed relative to real time */
+} result_t;
+
+static uint32_t GetLayout( unsigned i_channels )
+{
+    switch( i_channels )
+    {
+        case 1:  return AOUT_CHAN_CENTER;
+        case 2:  return AOUT_CHANS_STEREO;
+        case 6:  return AOUT_CHANS_5_1;
+        default: return AOUT_CHANS_7_1;
+    }
+}
+
+static filter_t *CreateResampler( vlc_object_t *p_parent, const char *psz_name,
+                                  unsigned i_in, unsigned i_out,
+                                  unsigned i_channels )
+{
+    filter_t *p_filter = vlc_object_create( p_parent, sizeof(*p_filter) );
+    if( p_filter == NULL )
+        return NULL;
+
+    audio_sample_format_t fmt;
+    memset( &fmt, 0, sizeof(fmt) );
+    fmt.i_format = VLC_CODEC_FL32;
+    fmt.i_rate = i_in;
+    fmt.i_physical_channels = fmt.i_original_channels =
+        GetLayout( i_channels );
+    aout_FormatPrepare( &fmt );
+
+    p_filter->fmt_in.i_codec = p_filter->fmt_out.i_codec = VLC_CODEC_FL32;
+    p_filter->fmt_in.audio = fmt;
+    p_filter->fmt_out.audio = fmt;
+    p_filter->fmt_out.audio.i_rate = i_out;
+
+    p_filter->p_module = module_need( p_filter, "audio resampler", psz_name,
+                                      true );
+    if( p_filter->p_module == NULL )
+    {
+        vlc_object_release( p_filter );
+        return NULL;
+    }
+    return p_filter;
+}
+
+static void DeleteResampler( filter_t *p_filter )
+{
+    module_unneed( p_filter, p_filter->p_module );
+    vlc_object_release( p_filter );
+}
+
+/**
+ * Resamples one second of a sine wave at f_freq Hz.
+ * Returns false if the resampler is not available.
+ */
+static bool RunSine( vlc_object_t *p_parent, const char *psz_name,
+                     unsigned i_in, unsigned i_out, unsigned i_channels,
+                     double f_freq, result_t *p_res )
+{
+    filter_t *p_filter = CreateResampler( p_parent, psz_name, i_in, i_out,
+                                          i_channels );
+    if( p_filter == NULL )
+        return false;
+
+    const unsigned i_frames = i_in;
+    float *p_out = malloc( (2 * i_out + BENCH_BLOCK) * sizeof(float) );
+    size_t i_out_frames = 0, i_total = 0;
+    mtime_t i_time = 0;
+    assert( p_out != NULL );
+
+    for( unsigned i_pos = 0; i_pos < i_frames; i_pos += BENCH_BLOCK )
+    {
+        block_t *p_block = block_Alloc( BENCH_BLOCK * i_channels *
+                                        sizeof(float) );
+        assert( p_block != NULL );
+
+        float *p_data = (float *)p_block->p_buffer;
+        for( unsigned i = 0; i < BENCH_BLOCK; i++ )
+        {
+            float f_sample = AMPLITUDE * sin( 2. * M_PI * f_freq * (i_pos + i) / i_in );
+            for( unsigned c = 0; c < i_channels; c++ )
+                *(p_data++) = f_sample;
+        }
+        p_block->i_nb_samples = BENCH_BLOCK;
+        p_block->i_pts = VLC_TS_0 + CLOCK_FREQ * i_pos / i_in;
+        if( i_pos == 0 )
+            p_block->i_flags |= BLOCK_FLAG_DISCONTINUITY;
+
+        mtime_t i_start = mdate();
+        p_block = p_filter->pf_audio_filter( p_filter, p_block );
+        i_time += mdate() - i_start;
+
+        /* Keep the first channel */
+        for( ; p_block != NULL; p_block = p_block->p_next )
+        {
+            const float *p_src = (const float *)p_block->p_buffer;
+            i_total += p_block->i_nb_samples;
+            for( unsigned i = 0; i < p_block->i_nb_samples
+                              && i_out_frames < 2 * i_out; i++ )
+                p_out[i_out_frames++] = p_src[i * i_channels];
+            block_Release( p_block );
+        }
+    }
+    DeleteResampler( p_filter );
+
+    /* Least square fit of the sine wave after the first quarter of a
+     * second, whatever the delay of the filter */
+    double ss = 0., cc = 0., sc = 0., ys = 0., yc = 0.;
+    size_t i_first = i_out / 4, i_last = i_out_frames - i_out / 10;
+    for( size_t i = i_first; i < i_last; i++ )
+    {
+        double w = 2. * M_PI * f_freq * i / i_out;
+        double s = sin( w ), c = cos( w ), y = p_out[i];
+        ss += s * s; cc += c * c; sc += s * c;
+        ys += y * s; yc += y * c;
+    }
+
+    double det = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / det, b = (yc * ss - ys * sc) / det;
+    double f_signal = 0., f_noise = 0.;
+    for( size_t i = i_first; i < i_last; i++ )
+    {
+        double w = 2. * M_PI * f_freq * i / i_out;
+        double fit = a * sin( w ) + b * cos( w );
+        f_signal += fit * fit;
+        f_noise += (p_out[i] - fit) * (p_out[i] - fit);
+    }
+    free( p_out );
+
+    const unsigned i_in_frames = ( i_frames + BENCH_BLOCK - 1 ) / BENCH_BLOCK
+                                 * BENCH_BLOCK;
+    p_res->f_snr = 10. * log10( f_signal / __MAX(f_noise, 1e-30) );
+    p_res->f_amplitude = sqrt( a * a + b * b );
+    p_res->f_frames = (double)i_in_frames * i_out / i_in;
+    p_res->i_frames = i_total;
+    p_res->f_speed = i_time > 0 ? (double)CLOCK_FREQ / i_time : INFINITY;
+    return true;
+}
+
+static void Check( const result_t *p_res, unsigned i_out, double f_min_snr,
+                   double f_min_amplitude )
+{
+    /* No frames lost nor added, besides the filter delay (10 ms at most) */
+    assert( fabs( p_res->i_frames - p_res->f_frames ) <= i_out / 100 );
+
+    if( isnan( f_min_snr ) )
+        return;
+    assert( p_res->f_snr >= f_min_snr );
+    assert( p_res->f_amplitude >= f_min_amplitude );
+    assert( p_res->f_amplitude <= AMPLITUDE * 1.01 );
+}
+
+static void bench_resamplers( libvlc_int_t *p_libvlc )
+{
+    for( size_t i = 0; i < ARRAY_SIZE(cases); i++ )
+    {
+        unsigned i_in = cases[i].i_in, i_out = cases[i].i_out;
+        unsigned i_channels = cases[i].i_channels;
+        /* Near the top of the pass band of a good filter */
+        double f_high = .4 * __MIN(i_in, i_out);
+
+        log( "%u -> %u Hz, %u channels\n", i_in, i_out, i_channels );
+        for( size_t j = 0; j < ARRAY_SIZE(resamplers); j++ )
+        {
+            const char *psz_name = resamplers[j].psz_name;
+            result_t low, high;
+
+            if( !RunSine( VLC_OBJECT(p_libvlc), psz_name, i_in, i_out,
+                          i_channels, 1000., &low ) )
+            {
+                log( "  %-22s not available\n", psz_name );
+                continue;
+            }
+            assert( RunSine( VLC_OBJECT(p_libvlc), psz_name, i_in, i_out,
+                             i_channels, f_high, &high ) );
+            log( "  %-22s SNR %6.1f dB at 1 kHz, %6.1f dB at %.0f Hz, "
+                 "%8.1fx real time\n", psz_name, low.f_snr, high.f_snr,
+                 f_high, low.f_speed );
+
+            /* Flat pass band: at most 0.1 dB below at 1 kHz, 1 dB near its
+             * top */
+            Check( &low, i_out, resamplers[j].f_min_snr, AMPLITUDE * .989 );
+            Check( &high, i_out, resamplers[j].f_min_snr, AMPLITUDE * .891 );
+        }
+    }
+}
+
+int main( void )
+{
+    libvlc_instance_t *p_vlc;
+
+    test_init();
+    alarm( 60 );
+
+    log( "Testing the audio resamplers\n" );
+    p_vlc = libvlc_new( test_defaults_nargs, test_defaults_args );
+    assert( p_vlc != NULL );
+
+    bench_resamplers( p_vlc->p_libvlc_int );
+
+    libvlc_release( p_vlc );
+
+    return 0;
+}
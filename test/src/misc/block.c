@@ -0,0 +1,194 @@
+/*****************************************************************************
+ * block.c: test for blocks sharing their payload
+ *****************************************************************************
+ * Copyright (C) 2026 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* The payload must stay readable until the last block using it is released,
+ * and be released exactly once, with the callback of the original block. */
+
+#include <string.h>
+
+#include "../../libvlc/test.h"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#define SIZE 1000
+
+static const char text[] = "shared payload";
+
+static struct
+{
+    block_t self;
+    uint8_t buf[SIZE];
+    unsigned releases;
+} custom;
+
+static void custom_Release (block_t *block)
+{
+    assert (block == &custom.self);
+    custom.releases++;
+}
+
+static block_t *custom_Alloc (void)
+{
+    block_Init (&custom.self, custom.buf, SIZE);
+    custom.self.pf_release = custom_Release;
+    custom.releases = 0;
+    memcpy (custom.self.p_buffer, text, sizeof (text));
+    custom.self.i_buffer = sizeof (text);
+    custom.self.i_pts = 1234;
+    custom.self.i_flags = BLOCK_FLAG_TYPE_I;
+    return &custom.self;
+}
+
+static void check_clone (const block_t *clone, const block_t *block)
+{
+    assert (clone != block);
+    assert (clone->p_buffer == block->p_buffer);
+    assert (clone->i_buffer == block->i_buffer);
+    assert (clone->i_pts == block->i_pts);
+    assert (clone->i_flags == block->i_flags);
+}
+
+static void test_clone (void)
+{
+    block_t *block = custom_Alloc ();
+
+    log ("Testing clones\n");
+    block_t *clone = block_Clone (block);
+    assert (clone != NULL);
+    check_clone (clone, block);
+
+    /* A clone of a clone shares the same payload */
+    block_t *clone2 = block_Clone (clone);
+    assert (clone2 != NULL);
+    check_clone (clone2, block);
+
+    /* The payload outlives the original block */
+    block_Release (block);
+    assert (custom.releases == 0);
+    assert (!strcmp ((char *)clone->p_buffer, text));
+    block_Release (clone2);
+    assert (custom.releases == 0);
+    block_Release (clone);
+    assert (custom.releases == 1);
+
+    /* Clones released first */
+    block = custom_Alloc ();
+    clone = block_Clone (block);
+    assert (clone != NULL);
+    block_Release (clone);
+    assert (custom.releases == 0);
+    block_Release (block);
+    assert (custom.releases == 1);
+}
+
+static void test_unshare (void)
+{
+    block_t *block = custom_Alloc ();
+
+    log ("Testing unsharing\n");
+    /* Not shared: nothing to copy */
+    assert (block_Unshare (block) == block);
+
+    block_t *clone = block_Clone (block);
+    assert (clone != NULL);
+
+    /* Shared: the payload is copied, the others are left untouched */
+    block_t *copy = block_Unshare (clone);
+    assert (copy != NULL);
+    assert (copy->p_buffer != block->p_buffer);
+    assert (copy->i_buffer == block->i_buffer);
+    assert (copy->i_pts == block->i_pts);
+    assert (copy->i_flags == block->i_flags);
+    copy->p_buffer[0] = 'S';
+    assert (!strcmp ((char *)block->p_buffer, text));
+    block_Release (copy);
+    assert (custom.releases == 0);
+
+    /* The last user of the payload may modify it */
+    assert (block_Unshare (block) == block);
+    block->p_buffer[0] = 'S';
+    block_Release (block);
+    assert (custom.releases == 1);
+}
+
+static void test_realloc (void)
+{
+    block_t *block = custom_Alloc ();
+
+    log ("Testing reallocation of shared payloads\n");
+    block_t *clone = block_Clone (block);
+    assert (clone != NULL);
+
+    /* Growing or emptying a clone must not write to the shared payload */
+    clone = block_Realloc (clone, 16, SIZE);
+    assert (clone != NULL);
+    assert (clone->i_buffer == 16 + SIZE);
+    memset (clone->p_buffer, 0, clone->i_buffer);
+    assert (!strcmp ((char *)block->p_buffer, text));
+    block_Release (clone);
+
+    clone = block_Clone (block);
+    assert (clone != NULL);
+    clone->i_buffer = 0;
+    clone = block_Realloc (clone, 0, 4);
+    assert (clone != NULL);
+    memset (clone->p_buffer, 0, clone->i_buffer);
+    assert (!strcmp ((char *)block->p_buffer, text));
+    block_Release (clone);
+
+    assert (custom.releases == 0);
+    block_Release (block);
+    assert (custom.releases == 1);
+}
+
+static void test_heap (void)
+{
+    log ("Testing allocated blocks\n");
+    /* Released blocks are checked by the memory debuggers */
+    block_t *block = block_Alloc (SIZE);
+    assert (block != NULL);
+    block_t *clone = block_Clone (block);
+    assert (clone != NULL);
+    block_Release (block);
+    block_Release (clone);
+
+    void *buf = malloc (SIZE);
+    assert (buf != NULL);
+    block = block_heap_Alloc (buf, SIZE);
+    assert (block != NULL);
+    clone = block_Clone (block);
+    assert (clone != NULL);
+    clone = block_Unshare (clone);
+    assert (clone != NULL && clone->p_buffer != buf);
+    block_Release (clone);
+    block_Release (block);
+}
+
+int main (void)
+{
+    test_init ();
+
+    test_clone ();
+    test_unshare ();
+    test_realloc ();
+    test_heap ();
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*****************************************************************************
+ * messages.c: test for the asynchronous log output
+ *****************************************************************************
+ * Copyright (C) 2026 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Messages are emitted on the instance object, and collected by the log
+ * callback, which runs on the logger thread. They are checked once the last
+ * one has been received. */
+
+#define MODULE_STRING "test"
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#define THREADS  4
+#define ORDERED  100 /* messages per thread */
+#define REPEATED 200
+#define BURST    50 /* identical messages let through per second */
+#define FLOODED  100
+#define FLOOD_SIZE 1000 /* bytes of text per flooding message */
+
+static struct
+{
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    char **msgs;
+    unsigned count;
+    bool blocked;
+    bool released;
+    bool done;
+} logs;
+
+static vlc_mutex_t order_lock;
+static unsigned order_count;
+
+static void log_cb (void *data, int level, const libvlc_log_t *ctx,
+                    const char *fmt, va_list ap)
+{
+    const char *module;
+    char *str;
+
+    libvlc_log_get_context (ctx, &module, NULL, NULL);
+    assert (vasprintf (&str, fmt, ap) != -1);
+    if (strcmp (module, "test")
+     && strstr (str, "dropped: logging too fast") == NULL)
+    {   /* not ours */
+        free (str);
+        return;
+    }
+
+    vlc_mutex_lock (&logs.lock);
+    logs.msgs = realloc (logs.msgs, (logs.count + 1) * sizeof (*logs.msgs));
+    assert (logs.msgs != NULL);
+    logs.msgs[logs.count++] = str;
+
+    if (!strcmp (str, "block"))
+    {   /* stall the logger thread, so that the ring fills up */
+        logs.blocked = true;
+        vlc_cond_broadcast (&logs.wait);
+        while (!logs.released)
+            vlc_cond_wait (&logs.wait, &logs.lock);
+    }
+    if (!strcmp (str, "done"))
+    {
+        logs.done = true;
+        vlc_cond_broadcast (&logs.wait);
+    }
+    vlc_mutex_unlock (&logs.lock);
+    (void) data; (void) level;
+}
+
+static void *emit_ordered (void *data)
+{
+    libvlc_int_t *obj = data;
+
+    for (unsigned i = 0; i < ORDERED; i++)
+    {
+        vlc_mutex_lock (&order_lock);
+        msg_Dbg (obj, "ordered %u", order_count++);
+        vlc_mutex_unlock (&order_lock);
+    }
+    return NULL;
+}
+
+static void emit (libvlc_int_t *obj)
+{
+    vlc_thread_t th[THREADS];
+
+    /* Messages from several threads come out in the emission order */
+    log ("Testing ordering across %u threads\n", THREADS);
+    vlc_mutex_init (&order_lock);
+    for (unsigned i = 0; i < THREADS; i++)
+        assert (vlc_clone (th + i, emit_ordered, obj,
+                           VLC_THREAD_PRIORITY_LOW) == 0);
+    for (unsigned i = 0; i < THREADS; i++)
+        vlc_join (th[i], NULL);
+    vlc_mutex_destroy (&order_lock);
+
+    /* Identical messages are limited, not those with other arguments */
+    log ("Testing rate limiting\n");
+    for (unsigned i = 0; i < REPEATED; i++)
+        msg_Dbg (obj, "repeated %s", "message");
+    msg_Dbg (obj, "after repetitions");
+
+    /* Records lost while the logger thread is stalled are reported */
+    log ("Testing overflow\n");
+    char big[FLOOD_SIZE + 1];
+    memset (big, 'x', FLOOD_SIZE);
+    big[FLOOD_SIZE] = '\0';
+
+    msg_Dbg (obj, "block");
+    vlc_mutex_lock (&logs.lock);
+    while (!logs.blocked)
+        vlc_cond_wait (&logs.wait, &logs.lock);
+    vlc_mutex_unlock (&logs.lock);
+    for (unsigned i = 0; i < FLOODED; i++)
+        msg_Dbg (obj, "flood %u %s", i, big);
+    vlc_mutex_lock (&logs.lock);
+    logs.released = true;
+    vlc_cond_broadcast (&logs.wait);
+    vlc_mutex_unlock (&logs.lock);
+    msg_Dbg (obj, "after flood");
+
+    /* Width, precision and string arguments */
+    log ("Testing conversions\n");
+    msg_Dbg (obj, "%4.4s|%.*s|%-6s|%*d|%5.2f|%lld|%c", "abcdefgh", 3, "xyzzy",
+             "ab", 5, 42, 3.14159, 1234567890123LL, '!');
+    msg_Dbg (obj, "done");
+
+    vlc_mutex_lock (&logs.lock);
+    while (!logs.done)
+        vlc_cond_wait (&logs.wait, &logs.lock);
+    vlc_mutex_unlock (&logs.lock);
+}
+
+static void check (void)
+{
+    unsigned i = 0, ordered = 0, repeated = 0, flooded = 0, dropped = 0;
+
+    for (; i < logs.count; i++)
+    {
+        unsigned n;
+
+        if (sscanf (logs.msgs[i], "ordered %u", &n) == 1)
+            assert (n == ordered++);
+        else if (!strcmp (logs.msgs[i], "repeated message"))
+            repeated++;
+        else if (!strcmp (logs.msgs[i], "after repetitions"))
+            break;
+    }
+    assert (ordered == THREADS * ORDERED);
+    assert (repeated == BURST);
+    assert (i > 0 && i < logs.count);
+    assert (sscanf (logs.msgs[i - 1], "previous message repeated %u more times",
+                    &repeated) == 1);
+    assert (repeated == REPEATED - BURST);
+
+    for (; i < logs.count; i++)
+    {
+        unsigned n, lost;
+
+        if (sscanf (logs.msgs[i], "flood %u ", &n) == 1)
+        {   /* the first ones fill the ring, the next ones are lost */
+            assert (n == flooded++);
+            assert (strlen (logs.msgs[i]) > FLOOD_SIZE);
+        }
+        else if (sscanf (logs.msgs[i], "%u log message(s) dropped", &lost) == 1)
+            dropped += lost;
+        else if (!strcmp (logs.msgs[i], "after flood"))
+            break;
+    }
+    log ("%u flooding messages output, %u dropped\n", flooded, dropped);
+    assert (dropped > 0);
+    assert (flooded + dropped == FLOODED);
+
+    assert (i + 2 < logs.count);
+    assert (!strcmp (logs.msgs[i + 1],
+                     "abcd|xyz|ab    |   42| 3.14|1234567890123|!"));
+    assert (!strcmp (logs.msgs[i + 2], "done"));
+}
+
+int main (void)
+{
+    test_init ();
+
+    vlc_mutex_init (&logs.lock);
+    vlc_cond_init (&logs.wait);
+
+    libvlc_instance_t *vlc = libvlc_new (test_defaults_nargs,
+                                         test_defaults_args);
+    assert (vlc != NULL);
+    libvlc_log_set (vlc, log_cb, NULL);
+
+    emit (vlc->p_libvlc_int);
+    check ();
+
+    libvlc_log_unset (vlc);
+    libvlc_release (vlc);
+
+    for (unsigned i = 0; i < logs.count; i++)
+        free (logs.msgs[i]);
+    free (logs.msgs);
+    vlc_cond_destroy (&logs.wait);
+    vlc_mutex_destroy (&logs.lock);
+    return 0;
+}
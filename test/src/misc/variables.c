@@ -26,6 +26,8 @@
 #include "../../libvlc/test.h"
 #include "../lib/libvlc_internal.h"
 
+#include <vlc_atomic.h>
+
 const char *psz_var_name[] = { "a", "abcdef", "abcdefg", "abc123", "abc-123", "é€!!" };
 const int i_var_count = 6;
 vlc_value_t var_value[6];
@@ -401,6 +403,73 @@ static void test_creation_and_type( libvlc_int_t *p_libvlc )
     assert( var_Get( p_libvlc, "bla", &val ) == VLC_ENOVAR );
 }
 
+typedef struct
+{
+    libvlc_int_t *p_libvlc;
+    atomic_bool   b_stop;
+} bench_setter_t;
+
+static void *bench_setter( void *data )
+{
+    bench_setter_t *p_bench = data;
+    int64_t i_value = 0;
+
+    while( !atomic_load( &p_bench->b_stop ) )
+    {
+        var_IncInteger( p_bench->p_libvlc, "bench" );
+        var_SetInteger( p_bench->p_libvlc, "bench-other", ++i_value );
+    }
+    return NULL;
+}
+
+/* Measures the lookups per second while other threads set the variables */
+static void bench_lookups( libvlc_int_t *p_libvlc )
+{
+    var_Create( p_libvlc, "bench", VLC_VAR_INTEGER );
+    var_Create( p_libvlc, "bench-other", VLC_VAR_INTEGER );
+
+    for( unsigned i_setters = 0; i_setters <= 2; i_setters++ )
+    {
+        bench_setter_t bench = { .p_libvlc = p_libvlc };
+        vlc_thread_t th[2];
+        int64_t i_last = 0;
+        unsigned long i_lookups = 0;
+
+        atomic_init( &bench.b_stop, false );
+        for( unsigned i = 0; i < i_setters; i++ )
+        {
+            int i_ret = vlc_clone( &th[i], bench_setter, &bench,
+                                   VLC_THREAD_PRIORITY_LOW );
+            assert( i_ret == 0 );
+        }
+
+        mtime_t i_start = mdate(), i_now;
+        do
+        {
+            for( unsigned i = 0; i < 1000; i++ )
+            {
+                int64_t i_value = var_GetInteger( p_libvlc, "bench" );
+                /* Never a torn nor an older value */
+                assert( i_value >= i_last );
+                i_last = i_value;
+            }
+            i_lookups += 1000;
+            i_now = mdate();
+        }
+        while( i_now - i_start < CLOCK_FREQ / 2 );
+
+        atomic_store( &bench.b_stop, true );
+        for( unsigned i = 0; i < i_setters; i++ )
+            vlc_join( th[i], NULL );
+
+        log( "%u setter(s): %.0f lookups per second\n", i_setters,
+             (double)i_lookups * CLOCK_FREQ / (i_now - i_start) );
+    }
+
+    var_Destroy( p_libvlc, "bench-other" );
+    var_Destroy( p_libvlc, "bench" );
+}
+
 static void test_variables( libvlc_instance_t *p_vlc )
 {
     libvlc_int_t *p_libvlc = p_vlc->p_libvlc_int;
@@ -438,6 +507,9 @@ static void test_variables( libvlc_instance_t *p_vlc )
 
     log( "Testing type at creation\n" );
     test_creation_and_type( p_libvlc );
+
+    log( "Benchmarking the lookups\n" );
+    bench_lookups( p_libvlc );
 }
 
 
@@ -0,0 +1,158 @@
+/*****************************************************************************
+ * memo.c: test for the module probe results memo
+ *****************************************************************************
+ * Copyright (C) 2026 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* The module loader is built into this program, on top of a fake bank of
+ * modules whose Open() callbacks count their calls. */
+
+#define MODULE_STRING "memo"
+#include "../../../src/modules/modules.c"
+
+#include "../../libvlc/test.h"
+
+enum { REJECT, FAIL, ACCEPT, MODULES };
+
+static unsigned calls[MODULES];
+
+static int OpenReject( vlc_object_t *obj )
+{
+    (void) obj;
+    calls[REJECT]++;
+    return VLC_ENOTSUP;
+}
+
+static int OpenFail( vlc_object_t *obj )
+{
+    (void) obj;
+    calls[FAIL]++;
+    return VLC_EGENERIC;
+}
+
+static int OpenAccept( vlc_object_t *obj )
+{
+    (void) obj;
+    calls[ACCEPT]++;
+    return VLC_SUCCESS;
+}
+
+static char *shortcuts[MODULES][1] = {
+    { "reject" }, { "fail" }, { "accept" },
+};
+
+/* Sorted by decreasing score, as in the bank */
+static module_t bank[MODULES] = {
+    { .i_shortcuts = 1, .pp_shortcuts = shortcuts[REJECT],
+      .psz_capability = "test", .i_score = 30, .pf_activate = OpenReject },
+    { .i_shortcuts = 1, .pp_shortcuts = shortcuts[FAIL],
+      .psz_capability = "test", .i_score = 20, .pf_activate = OpenFail },
+    { .i_shortcuts = 1, .pp_shortcuts = shortcuts[ACCEPT],
+      .psz_capability = "test", .i_score = 10, .pf_activate = OpenAccept },
+};
+
+/* Bank and core stubs */
+ssize_t module_list_cap( module_t ***restrict list, const char *cap )
+{
+    module_t **mods = malloc( MODULES * sizeof(*mods) );
+
+    assert( mods != NULL && !strcmp( cap, "test" ) );
+    for( unsigned i = 0; i < MODULES; i++ )
+        mods[i] = &bank[i];
+    *list = mods;
+    return MODULES;
+}
+
+void module_list_free( module_t **list )
+{
+    free( list );
+}
+
+module_t **module_list_get( size_t *n )
+{
+    *n = 0;
+    return NULL;
+}
+
+int module_Map( vlc_object_t *obj, module_t *m )
+{
+    (void) obj; (void) m;
+    return 0;
+}
+
+int var_Inherit( vlc_object_t *obj, const char *name, int type,
+                 vlc_value_t *val )
+{
+    (void) obj; (void) name; (void) type; (void) val;
+    return VLC_ENOVAR;
+}
+
+#undef vlc_object_set_name
+int vlc_object_set_name( vlc_object_t *obj, const char *name )
+{
+    (void) obj; (void) name;
+    return 0;
+}
+
+void vlc_Log( vlc_object_t *obj, int type, const char *module,
+              const char *format, ... )
+{
+    (void) obj; (void) type; (void) module; (void) format;
+}
+
+static void Probe( libvlc_int_t *obj, const char *name, int key,
+                   unsigned reject, unsigned fail, unsigned accept )
+{
+    memset( calls, 0, sizeof(calls) );
+
+    module_t *m = module_need_memo( VLC_OBJECT(obj), "test", name,
+                                    &key, sizeof(key) );
+    assert( m == &bank[ACCEPT] );
+    assert( calls[REJECT] == reject );
+    assert( calls[FAIL] == fail );
+    assert( calls[ACCEPT] == accept );
+}
+
+int main( void )
+{
+    test_init();
+
+    libvlc_int_t *obj = calloc( 1, sizeof(*obj) + sizeof(libvlc_priv_t) );
+    assert( obj != NULL );
+    obj->p_libvlc = obj;
+    libvlc_priv(obj)->probe_memo = module_MemoCreate();
+    assert( libvlc_priv(obj)->probe_memo != NULL );
+
+    log( "Testing format rejections\n" );
+    Probe( obj, NULL, 1, 1, 1, 1 );
+    /* Only the VLC_ENOTSUP rejection is remembered */
+    Probe( obj, NULL, 1, 0, 1, 1 );
+    Probe( obj, "any", 1, 0, 1, 1 );
+    /* Per key */
+    Probe( obj, NULL, 2, 1, 1, 1 );
+    Probe( obj, NULL, 2, 0, 1, 1 );
+
+    log( "Testing forced modules\n" );
+    Probe( obj, "reject,accept", 1, 1, 0, 1 );
+    Probe( obj, "reject,any", 1, 1, 1, 1 );
+    /* Not forced anymore */
+    Probe( obj, "fail,any", 1, 0, 1, 1 );
+
+    module_MemoDestroy( libvlc_priv(obj)->probe_memo );
+    free( obj );
+    return 0;
+}